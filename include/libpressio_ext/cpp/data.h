@@ -515,6 +515,19 @@ struct pressio_data {
    * \returns the data with its axes permuted
    */
   pressio_data transpose(std::vector<size_t> const& axis = {}) const;
+
+  /**
+   * \param[in] axis the permutation of the axes as passed to transpose
+   * \returns the dimensions of the result of transpose(axis)
+   */
+  std::vector<size_t> transposed_dims(std::vector<size_t> const& axis = {}) const;
+
+  /**
+   * \param[in] axis the permutation of the axes as passed to transpose
+   * \returns true if transpose(axis) leaves the elements in the same order, i.e. it only moves dimensions of
+   * extent 1, so a reshape to transposed_dims(axis) is equivalent
+   */
+  bool transpose_is_reshape(std::vector<size_t> const& axis = {}) const;
   
   /** 
    * \param[in] rhs the object to compare against
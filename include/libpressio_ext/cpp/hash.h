@@ -0,0 +1,140 @@
+#ifndef LIBPRESSIO_CPP_HASH_H
+#define LIBPRESSIO_CPP_HASH_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * \file
+ * \brief fast non-cryptographic hashes of buffers, pressio_data, and pressio_options
+ */
+
+struct pressio_data;
+struct pressio_options;
+
+namespace libpressio { namespace hash {
+
+/**
+ * a 128 bit hash value
+ */
+struct digest128 {
+  /** the low 64 bits of the hash */
+  uint64_t low;
+  /** the high 64 bits of the hash */
+  uint64_t high;
+};
+/**
+ * \returns true if the digests are equal
+ */
+inline bool operator==(digest128 const& lhs, digest128 const& rhs) {
+  return lhs.low == rhs.low && lhs.high == rhs.high;
+}
+/**
+ * \returns true if the digests differ
+ */
+inline bool operator!=(digest128 const& lhs, digest128 const& rhs) {
+  return !(lhs == rhs);
+}
+
+/**
+ * \param[in] data the bytes to hash
+ * \param[in] n the number of bytes to hash
+ * \param[in] seed the seed of the hash
+ * \returns the XXH64 hash of the bytes
+ */
+uint64_t xxh64(void const* data, size_t n, uint64_t seed = 0);
+
+/**
+ * a combinable tree hash of a stream of bytes
+ *
+ * The stream is divided into leaves of leaf_size bytes which are hashed independently and then combined, so the
+ * leaves of a large update are hashed in parallel, and the hashers of consecutive pieces of a stream may be joined
+ * with append.  The digest depends only on the bytes and the seed, not on how the bytes were divided between calls
+ * to update or threads.
+ *
+ * The hash is not cryptographic and MAY change between versions of LibPressio.
+ */
+class tree_hasher {
+  public:
+  /** the number of bytes in each leaf of the tree */
+  static constexpr size_t leaf_size = size_t{1} << 20;
+
+  /**
+   * \param[in] seed the seed of the hash
+   */
+  explicit tree_hasher(uint64_t seed = 0);
+
+  /**
+   * hashes the next n bytes of the stream
+   *
+   * \param[in] data the bytes to hash
+   * \param[in] n the number of bytes
+   * \param[in] nthreads the maximum number of threads of the task runtime used to hash the leaves
+   * \returns *this
+   */
+  tree_hasher& update(void const* data, size_t n, uint32_t nthreads = 1);
+
+  /**
+   * appends the stream hashed by other to the stream hashed by this hasher
+   *
+   * \param[in] other a hasher with the same seed
+   * \returns *this
+   * \throws std::logic_error if the bytes hashed so far are not a multiple of leaf_size or the seeds differ
+   */
+  tree_hasher& append(tree_hasher const& other);
+
+  /**
+   * \returns the number of bytes hashed
+   */
+  uint64_t size() const { return bytes; }
+
+  /**
+   * \returns the 64 bit hash of the stream
+   */
+  uint64_t digest64() const;
+
+  /**
+   * \returns the 128 bit hash of the stream
+   */
+  digest128 digest() const;
+
+  private:
+  std::vector<uint64_t> root() const;
+
+  uint64_t seed;
+  uint64_t bytes = 0;
+  std::vector<uint64_t> leaves;
+  std::vector<uint8_t> partial;
+};
+
+/**
+ * hashes the dtype, dimensions, and contents of a pressio_data
+ *
+ * \param[in] data the data to hash
+ * \param[in] seed the seed of the hash
+ * \param[in] nthreads the maximum number of threads of the task runtime used to hash the contents
+ * \returns the 128 bit hash
+ */
+digest128 hash(pressio_data const& data, uint64_t seed = 0, uint32_t nthreads = 1);
+
+/**
+ * hashes the keys, types, and values of a pressio_options; the values of userptr entries are ignored
+ *
+ * \param[in] options the options to hash
+ * \param[in] seed the seed of the hash
+ * \returns the 128 bit hash
+ */
+digest128 hash(pressio_options const& options, uint64_t seed = 0);
+
+/**
+ * hashes the keys of a pressio_options
+ *
+ * \param[in] options the options to hash
+ * \param[in] seed the seed of the hash
+ * \returns the 128 bit hash
+ */
+digest128 hash_keys(pressio_options const& options, uint64_t seed = 0);
+
+} }
+
+#endif /* end of include guard: LIBPRESSIO_CPP_HASH_H */
@@ -0,0 +1,66 @@
+#ifndef LIBPRESSIO_CPP_LAMBDA_FN_H
+#define LIBPRESSIO_CPP_LAMBDA_FN_H
+#include <functional>
+#include <string>
+#include <std_compat/span.h>
+#include "userptr.h"
+
+/**
+ * \file
+ * \brief native callbacks for the lambda_fn meta compressor
+ */
+
+struct pressio_data;
+struct pressio_options;
+
+namespace libpressio { namespace lambda_fn {
+
+/**
+ * the operation that lambda_fn is about to perform
+ */
+enum class lambda_fn_event {
+  /** compress is about to be called on the child */
+  compress,
+  /** decompress is about to be called on the child */
+  decompress,
+  /** set_options was called on lambda_fn */
+  set_options
+};
+
+/**
+ * the state passed to a native hook; it mirrors the globals defined for lambda_fn:script
+ */
+struct lambda_fn_context {
+  /** the operation that is about to be performed */
+  lambda_fn_event event;
+  /** the name of the lambda_fn */
+  std::string const& name;
+  /** the inputs to compress or decompress, empty for set_options */
+  compat::span<const pressio_data* const> inputs;
+  /** the outputs of compress or decompress, empty for set_options */
+  compat::span<pressio_data* const> outputs;
+  /** the options passed to set_options, nullptr for compress and decompress */
+  pressio_options const* set_options;
+  /** state persisted between calls to the hook */
+  pressio_options& persist;
+};
+
+/**
+ * a native replacement for lambda_fn:script
+ *
+ * The hook stores the options to apply to the child compressor in its second argument; it reports errors by
+ * throwing an exception derived from std::exception.
+ */
+using native_hook = std::function<void(lambda_fn_context const&, pressio_options&)>;
+
+/**
+ * \param[in] hook the hook to install
+ * \returns a value for the lambda_fn:native option that owns a copy of hook
+ */
+inline userdata make_native_hook(native_hook hook) {
+  return userdata(new native_hook(std::move(hook)), nullptr, newdelete_deleter<native_hook>(), newdelete_copy<native_hook>());
+}
+
+} }
+
+#endif /* end of include guard: LIBPRESSIO_CPP_LAMBDA_FN_H */
@@ -300,6 +300,20 @@ struct pressio {
    */
   static unsigned int patch_version();
 
+  /**
+   * sets the maximum number of threads of the shared task runtime
+   *
+   * \param[in] nthreads the maximum number of threads, 0 is treated as 1
+   * \see pressio_set_thread_budget
+   */
+  static void set_thread_budget(unsigned int nthreads);
+
+  /**
+   * \returns the maximum number of threads of the shared task runtime
+   * \see pressio_thread_budget
+   */
+  static unsigned int thread_budget();
+
   private:
   struct {
     int code;
@@ -0,0 +1,121 @@
+#ifndef LIBPRESSIO_TASK_RUNTIME_H
+#define LIBPRESSIO_TASK_RUNTIME_H
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+/**
+ * \file
+ * \brief a shared work-stealing task runtime for parallel plugins
+ */
+
+/**
+ * a process wide pool of worker threads that parallel plugins submit work to
+ *
+ * The runtime never runs more than budget() threads at once, counting the threads that call parallel_for.
+ * When a task running on a worker calls parallel_for, the nested work is queued on that worker and stolen by
+ * idle workers rather than spawning a new team, so nesting parallel meta-compressors does not oversubscribe
+ * the machine.  A plugin's nthreads option therefore bounds how many of the budgeted threads it may use at once
+ * rather than how many threads it creates.
+ */
+class pressio_task_runtime {
+  public:
+  /**
+   * \returns the runtime shared by all plugins
+   *
+   * The initial budget is taken from the LIBPRESSIO_NTHREADS environment variable if set, otherwise
+   * std::thread::hardware_concurrency()
+   */
+  static pressio_task_runtime& instance();
+
+  /**
+   * set the maximum number of threads used by the runtime including callers; must not be called while
+   * parallel_for is running
+   *
+   * \param[in] budget the maximum number of threads, values less than 1 are treated as 1
+   * \see pressio_set_thread_budget to set the budget from C
+   */
+  void set_budget(uint32_t budget);
+
+  /**
+   * \returns the maximum number of threads used by the runtime
+   */
+  uint32_t budget() const;
+
+  /**
+   * runs body(i, slot) for each i in [0, n) and waits for them to finish
+   *
+   * The calling thread participates in the loop.  slot identifies the participant running the iteration and is
+   * less than max_parallelism; no two participants in the same call share a slot, so it may index per-thread state.
+   * If an iteration throws, no further iterations are started and the first exception is rethrown to the caller.
+   * While iterations finish on other threads, the caller only runs work that they queued, so a loop never waits
+   * behind unrelated work that blocks.
+   *
+   * \param[in] n the number of iterations
+   * \param[in] max_parallelism the maximum number of participants, further limited by budget()
+   * \param[in] body the function to call for each iteration
+   */
+  template <class Func>
+  void parallel_for(size_t n, uint32_t max_parallelism, Func&& body) {
+    if(n == 0) return;
+    if(max_parallelism <= 1 || n == 1 || budget() <= 1) {
+      for (size_t i = 0; i < n; ++i) {
+        body(i, 0u);
+      }
+      return;
+    }
+    std::function<void(size_t, uint32_t)> fn = std::ref(body);
+    parallel_for_impl(n, max_parallelism, fn);
+  }
+
+  ~pressio_task_runtime();
+  pressio_task_runtime(pressio_task_runtime const&)=delete;
+  pressio_task_runtime& operator=(pressio_task_runtime const&)=delete;
+
+  private:
+  friend class pressio_task_group;
+  pressio_task_runtime();
+  void parallel_for_impl(size_t n, uint32_t max_parallelism, std::function<void(size_t, uint32_t)> const& body);
+  struct impl;
+  std::unique_ptr<impl> pimpl;
+};
+
+/**
+ * a set of tasks queued on the shared task runtime that are waited for together
+ *
+ * Tasks run on the runtime's workers or on the thread that calls wait(), so no more than budget() threads run
+ * them at once.  A task may queue further tasks in the same group.  wait() runs the group's tasks and the work they
+ * queue rather than blocking, so groups may be used inside parallel_for and inside other groups as long as tasks
+ * never block on each other.
+ */
+class pressio_task_group {
+  public:
+  pressio_task_group();
+  /**
+   * waits for the tasks that are still queued or running; exceptions are discarded
+   */
+  ~pressio_task_group();
+  pressio_task_group(pressio_task_group const&)=delete;
+  pressio_task_group& operator=(pressio_task_group const&)=delete;
+
+  /**
+   * queues task to run on the runtime
+   *
+   * \param[in] task the function to run
+   */
+  void run(std::function<void()> task);
+
+  /**
+   * runs queued work until every task in the group has finished
+   *
+   * If a task throws, the first exception is rethrown once every task has finished.
+   */
+  void wait();
+
+  private:
+  struct impl;
+  std::shared_ptr<impl> pimpl;
+};
+
+#endif /* end of include guard: LIBPRESSIO_TASK_RUNTIME_H */
@@ -76,7 +76,7 @@ class userdata {
         deleter(ptr, metadata);
       }
       if(data.copy) {
-        data.copy(&ptr, &metadata, &data.ptr, &data.metadata);
+        data.copy(&ptr, &metadata, data.ptr, data.metadata);
       }
       copy = data.copy;
       deleter = data.deleter;
@@ -7,6 +7,7 @@ extern "C" {
 #endif
 
 struct pressio;
+struct pressio_data;
 struct pressio_options;
 
 /**
@@ -28,7 +29,6 @@ uint8_t* libpressio_options_hashkeys(struct pressio* library, struct pressio_opt
  * This function MAY not be consistent in the following circumstances
  *  + different architectures or compilation targets
  *  + different versions of the C or C++ standard library
- *  + different versions of OpenSSL
  *  + different versions of LibPressio
  *  + different configurations of global variables that effect formatting such as locale
  *
@@ -41,6 +41,29 @@ uint8_t* libpressio_options_hashkeys(struct pressio* library, struct pressio_opt
  */
 uint8_t* libpressio_options_hashentries(struct pressio* library, struct pressio_options const* options, size_t* output_size);
 
+/**
+ * hash the dtype, dimensions, and contents of a pressio_data
+ *
+ * The contents are hashed as a tree of independent blocks using the threads of the task runtime, so large buffers
+ * are hashed at close to memory bandwidth.  This function is not cryptographic and has the same consistency
+ * caveats as libpressio_options_hashentries.
+ *
+ * \param[in] data the data to hash
+ * \param[in] seed the seed of the hash
+ * \returns the 64 bit hash of data
+ */
+uint64_t libpressio_data_hash64(struct pressio_data const* data, uint64_t seed);
+
+/**
+ * hash the dtype, dimensions, and contents of a pressio_data
+ *
+ * \param[in] data the data to hash
+ * \param[in] seed the seed of the hash
+ * \param[out] digest the 128 bit hash of data, low word first; the low word equals libpressio_data_hash64
+ * \see libpressio_data_hash64
+ */
+void libpressio_data_hash128(struct pressio_data const* data, uint64_t seed, uint64_t digest[2]);
+
 #ifdef __cplusplus
 }
 #endif
@@ -96,6 +96,19 @@ unsigned int pressio_minor_version();
  * \returns the patch version of the library
  */
 unsigned int pressio_patch_version();
+/**
+ * sets the maximum number of threads that plugins using the shared task runtime may use at once, counting the
+ * calling thread.  The budget is shared by every library instance in the process; a plugin's pressio:nthreads
+ * only bounds how many of these threads that plugin uses.  Must not be called while a compressor or metric is running.
+ *
+ * \param[in] nthreads the maximum number of threads, 0 is treated as 1
+ */
+void pressio_set_thread_budget(unsigned int nthreads);
+/**
+ * \returns the maximum number of threads that plugins may use at once; defaults to the LIBPRESSIO_NTHREADS
+ * environment variable if set, otherwise the number of hardware threads
+ */
+unsigned int pressio_thread_budget();
 #endif
 
 #ifdef __cplusplus 
@@ -0,0 +1,385 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/hash.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+#include "libpressio_ext/cpp/printers.h"
+#include "libpressio_ext/cpp/task_runtime.h"
+#include "pressio_data.h"
+#include "pressio_options.h"
+#include "std_compat/memory.h"
+
+namespace libpressio { namespace cache_ns {
+
+/**
+ * writes the dtype, dimensions, and hash of the contents of data
+ */
+void describe(std::ostream& out, pressio_data const& data) {
+  out << data.dtype() << '[';
+  for (auto dim : data.dimensions()) out << dim << ',';
+  auto const digest = hash::hash(data, 0, pressio_task_runtime::instance().budget());
+  out << "]#" << std::hex << std::setw(16) << std::setfill('0') << digest.high << std::setw(16) << digest.low << std::setfill(' ') << std::dec;
+}
+
+/**
+ * a cached result of the child compressor
+ */
+struct cache_entry {
+  pressio_data data;
+  pressio_options metrics;
+  size_t size_in_bytes() const { return data.size_in_bytes(); }
+};
+
+/**
+ * least recently used results shared by every cache plugin in the process
+ */
+struct memory_tier {
+  static memory_tier& instance() {
+    static memory_tier tier;
+    return tier;
+  }
+
+  bool find(std::string const& key, cache_entry& entry) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = index.find(key);
+    if(it == index.end()) return false;
+    entries.splice(entries.begin(), entries, it->second);
+    entry.data = pressio_data::clone(it->second->second.data);
+    entry.metrics = it->second->second.metrics;
+    return true;
+  }
+
+  /**
+   * inserts the entry and evicts the least recently used entries until the tier fits within the limits
+   */
+  void insert(std::string const& key, cache_entry const& entry, uint64_t max_entries, uint64_t max_bytes) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = index.find(key);
+    if(it != index.end()) {
+      bytes -= it->second->second.size_in_bytes();
+      entries.erase(it->second);
+      index.erase(it);
+    }
+    if(max_entries == 0 || entry.size_in_bytes() > max_bytes) return;
+    entries.emplace_front(key, cache_entry{pressio_data::clone(entry.data), entry.metrics});
+    index[key] = entries.begin();
+    bytes += entry.size_in_bytes();
+    while(entries.size() > max_entries || bytes > max_bytes) {
+      bytes -= entries.back().second.size_in_bytes();
+      index.erase(entries.back().first);
+      entries.pop_back();
+    }
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    index.clear();
+    entries.clear();
+    bytes = 0;
+  }
+
+  private:
+  std::mutex lock;
+  std::list<std::pair<std::string, cache_entry>> entries;
+  std::unordered_map<std::string, std::list<std::pair<std::string, cache_entry>>::iterator> index;
+  uint64_t bytes = 0;
+};
+
+/**
+ * results stored as one file per key in a directory so they persist across processes
+ *
+ * each file holds a magic number, the full key, the dtype, the dimensions, and the data; the key is compared on
+ * load so a collision of the file name is a miss rather than a wrong result.  metrics are not persisted.
+ */
+struct disk_tier {
+  static constexpr uint64_t magic = 0x31454843414350ull; //"PCACHE1"
+
+  static std::string path(std::string const& directory, std::string const& key) {
+    std::ostringstream ss;
+    ss << directory << "/libpressio-cache-" << std::hex << std::setw(16) << std::setfill('0') << hash::xxh64(key.data(), key.size()) << ".bin";
+    return ss.str();
+  }
+
+  static bool find(std::string const& directory, std::string const& key, cache_entry& entry) {
+    std::ifstream in(path(directory, key), std::ios::binary);
+    if(!in) return false;
+    uint64_t file_magic = 0, key_size = 0, ndims = 0;
+    int32_t dtype;
+    in.read(reinterpret_cast<char*>(&file_magic), sizeof(file_magic));
+    in.read(reinterpret_cast<char*>(&key_size), sizeof(key_size));
+    if(!in || file_magic != magic || key_size != key.size()) return false;
+    std::string file_key(key_size, '\0');
+    in.read(&file_key[0], key_size);
+    if(!in || file_key != key) return false;
+    in.read(reinterpret_cast<char*>(&dtype), sizeof(dtype));
+    in.read(reinterpret_cast<char*>(&ndims), sizeof(ndims));
+    if(!in || ndims > 64) return false;
+    std::vector<uint64_t> dims(ndims);
+    in.read(reinterpret_cast<char*>(dims.data()), ndims * sizeof(uint64_t));
+    if(!in) return false;
+    auto data = pressio_data::owning(static_cast<pressio_dtype>(dtype), std::vector<size_t>(dims.begin(), dims.end()));
+    in.read(static_cast<char*>(data.data()), data.size_in_bytes());
+    if(!in) return false;
+    entry.data = std::move(data);
+    entry.metrics.clear();
+    return true;
+  }
+
+  /**
+   * writes to a temporary file which is renamed into place so readers never see a partial entry
+   */
+  static void insert(std::string const& directory, std::string const& key, cache_entry const& entry) {
+    const std::string final_path = path(directory, key);
+    std::ostringstream tmp_path;
+    tmp_path << final_path << ".tmp" << std::hex << std::hash<std::thread::id>{}(std::this_thread::get_id())
+      << std::chrono::steady_clock::now().time_since_epoch().count();
+    {
+      std::ofstream out(tmp_path.str(), std::ios::binary | std::ios::trunc);
+      if(!out) return;
+      const uint64_t key_size = key.size(), ndims = entry.data.num_dimensions();
+      const int32_t dtype = entry.data.dtype();
+      std::vector<uint64_t> dims(entry.data.dimensions().begin(), entry.data.dimensions().end());
+      out.write(reinterpret_cast<char const*>(&magic), sizeof(magic));
+      out.write(reinterpret_cast<char const*>(&key_size), sizeof(key_size));
+      out.write(key.data(), key.size());
+      out.write(reinterpret_cast<char const*>(&dtype), sizeof(dtype));
+      out.write(reinterpret_cast<char const*>(&ndims), sizeof(ndims));
+      out.write(reinterpret_cast<char const*>(dims.data()), dims.size() * sizeof(uint64_t));
+      out.write(static_cast<char const*>(entry.data.data()), entry.data.size_in_bytes());
+      if(!out) {
+        out.close();
+        std::remove(tmp_path.str().c_str());
+        return;
+      }
+    }
+    if(std::rename(tmp_path.str().c_str(), final_path.c_str())) {
+      std::remove(tmp_path.str().c_str());
+    }
+  }
+};
+
+class cache_compressor_plugin : public libpressio_compressor_plugin {
+public:
+  struct pressio_options get_options_impl() const override
+  {
+    struct pressio_options options;
+    set_meta(options, "cache:compressor", compressor_id, compressor);
+    set(options, "cache:max_entries", max_entries);
+    set(options, "cache:max_bytes", max_bytes);
+    set(options, "cache:directory", directory);
+    set(options, "cache:decompress", cache_decompress);
+    set_type(options, "cache:clear", pressio_option_bool_type);
+    return options;
+  }
+
+  struct pressio_options get_configuration_impl() const override
+  {
+    struct pressio_options options;
+    set_meta_configuration(options, "cache:compressor", compressor_plugins(), compressor);
+    set(options, "pressio:thread_safe", get_threadsafe(*compressor));
+    set(options, "pressio:stability", "experimental");
+
+        std::vector<std::string> invalidations {"cache:max_entries", "cache:max_bytes", "cache:directory", "cache:decompress"};
+        std::vector<pressio_configurable const*> invalidation_children {&*compressor};
+
+        set(options, "predictors:error_dependent", get_accumulate_configuration("predictors:error_dependent", invalidation_children, {}));
+        set(options, "predictors:error_agnostic", get_accumulate_configuration("predictors:error_agnostic", invalidation_children, {}));
+        set(options, "predictors:runtime", get_accumulate_configuration("predictors:runtime", invalidation_children, invalidations));
+
+    return options;
+  }
+
+  struct pressio_options get_documentation_impl() const override
+  {
+    struct pressio_options options;
+    set_meta_docs(options, "cache:compressor", "compressor whose results are cached", compressor);
+    set(options, "pressio:description", R"(caches the results of a compressor so that compressing identical inputs with an identical
+      configuration returns the stored result instead of compressing again.  Results are keyed by the compressor, its version and the
+      versions of libpressio and of any compressors it contains, its options, the dtype and dimensions of the input, and a 128 bit
+      hash of the input's contents.)");
+    set(options, "cache:max_entries", R"(the maximum number of results kept in memory; the memory tier is shared by every cache plugin in the
+      process, and least recently used results are evicted to meet the limits of the plugin inserting a result)");
+    set(options, "cache:max_bytes", "the maximum total size in bytes of the results kept in memory");
+    set(options, "cache:directory", R"(if not empty, a directory where results are also stored as one file per result, so that they are
+      reused by later processes; results found there are added to the memory tier)");
+    set(options, "cache:decompress", "if true, decompression results are cached as well as compression results");
+    set(options, "cache:clear", "*write-only* when set to true, discards the results held in memory by every cache plugin in the process");
+    set(options, "cache:tier", R"(where the result of the last operation came from
+      + memory -- the memory tier
+      + disk -- the directory tier
+      + miss -- the compressor was called)");
+    set(options, "cache:hits", "the number of operations of this plugin answered from either tier");
+    set(options, "cache:misses", "the number of operations of this plugin that called the compressor");
+    return options;
+  }
+
+
+  int set_options_impl(struct pressio_options const& options) override
+  {
+    get_meta(options, "cache:compressor", compressor_plugins(), compressor_id, compressor);
+    get(options, "cache:max_entries", &max_entries);
+    get(options, "cache:max_bytes", &max_bytes);
+    get(options, "cache:directory", &directory);
+    get(options, "cache:decompress", &cache_decompress);
+    bool clear = false;
+    if(get(options, "cache:clear", &clear) == pressio_options_key_set && clear) {
+      memory_tier::instance().clear();
+    }
+    return 0;
+  }
+
+  int compress_impl(const pressio_data* input,
+                    struct pressio_data* output) override
+  {
+    return cached('c', *input, *output, [this](pressio_data const* in, pressio_data* out) {
+      return compressor->compress(in, out);
+    });
+  }
+
+  int decompress_impl(const pressio_data* input,
+                      struct pressio_data* output) override
+  {
+    if(!cache_decompress) {
+      tier = "miss";
+      misses++;
+      int rc = compressor->decompress(input, output);
+      if(rc) set_error(rc, compressor->error_msg());
+      return rc;
+    }
+    return cached('d', *input, *output, [this](pressio_data const* in, pressio_data* out) {
+      return compressor->decompress(in, out);
+    });
+  }
+
+  int major_version() const override { return 0; }
+  int minor_version() const override { return 0; }
+  int patch_version() const override { return 1; }
+  const char* version() const override { return "0.0.1"; }
+  const char* prefix() const override { return "cache"; }
+
+  void set_name_impl(std::string const& new_name) override {
+    if(new_name != "") {
+      compressor->set_name(new_name + "/" + compressor->prefix());
+    } else {
+      compressor->set_name(new_name);
+    }
+  }
+  std::vector<std::string> children_impl() const final {
+      return { compressor->get_name() };
+  }
+
+  pressio_options get_metrics_results_impl() const override {
+    pressio_options results = (tier == "miss") ? compressor->get_metrics_results() : cached_metrics;
+    set(results, "cache:tier", tier);
+    set(results, "cache:hits", hits);
+    set(results, "cache:misses", misses);
+    return results;
+  }
+
+  std::shared_ptr<libpressio_compressor_plugin> clone() override
+  {
+    return compat::make_unique<cache_compressor_plugin>(*this);
+  }
+
+private:
+  /**
+   * \returns the key of an operation; output contributes its dtype and dimensions since they guide decompression
+   *
+   * The versions of libpressio and of every compressor in the child's tree are part of the key so that results stored in
+   * cache:directory by an older version are not returned after an upgrade.
+   */
+  std::string make_key(char operation, pressio_data const& input, pressio_data const& output) const {
+    std::ostringstream key;
+    key << std::setprecision(17) << operation << '\n' << pressio::version() << '\n'
+        << compressor_id << ' ' << compressor->prefix() << ' ' << compressor->version() << '\n';
+    const std::string version_key = "pressio:version";
+    for (auto const& entry : compressor->get_configuration()) {
+      auto const& name = entry.first;
+      if(name.size() >= version_key.size() && name.compare(name.size() - version_key.size(), version_key.size(), version_key) == 0) {
+        key << name << '=' << entry.second << '\n';
+      }
+    }
+    for (auto const& option : compressor->get_options()) {
+      key << option.first << '=';
+      if(option.second.type() == pressio_option_data_type && option.second.has_value()) {
+        describe(key, option.second.get_value<pressio_data>());
+      } else {
+        key << option.second;
+      }
+      key << '\n';
+    }
+    describe(key, input);
+    if(operation == 'd') {
+      key << '\n' << output.dtype() << '[';
+      for (auto dim : output.dimensions()) key << dim << ',';
+      key << ']';
+    }
+    return key.str();
+  }
+
+  template <class Operation>
+  int cached(char operation, pressio_data const& input, pressio_data& output, Operation&& run) {
+    const std::string key = make_key(operation, input, output);
+    cache_entry entry;
+    if(memory_tier::instance().find(key, entry)) {
+      tier = "memory";
+    } else if(!directory.empty() && disk_tier::find(directory, key, entry)) {
+      tier = "disk";
+      memory_tier::instance().insert(key, entry, max_entries, max_bytes);
+    } else {
+      tier = "miss";
+      misses++;
+      int rc = run(&input, &output);
+      if(rc) {
+        set_error(rc, compressor->error_msg());
+        if(rc > 0) return rc;
+      }
+      entry.data = pressio_data::nonowning(output.dtype(), output.data(), output.dimensions());
+      entry.metrics = compressor->get_metrics_results();
+      memory_tier::instance().insert(key, entry, max_entries, max_bytes);
+      if(!directory.empty()) {
+        disk_tier::insert(directory, key, entry);
+      }
+      return rc;
+    }
+    hits++;
+    cached_metrics = std::move(entry.metrics);
+    if(output.has_data() && output.capacity_in_bytes() >= entry.data.size_in_bytes()) {
+      //keep the caller's buffer, which may be preallocated or owned by the caller
+      output.set_dtype(entry.data.dtype());
+      output.reshape(entry.data.dimensions());
+      memcpy(output.data(), entry.data.data(), entry.data.size_in_bytes());
+    } else {
+      output = std::move(entry.data);
+    }
+    return 0;
+  }
+
+  pressio_compressor compressor = compressor_plugins().build("noop");
+  std::string compressor_id = "noop";
+  uint64_t max_entries = 64;
+  uint64_t max_bytes = 256ull * 1024 * 1024;
+  std::string directory;
+  bool cache_decompress = true;
+
+  std::string tier = "miss";
+  pressio_options cached_metrics;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+};
+
+static pressio_register compressor_cache_plugin(compressor_plugins(), "cache", []() {
+  return compat::make_unique<cache_compressor_plugin>();
+});
+
+} }
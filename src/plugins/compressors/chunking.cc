@@ -1,12 +1,20 @@
+#include <atomic>
+#include <cmath>
 #include <sstream>
 #include <chrono>
+#include <limits>
+#include <map>
+#include <mutex>
 #include "libpressio_ext/cpp/data.h" //for access to pressio_data structures
 #include "libpressio_ext/cpp/compressor.h" //for the libpressio_compressor_plugin class
 #include "libpressio_ext/cpp/options.h" // for access to pressio_options
 #include "libpressio_ext/cpp/pressio.h" //for the plugin registries
+#include "libpressio_ext/cpp/printers.h"
 #include "pressio_options.h"
 #include "pressio_data.h"
 #include "chunking_impl.h"
+#include "compressor_pool.h"
+#include "libpressio_ext/cpp/task_runtime.h"
 #include "pressio_compressor.h"
 #include "std_compat/memory.h"
 #include "std_compat/numeric.h"
@@ -14,6 +22,149 @@
 
 namespace libpressio { namespace chunking {
 
+/**
+ * set in the chunk count of the header when the header also records the offset of each chunk
+ */
+constexpr uint64_t chunk_offsets_flag = uint64_t{1} << 63;
+/**
+ * set in the chunk count of the header when the header also records the dimensions of the data
+ */
+constexpr uint64_t chunk_dims_flag = uint64_t{1} << 62;
+/**
+ * set in the chunk count of the header when the header also records the chunk size used to compress
+ */
+constexpr uint64_t chunk_size_flag = uint64_t{1} << 61;
+/**
+ * set in the chunk count of the header when the edge chunks were stored with edge_mode::exact
+ */
+constexpr uint64_t chunk_exact_edges_flag = uint64_t{1} << 60;
+constexpr uint64_t chunk_header_flags = chunk_offsets_flag | chunk_dims_flag | chunk_size_flag | chunk_exact_edges_flag;
+
+/**
+ * the container header
+ *
+ * the chunk count and flags, then if chunk_dims_flag is set the number of dimensions and the dimensions,
+ * then if chunk_size_flag is set the number of dimensions of a chunk and the chunk size,
+ * then the compressed size of each chunk, then if chunk_offsets_flag is set the offset of each chunk.
+ * Without chunk_offsets_flag the chunks follow the header in order.
+ */
+struct chunk_header {
+  size_t size_in_bytes(size_t nchunks, bool with_offsets) const {
+    const size_t chunk_size_words = chunk_size.empty() ? 0 : 1 + chunk_size.size();
+    return sizeof(uint64_t) * (2 + dims.size() + chunk_size_words + (with_offsets ? 2 : 1) * nchunks);
+  }
+
+  void write(void* out, bool with_offsets) const {
+    uint64_t* ptr = static_cast<uint64_t*>(out);
+    *ptr++ = sizes.size() | chunk_dims_flag | (with_offsets ? chunk_offsets_flag : 0) | (chunk_size.empty() ? 0 : chunk_size_flag) |
+      (edges == edge_mode::exact ? chunk_exact_edges_flag : 0);
+    *ptr++ = dims.size();
+    ptr = std::copy(dims.begin(), dims.end(), ptr);
+    if(!chunk_size.empty()) {
+      *ptr++ = chunk_size.size();
+      ptr = std::copy(chunk_size.begin(), chunk_size.end(), ptr);
+    }
+    ptr = std::copy(sizes.begin(), sizes.end(), ptr);
+    if(with_offsets) {
+      std::copy(offsets.begin(), offsets.end(), ptr);
+    }
+  }
+
+  /**
+   * \returns false if the input is too small to hold the header or the chunks it describes
+   */
+  bool read(pressio_data const& input) {
+    const size_t input_size = input.size_in_bytes();
+    uint64_t const* ptr = static_cast<uint64_t const*>(input.data());
+    uint64_t const* end = ptr + input_size / sizeof(uint64_t);
+    if(ptr == end) return false;
+    const bool has_offsets = (*ptr & chunk_offsets_flag) != 0;
+    has_dims = (*ptr & chunk_dims_flag) != 0;
+    const bool has_chunk_size = (*ptr & chunk_size_flag) != 0;
+    edges = (*ptr & chunk_exact_edges_flag) ? edge_mode::exact : edge_mode::pad;
+    const size_t n = *ptr++ & ~chunk_header_flags;
+    dims.clear();
+    chunk_size.clear();
+    if(has_dims) {
+      if(ptr == end || static_cast<size_t>(end - ptr) <= *ptr) return false;
+      const size_t ndims = *ptr++;
+      dims.assign(ptr, ptr + ndims);
+      ptr += ndims;
+    }
+    if(has_chunk_size) {
+      if(ptr == end || static_cast<size_t>(end - ptr) <= *ptr) return false;
+      const size_t ndims = *ptr++;
+      chunk_size.assign(ptr, ptr + ndims);
+      ptr += ndims;
+    }
+    if(static_cast<size_t>(end - ptr) < (has_offsets ? 2 : 1) * n) return false;
+    sizes.assign(ptr, ptr + n);
+    ptr += n;
+    offsets.resize(n);
+    if(has_offsets) {
+      std::copy(ptr, ptr + n, offsets.begin());
+      ptr += n;
+    } else {
+      const uint64_t header_size = (ptr - static_cast<uint64_t const*>(input.data())) * sizeof(uint64_t);
+      compat::exclusive_scan(sizes.begin(), sizes.end(), offsets.begin(), header_size);
+    }
+    for (size_t i = 0; i < n; ++i) {
+      if(offsets[i] > input_size || sizes[i] > input_size - offsets[i]) return false;
+    }
+    return true;
+  }
+
+  std::vector<uint64_t> dims;
+  /** the chunk size used to compress, empty for containers written before it was recorded */
+  std::vector<uint64_t> chunk_size;
+  /** how the edge chunks were stored, only meaningful when chunk_size is recorded */
+  edge_mode edges = edge_mode::pad;
+  std::vector<uint64_t> sizes;
+  std::vector<uint64_t> offsets;
+  bool has_dims = false;
+};
+
+/**
+ * the outcome of tuning the chunk size for one configuration
+ */
+struct tune_result {
+  std::vector<size_t> chunk_size;
+  double throughput;
+  double ratio;
+};
+
+/**
+ * tuning results shared by every chunking plugin in the process, keyed by the configuration that was tuned
+ */
+struct tune_cache {
+  static tune_cache& instance() {
+    static tune_cache cache;
+    return cache;
+  }
+
+  bool find(std::string const& key, tune_result& result) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = results.find(key);
+    if(it == results.end()) return false;
+    result = it->second;
+    return true;
+  }
+
+  void insert(std::string const& key, tune_result const& result) {
+    std::lock_guard<std::mutex> guard(lock);
+    results[key] = result;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    results.clear();
+  }
+
+  private:
+  std::mutex lock;
+  std::map<std::string, tune_result> results;
+};
+
 class chunking_plugin: public libpressio_compressor_plugin {
   public:
     chunking_plugin() {
@@ -27,6 +178,15 @@ class chunking_plugin: public libpressio_compressor_plugin {
       set(options, "pressio:nthreads", static_cast<uint32_t>(nthreads));
       set(options, "chunking:size", pressio_data(chunk_size.begin(), chunk_size.end()));
       set(options, "chunking:chunk_nthreads", nthreads);
+      set(options, "chunking:stream", stream);
+      set(options, "chunking:edge_mode", edge_mode_str);
+      set(options, "chunking:region_start", pressio_data(region_start.begin(), region_start.end()));
+      set(options, "chunking:region_size", pressio_data(region_size.begin(), region_size.end()));
+      set(options, "chunking:tune", tune);
+      set(options, "chunking:tune_throughput_weight", tune_throughput_weight);
+      set(options, "chunking:tune_sample_bytes", tune_sample_bytes);
+      set_type(options, "chunking:retune", pressio_option_bool_type);
+      set_type(options, "chunking:tune_clear_cache", pressio_option_bool_type);
       return options;
     }
 
@@ -35,12 +195,13 @@ class chunking_plugin: public libpressio_compressor_plugin {
       set_meta_configuration(options, "chunking:compressor", compressor_plugins(), compressor);
       set(options, "pressio:thread_safe", get_threadsafe(*compressor));
       set(options, "pressio:stability", "experimental");
+      set(options, "chunking:edge_mode", std::vector<std::string>{"pad", "exact"});
       
-        std::vector<std::string> invalidations {"chunking:chunk_nthreads", "pressio:nthreads", "chunking:size"}; 
+        std::vector<std::string> invalidations {"chunking:chunk_nthreads", "pressio:nthreads", "chunking:size", "chunking:stream", "chunking:edge_mode", "chunking:tune", "chunking:tune_throughput_weight", "chunking:tune_sample_bytes"}; 
         std::vector<pressio_configurable const*> invalidation_children {&*compressor}; 
         
         set(options, "predictors:error_dependent", get_accumulate_configuration("predictors:error_dependent", invalidation_children, {}));
-        set(options, "predictors:error_agnostic", get_accumulate_configuration("predictors:error_agnostic", invalidation_children, std::vector<std::string>{"chunking:size"}));
+        set(options, "predictors:error_agnostic", get_accumulate_configuration("predictors:error_agnostic", invalidation_children, std::vector<std::string>{"chunking:size", "chunking:edge_mode", "chunking:tune", "chunking:tune_throughput_weight", "chunking:tune_sample_bytes"}));
         set(options, "predictors:runtime", get_accumulate_configuration("predictors:runtime", invalidation_children, invalidations));
         set(options, "pressio:highlevel", get_accumulate_configuration("pressio:highlevel", invalidation_children, std::vector<std::string>{"pressio:nthreads"}));
 
@@ -51,8 +212,34 @@ class chunking_plugin: public libpressio_compressor_plugin {
       struct pressio_options options;
       set_meta_docs(options, "chunking:compressor", "compressor to use after chunking", compressor);
       set(options, "pressio:description", R"(Chunks a larger dataset into smaller datasets for parallel compression)");
-      set(options, "chunking:size", "size of the chunks to use");
-      set(options, "chunking:chunk_nthreads", "number of threads to use to chunk the data");
+      set(options, "chunking:size", "size of the chunks to use; decompress uses the size recorded in the container when it has one");
+      set(options, "chunking:chunk_nthreads", "maximum number of threads from the shared task runtime to use to chunk the data");
+      set(options, "chunking:stream", R"(when true, chunks are compressed with per-thread clones of chunking:compressor on the
+      shared task runtime and each chunk is copied into the output at an atomically reserved offset as soon as it finishes,
+      so chunks are stored in completion order and each chunk's temporary buffer is released immediately; when false, all chunks
+      are passed to the compressor's compress_many and stored in order)");
+      set(options, "chunking:edge_mode", R"(how chunks that extend past the edge of the data are stored when the dimensions are not divisible by chunking:size
+      + pad -- edge chunks have the full chunk size and are padded with zeros
+      + exact -- edge chunks are clipped to the data and compressed with their true dimensions
+      the same mode must be used to decompress)");
+      set(options, "chunking:region_start", R"(if chunking:region_size is non-empty, the global coordinates of the first element to decompress;
+      only the chunks that intersect the region are decompressed and the output has the dimensions of chunking:region_size)");
+      set(options, "chunking:region_size", "if non-empty, the dimensions of the region to decompress; otherwise the entire dataset is decompressed");
+      set(options, "chunking:tune", R"(when true, compress chooses chunking:size by benchmarking candidate chunk shapes on a sample of the input
+      with the configured child compressor, thread count, and edge mode.  Results are cached for the process by the child compressor's
+      configuration, dtype, dimensions, and the tuning options, so only the first compression of each configuration pays for tuning.
+      chunking:size is replaced by the tuned size, which is recorded in the container so any instance can decompress it)");
+      set(options, "chunking:retune", "when set to true, the next compress tunes chunking:size even if a cached result exists and replaces it");
+      set(options, "chunking:tune_clear_cache", "when set to true, discards the tuning results cached by every chunking plugin in the process");
+      set(options, "chunking:tune_throughput_weight", R"(objective used to compare candidate chunk shapes, between 0 and 1;
+      the candidate with the largest weight*log(throughput) + (1-weight)*log(compression ratio) is chosen, so 1 optimizes only throughput
+      and 0 only the compression ratio)");
+      set(options, "chunking:tune_sample_bytes", R"(maximum size of the sample used for tuning; the sample is taken from the middle of the
+      input by reducing its slowest dimensions, and candidate chunks must fit at least 4 times in it)");
+      set(options, "chunking:tune_throughput", "the compression throughput in bytes per second of the tuned chunk size on the sample");
+      set(options, "chunking:tune_ratio", "the compression ratio of the tuned chunk size on the sample");
+      set(options, "chunking:tune_cache_hit", "true if the tuned chunk size for the last compress was found in the cache");
+      set(options, "chunking:tune_time", "time in milliseconds spent tuning during the last compress");
       return options;
     }
 
@@ -73,22 +260,55 @@ class chunking_plugin: public libpressio_compressor_plugin {
         chunk_size = d.to_vector<size_t>();
       }
       get(options, "chunking:chunk_nthreads", &nthreads);
-
+      get(options, "chunking:stream", &stream);
+      std::string tmp_edge_mode;
+      if(get(options, "chunking:edge_mode", &tmp_edge_mode) == pressio_options_key_set) {
+        if(tmp_edge_mode != "pad" && tmp_edge_mode != "exact") {
+          return set_error(1, "unsupported chunking:edge_mode " + tmp_edge_mode);
+        }
+        edge_mode_str = tmp_edge_mode;
+      }
+      if (get(options, "chunking:region_start", &d) == pressio_options_key_set) {
+        region_start = d.to_vector<size_t>();
+      }
+      if (get(options, "chunking:region_size", &d) == pressio_options_key_set) {
+        region_size = d.to_vector<size_t>();
+      }
+      get(options, "chunking:tune", &tune);
+      get(options, "chunking:retune", &retune);
+      double tmp_weight;
+      if(get(options, "chunking:tune_throughput_weight", &tmp_weight) == pressio_options_key_set) {
+        if(tmp_weight < 0 || tmp_weight > 1) {
+          return set_error(1, "chunking:tune_throughput_weight must be between 0 and 1");
+        }
+        tune_throughput_weight = tmp_weight;
+      }
+      get(options, "chunking:tune_sample_bytes", &tune_sample_bytes);
+      bool clear_cache = false;
+      if(get(options, "chunking:tune_clear_cache", &clear_cache) == pressio_options_key_set && clear_cache) {
+        tune_cache::instance().clear();
+      }
+      pool.clear();
 
       return 0;
     }
 
     pressio_options get_metrics_results_impl() const override {
-      pressio_options mr = compressor->get_metrics_results();
+      pressio_options mr = streamed ? stream_metrics_results : compressor->get_metrics_results();
       set(mr, "chunking:chunk_time", chunk_time);
       set(mr, "chunking:dechunk_time", dechunk_time);
       set(mr, "chunking:write_chunk_time", write_chunk_time);
       set(mr, "chunking:read_dechunk_time", read_dechunk_time);
+      set(mr, "chunking:tune_throughput", tune_throughput);
+      set(mr, "chunking:tune_ratio", tune_ratio);
+      set(mr, "chunking:tune_cache_hit", tune_cache_hit);
+      set(mr, "chunking:tune_time", tune_time);
       return mr;
     }
 
 
     void set_name_impl(std::string const& new_name) override {
+      pool.clear();
       if(new_name != "") {
       compressor->set_name(new_name + "/" + compressor->prefix());
       } else {
@@ -101,6 +321,9 @@ class chunking_plugin: public libpressio_compressor_plugin {
 
 
     int compress_impl(const pressio_data *input, struct pressio_data* output) override {
+      if(tune || retune) {
+        if(int rc = tune_chunk_size(*input)) return rc;
+      }
       auto chunk_begin = std::chrono::steady_clock::now();
       //partition data into chunks
       pressio_data tmp;
@@ -119,7 +342,7 @@ class chunking_plugin: public libpressio_compressor_plugin {
           inputs_ptr.emplace_back(input);
           outputs.emplace_back(pressio_data::empty(pressio_byte_dtype, empty_dims));
           outputs_ptr.emplace_back(&outputs.back());
-      } else if (check_contigous(input) and check_valid_dims(input)){
+      } else if (check_contigous(input, chunk_size) and check_valid_dims(input, chunk_size)){
         auto* ptr = reinterpret_cast<unsigned char*>(input->data());
         for (size_t i = 0; i < num_chunks; ++i) {
           inputs.emplace_back(pressio_data::nonowning(input->dtype(), ptr+(i*stride), chunk_size));
@@ -129,10 +352,12 @@ class chunking_plugin: public libpressio_compressor_plugin {
         }
       } else {
         //non-contigious, need to copy
-        tmp = libpressio::chunking::chunk_data(*input, chunk_size, {{"nthreads", nthreads}});
+        tmp = libpressio::chunking::chunk_data(*input, chunk_size, {{"nthreads", nthreads}, {"edge_mode", edge_mode_str}});
         auto ptr = static_cast<uint8_t*>(tmp.data());
+        const chunk_layout layout(input->dimensions(), chunk_size, get_edge_mode());
+        const size_t elem_size = pressio_dtype_size(input->dtype());
         for (size_t i = 0; i < num_chunks; ++i) {
-          inputs.emplace_back(pressio_data::nonowning(input->dtype(), ptr+(i*stride), chunk_size));
+          inputs.emplace_back(pressio_data::nonowning(input->dtype(), ptr+(layout.offsets[i]*elem_size), layout.chunk_dims(i)));
           inputs_ptr.emplace_back(&inputs.back());
           outputs.emplace_back(pressio_data::empty(pressio_byte_dtype, empty_dims));
           outputs_ptr.emplace_back(&outputs.back());
@@ -141,6 +366,11 @@ class chunking_plugin: public libpressio_compressor_plugin {
       auto chunk_end = std::chrono::steady_clock::now();
       chunk_time = std::chrono::duration_cast<std::chrono::milliseconds>(chunk_end-chunk_begin).count();
 
+      streamed = stream;
+      if(stream) {
+        return compress_streaming(inputs_ptr, input->dimensions(), output);
+      }
+
       //run the child compressor on the chunks
       int rc = compressor->compress_many(
           inputs_ptr.data(),
@@ -166,29 +396,33 @@ class chunking_plugin: public libpressio_compressor_plugin {
           [](size_t acc, pressio_data const& data) {
             return acc+ data.size_in_bytes();
           });
-      size_t header_size = sizeof(uint64_t)*(outputs.size() + 1);
-
-      *output = pressio_data::owning(pressio_byte_dtype, {header_size + total_compsize});
-
-      //write header
-      unsigned char* outptr = reinterpret_cast<unsigned char*>(output->data());
-      uint64_t* outputs_ptr64 = reinterpret_cast<uint64_t*>(outptr);
-      *outputs_ptr64 = outputs.size();
-      outputs_ptr64++;
+      chunk_header header;
+      header.dims.assign(input->dimensions().begin(), input->dimensions().end());
+      header.chunk_size.assign(chunk_size.begin(), chunk_size.end());
+      header.edges = get_edge_mode();
+      header.sizes.resize(outputs.size());
       std::transform(
           std::begin(outputs),
           std::end(outputs),
-          outputs_ptr64,
+          std::begin(header.sizes),
           [](pressio_data const& data) {
             return static_cast<uint64_t>(data.size_in_bytes());
           });
+      const size_t header_size = header.size_in_bytes(outputs.size(), false);
+
+      *output = pressio_data::owning(pressio_byte_dtype, {header_size + total_compsize});
+
+      //write header
+      unsigned char* outptr = reinterpret_cast<unsigned char*>(output->data());
+      header.write(outptr, false);
 
       //write compressed data
-      size_t accum_size = header_size;
-      for (auto const& i : outputs) {
-        memcpy(outptr+accum_size, i.data(), i.size_in_bytes());
-        accum_size += i.size_in_bytes();
-      }
+      std::vector<size_t> offsets(outputs.size());
+      compat::exclusive_scan(header.sizes.begin(), header.sizes.end(), offsets.begin(), header_size);
+      pressio_task_runtime::instance().parallel_for(outputs.size(), static_cast<uint32_t>(nthreads), [&](size_t i, uint32_t) {
+        memcpy(outptr+offsets[i], outputs[i].data(), outputs[i].size_in_bytes());
+        outputs[i] = pressio_data();
+      });
       auto write_chunk_end = std::chrono::steady_clock::now();
       write_chunk_time = std::chrono::duration_cast<std::chrono::milliseconds>(write_chunk_end-write_chunk_begin).count();
       return rc;
@@ -198,10 +432,27 @@ class chunking_plugin: public libpressio_compressor_plugin {
       //read in the header
       auto read_dechunk_begin = std::chrono::steady_clock::now();
       unsigned char* inptr = reinterpret_cast<unsigned char*>(input->data());
-      uint64_t* inptr64 = reinterpret_cast<uint64_t*>(input->data());
-      size_t n_buffers = *inptr64;
-      const size_t header_size = sizeof(uint64_t) *(n_buffers+1);
-      std::vector<uint64_t> sizes(inptr64+1, inptr64+(1+n_buffers));
+      chunk_header header;
+      if(!header.read(*input)) {
+        return set_error(2, "invalid chunking header");
+      }
+      //the container records the chunk size it was written with, which may have been tuned
+      const std::vector<size_t> effective_chunk_size = header.chunk_size.empty() ? chunk_size :
+        std::vector<size_t>(header.chunk_size.begin(), header.chunk_size.end());
+      if(!region_size.empty()) {
+        return decompress_region(header, effective_chunk_size, inptr, output);
+      }
+      const size_t n_buffers = header.sizes.size();
+      auto const& sizes = header.sizes;
+      auto const& offsets = header.offsets;
+      const libpressio::chunking::edge_mode edges = container_edge_mode(header);
+      std::unique_ptr<chunk_layout> layout;
+      if(!effective_chunk_size.empty()) {
+        layout = compat::make_unique<chunk_layout>(output->dimensions(), effective_chunk_size, edges);
+        if(layout->num_chunks() != n_buffers) {
+          return set_error(2, "chunking:size does not match the number of chunks in the container");
+        }
+      }
 
       //create the buffers to decompress
       std::vector<pressio_data> inputs;
@@ -212,13 +463,11 @@ class chunking_plugin: public libpressio_compressor_plugin {
       inputs_ptr.reserve(n_buffers);
       outputs.reserve(n_buffers);
       outputs_ptr.reserve(n_buffers);
-      size_t accum_size = header_size;
       for (size_t i = 0; i < n_buffers; ++i) {
-        inputs.emplace_back(pressio_data::nonowning(pressio_byte_dtype, inptr+accum_size, {sizes[i]}));
-        outputs.emplace_back(pressio_data::owning(output->dtype(), (chunk_size.empty() ? output->dimensions(): chunk_size )));
+        inputs.emplace_back(pressio_data::nonowning(pressio_byte_dtype, inptr+offsets[i], {sizes[i]}));
+        outputs.emplace_back(pressio_data::owning(output->dtype(), (effective_chunk_size.empty() ? output->dimensions(): layout->chunk_dims(i))));
         inputs_ptr.emplace_back(&inputs.back());
         outputs_ptr.emplace_back(&outputs.back());
-        accum_size+=sizes[i];
       }
       auto read_dechunk_end = std::chrono::steady_clock::now();
       read_dechunk_time = std::chrono::duration_cast<std::chrono::milliseconds>(read_dechunk_end-read_dechunk_begin).count();
@@ -238,24 +487,22 @@ class chunking_plugin: public libpressio_compressor_plugin {
       //join the buffers
       if(n_buffers == 1) {
         *output = std::move(outputs[0]);
-      } else if(check_contigous(output) and check_valid_dims(output)) {
+      } else if(check_contigous(output, effective_chunk_size) and check_valid_dims(output, effective_chunk_size)) {
         unsigned char* outptr = reinterpret_cast<unsigned char*>(output->data());
         size_t accum_size_out = 0;
-        const size_t stride_in_bytes = std::accumulate( std::begin(chunk_size), std::end(chunk_size), static_cast<size_t>(pressio_dtype_size(output->dtype())), compat::multiplies<>{});
+        const size_t stride_in_bytes = std::accumulate( std::begin(effective_chunk_size), std::end(effective_chunk_size), static_cast<size_t>(pressio_dtype_size(output->dtype())), compat::multiplies<>{});
         for (size_t i = 0; i < n_buffers; ++i) {
           memcpy(outptr+accum_size_out, outputs[i].data(), stride_in_bytes);
           accum_size_out += stride_in_bytes;
         }
       } else {
-        size_t accum_size_out = 0;
-        const size_t stride_in_bytes = std::accumulate( std::begin(chunk_size), std::end(chunk_size), static_cast<size_t>(pressio_dtype_size(output->dtype())), compat::multiplies<>{});
-        pressio_data combined(pressio_data::owning(pressio_byte_dtype, {n_buffers * stride_in_bytes}));
+        const size_t elem_size = pressio_dtype_size(output->dtype());
+        pressio_data combined(pressio_data::owning(pressio_byte_dtype, {layout->offsets.back() * elem_size}));
         unsigned char* outptr = reinterpret_cast<unsigned char*>(combined.data());
-        for (size_t i = 0; i < n_buffers; ++i) {
-          memcpy(outptr+accum_size_out, outputs[i].data(), stride_in_bytes);
-          accum_size_out += stride_in_bytes;
-        }
-        libpressio::chunking::restore_data(*output, combined, chunk_size, {{"nthreads", nthreads}});
+        pressio_task_runtime::instance().parallel_for(n_buffers, static_cast<uint32_t>(nthreads), [&](size_t i, uint32_t) {
+          memcpy(outptr+layout->offsets[i]*elem_size, outputs[i].data(), layout->chunk_elements(i)*elem_size);
+        });
+        libpressio::chunking::restore_data(*output, combined, effective_chunk_size, {{"nthreads", nthreads}, {"edge_mode", std::string(edges == libpressio::chunking::edge_mode::exact ? "exact" : "pad")}});
       }
       auto dechunk_end = std::chrono::steady_clock::now();
       dechunk_time = std::chrono::duration_cast<std::chrono::milliseconds>(dechunk_end-dechunk_begin).count();
@@ -267,7 +514,7 @@ class chunking_plugin: public libpressio_compressor_plugin {
       return 0; 
     }
     int minor_version() const override {
-      return 1;
+      return 2;
     }
     int patch_version() const override {
       return 0;
@@ -286,29 +533,290 @@ class chunking_plugin: public libpressio_compressor_plugin {
       return compat::make_unique<chunking_plugin>(*this);
     }
   private:
-    bool check_valid_dims(pressio_data const* input) const {
+    /**
+     * decompress only the chunks that intersect the requested region and copy their overlap into the output
+     *
+     * chunks are numbered with the first dimension of the chunk grid varying fastest
+     */
+    int decompress_region(chunk_header const& header, std::vector<size_t> const& effective_chunk_size, uint8_t const* inptr, pressio_data* output) {
+      if(!header.has_dims) {
+        return set_error(3, "region decompression requires a container that records its dimensions");
+      }
+      const std::vector<size_t> dims(header.dims.begin(), header.dims.end());
+      const size_t ndims = dims.size();
+      if(region_start.size() != ndims || region_size.size() != ndims) {
+        return set_error(3, "chunking:region_start and chunking:region_size must have one entry per dimension");
+      }
+      for (size_t d = 0; d < ndims; ++d) {
+        if(region_size[d] == 0 || region_start[d] > dims[d] || region_size[d] > dims[d] - region_start[d]) {
+          return set_error(3, "chunking region is out of bounds");
+        }
+      }
+      const std::vector<size_t> block = effective_chunk_size.empty() ? dims : effective_chunk_size;
+      if(block.size() != ndims) {
+        return set_error(3, "chunking:size does not match the dimensions of the container");
+      }
+
+      //find the chunks that intersect the region
+      std::vector<size_t> grid(ndims), first(ndims), last(ndims);
+      for (size_t d = 0; d < ndims; ++d) {
+        grid[d] = (dims[d] + block[d] - 1) / block[d];
+        first[d] = region_start[d] / block[d];
+        last[d] = (region_start[d] + region_size[d] - 1) / block[d];
+      }
+      std::vector<size_t> grid_strides(ndims);
+      compat::exclusive_scan(grid.begin(), grid.end(), grid_strides.begin(), size_t{1}, compat::multiplies<>{});
+      std::vector<size_t> selected;
+      std::vector<std::vector<size_t>> origins;
+      std::vector<size_t> coord(first);
+      while(true) {
+        size_t id = 0;
+        std::vector<size_t> origin(ndims);
+        for (size_t d = 0; d < ndims; ++d) {
+          id += coord[d] * grid_strides[d];
+          origin[d] = coord[d] * block[d];
+        }
+        selected.push_back(id);
+        origins.emplace_back(std::move(origin));
+        size_t d = 0;
+        for (; d < ndims; ++d) {
+          if(++coord[d] <= last[d]) break;
+          coord[d] = first[d];
+        }
+        if(d >= ndims) break;
+      }
+      if(selected.back() >= header.sizes.size()) {
+        return set_error(3, "chunking:size does not match the number of chunks in the container");
+      }
+
+      const chunk_layout layout(dims, block, container_edge_mode(header));
+      std::vector<pressio_data> inputs, outputs;
+      std::vector<pressio_data const*> inputs_ptr;
+      std::vector<pressio_data*> outputs_ptr;
+      inputs.reserve(selected.size());
+      outputs.reserve(selected.size());
+      for (size_t id : selected) {
+        inputs.emplace_back(pressio_data::nonowning(pressio_byte_dtype, const_cast<uint8_t*>(inptr)+header.offsets[id], {header.sizes[id]}));
+        outputs.emplace_back(pressio_data::owning(output->dtype(), layout.chunk_dims(id)));
+        inputs_ptr.emplace_back(&inputs.back());
+        outputs_ptr.emplace_back(&outputs.back());
+      }
+      int rc = compressor->decompress_many(
+          inputs_ptr.data(),
+          inputs_ptr.size(),
+          outputs_ptr.data(),
+          outputs_ptr.size()
+          );
+      if(rc) {
+        set_error(rc, compressor->error_msg());
+        if(rc > 0) return rc;
+      }
+
+      auto dechunk_begin = std::chrono::steady_clock::now();
+      if(output->dimensions() != region_size || !output->has_data()) {
+        *output = pressio_data::owning(output->dtype(), region_size);
+      }
+      pressio_task_runtime::instance().parallel_for(selected.size(), static_cast<uint32_t>(nthreads), [&](size_t i, uint32_t) {
+        copy_chunk_to_region(outputs[i], origins[i], region_start, *output);
+      });
+      auto dechunk_end = std::chrono::steady_clock::now();
+      dechunk_time = std::chrono::duration_cast<std::chrono::milliseconds>(dechunk_end-dechunk_begin).count();
+      return rc;
+    }
+
+    /**
+     * compress each chunk on the task runtime and copy it into the output as soon as it completes
+     *
+     * The output is allocated up front with room for chunks that grow slightly; each finished chunk reserves
+     * the next free region with an atomic add and is copied there.  Reservations only increase, so once a
+     * chunk does not fit every later one does not either; those chunks are appended after the parallel loop.
+     * The header lists the dimensions, and then the size and offset of each chunk in chunk order.  When the
+     * result uses less than half of the allocation it is copied into a buffer of the exact size.
+     */
+    int compress_streaming(std::vector<pressio_data const*> const& inputs, std::vector<size_t> const& inputs_dims, pressio_data* output) {
+      const size_t n = inputs.size();
+      chunk_header header;
+      header.dims.assign(inputs_dims.begin(), inputs_dims.end());
+      header.chunk_size.assign(chunk_size.begin(), chunk_size.end());
+      header.edges = get_edge_mode();
+      const size_t header_size = header.size_in_bytes(n, true);
+      const size_t input_bytes = std::accumulate(inputs.begin(), inputs.end(), size_t{0},
+          [](size_t acc, pressio_data const* data) { return acc + data->size_in_bytes(); });
+      const size_t capacity = header_size + input_bytes + input_bytes/8 + 64*n;
+      pressio_data container = pressio_data::owning(pressio_byte_dtype, {capacity});
+      uint8_t* base = static_cast<uint8_t*>(container.data());
+
+      std::vector<uint64_t> sizes(n), offsets(n);
+      std::vector<pressio_data> overflow(n);
+      std::vector<char> overflowed(n, 0);
+      std::atomic<size_t> reserved{header_size};
+      std::atomic<bool> failed{false};
+      std::mutex error_lock;
+      int status = 0;
+
+      pool.reserve(nthreads, 1);
+      pressio_task_runtime::instance().parallel_for(n, static_cast<uint32_t>(nthreads), [&](size_t i, uint32_t slot) {
+        if(failed) return;
+        pressio_compressor& local = pool.get(slot, 0, compressor);
+        pressio_data compressed = pressio_data::empty(pressio_byte_dtype, {});
+        int rc = local->compress(inputs[i], &compressed);
+        if(rc) {
+          std::lock_guard<std::mutex> guard(error_lock);
+          set_error(local->error_code(), local->error_msg());
+          if(rc > 0) {
+            failed = true;
+            status = rc;
+            return;
+          } else if(status == 0) {
+            status = rc;
+          }
+        }
+        const size_t size = compressed.size_in_bytes();
+        const size_t offset = reserved.fetch_add(size);
+        sizes[i] = size;
+        if(offset + size <= capacity) {
+          memcpy(base + offset, compressed.data(), size);
+          offsets[i] = offset;
+        } else {
+          overflow[i] = std::move(compressed);
+          overflowed[i] = 1;
+        }
+      });
+
+      stream_metrics_results.clear();
+      pool.for_each([this](pressio_compressor& clone) {
+        stream_metrics_results.copy_from(clone->get_metrics_results(), /*ignore_empty*/true);
+      });
+      if(failed) return status;
+
+      auto write_chunk_begin = std::chrono::steady_clock::now();
+      size_t used = header_size;
+      for (size_t i = 0; i < n; ++i) {
+        if(!overflowed[i]) used += sizes[i];
+      }
+      size_t total = used;
+      for (size_t i = 0; i < n; ++i) {
+        if(overflowed[i]) total += sizes[i];
+      }
+      if(total <= capacity / 2) {
+        //set_dimensions never shrinks the allocation, so move well compressed results into an exact size buffer
+        pressio_data exact = pressio_data::owning(pressio_byte_dtype, {total});
+        memcpy(exact.data(), base, used);
+        container = std::move(exact);
+      } else {
+        container.set_dimensions({total});
+      }
+      base = static_cast<uint8_t*>(container.data());
+      for (size_t i = 0; i < n; ++i) {
+        if(overflowed[i]) {
+          memcpy(base + used, overflow[i].data(), sizes[i]);
+          offsets[i] = used;
+          used += sizes[i];
+        }
+      }
+
+      header.sizes = std::move(sizes);
+      header.offsets = std::move(offsets);
+      header.write(base, true);
+      *output = std::move(container);
+      auto write_chunk_end = std::chrono::steady_clock::now();
+      write_chunk_time = std::chrono::duration_cast<std::chrono::milliseconds>(write_chunk_end-write_chunk_begin).count();
+      return status;
+    }
+
+    /**
+     * set chunk_size from the cache or by benchmarking candidate chunk shapes on a sample of the input
+     *
+     * each candidate is compressed by a copy of this plugin so the measurement includes chunking, the child
+     * compressor, and the parallelism used for the real input
+     */
+    int tune_chunk_size(pressio_data const& input) {
+      auto tune_begin = std::chrono::steady_clock::now();
+      std::ostringstream key;
+      key << compressor_id << '\n' << compressor->get_options() << input.dtype();
+      for (auto dim : input.dimensions()) key << ' ' << dim;
+      key << '\n' << nthreads << ' ' << stream << ' ' << edge_mode_str << ' ' << tune_throughput_weight << ' ' << tune_sample_bytes;
+
+      tune_result best;
+      tune_cache_hit = !retune && tune_cache::instance().find(key.str(), best);
+      if(!*tune_cache_hit) {
+        const size_t elem_size = pressio_dtype_size(input.dtype());
+        const std::vector<size_t> dims = input.dimensions();
+        const std::vector<size_t> sample_size = sample_dims(dims, elem_size, tune_sample_bytes);
+        pressio_data sample = pressio_data::owning(input.dtype(), sample_size);
+        std::vector<size_t> sample_start(dims.size());
+        for (size_t d = 0; d < dims.size(); ++d) {
+          sample_start[d] = (dims[d] - sample_size[d]) / 2;
+        }
+        copy_chunk_to_region(input, std::vector<size_t>(dims.size(), 0), sample_start, sample);
+
+        double best_score = -std::numeric_limits<double>::infinity();
+        for (auto const& candidate : tune_candidates(sample_size, elem_size)) {
+          chunking_plugin trial(*this);
+          trial.tune = false;
+          trial.retune = false;
+          trial.chunk_size = candidate;
+          pressio_data compressed = pressio_data::empty(pressio_byte_dtype, {});
+          auto begin = std::chrono::steady_clock::now();
+          if(trial.compress_impl(&sample, &compressed) > 0) continue;
+          auto end = std::chrono::steady_clock::now();
+          const double seconds = std::max(1e-9, std::chrono::duration<double>(end - begin).count());
+          const double throughput = sample.size_in_bytes() / seconds;
+          const double ratio = static_cast<double>(sample.size_in_bytes()) / std::max<size_t>(1, compressed.size_in_bytes());
+          const double score = tune_throughput_weight * std::log(throughput) + (1 - tune_throughput_weight) * std::log(ratio);
+          if(score > best_score) {
+            best_score = score;
+            best = tune_result{candidate, throughput, ratio};
+          }
+        }
+        if(best.chunk_size.empty()) {
+          return set_error(4, "chunking:tune found no chunk size the compressor accepts");
+        }
+        tune_cache::instance().insert(key.str(), best);
+        retune = false;
+      }
+      chunk_size = best.chunk_size;
+      tune_throughput = best.throughput;
+      tune_ratio = best.ratio;
+      auto tune_end = std::chrono::steady_clock::now();
+      tune_time = std::chrono::duration_cast<std::chrono::milliseconds>(tune_end-tune_begin).count();
+      return 0;
+    }
+
+    libpressio::chunking::edge_mode get_edge_mode() const {
+      return (edge_mode_str == "exact") ? libpressio::chunking::edge_mode::exact : libpressio::chunking::edge_mode::pad;
+    }
+
+    /**
+     * \returns the edge mode recorded in the container, or chunking:edge_mode for containers that do not record it
+     */
+    libpressio::chunking::edge_mode container_edge_mode(chunk_header const& header) const {
+      return header.chunk_size.empty() ? get_edge_mode() : header.edges;
+    }
+
+    static bool check_valid_dims(pressio_data const* input, std::vector<size_t> const& block) {
       auto const& dims = input->dimensions();
-      if(dims.size() != chunk_size.size()) return false;
+      if(dims.size() != block.size()) return false;
       //only support chunks without padding for now.
       return compat::transform_reduce(
           dims.begin(),
           dims.end(),
-          chunk_size.begin(),
+          block.begin(),
           true,
           [](bool current, bool next){ return current && next; },
           [](size_t dim, size_t chunk){ return dim % chunk == 0; }
           );
     }
-    bool check_contigous(pressio_data const* input) const {
+    static bool check_contigous(pressio_data const* input, std::vector<size_t> const& block) {
       auto const& dims = input->dimensions();
       bool mismatch = false;
-      for (size_t i = 0; i < std::min(dims.size(), chunk_size.size()); ++i) {
+      for (size_t i = 0; i < std::min(dims.size(), block.size()); ++i) {
         if(mismatch) {
-          if (chunk_size[i] != 1) {
+          if (block[i] != 1) {
             return false;
           } 
         } else {
-          mismatch = (dims[i] != chunk_size[i]);
+          mismatch = (dims[i] != block[i]);
         }
       }
       return true;
@@ -340,7 +848,22 @@ class chunking_plugin: public libpressio_compressor_plugin {
     compat::optional<uint64_t> read_dechunk_time;
     compat::optional<uint64_t> dechunk_time;
     compat::optional<uint64_t> write_chunk_time;
+    compat::optional<uint64_t> tune_time;
+    compat::optional<double> tune_throughput;
+    compat::optional<double> tune_ratio;
+    compat::optional<bool> tune_cache_hit;
     uint64_t nthreads = 1;
+    bool stream = false;
+    std::string edge_mode_str = "pad";
+    std::vector<size_t> region_start;
+    std::vector<size_t> region_size;
+    bool streamed = false;
+    bool tune = false;
+    bool retune = false;
+    double tune_throughput_weight = 0.5;
+    uint64_t tune_sample_bytes = uint64_t{16} << 20;
+    compressor_pool pool;
+    pressio_options stream_metrics_results;
 };
 
 static pressio_register compressor_chunking_plugin(compressor_plugins(), "chunking", [](){return compat::make_unique<chunking_plugin>(); });
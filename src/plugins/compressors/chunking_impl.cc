@@ -1,5 +1,9 @@
 #include "chunking_impl.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <limits>
+#include <string>
 #include <vector>
 #include <cstddef>
 #include <numeric>
@@ -8,6 +12,7 @@
 #include <std_compat/iterator.h>
 #include "libpressio_ext/cpp/data.h"
 #include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/task_runtime.h"
 
 namespace libpressio {
 namespace chunking {
@@ -69,10 +74,7 @@ struct dispatch_1d {
     }
     std::vector<size_t> block_stide(block.size());
     compat::exclusive_scan(compat::cbegin(max_idx), compat::cend(max_idx), std::begin(block_stide), size_t{1}, compat::multiplies<>{});
-#ifdef  _OPENMP
-#pragma omp parallel for num_threads(nthreads)
-#endif
-    for (size_t block_i = 0; block_i < max_idx[0]; block_i++) {
+    pressio_task_runtime::instance().parallel_for(max_idx[0], static_cast<uint32_t>(nthreads), [&](size_t block_i, uint32_t) {
       size_t base_offset = block_i * block[0] * strides[0];
       size_t output_idx = block_i * block_stide[0];
       T* elements = static_cast<T*>(memory.data()) + (output_idx * elements_in_block );
@@ -97,7 +99,7 @@ struct dispatch_1d {
           ++elements;
         }
       }
-    }
+    });
 
     return 0;
   }
@@ -126,10 +128,7 @@ struct dispatch_2d {
   std::vector<size_t> block_stide(block.size());
   compat::exclusive_scan(compat::cbegin(max_idx), compat::cend(max_idx), std::begin(block_stide), size_t{1}, compat::multiplies<>{});
   
-#ifdef  _OPENMP
-#pragma omp parallel for num_threads(nthreads)
-#endif
-  for (size_t block_j = 0; block_j < max_idx[1]; block_j++) {
+  pressio_task_runtime::instance().parallel_for(max_idx[1], static_cast<uint32_t>(nthreads), [&](size_t block_j, uint32_t) {
   for (size_t block_i = 0; block_i < max_idx[0]; block_i++) {
     size_t base_offset = block_i * block[0] * strides[0] + block_j * block[1] * strides[1];
     size_t output_idx = block_i * block_stide[0] + block_j * block_stide[1];
@@ -161,7 +160,7 @@ struct dispatch_2d {
         ++elements;
       }
     }}
-  }}
+  }});
 
     return 0;
   }
@@ -191,10 +190,7 @@ struct dispatch_3d {
     std::vector<size_t> block_stide(block.size());
     compat::exclusive_scan(compat::cbegin(max_idx), compat::cend(max_idx), std::begin(block_stide), size_t{1}, compat::multiplies<>{});
     
-#ifdef _OPENMP
-#pragma omp parallel for num_threads(nthreads)
-#endif
-    for (size_t block_k = 0; block_k < max_idx[2]; block_k++) {
+    pressio_task_runtime::instance().parallel_for(max_idx[2], static_cast<uint32_t>(nthreads), [&](size_t block_k, uint32_t) {
     for (size_t block_j = 0; block_j < max_idx[1]; block_j++) {
     for (size_t block_i = 0; block_i < max_idx[0]; block_i++) {
       size_t base_offset = block_i * block[0] * strides[0] + block_j * strides[1] * block[1] + block_k * strides[2] * block[2];
@@ -230,7 +226,7 @@ struct dispatch_3d {
         ++elements;
         }}}
       }
-    }}}
+    }}});
 
     return 0;
   }
@@ -240,203 +236,119 @@ struct dispatch_3d {
   PressioData& memory;
 };
 
-template <class CopyPolicy, class PressioData>
-struct dispatch_generic {
-  template <template <typename...> class vector_type, class IndexStride>
-  static IndexStride incr_counter(vector_type<IndexStride>& counter, vector_type<IndexStride> const& max) noexcept {
-
-    IndexStride i = 0;
-    while(i < counter.size() && counter[i] == (max[i] - 1)) {
-      counter[i] = 0;
-      ++i;
+/**
+ * copies between the data and the chunked memory for any number of dimensions
+ *
+ * chunks are processed in parallel and each chunk is copied as contiguous runs along the first dimension;
+ * since every chunk is a small tile of the data, this also keeps the accesses to the data cache friendly
+ */
+struct copy_blocks_nd {
+  void operator()(size_t id, uint32_t) const {
+    const size_t ndims = dims.size();
+    std::vector<size_t> origin(ndims), extent(ndims), chunk(ndims);
+    size_t rest = id;
+    bool partial = false;
+    for (size_t d = 0; d < ndims; ++d) {
+      origin[d] = (rest % layout.grid[d]) * block[d];
+      rest /= layout.grid[d];
+      extent[d] = std::min(block[d], dims[d] - origin[d]);
+      chunk[d] = (layout.mode == edge_mode::exact) ? extent[d] : block[d];
+      partial |= extent[d] != block[d];
     }
-    if (i < counter.size()) {
-      counter[i] += 1;
-    }
-    return i+1;
-  }
+    std::vector<size_t> chunk_strides(ndims);
+    compat::exclusive_scan(compat::cbegin(chunk), compat::cend(chunk), std::begin(chunk_strides), size_t{1}, compat::multiplies<>{});
 
-
-  template <template <class...> class vector_type, class IndexStride, class IndexBlock, class IndexDims>
-  static bool in_bounds(
-      vector_type<IndexStride> const& start,
-      vector_type<IndexBlock>  const& block_idx,
-      vector_type<IndexDims>  const& dims
-      ) noexcept {
-    for (IndexStride i = 0; i < start.size(); ++i) {
-      if (start[i] + block_idx[i] >= dims[i]){
-        return false;
-      }
+    uint8_t* chunk_begin = memory + layout.offsets[id] * elem_size;
+    if(to_blocks && partial && layout.mode == edge_mode::pad) {
+      memset(chunk_begin, 0, layout.chunk_elements(id) * elem_size);
     }
 
-    return true;
-  }
-
-
-  template <class RandomIt, template <typename...> class vector_type, class elements_storage, class IndexStride, class IndexDims, class IndexBlock>
-  static void
-  prepare_block(RandomIt begin_it, vector_type<IndexDims> const& start,  vector_type<IndexDims> const& dims, vector_type<IndexBlock> const& block, vector_type<IndexStride> const& strides, vector_type<IndexBlock>& block_idx, 
-      elements_storage elements
-      ) noexcept {
-    std::fill(begin(block_idx), end(block_idx), 0);
-
-    bool done = false;
-    while(not done) {
-      if(in_bounds(start, block_idx, dims)) {
-        IndexStride offset = 0;
-        for (IndexStride i = 0; i < start.size(); ++i) {
-           offset += (block_idx[i] + start[i]) * strides[i];
-        }
-        RandomIt it = std::next(begin_it, offset);
-        CopyPolicy::in_bounds(*elements, *it);
+    const size_t run_bytes = extent[0] * elem_size;
+    std::vector<size_t> idx(ndims, 0);
+    while(true) {
+      size_t data_offset = 0, chunk_offset = 0;
+      for (size_t d = 0; d < ndims; ++d) {
+        data_offset += (origin[d] + idx[d]) * strides[d];
+        chunk_offset += idx[d] * chunk_strides[d];
+      }
+      if(to_blocks) {
+        memcpy(chunk_begin + chunk_offset * elem_size, data + data_offset * elem_size, run_bytes);
       } else {
-        CopyPolicy::out_of_bounds(*elements);
+        memcpy(data + data_offset * elem_size, chunk_begin + chunk_offset * elem_size, run_bytes);
       }
-      elements++;
-      IndexStride modified = incr_counter(block_idx, block);
-      if (modified == start.size() + 1) {
-        done = true;
-      } 
-    }
-  }
-
-  template <class RandomIt, template <typename...> class vector_type, class elements_storage, class IndexStride, class IndexDims, class IndexBlock>
-  static void
-  prepare_block_in_bounds(RandomIt begin_it, vector_type<IndexDims> const& start,  vector_type<IndexDims> const& /*dims*/ , vector_type<IndexBlock> const& block, vector_type<IndexStride> const& strides, vector_type<IndexBlock>& block_idx, 
-      elements_storage elements
-      ) noexcept {
-    std::fill(begin(block_idx), end(block_idx), 0);
-
-    bool done = false;
-    while(not done) {
-      IndexStride offset = 0;
-      for (IndexStride i = 0; i < start.size(); ++i) {
-         offset += (block_idx[i] + start[i]) * strides[i];
+      size_t d = 1;
+      for (; d < ndims; ++d) {
+        if(++idx[d] < extent[d]) break;
+        idx[d] = 0;
       }
-      RandomIt it = std::next(begin_it, offset);
-      CopyPolicy::in_bounds(*elements, *it);
-      ++elements;
-      IndexStride modified = incr_counter(block_idx, block);
-      if (modified == start.size() + 1) {
-        done = true;
-      } 
+      if(d >= ndims) break;
     }
   }
 
-  template <class T, class IndexStride, class IndexDims, class IndexBlock>
-  int work(T* data_begin, std::vector<IndexStride> const& stride, std::vector<IndexDims> const& dims, std::vector<IndexBlock> const& block) {
-    std::vector<IndexDims> block_idx(dims.size());
-    std::vector<IndexDims> max_idx(dims.size());
-    std::vector<IndexDims> start(dims.size());
-    std::vector<IndexBlock> inner_block_idx(start.size());
-    size_t items_in_block = 1;
-    for (IndexStride i = 0; i < max_idx.size(); ++i) {
-      if(dims[i] % block[i] == 0) {
-        max_idx[i] = (dims[i]/block[i]);
-      } else {
-        max_idx[i] = (dims[i]/block[i]) + 1;
-      }
-      items_in_block *= block[i];
-    }
-    bool done = false;
-
-    T* elements = static_cast<T*>(memory.data());
-    while(not done) {
-      for (IndexStride i = 0; i < start.size(); ++i) {
-        start[i] = block[i]*block_idx[i];
-      }
+  chunk_layout const& layout;
+  std::vector<size_t> const& dims;
+  std::vector<size_t> const& block;
+  std::vector<size_t> const& strides;
+  uint8_t* data;
+  uint8_t* memory;
+  size_t elem_size;
+  bool to_blocks;
+};
 
+void copy_blocks(chunk_layout const& layout, uint8_t* data, uint8_t* memory, size_t elem_size, uint64_t nthreads, bool to_blocks) {
+  std::vector<size_t> strides(layout.dims.size());
+  compat::exclusive_scan(compat::cbegin(layout.dims), compat::cend(layout.dims), std::begin(strides), size_t{1}, compat::multiplies<>{});
+  pressio_task_runtime::instance().parallel_for(layout.num_chunks(), static_cast<uint32_t>(nthreads),
+      copy_blocks_nd{layout, layout.dims, layout.block, strides, data, memory, elem_size, to_blocks});
+}
 
-      for (IndexStride i = 0; i < inner_block_idx.size(); ++i) {
-        inner_block_idx[i] = block[i]-1;
-      }
-      if(in_bounds(start, inner_block_idx, dims)) {
-        prepare_block_in_bounds(data_begin, start, dims, block, stride, inner_block_idx, elements);
-      } else {
-        prepare_block(data_begin, start, dims, block, stride, inner_block_idx, elements);
-      }
+edge_mode get_edge_mode(pressio_options const& options) {
+  std::string mode = "pad";
+  options.get("edge_mode", &mode);
+  return (mode == "exact") ? edge_mode::exact : edge_mode::pad;
+}
 
-      IndexStride modified = incr_counter(block_idx, max_idx);
-      if(modified == start.size() + 1) {
-        done = true;
-      }
-      elements += items_in_block;
-    }
+}
 
-    return 0;
+chunk_layout::chunk_layout(std::vector<size_t> const& dims, std::vector<size_t> const& block, edge_mode mode):
+  dims(dims), block(block), grid(dims.size()), mode(mode)
+{
+  for (size_t d = 0; d < dims.size(); ++d) {
+    grid[d] = (dims[d] + block[d] - 1) / block[d];
   }
-
-  template <class T, class IndexStride, class IndexDims>
-  int dispatch_block(T* data_begin, std::vector<IndexStride> const& stride, std::vector<IndexDims> const& dim, size_t max_block) {
-    if(max_block <= std::numeric_limits<uint8_t>::max()) {
-      std::vector<uint8_t> block(block_size_t.begin(), block_size_t.end());
-      return work(data_begin, stride, dim, block);
-    } else if(max_block <= std::numeric_limits<uint16_t>::max()) {
-      std::vector<uint16_t> block(block_size_t.begin(), block_size_t.end());
-      return work(data_begin, stride, dim, block);
-    } else if(max_block <= std::numeric_limits<uint32_t>::max()) {
-      std::vector<uint32_t> block(block_size_t.begin(), block_size_t.end());
-      return work(data_begin, stride, dim, block);
-    } else {
-      std::vector<uint64_t> block(block_size_t.begin(), block_size_t.end());
-      return work(data_begin, stride, dim, block);
-    }
-  }
-
-  template <class T, class IndexStride>
-  int dispatch_dims(T* data_begin, std::vector<IndexStride> const& stride, size_t max_dim, size_t max_block) {
-    if(max_dim <= std::numeric_limits<uint8_t>::max()) {
-      std::vector<uint8_t> dims(dims_size_t.begin(), dims_size_t.end());
-      return dispatch_block(data_begin, stride, dims, max_block);
-    } else if(max_dim <= std::numeric_limits<uint16_t>::max()) {
-      std::vector<uint16_t> dims(dims_size_t.begin(), dims_size_t.end());
-      return dispatch_block(data_begin, stride, dims, max_block);
-    } else if(max_dim <= std::numeric_limits<uint32_t>::max()) {
-      std::vector<uint32_t> dims(dims_size_t.begin(), dims_size_t.end());
-      return dispatch_block(data_begin, stride, dims, max_block);
-    } else {
-      std::vector<uint64_t> dims(dims_size_t.begin(), dims_size_t.end());
-      return dispatch_block(data_begin, stride, dims, max_block);
-    }
+  const size_t n = std::accumulate(std::begin(grid), std::end(grid), size_t{1}, compat::multiplies<>{});
+  offsets.resize(n + 1);
+  offsets[0] = 0;
+  for (size_t id = 0; id < n; ++id) {
+    auto chunk = chunk_dims(id);
+    offsets[id+1] = offsets[id] + std::accumulate(std::begin(chunk), std::end(chunk), size_t{1}, compat::multiplies<>{});
   }
+}
 
-  template <class T>
-  int operator()(T * data_begin, T * ) {
-    size_t max_block_size = *std::max_element(std::begin(block_size_t), std::end(block_size_t));
-    size_t max_dim_size = *std::max_element(std::begin(dims_size_t), std::end(dims_size_t));
-    std::vector<size_t> strides(dims_size_t.size());
-    compat::exclusive_scan(std::begin(dims_size_t), std::end(dims_size_t), std::begin(strides), size_t{1}, compat::multiplies<>{});
-    if(std::is_sorted(std::begin(strides), std::end(strides))) {
-      throw std::runtime_error("strides are too large");
-    }
-    size_t max_stride_size = *std::max_element(std::begin(strides), std::end(strides));
-
-    if(max_stride_size <= std::numeric_limits<uint8_t>::max()) {
-      std::vector<uint8_t> stride(strides.begin(), strides.end());
-      return dispatch_dims(data_begin, stride, max_dim_size, max_block_size);
-    } else if(max_stride_size <= std::numeric_limits<uint16_t>::max()) {
-      std::vector<uint16_t> stride(strides.begin(), strides.end());
-      return dispatch_dims(data_begin, stride, max_dim_size, max_block_size);
-    } else if(max_stride_size <= std::numeric_limits<uint32_t>::max()) {
-      std::vector<uint32_t> stride(strides.begin(), strides.end());
-      return dispatch_dims(data_begin, stride, max_dim_size, max_block_size);
-    } else {
-      std::vector<uint64_t> stride(strides.begin(), strides.end());
-      return dispatch_dims(data_begin, stride, max_dim_size, max_block_size);
+std::vector<size_t> chunk_layout::chunk_dims(size_t id) const {
+  std::vector<size_t> chunk(block);
+  if(mode == edge_mode::exact) {
+    for (size_t d = 0; d < dims.size(); ++d) {
+      const size_t origin = (id % grid[d]) * block[d];
+      id /= grid[d];
+      chunk[d] = std::min(block[d], dims[d] - origin);
     }
-  
-    return 0;
   }
-  std::vector<size_t> const& dims_size_t;
-  std::vector<size_t> const& block_size_t;
-  PressioData& memory;
-};
-
+  return chunk;
 }
 
 pressio_data chunk_data(pressio_data const& data, std::vector<size_t> const& block, pressio_options const& options) {
   uint64_t nthreads = 1;
   options.get("nthreads", &nthreads);
+  const edge_mode mode = detail::get_edge_mode(options);
+
+  if(mode == edge_mode::exact || data.num_dimensions() > 3) {
+    chunk_layout layout(data.dimensions(), block, mode);
+    const size_t elem_size = pressio_dtype_size(data.dtype());
+    pressio_data memory(pressio_data::owning(pressio_byte_dtype, {layout.offsets.back() * elem_size}));
+    detail::copy_blocks(layout, static_cast<uint8_t*>(data.data()), static_cast<uint8_t*>(memory.data()), elem_size, nthreads, true);
+    return memory;
+  }
 
   pressio_data memory(pressio_data::owning(pressio_byte_dtype, {detail::working_memory_size(data, block)}));
 
@@ -447,11 +359,8 @@ pressio_data chunk_data(pressio_data const& data, std::vector<size_t> const& blo
     case 2:
       pressio_data_for_each<int>(data, detail::dispatch_2d<detail::copy_to_blocks, pressio_data>{nthreads, data.dimensions(), block, memory});
       break;
-    case 3:
-      pressio_data_for_each<int>(data, detail::dispatch_3d<detail::copy_to_blocks, pressio_data>{nthreads, data.dimensions(), block, memory});
-      break;
     default:
-      pressio_data_for_each<int>(data, detail::dispatch_generic<detail::copy_to_blocks, pressio_data>{data.dimensions(), block, memory});
+      pressio_data_for_each<int>(data, detail::dispatch_3d<detail::copy_to_blocks, pressio_data>{nthreads, data.dimensions(), block, memory});
       break;
   }
 
@@ -466,7 +375,13 @@ void restore_data(
     ) {
   uint64_t nthreads = 1;
   options.get("nthreads", &nthreads);
+  const edge_mode mode = detail::get_edge_mode(options);
 
+  if(mode == edge_mode::exact || data.num_dimensions() > 3) {
+    chunk_layout layout(data.dimensions(), block, mode);
+    detail::copy_blocks(layout, static_cast<uint8_t*>(data.data()), static_cast<uint8_t*>(memory.data()), pressio_dtype_size(data.dtype()), nthreads, false);
+    return;
+  }
 
   switch (data.num_dimensions()) {
     case 1:
@@ -475,16 +390,95 @@ void restore_data(
     case 2:
       pressio_data_for_each<int>(data, detail::dispatch_2d<detail::copy_from_blocks, const pressio_data>{nthreads, data.dimensions(), block, memory});
       break;
-    case 3:
-      pressio_data_for_each<int>(data, detail::dispatch_3d<detail::copy_from_blocks, const pressio_data>{nthreads, data.dimensions(), block, memory});
-      break;
     default:
-      pressio_data_for_each<int>(data, detail::dispatch_generic<detail::copy_from_blocks, const pressio_data>{data.dimensions(), block, memory});
+      pressio_data_for_each<int>(data, detail::dispatch_3d<detail::copy_from_blocks, const pressio_data>{nthreads, data.dimensions(), block, memory});
       break;
   }
 
 }
 
+void copy_chunk_to_region(pressio_data const& chunk, std::vector<size_t> const& chunk_origin, std::vector<size_t> const& region_start, pressio_data& region) {
+  auto const& block = chunk.dimensions();
+  auto const& region_dims = region.dimensions();
+  const size_t ndims = block.size();
+  const size_t elem_size = pressio_dtype_size(chunk.dtype());
+
+  //the intersection of the chunk and the region in global coordinates
+  std::vector<size_t> lo(ndims), hi(ndims);
+  for (size_t d = 0; d < ndims; ++d) {
+    lo[d] = std::max(chunk_origin[d], region_start[d]);
+    hi[d] = std::min(chunk_origin[d] + block[d], region_start[d] + region_dims[d]);
+    if(lo[d] >= hi[d]) return;
+  }
+  std::vector<size_t> chunk_strides(ndims), region_strides(ndims);
+  compat::exclusive_scan(compat::cbegin(block), compat::cend(block), std::begin(chunk_strides), size_t{1}, compat::multiplies<>{});
+  compat::exclusive_scan(compat::cbegin(region_dims), compat::cend(region_dims), std::begin(region_strides), size_t{1}, compat::multiplies<>{});
+
+  //copy one contiguous run along the first dimension at a time
+  const size_t run_bytes = (hi[0] - lo[0]) * elem_size;
+  auto const* src = static_cast<uint8_t const*>(chunk.data());
+  auto* dst = static_cast<uint8_t*>(region.data());
+  std::vector<size_t> idx(lo);
+  while(true) {
+    size_t src_offset = 0, dst_offset = 0;
+    for (size_t d = 0; d < ndims; ++d) {
+      src_offset += (idx[d] - chunk_origin[d]) * chunk_strides[d];
+      dst_offset += (idx[d] - region_start[d]) * region_strides[d];
+    }
+    memcpy(dst + dst_offset * elem_size, src + src_offset * elem_size, run_bytes);
+
+    size_t d = 1;
+    for (; d < ndims; ++d) {
+      if(++idx[d] < hi[d]) break;
+      idx[d] = lo[d];
+    }
+    if(d >= ndims) break;
+  }
+}
+
+std::vector<size_t> sample_dims(std::vector<size_t> const& dims, size_t elem_size, size_t max_bytes) {
+  std::vector<size_t> sample(dims);
+  const size_t max_elements = std::max<size_t>(1, max_bytes / elem_size);
+  for (size_t d = sample.size(); d-- > 0;) {
+    const size_t elements = std::accumulate(sample.begin(), sample.end(), size_t{1}, compat::multiplies<>{});
+    if(elements <= max_elements) break;
+    const size_t others = elements / sample[d];
+    sample[d] = std::max<size_t>(1, max_elements / others);
+  }
+  return sample;
+}
+
+std::vector<std::vector<size_t>> tune_candidates(std::vector<size_t> const& dims, size_t elem_size) {
+  const size_t ndims = dims.size();
+  const size_t total = std::accumulate(dims.begin(), dims.end(), size_t{1}, compat::multiplies<>{});
+  std::vector<std::vector<size_t>> candidates;
+  for (size_t target_bytes = size_t{4} << 10; target_bytes <= size_t{16} << 20; target_bytes *= 4) {
+    const size_t target = std::max<size_t>(1, target_bytes / elem_size);
+    if(target * 4 > total) break;
+
+    std::vector<size_t> slab(ndims);
+    size_t remaining = target;
+    for (size_t d = 0; d < ndims; ++d) {
+      slab[d] = std::max<size_t>(1, std::min(dims[d], remaining));
+      remaining = std::max<size_t>(1, remaining / slab[d]);
+    }
+    candidates.emplace_back(std::move(slab));
+
+    const size_t edge = std::max<size_t>(1, static_cast<size_t>(std::pow(static_cast<double>(target), 1.0 / ndims)));
+    std::vector<size_t> cube(ndims);
+    for (size_t d = 0; d < ndims; ++d) {
+      cube[d] = std::min(dims[d], edge);
+    }
+    candidates.emplace_back(std::move(cube));
+  }
+  if(candidates.empty()) {
+    candidates.emplace_back(dims);
+  }
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+  return candidates;
+}
+
 } /* chunking */ 
 } /* pressio */ 
 
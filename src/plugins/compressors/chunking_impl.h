@@ -11,16 +11,58 @@ namespace libpressio {
 namespace chunking {
 
 /**
- * preform the chunking as optimal-ally we know how to
+ * how chunks that extend past the upper edge of the data are stored
+ */
+enum class edge_mode {
+  pad, /// edge chunks have the full chunk size and the extra elements are zero
+  exact, /// edge chunks are clipped to the data
+};
+
+/**
+ * the arrangement of chunks in chunked memory
  *
- * For 1d - 3d it dispatches to a handcoded loop; the handcoded loop can be
- * paralleled if OpenMP is availible
+ * chunks are numbered with the first dimension of the chunk grid varying fastest and are stored one
+ * after another in that order
+ */
+struct chunk_layout {
+  chunk_layout(std::vector<size_t> const& dims, std::vector<size_t> const& block, edge_mode mode);
+
+  /**
+   * \returns the number of chunks
+   */
+  size_t num_chunks() const {
+    return offsets.size() - 1;
+  }
+  /**
+   * \returns the dimensions of chunk id as stored
+   */
+  std::vector<size_t> chunk_dims(size_t id) const;
+  /**
+   * \returns the number of elements in chunk id as stored
+   */
+  size_t chunk_elements(size_t id) const {
+    return offsets[id+1] - offsets[id];
+  }
+
+  std::vector<size_t> dims;
+  std::vector<size_t> block;
+  /** the number of chunks in each dimension */
+  std::vector<size_t> grid;
+  /** the offset in elements of each chunk followed by the total number of elements */
+  std::vector<size_t> offsets;
+  edge_mode mode;
+};
+
+/**
+ * preform the chunking as optimal-ally we know how to
  *
- * support is availible For 4d+ it dispatches generic loop
+ * For 1d - 3d with padded edges it dispatches to a handcoded loop; otherwise
+ * it uses a generic loop which copies contiguous runs of each chunk.  Both are
+ * parallelized over blocks with the shared task runtime
  *
  * \param[in] data the dataset to preform chunking on
  * \param[in] block the dimensions to for the block size
- * \param[in] options options for how to chunk the data, mostly for performance
+ * \param[in] options options for how to chunk the data: "nthreads" and "edge_mode" ("pad" or "exact")
  * \returns the data in a single pressio_data buffer 
  */
 pressio_data chunk_data(pressio_data const &data, std::vector<size_t> const &block, pressio_options const&);
@@ -28,18 +70,53 @@ pressio_data chunk_data(pressio_data const &data, std::vector<size_t> const &blo
 /**
  * preform the chunking as optimal-ally we know how to
  *
- * For 1d - 3d it dispatches to a handcoded loop; the handcoded loop can be
- * paralleled if OpenMP is availible
- *
- * support is availible For 4d+ it dispatches generic loop
+ * For 1d - 3d with padded edges it dispatches to a handcoded loop; otherwise
+ * it uses a generic loop which copies contiguous runs of each chunk.  Both are
+ * parallelized over blocks with the shared task runtime
  *
  * \param[in] data the dataset to write the de-chunked memory into
  * \param[in] memory the dataset containing the chunked data
  * \param[in] block the dimensions to for the block size
- * \param[in] options options for how to chunk the data, mostly for performance
- * \returns the data in a single pressio_data buffer 
+ * \param[in] options options for how to chunk the data: "nthreads" and "edge_mode" ("pad" or "exact")
  */
 void restore_data(pressio_data &data, pressio_data const& memory, std::vector<size_t> const &block, pressio_options const&);
+
+/**
+ * copy the part of a decompressed chunk that falls inside a region into the region's buffer
+ *
+ * the chunk and the region use the same dtype and the first dimension is the fastest varying
+ *
+ * \param[in] chunk the decompressed chunk; its dimensions are the chunk size
+ * \param[in] chunk_origin the global coordinates of the first element of the chunk
+ * \param[in] region_start the global coordinates of the first element of the region
+ * \param[out] region the buffer for the region; its dimensions are the region size
+ */
+void copy_chunk_to_region(pressio_data const& chunk, std::vector<size_t> const& chunk_origin, std::vector<size_t> const& region_start, pressio_data& region);
+
+/**
+ * choose the dimensions of the sample used to tune the chunk size
+ *
+ * the slowest varying dimensions are reduced first so that the sample covers whole rows where possible
+ *
+ * \param[in] dims the dimensions of the dataset
+ * \param[in] elem_size the size of each element in bytes
+ * \param[in] max_bytes the maximum size of the sample in bytes
+ * \returns the dimensions of the sample; dims if the dataset is no larger than max_bytes
+ */
+std::vector<size_t> sample_dims(std::vector<size_t> const& dims, size_t elem_size, size_t max_bytes);
+
+/**
+ * propose chunk shapes to benchmark on a sample
+ *
+ * For each target size between a fraction of the L1 cache and a multiple of the L3 cache, proposes a slab which
+ * keeps the fastest dimensions whole and a chunk with roughly equal extents.  Only chunks that fit at least 4
+ * times in the sample are proposed; if none do, the sample dimensions are returned.
+ *
+ * \param[in] dims the dimensions of the sample
+ * \param[in] elem_size the size of each element in bytes
+ * \returns a list of distinct chunk shapes
+ */
+std::vector<std::vector<size_t>> tune_candidates(std::vector<size_t> const& dims, size_t elem_size);
   
 
 
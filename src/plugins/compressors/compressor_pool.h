@@ -0,0 +1,65 @@
+#ifndef LIBPRESSIO_COMPRESSOR_POOL_H
+#define LIBPRESSIO_COMPRESSOR_POOL_H
+#include <cstddef>
+#include <vector>
+#include "libpressio_ext/cpp/compressor.h"
+
+namespace libpressio {
+
+  /**
+   * clones of child compressors indexed by task runtime slot and then by child
+   *
+   * cloning and configuring a child can cost as much as compressing a small buffer, so clones are made
+   * once per slot and reused across calls until the plugin is reconfigured.  The clones are never
+   * shared between copies of the plugin, so copying produces an empty pool.
+   */
+  struct compressor_pool {
+    compressor_pool()=default;
+    compressor_pool(compressor_pool const&) {}
+    compressor_pool(compressor_pool &&)=default;
+    compressor_pool& operator=(compressor_pool const&) {
+      clear();
+      return *this;
+    }
+    compressor_pool& operator=(compressor_pool &&)=default;
+
+    void clear() {
+      clones.clear();
+    }
+    void reserve(size_t nslots, size_t nchildren) {
+      if(clones.size() != nslots || (!clones.empty() && clones.front().size() != nchildren)) {
+        //pressio_compressor's copy constructor clones, so build each row in place
+        clones.clear();
+        clones.resize(nslots);
+        for (auto& row : clones) {
+          row.resize(nchildren);
+        }
+      }
+    }
+    pressio_compressor& get(size_t slot, size_t child, pressio_compressor const& prototype) {
+      pressio_compressor& clone = clones[slot][child];
+      if(!clone) {
+        clone = prototype->clone();
+      }
+      return clone;
+    }
+
+    /**
+     * calls func on each clone that has been created
+     */
+    template <class Func>
+    void for_each(Func&& func) {
+      for (auto& row : clones) {
+        for (auto& clone : row) {
+          if(clone) func(clone);
+        }
+      }
+    }
+
+    private:
+    std::vector<std::vector<pressio_compressor>> clones;
+  };
+
+}
+
+#endif /* end of include guard: LIBPRESSIO_COMPRESSOR_POOL_H */
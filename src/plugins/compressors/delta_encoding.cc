@@ -1,7 +1,10 @@
 #include <libpressio_ext/cpp/compressor.h>
 #include <libpressio_ext/cpp/pressio.h>
 #include <std_compat/memory.h>
+#include <std_compat/functional.h>
+#include <numeric>
 #include <sstream>
+#include "elementwise_transform.h"
 
 namespace libpressio { namespace delta_encoder {
 
@@ -40,7 +43,50 @@ struct delta_decoder {
 
 
 
-class delta_encoding: public libpressio_compressor_plugin {
+template <class T>
+struct delta_encode_block: public elementwise::block_transform {
+  void apply(void const* in_ptr, void* out_ptr, size_t n) override {
+    T const* in = static_cast<T const*>(in_ptr);
+    T* out = static_cast<T*>(out_ptr);
+    size_t i = 0;
+    if(first && n > 0) {
+      out[0] = in[0];
+      prev = in[0];
+      first = false;
+      i = 1;
+    }
+    for (; i < n; ++i) {
+      out[i] = in[i] - prev;
+      prev = in[i];
+    }
+  }
+  T prev{};
+  bool first = true;
+};
+
+template <class T>
+struct delta_decode_block: public elementwise::block_transform {
+  void apply(void const* in_ptr, void* out_ptr, size_t n) override {
+    T const* in = static_cast<T const*>(in_ptr);
+    T* out = static_cast<T*>(out_ptr);
+    size_t i = 0;
+    if(first && n > 0) {
+      out[0] = in[0];
+      prev = out[0];
+      first = false;
+      i = 1;
+    }
+    for (; i < n; ++i) {
+      out[i] = in[i] + prev;
+      prev = out[i];
+    }
+  }
+  T prev{};
+  bool first = true;
+};
+
+
+class delta_encoding: public libpressio_compressor_plugin, public elementwise::fusible_transform {
   pressio_options get_options_impl() const override {
     pressio_options opts;
     set_meta(opts, "delta_encoding:compressor", meta_id, meta);
@@ -89,6 +135,20 @@ y[i] = x[i] - x[i-1];
     *output = pressio_data_for_each<pressio_data>(*output, delta_decoder{});
     return ret;
   }
+  std::unique_ptr<elementwise::block_transform> fused_encoder(pressio_dtype dtype, std::vector<size_t> const&) override {
+    if(meta_id != "noop") return nullptr;
+    return elementwise::make_block_transform<delta_encode_block>(dtype);
+  }
+  std::unique_ptr<elementwise::block_transform> fused_decoder(pressio_dtype dtype, std::vector<size_t> const&) override {
+    if(meta_id != "noop") return nullptr;
+    return elementwise::make_block_transform<delta_decode_block>(dtype);
+  }
+  pressio_dtype fused_output_dtype(pressio_dtype dtype) const override {
+    return dtype;
+  }
+  std::vector<size_t> fused_output_dims(std::vector<size_t> const& dims) const override {
+    return {std::accumulate(dims.begin(), dims.end(), size_t{1}, compat::multiplies<>{})};
+  }
   void set_name_impl(std::string const& new_name) override {
     if(new_name != "") {
     meta->set_name(new_name + "/" + meta->prefix());
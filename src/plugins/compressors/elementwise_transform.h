@@ -0,0 +1,82 @@
+#ifndef LIBPRESSIO_ELEMENTWISE_TRANSFORM_H
+#define LIBPRESSIO_ELEMENTWISE_TRANSFORM_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "pressio_dtype.h"
+#include "std_compat/memory.h"
+
+namespace libpressio { namespace elementwise {
+
+  /**
+   * a one-to-one transform of elements applied a block at a time
+   *
+   * blocks of a buffer are passed in order, so a transform may carry state such as the previous element
+   * from one block to the next
+   */
+  struct block_transform {
+    virtual ~block_transform()=default;
+    /**
+     * transform n elements from in into out
+     */
+    virtual void apply(void const* in, void* out, size_t n) = 0;
+  };
+
+  /**
+   * implemented by compressors whose compress is an element-wise transform followed by their child compressor
+   *
+   * when the child is noop, the compressed output is the transformed data, so a pipeline can run a sequence
+   * of these stages as one pass over the data through cache sized blocks instead of materializing each stage.
+   */
+  struct fusible_transform {
+    virtual ~fusible_transform()=default;
+    /**
+     * prepares to encode data without calling compress
+     *
+     * \param[in] dtype the type of the data to be encoded
+     * \param[in] dims the dimensions of the data to be encoded
+     * \returns the forward transform, or nullptr if this configuration cannot be fused
+     */
+    virtual std::unique_ptr<block_transform> fused_encoder(pressio_dtype dtype, std::vector<size_t> const& dims) = 0;
+    /**
+     * prepares to decode data without calling decompress
+     *
+     * \param[in] dtype the type of the data before it was encoded
+     * \param[in] dims the dimensions of the data before it was encoded
+     * \returns the inverse transform, or nullptr if this configuration cannot be fused
+     */
+    virtual std::unique_ptr<block_transform> fused_decoder(pressio_dtype dtype, std::vector<size_t> const& dims) = 0;
+    /**
+     * \returns the type of the encoded data that compress would produce
+     */
+    virtual pressio_dtype fused_output_dtype(pressio_dtype dtype) const = 0;
+    /**
+     * \returns the dimensions of the encoded data that compress would produce
+     */
+    virtual std::vector<size_t> fused_output_dims(std::vector<size_t> const& dims) const = 0;
+  };
+
+  /**
+   * constructs Kernel<T> for the C++ type T corresponding to dtype
+   */
+  template <template <class> class Kernel, class... Args>
+  std::unique_ptr<block_transform> make_block_transform(pressio_dtype dtype, Args&&... args) {
+    switch(dtype) {
+      case pressio_double_dtype: return compat::make_unique<Kernel<double>>(std::forward<Args>(args)...);
+      case pressio_float_dtype: return compat::make_unique<Kernel<float>>(std::forward<Args>(args)...);
+      case pressio_uint8_dtype: return compat::make_unique<Kernel<uint8_t>>(std::forward<Args>(args)...);
+      case pressio_uint16_dtype: return compat::make_unique<Kernel<uint16_t>>(std::forward<Args>(args)...);
+      case pressio_uint32_dtype: return compat::make_unique<Kernel<uint32_t>>(std::forward<Args>(args)...);
+      case pressio_uint64_dtype: return compat::make_unique<Kernel<uint64_t>>(std::forward<Args>(args)...);
+      case pressio_int8_dtype: return compat::make_unique<Kernel<int8_t>>(std::forward<Args>(args)...);
+      case pressio_int16_dtype: return compat::make_unique<Kernel<int16_t>>(std::forward<Args>(args)...);
+      case pressio_int32_dtype: return compat::make_unique<Kernel<int32_t>>(std::forward<Args>(args)...);
+      case pressio_int64_dtype: return compat::make_unique<Kernel<int64_t>>(std::forward<Args>(args)...);
+      default: return compat::make_unique<Kernel<char>>(std::forward<Args>(args)...);
+    }
+  }
+
+} }
+
+#endif /* end of include guard: LIBPRESSIO_ELEMENTWISE_TRANSFORM_H */
@@ -1,18 +1,109 @@
+#include "pressio_version.h"
+#if LIBPRESSIO_HAS_LUA
 #define SOL_ALL_SAFETIES_ON 1
 #define SOL_PRINT_ERRORS 1
+#include <sol/sol.hpp>
+#include <mutex>
+#include <unordered_map>
+#endif
 #include <chrono>
 #include <stdexcept>
-#include <sol/sol.hpp>
 #include "std_compat/memory.h"
 #include "libpressio_ext/cpp/libpressio.h"
+#include "libpressio_ext/cpp/lambda_fn.h"
 
 namespace libpressio { namespace lambda_fn_ns {
 
-enum class lambda_fn_event {
-  compress,
-  decompress,
-  set_options
+using lambda_fn::lambda_fn_event;
+using lambda_fn::lambda_fn_context;
+using lambda_fn::native_hook;
+
+#if LIBPRESSIO_HAS_LUA
+/**
+ * the bytecode of each script, shared by every lambda_fn in the process so that a script is only parsed once
+ */
+class bytecode_cache {
+  public:
+  static bytecode_cache& instance() {
+    static bytecode_cache cache;
+    return cache;
+  }
+
+  /**
+   * \returns the bytecode for script, compiling it if it has not been seen before
+   */
+  std::string compile(std::string const& script) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      auto it = entries.find(script);
+      if(it != entries.end()) return it->second;
+    }
+    sol::state lua;
+    sol::load_result chunk = lua.load(script, "lambda_fn:script");
+    if(!chunk.valid()) {
+      sol::error err = chunk;
+      throw std::runtime_error(err.what());
+    }
+    sol::protected_function fn = chunk.get<sol::protected_function>();
+    std::string bytecode(fn.dump().as_string_view());
+
+    std::lock_guard<std::mutex> guard(lock);
+    if(entries.size() >= max_entries) entries.clear();
+    entries.emplace(script, bytecode);
+    return bytecode;
+  }
+
+  private:
+  static constexpr size_t max_entries = 64;
+  std::mutex lock;
+  std::unordered_map<std::string, std::string> entries;
+};
+
+/**
+ * a lua state and the loaded script, built on first use; copies start without a state so each clone gets its own
+ */
+class lua_runtime {
+  public:
+  lua_runtime() = default;
+  lua_runtime(lua_runtime const&) {}
+  lua_runtime& operator=(lua_runtime const&) {
+    state.reset();
+    return *this;
+  }
+
+  struct state_t {
+    sol::state lua;
+    sol::protected_function chunk;
+    std::string script;
+  };
+
+  /**
+   * \returns the state with script loaded, reusing the loaded chunk if the script has not changed
+   */
+  template <class Bind>
+  state_t& get(std::string const& script, Bind&& bind) {
+    if(!state) {
+      state = compat::make_unique<state_t>();
+      state->lua.open_libraries(sol::lib::base, sol::lib::math);
+      bind(state->lua);
+    }
+    if(!state->chunk.valid() || state->script != script) {
+      const std::string bytecode = bytecode_cache::instance().compile(script);
+      sol::load_result chunk = state->lua.load(bytecode, "lambda_fn:script", sol::load_mode::binary);
+      if(!chunk.valid()) {
+        sol::error err = chunk;
+        throw std::runtime_error(err.what());
+      }
+      state->chunk = chunk.get<sol::protected_function>();
+      state->script = script;
+    }
+    return *state;
+  }
+
+  private:
+  std::unique_ptr<state_t> state;
 };
+#endif
 
 class lambda_fn_compressor_plugin : public libpressio_compressor_plugin {
 public:
@@ -23,6 +114,11 @@ public:
     set(options, "lambda_fn:script",  script);
     set(options, "lambda_fn:on_set_options",  on_set_options);
     set(options, "lambda_fn:on_compress",  on_compress);
+    if(native) {
+      set(options, "lambda_fn:native", lambda_fn::make_native_hook(native));
+    } else {
+      set_type(options, "lambda_fn:native", pressio_option_userptr_type);
+    }
     return options;
   }
 
@@ -33,7 +129,7 @@ public:
     set(options, "pressio:thread_safe", pressio_thread_safety_multiple);
     set(options, "pressio:stability", "experimental");
     
-        std::vector<std::string> invalidations {"lambda_fn:script", "lambda_fn:on_set_options", "lambda_fn:on_compress"}; 
+        std::vector<std::string> invalidations {"lambda_fn:script", "lambda_fn:on_set_options", "lambda_fn:on_compress", "lambda_fn:native"}; 
         std::vector<pressio_configurable const*> invalidation_children {&*compressor}; 
         
         set(options, "predictors:error_dependent", get_accumulate_configuration("predictors:error_dependent", invalidation_children, invalidations));
@@ -62,6 +158,10 @@ public:
     + is_decompress -- true if decompression is the next operation
     + is_set_options -- true if set_options is the next operation
 
+    The script is compiled to bytecode once per process and each lambda_fn keeps its own lua state, so
+    globals other than the ones above keep their values between calls; use persist for state that
+    should be copied with the compressor.
+
     The lua base and math libraries are exposed by default, this may change in the future to allow
     the user to specify which libraries are allowed
 
@@ -164,6 +264,12 @@ public:
     end
     ```
     )");
+    set(options, "lambda_fn:native", R"(a native hook used instead of lambda_fn:script, constructed with
+        libpressio::lambda_fn::make_native_hook from libpressio_ext/cpp/lambda_fn.h.  The hook receives the
+        same state as the script's globals and stores the options to apply to the child compressor in its
+        second argument.  It is available even when libpressio is built without lua)");
+    set(options, "lambda_fn:compress_script_time", R"(time in milliseconds to run the script or hook before compress)");
+    set(options, "lambda_fn:decompress_script_time", R"(time in milliseconds to run the script or hook before decompress)");
     set(options, "lambda_fn:on_set_options", R"(nonzero if the script should be called at the end of set_options,
         takes effect as soon as it is set)");
     set(options, "lambda_fn:on_compress", R"(nonzero if the script should be called just before the child compressor is invoked,
@@ -178,8 +284,16 @@ public:
     get(options, "lambda_fn:script", &script);
     get(options, "lambda_fn:on_set_options",  &on_set_options);
     get(options, "lambda_fn:on_compress",  &on_compress);
+    userdata hook;
+    if(get(options, "lambda_fn:native", &hook) == pressio_options_key_set) {
+      native = hook ? *static_cast<native_hook const*>(hook.get()) : native_hook{};
+    }
     if(on_set_options) {
-      run_options_script(options, lambda_fn_event::set_options);
+      try {
+        run_options_script(options, lambda_fn_event::set_options);
+      } catch(std::exception const& ex) {
+        return set_error(1, ex.what());
+      }
     }
     return 0;
   }
@@ -187,7 +301,9 @@ public:
   int compress_many_impl(compat::span<const pressio_data* const> const& inputs, compat::span<pressio_data*> & outputs) override 
   {
     try { 
-      run_compress_script(inputs, outputs, lambda_fn_event::compress);
+      if(on_compress) {
+        run_compress_script(inputs, outputs, lambda_fn_event::compress);
+      }
       int ret = compressor->compress_many(inputs.data(), inputs.size(), outputs.data(), outputs.size());
       if(ret) {
         set_error(ret, compressor->error_msg());
@@ -201,7 +317,9 @@ public:
   int decompress_many_impl(compat::span<const pressio_data* const> const& inputs, compat::span<pressio_data*> & outputs) override 
   {
     try {
-      run_compress_script(inputs, outputs, lambda_fn_event::decompress);
+      if(on_compress) {
+        run_compress_script(inputs, outputs, lambda_fn_event::decompress);
+      }
       int ret = compressor->decompress_many(inputs.data(), inputs.size(), outputs.data(), outputs.size());
       if(ret) {
         set_error(ret, compressor->error_msg());
@@ -229,9 +347,9 @@ public:
   }
 
   int major_version() const override { return 0; }
-  int minor_version() const override { return 0; }
-  int patch_version() const override { return 1; }
-  const char* version() const override { return "0.0.1"; }
+  int minor_version() const override { return 1; }
+  int patch_version() const override { return 0; }
+  const char* version() const override { return "0.1.0"; }
   const char* prefix() const override { return "lambda_fn"; }
 
   pressio_options get_metrics_results_impl() const override {
@@ -260,7 +378,8 @@ public:
 
 private:
 
-  void bind_pressio(sol::state& lua) 
+#if LIBPRESSIO_HAS_LUA
+  static void bind_pressio(sol::state& lua) 
   {
     lua.new_enum<pressio_dtype>("pressio_dtype", {
           {"int8", pressio_int8_dtype},
@@ -359,17 +478,13 @@ private:
 
 
   }
+#endif
 
   void run_options_script(pressio_options const& set_opts, lambda_fn_event event) {
-    run_script_common(event, [&set_opts](sol::state& lua){
-        lua["set_options"] = std::ref(set_opts);
-    });
+    run_script_common(event, {}, {}, &set_opts);
   }
   void run_compress_script(compat::span<const pressio_data* const> const& inputs, compat::span<pressio_data*> & outputs, lambda_fn_event event) {
-    auto time = run_script_common(event, [&inputs, &outputs](sol::state& lua){
-        lua["inputs"] = std::ref(inputs);
-        lua["outputs"] = std::ref(outputs);
-    });
+    auto time = run_script_common(event, inputs, outputs, nullptr);
     switch(event) {
       case lambda_fn_event::compress:
         compress_script_time = time;
@@ -382,31 +497,66 @@ private:
     }
   }
 
-  template <class Func>
-  uint64_t run_script_common(lambda_fn_event event, Func&& func) {
+  uint64_t run_script_common(lambda_fn_event event, compat::span<const pressio_data* const> inputs, compat::span<pressio_data*> outputs, pressio_options const* set_opts) {
     pressio_options opts;
     auto begin = std::chrono::steady_clock::now();
 
-    sol::state lua;
-    lua.open_libraries(sol::lib::base, sol::lib::math);
-    bind_pressio(lua);
+    if(native) {
+      native(lambda_fn_context{event, get_name(), inputs, outputs, set_opts, persist}, opts);
+    } else {
+      run_lua(event, inputs, outputs, set_opts, opts);
+    }
+
+    int ret = 0;
+    if(opts.size()) {
+      ret = compressor->set_options(opts); 
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    if(ret > 0) {
+      throw std::runtime_error(compressor->error_msg());
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(end-begin).count();
+  }
+
+  void run_lua(lambda_fn_event event, compat::span<const pressio_data* const> inputs, compat::span<pressio_data*> outputs, pressio_options const* set_opts, pressio_options& opts) {
+#if LIBPRESSIO_HAS_LUA
+    if(script.empty()) return;
+    auto& state = runtime.get(script, bind_pressio);
+    sol::state& lua = state.lua;
     lua["persist"] = std::ref(persist);
     lua["options"] = std::ref(opts);
     lua["name"] = get_name();
     lua["is_compress"] = event == lambda_fn_event::compress;
     lua["is_decompress"] = event == lambda_fn_event::decompress;
     lua["is_set_options"] = event == lambda_fn_event::set_options;
-    func(lua);
-
-    lua.safe_script(script);
+    if(set_opts) {
+      lua["set_options"] = std::ref(*set_opts);
+    } else {
+      lua["inputs"] = std::ref(inputs);
+      lua["outputs"] = std::ref(outputs);
+    }
 
-    auto ret = compressor->set_options(opts); 
+    sol::protected_function_result result = state.chunk();
 
-    auto end = std::chrono::steady_clock::now();
-    if(ret > 0) {
-      throw std::runtime_error(error_msg());
+    //the references are only valid during this call
+    for (auto const* global : {"options", "set_options", "inputs", "outputs"}) {
+      lua[global] = sol::lua_nil;
     }
-    return std::chrono::duration_cast<std::chrono::milliseconds>(end-begin).count();
+    if(!result.valid()) {
+      sol::error err = result;
+      throw std::runtime_error(err.what());
+    }
+#else
+    (void)event;
+    (void)inputs;
+    (void)outputs;
+    (void)set_opts;
+    (void)opts;
+    if(!script.empty()) {
+      throw std::runtime_error("lambda_fn:script requires libpressio to be built with lua, use lambda_fn:native instead");
+    }
+#endif
   }
 
   std::string script;
@@ -416,6 +566,10 @@ private:
   uint64_t decompress_script_time = 0;
   pressio_options persist;
   int32_t on_compress=1, on_set_options=0;
+  native_hook native;
+#if LIBPRESSIO_HAS_LUA
+  lua_runtime runtime;
+#endif
 };
 
 static pressio_register compressor_many_fields_plugin(compressor_plugins(), "lambda_fn", []() {
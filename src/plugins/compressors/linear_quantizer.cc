@@ -2,6 +2,7 @@
 #include <libpressio_ext/cpp/pressio.h>
 #include <std_compat/memory.h>
 #include <sstream>
+#include "elementwise_transform.h"
 
 namespace  libpressio { namespace linear_quantizer {
 
@@ -43,7 +44,34 @@ struct linear_quantizer_decoder {
 
 
 
-class linear_quantizer: public libpressio_compressor_plugin {
+template <class T>
+struct linear_quantizer_encode_block: public elementwise::block_transform {
+  explicit linear_quantizer_encode_block(double step): step(step) {}
+  void apply(void const* in_ptr, void* out_ptr, size_t n) override {
+    T const* in = static_cast<T const*>(in_ptr);
+    int64_t* out = static_cast<int64_t*>(out_ptr);
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = in[i]/step;
+    }
+  }
+  double step;
+};
+
+template <class T>
+struct linear_quantizer_decode_block: public elementwise::block_transform {
+  explicit linear_quantizer_decode_block(double step): step(step) {}
+  void apply(void const* in_ptr, void* out_ptr, size_t n) override {
+    int64_t const* in = static_cast<int64_t const*>(in_ptr);
+    T* out = static_cast<T*>(out_ptr);
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = in[i]*step;
+    }
+  }
+  double step;
+};
+
+
+class linear_quantizer: public libpressio_compressor_plugin, public elementwise::fusible_transform {
   pressio_options get_options_impl() const override {
     pressio_options opts;
     set_meta(opts, "linear_quantizer:compressor", meta_id, meta);
@@ -116,6 +144,21 @@ applies linear_quantizer encoding to prior to compression and reverses it post d
     pressio_data_for_each<int>(quantized_output, *output, linear_quantizer_decoder{step});
     return ret;
   }
+  std::unique_ptr<elementwise::block_transform> fused_encoder(pressio_dtype dtype, std::vector<size_t> const&) override {
+    //the automatic step size needs a pass over the data before encoding
+    if(meta_id != "noop" || auto_step) return nullptr;
+    return elementwise::make_block_transform<linear_quantizer_encode_block>(dtype, step);
+  }
+  std::unique_ptr<elementwise::block_transform> fused_decoder(pressio_dtype dtype, std::vector<size_t> const&) override {
+    if(meta_id != "noop") return nullptr;
+    return elementwise::make_block_transform<linear_quantizer_decode_block>(dtype, step);
+  }
+  pressio_dtype fused_output_dtype(pressio_dtype) const override {
+    return pressio_int64_dtype;
+  }
+  std::vector<size_t> fused_output_dims(std::vector<size_t> const& dims) const override {
+    return dims;
+  }
   pressio_options get_metrics_results_impl() const override {
     return meta->get_metrics_results();
   }
@@ -1,8 +1,11 @@
 #include <libpressio_ext/cpp/compressor.h>
 #include <libpressio_ext/cpp/pressio.h>
 #include <std_compat/memory.h>
+#include <std_compat/functional.h>
+#include <numeric>
 #include <sstream>
 #include <cmath>
+#include "elementwise_transform.h"
 
 namespace libpressio { namespace log_transform {
 
@@ -38,7 +41,30 @@ struct log_decoder {
 
 
 
-class log_transform: public libpressio_compressor_plugin {
+template <class T>
+struct log_encode_block: public elementwise::block_transform {
+  void apply(void const* in_ptr, void* out_ptr, size_t n) override {
+    T const* in = static_cast<T const*>(in_ptr);
+    T* out = static_cast<T*>(out_ptr);
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = log(in[i]);
+    }
+  }
+};
+
+template <class T>
+struct log_decode_block: public elementwise::block_transform {
+  void apply(void const* in_ptr, void* out_ptr, size_t n) override {
+    T const* in = static_cast<T const*>(in_ptr);
+    T* out = static_cast<T*>(out_ptr);
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = exp(in[i]);
+    }
+  }
+};
+
+
+class log_transform: public libpressio_compressor_plugin, public elementwise::fusible_transform {
   pressio_options get_options_impl() const override {
     pressio_options opts;
     set_meta(opts, "log_transform:compressor", meta_id, meta);
@@ -86,6 +112,20 @@ y[0] = log(x[0]);
     *output = pressio_data_for_each<pressio_data>(*output, log_decoder{});
     return ret;
   }
+  std::unique_ptr<elementwise::block_transform> fused_encoder(pressio_dtype dtype, std::vector<size_t> const&) override {
+    if(meta_id != "noop") return nullptr;
+    return elementwise::make_block_transform<log_encode_block>(dtype);
+  }
+  std::unique_ptr<elementwise::block_transform> fused_decoder(pressio_dtype dtype, std::vector<size_t> const&) override {
+    if(meta_id != "noop") return nullptr;
+    return elementwise::make_block_transform<log_decode_block>(dtype);
+  }
+  pressio_dtype fused_output_dtype(pressio_dtype dtype) const override {
+    return dtype;
+  }
+  std::vector<size_t> fused_output_dims(std::vector<size_t> const& dims) const override {
+    return {std::accumulate(dims.begin(), dims.end(), size_t{1}, compat::multiplies<>{})};
+  }
   void set_name_impl(std::string const& new_name) override {
     if(new_name != "") {
     meta->set_name(new_name + "/" + meta->prefix());
@@ -7,12 +7,420 @@
 #include "libpressio_ext/cpp/pressio.h"
 #include <nlohmann/json.hpp>
 #include "libpressio_ext/cpp/json.h"
+#include "libpressio_ext/cpp/hash.h"
+#include <limits>
+#include <list>
+#include <mutex>
 #include <sstream>
-#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
 
 
 namespace libpressio { namespace manifest_ns {
 
+/**
+ * the binary lineage format
+ *
+ * A version 2 header is
+ *
+ *   varint dtype, varint ndims, varint dims[ndims], varint config_size, config
+ *
+ * where config describes the compressor independently of the buffer, so it can be hashed to find a compressor
+ * that was already built for it:
+ *
+ *   varint nstrings, uint32 offsets[nstrings + 1], string bytes,
+ *   varint name, varint noptions, options, varint nversions, {varint path, varint version}[nversions]
+ *
+ * Strings are indices into the string table, whose fixed width offsets let any string be read in place.  Each
+ * option is a varint key, a byte type, a byte has_value, and if it has a value: a varint for unsigned integers,
+ * dtypes, and thread safety; a zigzag varint for signed integers; little endian IEEE bits for floating point; a
+ * byte for bool; a string for strings; a varint count of strings for string arrays; and a varint dtype, varint
+ * ndims, dims, and the raw bytes for data.  userptr options are not recorded.
+ */
+namespace lineage {
+
+  constexpr uint32_t binary_version = 2;
+
+  template <class T>
+  T to_little(T value) {
+    if (compat::endian::native == compat::endian::big) {
+      return compat::byteswap(value);
+    }
+    return value;
+  }
+
+  /**
+   * builds a config, interning strings into the string table
+   */
+  class writer {
+    public:
+    void varint(uint64_t value) {
+      while(value >= 0x80) {
+        body.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+      }
+      body.push_back(static_cast<uint8_t>(value));
+    }
+    void zigzag(int64_t value) {
+      varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+    template <class T>
+    void fixed(T value) {
+      value = to_little(value);
+      raw(&value, sizeof(value));
+    }
+    void raw(void const* data, size_t n) {
+      auto bytes = static_cast<uint8_t const*>(data);
+      body.insert(body.end(), bytes, bytes + n);
+    }
+    void string(std::string const& s) {
+      auto it = index.find(s);
+      if(it == index.end()) {
+        it = index.emplace(s, strings.size()).first;
+        strings.push_back(s);
+      }
+      varint(it->second);
+    }
+
+    void option(std::string const& key, pressio_option const& option) {
+      if(option.type() == pressio_option_userptr_type) return;
+      string(key);
+      body.push_back(static_cast<uint8_t>(option.type()));
+      body.push_back(static_cast<uint8_t>(option.has_value()));
+      if(!option.has_value()) return;
+      switch(option.type()) {
+        case pressio_option_uint8_type: varint(option.get_value<uint8_t>()); break;
+        case pressio_option_uint16_type: varint(option.get_value<uint16_t>()); break;
+        case pressio_option_uint32_type: varint(option.get_value<uint32_t>()); break;
+        case pressio_option_uint64_type: varint(option.get_value<uint64_t>()); break;
+        case pressio_option_int8_type: zigzag(option.get_value<int8_t>()); break;
+        case pressio_option_int16_type: zigzag(option.get_value<int16_t>()); break;
+        case pressio_option_int32_type: zigzag(option.get_value<int32_t>()); break;
+        case pressio_option_int64_type: zigzag(option.get_value<int64_t>()); break;
+        case pressio_option_float_type:
+          {
+            uint32_t bits;
+            float value = option.get_value<float>();
+            memcpy(&bits, &value, sizeof(bits));
+            fixed(bits);
+            break;
+          }
+        case pressio_option_double_type:
+          {
+            uint64_t bits;
+            double value = option.get_value<double>();
+            memcpy(&bits, &value, sizeof(bits));
+            fixed(bits);
+            break;
+          }
+        case pressio_option_bool_type: body.push_back(option.get_value<bool>()); break;
+        case pressio_option_charptr_type: string(option.get_value<std::string>()); break;
+        case pressio_option_charptr_array_type:
+          {
+            auto const& values = option.get_value<std::vector<std::string>>();
+            varint(values.size());
+            for (auto const& value : values) string(value);
+            break;
+          }
+        case pressio_option_dtype_type: varint(option.get_value<pressio_dtype>()); break;
+        case pressio_option_threadsafety_type: varint(option.get_value<pressio_thread_safety>()); break;
+        case pressio_option_data_type:
+          {
+            auto const& data = option.get_value<pressio_data>();
+            varint(data.dtype());
+            varint(data.num_dimensions());
+            for (auto dim : data.dimensions()) varint(dim);
+            raw(data.data(), data.size_in_bytes());
+            break;
+          }
+        case pressio_option_userptr_type:
+        case pressio_option_unset_type:
+          break;
+      }
+    }
+
+    /**
+     * \returns the string table followed by the body
+     */
+    std::vector<uint8_t> finish() {
+      std::vector<uint8_t> encoded;
+      std::swap(encoded, body);
+      varint(strings.size());
+      uint32_t offset = 0;
+      fixed(offset);
+      for (auto const& s : strings) {
+        offset += static_cast<uint32_t>(s.size());
+        fixed(offset);
+      }
+      for (auto const& s : strings) raw(s.data(), s.size());
+      body.insert(body.end(), encoded.begin(), encoded.end());
+      std::swap(encoded, body);
+      body.clear();
+      return encoded;
+    }
+
+    std::vector<uint8_t> body;
+
+    private:
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, size_t> index;
+  };
+
+  /**
+   * \returns the dtype with the given encoding, rejecting values that are not a pressio_dtype
+   */
+  inline pressio_dtype checked_dtype(uint64_t value) {
+    if(value > pressio_bool_dtype) throw std::runtime_error("malformed lineage dtype");
+    return static_cast<pressio_dtype>(value);
+  }
+
+  /**
+   * reads values in place from a bounded range of bytes
+   */
+  class reader {
+    public:
+    reader(uint8_t const* begin, uint8_t const* end): pos(begin), end(end) {}
+
+    uint64_t varint() {
+      uint64_t value = 0;
+      for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t byte = next();
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if(!(byte & 0x80)) return value;
+      }
+      throw std::runtime_error("malformed varint in lineage");
+    }
+    int64_t zigzag() {
+      uint64_t value = varint();
+      return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+    template <class T>
+    T fixed() {
+      T value;
+      memcpy(&value, bytes(sizeof(T)), sizeof(T));
+      return to_little(value);
+    }
+    uint8_t next() {
+      return *bytes(1);
+    }
+    uint8_t const* bytes(size_t n) {
+      if(static_cast<size_t>(end - pos) < n) throw std::runtime_error("truncated lineage");
+      auto start = pos;
+      pos += n;
+      return start;
+    }
+    uint8_t const* position() const { return pos; }
+
+    private:
+    uint8_t const* pos;
+    uint8_t const* end;
+  };
+
+  /**
+   * the decoded configuration of a compressor
+   */
+  struct config {
+    std::string name;
+    pressio_options options;
+    std::map<std::string, std::string> versions;
+  };
+
+  /**
+   * a view of a version 2 header in the buffer it was read from
+   *
+   * Constructing the view reads only the dtype, dimensions, and extent of the config; the config itself is decoded
+   * by decode, which is only needed when no compressor has been built for it yet.
+   */
+  class view {
+    public:
+    view(uint8_t const* begin, size_t size) {
+      reader r(begin, begin + size);
+      data_dtype = checked_dtype(r.varint());
+      const uint64_t ndims = r.varint();
+      if(ndims > size) throw std::runtime_error("malformed lineage dimensions");
+      data_dims.resize(ndims);
+      for (auto& dim : data_dims) dim = r.varint();
+      const uint64_t config_size = r.varint();
+      config_begin = r.bytes(config_size);
+      config_end = config_begin + config_size;
+    }
+
+    pressio_dtype dtype() const { return data_dtype; }
+    std::vector<size_t> const& dims() const { return data_dims; }
+    compat::string_view config_bytes() const {
+      return compat::string_view(reinterpret_cast<char const*>(config_begin), config_end - config_begin);
+    }
+
+    config decode() const {
+      reader r(config_begin, config_end);
+      const uint64_t nstrings = r.varint();
+      if(nstrings > static_cast<uint64_t>(config_end - config_begin)) throw std::runtime_error("malformed lineage strings");
+      uint8_t const* offsets = r.bytes((nstrings + 1) * sizeof(uint32_t));
+      uint32_t last;
+      memcpy(&last, offsets + nstrings * sizeof(uint32_t), sizeof(last));
+      const uint32_t strings_size = to_little(last);
+      uint8_t const* strings = r.bytes(strings_size);
+      auto string = [&]() {
+        const uint64_t i = r.varint();
+        if(i >= nstrings) throw std::runtime_error("malformed lineage string index");
+        uint32_t first, last;
+        memcpy(&first, offsets + i * sizeof(uint32_t), sizeof(first));
+        memcpy(&last, offsets + (i + 1) * sizeof(uint32_t), sizeof(last));
+        first = to_little(first);
+        last = to_little(last);
+        if(first > last || last > strings_size) throw std::runtime_error("malformed lineage string table");
+        return std::string(reinterpret_cast<char const*>(strings + first), last - first);
+      };
+
+      config c;
+      c.name = string();
+      const uint64_t noptions = r.varint();
+      for (uint64_t i = 0; i < noptions; ++i) {
+        std::string key = string();
+        auto type = static_cast<pressio_option_type>(r.next());
+        bool has_value = r.next();
+        pressio_option option;
+        if(!has_value) {
+          option.set_type(type);
+        } else {
+          switch(type) {
+            case pressio_option_uint8_type: option = static_cast<uint8_t>(r.varint()); break;
+            case pressio_option_uint16_type: option = static_cast<uint16_t>(r.varint()); break;
+            case pressio_option_uint32_type: option = static_cast<uint32_t>(r.varint()); break;
+            case pressio_option_uint64_type: option = static_cast<uint64_t>(r.varint()); break;
+            case pressio_option_int8_type: option = static_cast<int8_t>(r.zigzag()); break;
+            case pressio_option_int16_type: option = static_cast<int16_t>(r.zigzag()); break;
+            case pressio_option_int32_type: option = static_cast<int32_t>(r.zigzag()); break;
+            case pressio_option_int64_type: option = static_cast<int64_t>(r.zigzag()); break;
+            case pressio_option_float_type:
+              {
+                uint32_t bits = r.fixed<uint32_t>();
+                float value;
+                memcpy(&value, &bits, sizeof(value));
+                option = value;
+                break;
+              }
+            case pressio_option_double_type:
+              {
+                uint64_t bits = r.fixed<uint64_t>();
+                double value;
+                memcpy(&value, &bits, sizeof(value));
+                option = value;
+                break;
+              }
+            case pressio_option_bool_type: option = static_cast<bool>(r.next()); break;
+            case pressio_option_charptr_type: option = string(); break;
+            case pressio_option_charptr_array_type:
+              {
+                const uint64_t n = r.varint();
+                std::vector<std::string> values;
+                for (uint64_t j = 0; j < n; ++j) values.emplace_back(string());
+                option = values;
+                break;
+              }
+            case pressio_option_dtype_type: option = checked_dtype(r.varint()); break;
+            case pressio_option_threadsafety_type: option = static_cast<pressio_thread_safety>(r.varint()); break;
+            case pressio_option_data_type:
+              {
+                auto dtype = checked_dtype(r.varint());
+                const uint64_t ndims = r.varint();
+                if(ndims > static_cast<uint64_t>(config_end - config_begin)) throw std::runtime_error("malformed lineage data");
+                std::vector<size_t> dims(ndims);
+                //bound the size by the remaining header before allocating so corrupt dims cannot force a huge allocation
+                uint64_t size = pressio_dtype_size(dtype);
+                for (auto& dim : dims) {
+                  dim = r.varint();
+                  if(dim != 0 && size > std::numeric_limits<uint64_t>::max() / dim) throw std::runtime_error("malformed lineage data");
+                  size *= dim;
+                }
+                uint8_t const* bytes = r.bytes(size);
+                auto data = pressio_data::owning(dtype, dims);
+                if(data.size_in_bytes() != size) throw std::runtime_error("malformed lineage data");
+                memcpy(data.data(), bytes, size);
+                option = std::move(data);
+                break;
+              }
+            default:
+              throw std::runtime_error("unsupported option type in lineage");
+          }
+        }
+        c.options.set(key, option);
+      }
+      const uint64_t nversions = r.varint();
+      for (uint64_t i = 0; i < nversions; ++i) {
+        std::string path = string();
+        c.versions[path] = string();
+      }
+      return c;
+    }
+
+    private:
+    pressio_dtype data_dtype;
+    std::vector<size_t> data_dims;
+    uint8_t const* config_begin;
+    uint8_t const* config_end;
+  };
+
+  /**
+   * compressors already configured from a lineage config, shared by every manifest plugin in the process
+   */
+  class decoder_cache {
+    public:
+    struct entry {
+      std::string config;
+      std::string name;
+      std::string impl_id;
+      pressio_compressor prototype;
+      bool record_on_decompress;
+      int versions_rc;
+      std::string versions_msg;
+    };
+
+    static decoder_cache& instance() {
+      static decoder_cache cache;
+      return cache;
+    }
+
+    /**
+     * \returns true and a copy of the entry with a clone of its compressor if config was cached
+     */
+    bool find(uint64_t hash, compat::string_view config, entry& found) {
+      std::lock_guard<std::mutex> guard(lock);
+      auto it = index.find(hash);
+      if(it == index.end() || it->second->config != config) return false;
+      entries.splice(entries.begin(), entries, it->second);
+      auto const& e = *it->second;
+      found = entry{e.config, e.name, e.impl_id, e.prototype->clone(), e.record_on_decompress, e.versions_rc, e.versions_msg};
+      return true;
+    }
+
+    void insert(uint64_t hash, entry&& e, uint64_t capacity) {
+      std::lock_guard<std::mutex> guard(lock);
+      auto it = index.find(hash);
+      if(it != index.end()) {
+        entries.erase(it->second);
+        index.erase(it);
+      }
+      if(capacity == 0) return;
+      entries.emplace_front(std::move(e));
+      index[hash] = entries.begin();
+      while(entries.size() > capacity) {
+        index.erase(xxh(entries.back().config));
+        entries.pop_back();
+      }
+    }
+
+    static uint64_t xxh(compat::string_view config) {
+      return hash::xxh64(config.data(), config.size());
+    }
+
+    private:
+    std::mutex lock;
+    std::list<entry> entries;
+    std::unordered_map<uint64_t, std::list<entry>::iterator> index;
+  };
+}
+
 class manifest_compressor_plugin : public libpressio_compressor_plugin {
 public:
   struct pressio_options get_options_impl() const override
@@ -21,6 +429,8 @@ public:
     set_meta(options, "manifest:compressor", impl_id, impl);
     set(options, "manifest:lineage", lineage);
     set(options, "manifest:record_lineage_on_decompress", record_on_decompress);
+    set(options, "manifest:binary", binary);
+    set(options, "manifest:cache_size", cache_size);
     return options;
   }
 
@@ -32,7 +442,7 @@ public:
     set(options, "pressio:stability", "experimental");
     
         //TODO fix the list of options for each command
-        std::vector<std::string> invalidations {"manifest:lineage", "manifest:record_lineage_on_decompress"}; 
+        std::vector<std::string> invalidations {"manifest:lineage", "manifest:record_lineage_on_decompress", "manifest:binary", "manifest:cache_size"}; 
         std::vector<pressio_configurable const*> invalidation_children {&*impl}; 
         
         set(options, "predictors:error_dependent", get_accumulate_configuration("predictors:error_dependent", invalidation_children, {}));
@@ -49,6 +459,11 @@ public:
     set(options, "pressio:description", R"(compressor plugin that records meta data from compression to enable reconstruction)");
     set(options, "manifest:lineage", R"(header for the last compression operation)");
     set(options, "manifest:record_lineage_on_decompress", R"(update manifest:lineage when decompress is called)");
+    set(options, "manifest:binary", R"(write the compact binary header instead of the msgpack header; both are read by decompress, but
+    versions of manifest older than 0.1.0 can only read the msgpack header, so this defaults to false)");
+    set(options, "manifest:cache_size", R"(the number of configured compressors kept in the process wide cache used to skip reconfiguration when decompressing binary headers, 0 disables the cache)");
+    set(options, "manifest:header_size", R"(the size in bytes of the header of the last operation)");
+    set(options, "manifest:cache_hit", R"(true if the last decompression reused a configured compressor instead of applying the options in the header)");
     return options;
   }
 
@@ -58,35 +473,31 @@ public:
     get_meta(options, "manifest:compressor", compressor_plugins(), impl_id, impl);
     get(options, "manifest:lineage", &lineage);
     get(options, "manifest:record_lineage_on_decompress", &record_on_decompress);
+    get(options, "manifest:binary", &binary);
+    get(options, "manifest:cache_size", &cache_size);
+    applied_config.clear();
     return 0;
   }
 
   int compress_impl(const pressio_data* input,
                     struct pressio_data* output) override
   {
-    nlohmann::json j{};
-    j["t"] = input->dtype(); //dtype
-    j["d"] = input->dimensions(); //dims
-    j["o"] = get_options(); //options
-    j["n"] = get_name(); //name
-    j["c"] = versions(); //versions tree
-
-    std::vector<uint8_t> msgpk = nlohmann::json::to_msgpack(j);
+    std::vector<uint8_t> header = binary ? binary_header(*input) : msgpack_header(*input);
 
     int rc = impl->compress(input, output);
     if(rc) {
       return set_error(impl->error_code(), impl->error_msg());
     }
-    this->header_size = msgpk.size() + sizeof(uint32_t) + sizeof(uint64_t);
+    this->header_size = header.size() + sizeof(uint32_t) + sizeof(uint64_t);
     auto tmp = pressio_data::owning(
         pressio_byte_dtype,
         { sizeof(uint32_t) +
           sizeof(uint64_t) +
-          msgpk.size() +
+          header.size() +
           output->size_in_bytes()}
         );
-    uint32_t version = 1;
-    uint64_t header_size = msgpk.size();
+    uint32_t version = binary ? lineage::binary_version : 1;
+    uint64_t header_size = header.size();
     if (compat::endian::native == compat::endian::big) {
       version = compat::byteswap(version);
       header_size = compat::byteswap(header_size);
@@ -94,8 +505,8 @@ public:
 
     memmove(tmp.data(), &version, sizeof(version));
     memmove(reinterpret_cast<uint8_t*>(tmp.data()) + sizeof(version), &header_size, sizeof(header_size));
-    memmove(reinterpret_cast<uint8_t*>(tmp.data()) + sizeof(version) + sizeof(header_size), msgpk.data(), msgpk.size());
-    memmove(reinterpret_cast<uint8_t*>(tmp.data()) + sizeof(version) + sizeof(header_size) + msgpk.size(), output->data(), output->size_in_bytes());
+    memmove(reinterpret_cast<uint8_t*>(tmp.data()) + sizeof(version) + sizeof(header_size), header.data(), header.size());
+    memmove(reinterpret_cast<uint8_t*>(tmp.data()) + sizeof(version) + sizeof(header_size) + header.size(), output->data(), output->size_in_bytes());
 
     *output = std::move(tmp);
 
@@ -105,69 +516,50 @@ public:
   int decompress_impl(const pressio_data* input,
                       struct pressio_data* output) override
   {
-    uint32_t version = *reinterpret_cast<uint32_t*>(input->data());
+    if(input->size_in_bytes() < sizeof(uint32_t) + sizeof(uint64_t)) {
+      return set_error(1, "manifest header is truncated");
+    }
+    uint32_t version;
+    uint64_t header_size;
+    memcpy(&version, input->data(), sizeof(version));
+    memcpy(&header_size, reinterpret_cast<uint8_t*>(input->data()) + sizeof(uint32_t), sizeof(header_size));
     if (compat::endian::native == compat::endian::big) {
       version = compat::byteswap(version);
+      header_size = compat::byteswap(header_size);
     }
-    if(version == 1) {
-      uint64_t header_size = *reinterpret_cast<uint64_t*>(reinterpret_cast<uint8_t*>(input->data()) + sizeof(uint32_t));
-      if (compat::endian::native == compat::endian::big) {
-        header_size = compat::byteswap(header_size);
-      }
-      this->header_size = header_size + sizeof(uint32_t) + sizeof(uint64_t);
-
-      compat::string_view sv (
-            reinterpret_cast<char*>(input->data()) + sizeof(uint32_t) + sizeof(uint64_t),
-            header_size
-          );
-
-      nlohmann::json j = nlohmann::json::from_msgpack(sv);
-      auto real_input = pressio_data::nonowning(
-          pressio_byte_dtype,
-          reinterpret_cast<uint8_t*>(input->data()) + sizeof(uint32_t) + sizeof(uint64_t) + header_size,
-          {input->size_in_bytes() - (sizeof(uint32_t) + sizeof(uint64_t) + header_size)}
-          );
-      pressio_dtype dtype = j["t"].get<pressio_dtype>();
-      auto dims = j["d"].get<std::vector<size_t>>();
-
-      if(output->dtype() != dtype && dims != output->dimensions()) {
-        *output = pressio_data::empty( dtype,dims);
-      }
+    if(header_size > input->size_in_bytes() - (sizeof(uint32_t) + sizeof(uint64_t))) {
+      return set_error(1, "manifest header is truncated");
+    }
+    this->header_size = header_size + sizeof(uint32_t) + sizeof(uint64_t);
+    this->cache_hit = false;
 
-      set_name(j["n"].get<std::string>());
-      set_options(j["o"].get<pressio_options>());
-
-      auto saved_versions = j["c"].get<std::map<std::string, std::string>>();
-      auto current_versions = versions();
-      
-      int val_rc = validate_versions(saved_versions, current_versions);
-      if(val_rc < 0) {
-        //warning
-        std::stringstream ss;
-        ss << "some versions didn't match old={";
-        for (auto const& i : saved_versions) {
-          ss << '{' << i.first << ',' << i.second << '}';
-        }
-        ss << "} new={";
-        for (auto const& i : current_versions) {
-          ss << '{' << i.first << ',' << i.second << '}';
-        }
-        ss << "}";
-        set_error(1, ss.str());
-      } 
-      if(val_rc > 0) {
-        return error_code();
-      }
+    uint8_t const* header = reinterpret_cast<uint8_t*>(input->data()) + sizeof(uint32_t) + sizeof(uint64_t);
+    auto real_input = pressio_data::nonowning(
+        pressio_byte_dtype,
+        const_cast<uint8_t*>(header) + header_size,
+        {input->size_in_bytes() - this->header_size}
+        );
 
-      impl->decompress(&real_input, output);
-      if(record_on_decompress) {
-        lineage = static_cast<std::string>(sv);
-      }
+    int rc;
+    if(version == lineage::binary_version) {
+      rc = decompress_binary(header, header_size, output);
+    } else if(version == 1) {
+      rc = decompress_msgpack(header, header_size, output);
     } else {
       return set_error(1, "unsuported version");
     }
+    if(rc > 0) {
+      return rc;
+    }
 
-    return 0;
+    if(impl->decompress(&real_input, output)) {
+      return set_error(impl->error_code(), impl->error_msg());
+    }
+    if(record_on_decompress) {
+      lineage = std::string(reinterpret_cast<char const*>(header), header_size);
+    }
+
+    return rc;
   }
 
   std::map<std::string, std::string> versions() {
@@ -206,14 +598,15 @@ public:
   }
 
   int major_version() const override { return 0; }
-  int minor_version() const override { return 0; }
-  int patch_version() const override { return 1; }
-  const char* version() const override { return "0.0.1"; }
+  int minor_version() const override { return 1; }
+  int patch_version() const override { return 0; }
+  const char* version() const override { return "0.1.0"; }
   const char* prefix() const override { return "manifest"; }
 
   pressio_options get_metrics_results_impl() const override {
     auto options =  impl->get_metrics_results();
     set(options, "manifest:header_size", header_size);
+    set(options, "manifest:cache_hit", cache_hit);
 
     return options;
   }
@@ -224,6 +617,158 @@ public:
   }
 
 private:
+  /**
+   * \returns the options that describe how to reconstruct the compressor, without the options that only control
+   * how the manifest itself is written and cached
+   */
+  pressio_options recorded_options() {
+    auto options = get_options();
+    for (auto const& key : {"manifest:lineage", "manifest:binary", "manifest:cache_size"}) {
+      options.erase(get_name().empty() ? std::string(key) : '/' + get_name() + ':' + key);
+    }
+    return options;
+  }
+
+  std::vector<uint8_t> msgpack_header(pressio_data const& input) {
+    nlohmann::json j{};
+    j["t"] = input.dtype(); //dtype
+    j["d"] = input.dimensions(); //dims
+    j["o"] = recorded_options(); //options
+    j["n"] = get_name(); //name
+    j["c"] = versions(); //versions tree
+    return nlohmann::json::to_msgpack(j);
+  }
+
+  std::vector<uint8_t> binary_header(pressio_data const& input) {
+    lineage::writer config;
+    config.string(get_name());
+    auto const options = recorded_options();
+    size_t noptions = 0;
+    for (auto const& o : options) {
+      noptions += o.second.type() != pressio_option_userptr_type;
+    }
+    config.varint(noptions);
+    for (auto const& o : options) {
+      config.option(o.first, o.second);
+    }
+    auto const current_versions = versions();
+    config.varint(current_versions.size());
+    for (auto const& v : current_versions) {
+      config.string(v.first);
+      config.string(v.second);
+    }
+    auto const config_bytes = config.finish();
+    //this instance is already configured as the header describes
+    applied_config.assign(config_bytes.begin(), config_bytes.end());
+
+    lineage::writer header;
+    header.varint(input.dtype());
+    header.varint(input.num_dimensions());
+    for (auto dim : input.dimensions()) {
+      header.varint(dim);
+    }
+    header.varint(config_bytes.size());
+    header.raw(config_bytes.data(), config_bytes.size());
+    return std::move(header.body);
+  }
+
+  /**
+   * configures this compressor from a binary header, reusing a cached compressor when one was already built for
+   * the same config
+   */
+  int decompress_binary(uint8_t const* header, size_t header_size, pressio_data* output) {
+    try {
+      lineage::view view(header, header_size);
+      if(output->dtype() != view.dtype() || output->dimensions() != view.dims()) {
+        *output = pressio_data::empty(view.dtype(), view.dims());
+      }
+
+      auto const config = view.config_bytes();
+      if(!applied_config.empty() && config == applied_config) {
+        cache_hit = true;
+        return 0;
+      }
+
+      auto& cache = lineage::decoder_cache::instance();
+      const uint64_t key = lineage::decoder_cache::xxh(config);
+      lineage::decoder_cache::entry entry;
+      if(cache_size > 0 && cache.find(key, config, entry)) {
+        impl_id = entry.impl_id;
+        impl = std::move(entry.prototype);
+        set_name(entry.name);
+        record_on_decompress = entry.record_on_decompress;
+        applied_config = std::move(entry.config);
+        cache_hit = true;
+        if(entry.versions_rc < 0) {
+          set_error(1, entry.versions_msg);
+        }
+        return entry.versions_rc;
+      }
+
+      auto decoded = view.decode();
+      int rc = apply(decoded.name, decoded.options, decoded.versions);
+      if(rc > 0) {
+        return rc;
+      }
+      applied_config = static_cast<std::string>(config);
+      if(cache_size > 0) {
+        cache.insert(key, {applied_config, decoded.name, impl_id, impl->clone(), record_on_decompress, rc, rc < 0 ? error_msg() : ""}, cache_size);
+      }
+      return rc;
+    } catch(std::exception const& ex) {
+      return set_error(2, ex.what());
+    }
+  }
+
+  int decompress_msgpack(uint8_t const* header, size_t header_size, pressio_data* output) {
+    try {
+      compat::string_view sv (reinterpret_cast<char const*>(header), header_size);
+      nlohmann::json j = nlohmann::json::from_msgpack(sv);
+      pressio_dtype dtype = lineage::checked_dtype(j.at("t").get<uint64_t>());
+      auto dims = j.at("d").get<std::vector<size_t>>();
+
+      if(output->dtype() != dtype || dims != output->dimensions()) {
+        *output = pressio_data::empty( dtype,dims);
+      }
+
+      return apply(j.at("n").get<std::string>(), j.at("o").get<pressio_options>(), j.at("c").get<std::map<std::string, std::string>>());
+    } catch(std::exception const& ex) {
+      return set_error(2, ex.what());
+    }
+  }
+
+  /**
+   * applies a recorded configuration to this compressor
+   *
+   * \returns 0 on success, a negative number if some versions differ, and a positive number if a recorded
+   * component is missing
+   */
+  int apply(std::string const& name, pressio_options const& options, std::map<std::string, std::string> const& saved_versions) {
+    set_name(name);
+    set_options(options);
+
+    auto current_versions = versions();
+    int val_rc = validate_versions(saved_versions, current_versions);
+    if(val_rc < 0) {
+      //warning
+      std::stringstream ss;
+      ss << "some versions didn't match old={";
+      for (auto const& i : saved_versions) {
+        ss << '{' << i.first << ',' << i.second << '}';
+      }
+      ss << "} new={";
+      for (auto const& i : current_versions) {
+        ss << '{' << i.first << ',' << i.second << '}';
+      }
+      ss << "}";
+      set_error(1, ss.str());
+    } 
+    if(val_rc > 0) {
+      return set_error(1, "a component recorded in the manifest is missing");
+    }
+    return val_rc;
+  }
+
   int validate_versions(std::map<std::string, std::string> const& old_versions,
     std::map<std::string, std::string> const& loaded_versions) {
     int ret = 0;
@@ -248,6 +793,11 @@ private:
   std::string lineage = "";
   uint64_t header_size = 0;
   bool record_on_decompress = false;
+  bool binary = false;
+  uint64_t cache_size = 64;
+  bool cache_hit = false;
+  /** the binary config this instance was last configured from, empty if set_options was called since */
+  std::string applied_config;
 };
 
 static pressio_register compressor_many_fields_plugin(compressor_plugins(), "manifest", []() {
@@ -255,4 +805,3 @@ static pressio_register compressor_many_fields_plugin(compressor_plugins(), "man
 });
 
 } }
-
@@ -3,6 +3,8 @@
 #include <memory>
 #include <random>
 #include <numeric>
+#include <algorithm>
+#include <cmath>
 #include "libpressio_ext/cpp/data.h"
 #include "libpressio_ext/cpp/compressor.h"
 #include "libpressio_ext/cpp/options.h"
@@ -29,6 +31,9 @@ public:
     options.copy_from(subgroups.get_options());
     set(options, "many_dependent:to_names", to_names);
     set(options, "many_dependent:from_names", from_names);
+    set(options, "many_dependent:speculate", speculate);
+    set(options, "many_dependent:tolerance", tolerance);
+    set(options, "many_dependent:predictor", predictor);
     return options;
   }
 
@@ -38,10 +43,11 @@ public:
     set_meta_configuration(options, "many_dependent:compressor", compressor_plugins(), compressor);
     set(options, "pressio:thread_safe", pressio_thread_safety_multiple);
     set(options, "pressio:stability", "experimental");
+    set(options, "many_dependent:predictor", std::vector<std::string>{"last", "linear"});
     options.copy_from(manager.get_configuration());
     options.copy_from(subgroups.get_configuration());
     
-        std::vector<std::string> invalidations {"many_dependent:to_names", "many_dependent:from_names"}; 
+        std::vector<std::string> invalidations {"many_dependent:to_names", "many_dependent:from_names", "many_dependent:speculate", "many_dependent:tolerance", "many_dependent:predictor"}; 
         std::vector<pressio_configurable const*> invalidation_children {&*compressor}; 
         
         set(options, "predictors:error_dependent", get_accumulate_configuration("predictors:error_dependent", invalidation_children, invalidations));
@@ -61,6 +67,14 @@ public:
       successful compressions to guide future compressions)");
     set(options, "many_dependent:to_names", "list of options to set on each launch");
     set(options, "many_dependent:from_names", "list of metrics to pull the next set of configurations from");
+    set(options, "many_dependent:speculate", R"(if true, buffers start before the buffer they depend on finishes using predicted options,
+      and are re-run if the options implied by their predecessor differ from the prediction; otherwise buffers start with the
+      options from the most recently finished buffer and are never re-run)");
+    set(options, "many_dependent:tolerance", "the relative difference allowed between a predicted numeric option and the option implied by the predecessor before a speculative buffer is re-run");
+    set(options, "many_dependent:predictor", R"(how options are predicted for speculative buffers
+      + last -- the options implied by the most recently finished buffer
+      + linear -- extends the trend in numeric options between the two most recently finished buffers)");
+    set(options, "many_dependent:reruns", "the number of speculative buffers that were re-run in the last call to compress");
     return options;
   }
 
@@ -72,6 +86,15 @@ public:
     subgroups.set_options(options);
     get(options, "many_dependent:to_names", &to_names);
     get(options, "many_dependent:from_names", &from_names);
+    get(options, "many_dependent:speculate", &speculate);
+    get(options, "many_dependent:tolerance", &tolerance);
+    std::string tmp_predictor;
+    if(get(options, "many_dependent:predictor", &tmp_predictor) == pressio_options_key_set) {
+      if(tmp_predictor != "last" && tmp_predictor != "linear") {
+        return set_error(1, "unsupported many_dependent:predictor " + tmp_predictor);
+      }
+      predictor = tmp_predictor;
+    }
     return 0;
   }
 
@@ -92,118 +115,112 @@ public:
   }
 
   int compress_many_impl(compat::span<const pressio_data* const> const& inputs, compat::span<pressio_data*> & outputs) override {
-    using request_t = std::tuple<int, pressio_options>; //index, metrics
-    using response_t = std::tuple<int, pressio_options, std::vector<pressio_data>, int, std::string>; //index, metrics, compressed, error code, error_message
     using distributed::queue::TaskManager;
     std::vector<request_t> requests;
     requests.emplace_back(
+      0,
       0,
       pressio_options{}
     );
     size_t outstanding = 1;
     size_t next_task = 1;
+    reruns = 0;
 
     if(subgroups.normalize_and_validate(inputs, outputs)) {
       return set_error(subgroups.error_code(), subgroups.error_msg());
     }
 
+    //when speculating, the first tasks run with the starting options rather than waiting for the first task
+    std::vector<task_state> tasks(outputs.size());
+    if(speculate) {
+      baseline = baseline_options();
+      std::get<2>(requests.front()) = baseline;
+      tasks.front().launched = baseline;
+      int initialized = 0;
+      MPI_Initialized(&initialized);
+      if(initialized) {
+        size_t n_workers = std::max(1, manager.comm_size() - 1);
+        while(next_task < std::min(n_workers, outputs.size())) {
+          tasks[next_task].launched = baseline;
+          requests.emplace_back(static_cast<int>(next_task++), 0, baseline);
+          outstanding++;
+        }
+      }
+    }
+    size_t validated = 0;
 
     int ret = 0;
     ret = manager.work_queue(
         std::begin(requests), std::end(requests),
-        [&inputs, &outputs, this](request_t request, distributed::queue::TaskManager<request_t, MPI_Comm>& task_manager) {
-
-          std::vector<pressio_data> output_data;
-          auto index = std::get<0>(request);
-          auto request_options = std::move(std::get<1>(request));
-          request_options.set(compressor->get_name(), "distributed:mpi_comm", 
-              userdata(
-                (void*)new MPI_Comm(*task_manager.get_subcommunicator()),
-                nullptr,
-                newdelete_deleter<MPI_Comm>(),
-                newdelete_copy<MPI_Comm>()
-                ));
-
-          if(compressor->set_options(request_options)) {
-            return response_t{index, pressio_options{}, output_data, compressor->error_code(), compressor->error_msg()};
-          }
-          auto input_data_ptrs = subgroups.get_input_group(inputs, index);
-          auto output_data_ptrs = subgroups.get_output_group(outputs, index);
-          if(compressor->compress_many(
-                input_data_ptrs.data(),
-                input_data_ptrs.data() + input_data_ptrs.size(),
-                output_data_ptrs.data(),
-                output_data_ptrs.data() + output_data_ptrs.size()
-                )) {
-            for (auto& i : output_data_ptrs) {
-              output_data.emplace_back(std::move(*i));
-            }
-            
-            return response_t{index, pressio_options{}, output_data, compressor->error_code(), compressor->error_msg()};
-          }
-
-          for (auto& i : output_data_ptrs) {
-            output_data.emplace_back(std::move(*i));
-          }
-
-          pressio_options metrics_results = compressor->get_metrics_results();
-          int error_code = compressor->error_code();
-          std::string error_msg = compressor->error_msg();
-
-          pressio_options new_options;
-          for (size_t i = 0; i < to_names.size(); ++i) {
-            auto option_it = metrics_results.find(from_names[i]);
-            if(option_it != metrics_results.end()){
-              new_options.set(from_names[i], option_it->second);
-            } else {
-              error_code = 3;
-              error_msg = std::string("invalid option in from_names: ") + from_names[i];
-              break;
-            }
-          }
-
-
-          return response_t{index, std::move(new_options), output_data, error_code, error_msg};
+        [&inputs, &outputs, this](request_t request, TaskManager<request_t, MPI_Comm>& task_manager) {
+          return run_task(std::move(request), inputs, outputs, task_manager);
         },
-        [&outputs, &outstanding, &next_task, &ret, this](response_t response, TaskManager<request_t, MPI_Comm>& task_manager) {
+        [&](response_t response, TaskManager<request_t, MPI_Comm>& task_manager) {
           //one less outstanding
           outstanding--;
 
           auto index = std::get<0>(response);
-          auto ec = std::get<3>(response);
-          if(ec) {
-            ret |= set_error(ec, std::get<4>(response));
-          }
+          if(!speculate) {
+            auto ec = std::get<4>(response);
+            if(ec) {
+              ret |= set_error(ec, std::get<5>(response));
+            }
+            store_outputs(outputs, index, std::move(std::get<3>(response)));
+
+            //determine the next set of options
+            pressio_options new_options;
+            auto missing = next_options(std::get<2>(response), new_options);
+            if(!missing.empty()) {
+              set_error(3, "invalid option in from_names" + missing);
+            }
 
-          
-          //retrieve outputs
-          auto output_data = std::move(std::get<2>(response));
-          size_t out_idx=0;
-          for (size_t i =0; i < subgroups.effective_output_groups().size(); ++i) {
-            if(subgroups.effective_output_groups()[i] == index) {
-              *outputs[i] = std::move(output_data[out_idx++]);
+            //push search_requests to fill workers
+            while(outstanding < task_manager.num_workers() && next_task < outputs.size()) {
+              request_t request{next_task, 0, new_options};
+              task_manager.push(request);
+              outstanding++;
+              next_task++;
             }
+            return;
           }
 
-          //determine the next set of options
-          auto options = std::move(std::get<1>(response));
-          pressio_options new_options;
-          for (size_t i = 0; i < to_names.size(); ++i) {
-            auto option_it = options.find(from_names[i]);
-            if(option_it != options.end()){
-              new_options.set(to_names[i], option_it->second);
-            } else {
-              set_error(3, "invalid option in from_names" + from_names[i]);
+          //record the result unless a newer attempt for this task has been launched since
+          auto& task = tasks[index];
+          if(std::get<1>(response) == task.attempt && !task.has_result) {
+            task.has_result = true;
+            task.error_code = std::get<4>(response);
+            task.error_msg = std::move(std::get<5>(response));
+            task.outputs = std::move(std::get<3>(response));
+            next_options(std::get<2>(response), task.next);
+          }
+
+          auto launch = [&](size_t i, pressio_options const& options) {
+            tasks[i].launched = options;
+            tasks[i].has_result = false;
+            task_manager.push(request_t{static_cast<int>(i), tasks[i].attempt, options});
+            outstanding++;
+          };
+
+          //accept results in order, re-running tasks whose predicted options were wrong
+          while(validated < outputs.size() && validated < next_task) {
+            auto& current = tasks[validated];
+            if(validated > 0 && !matches(current.launched, tasks[validated - 1].next)) {
+              current.attempt++;
+              reruns++;
+              launch(validated, tasks[validated - 1].next);
               break;
             }
+            if(!current.has_result) break;
+            if(current.error_code) {
+              ret |= set_error(current.error_code, current.error_msg);
+            }
+            store_outputs(outputs, validated, std::move(current.outputs));
+            validated++;
           }
 
-
-          //push search_requests to fill workers
+          //speculatively start later tasks with predicted options to fill workers
           while(outstanding < task_manager.num_workers() && next_task < outputs.size()) {
-            request_t request{next_task, new_options};
-            task_manager.push(request);
-            outstanding++;
+            launch(next_task, predict(tasks, next_task));
             next_task++;
           }
 
@@ -261,7 +278,9 @@ public:
   }
 
   pressio_options get_metrics_results_impl() const override {
-    return compressor->get_metrics_results();
+    pressio_options results = compressor->get_metrics_results();
+    set(results, "many_dependent:reruns", reruns);
+    return results;
   }
 
   std::shared_ptr<libpressio_compressor_plugin> clone() override
@@ -270,6 +289,166 @@ public:
   }
 
 private:
+  using request_t = std::tuple<int, int, pressio_options>; //index, attempt, options
+  using response_t = std::tuple<int, int, pressio_options, std::vector<pressio_data>, int, std::string>; //index, attempt, metrics, compressed, error code, error_message
+
+  /**
+   * what the master knows about one task while speculating
+   */
+  struct task_state {
+    /** incremented each time the task is re-run so that results from older launches are ignored */
+    int attempt = 0;
+    /** the options the latest attempt was launched with */
+    pressio_options launched;
+    /** true if the latest attempt has finished */
+    bool has_result = false;
+    /** the options the latest attempt implies for the following task */
+    pressio_options next;
+    std::vector<pressio_data> outputs;
+    int error_code = 0;
+    std::string error_msg;
+  };
+
+  response_t run_task(request_t request, compat::span<const pressio_data* const> const& inputs, compat::span<pressio_data*>& outputs, distributed::queue::TaskManager<request_t, MPI_Comm>& task_manager) {
+    std::vector<pressio_data> output_data;
+    auto index = std::get<0>(request);
+    auto attempt = std::get<1>(request);
+    auto request_options = std::move(std::get<2>(request));
+    request_options.set(compressor->get_name(), "distributed:mpi_comm", 
+        userdata(
+          (void*)new MPI_Comm(*task_manager.get_subcommunicator()),
+          nullptr,
+          newdelete_deleter<MPI_Comm>(),
+          newdelete_copy<MPI_Comm>()
+          ));
+
+    if(compressor->set_options(request_options)) {
+      return response_t{index, attempt, pressio_options{}, output_data, compressor->error_code(), compressor->error_msg()};
+    }
+    auto input_data_ptrs = subgroups.get_input_group(inputs, index);
+    auto output_data_ptrs = subgroups.get_output_group(outputs, index);
+    if(compressor->compress_many(
+          input_data_ptrs.data(),
+          input_data_ptrs.data() + input_data_ptrs.size(),
+          output_data_ptrs.data(),
+          output_data_ptrs.data() + output_data_ptrs.size()
+          )) {
+      for (auto& i : output_data_ptrs) {
+        output_data.emplace_back(std::move(*i));
+      }
+      
+      return response_t{index, attempt, pressio_options{}, output_data, compressor->error_code(), compressor->error_msg()};
+    }
+
+    for (auto& i : output_data_ptrs) {
+      output_data.emplace_back(std::move(*i));
+    }
+
+    pressio_options metrics_results = compressor->get_metrics_results();
+    int error_code = compressor->error_code();
+    std::string error_msg = compressor->error_msg();
+
+    pressio_options new_options;
+    for (size_t i = 0; i < to_names.size(); ++i) {
+      auto option_it = metrics_results.find(from_names[i]);
+      if(option_it != metrics_results.end()){
+        new_options.set(from_names[i], option_it->second);
+      } else {
+        error_code = 3;
+        error_msg = std::string("invalid option in from_names: ") + from_names[i];
+        break;
+      }
+    }
+
+    return response_t{index, attempt, std::move(new_options), output_data, error_code, error_msg};
+  }
+
+  void store_outputs(compat::span<pressio_data*>& outputs, size_t index, std::vector<pressio_data>&& output_data) {
+    size_t out_idx=0;
+    for (size_t i =0; i < subgroups.effective_output_groups().size() && out_idx < output_data.size(); ++i) {
+      if(subgroups.effective_output_groups()[i] == static_cast<int>(index)) {
+        *outputs[i] = std::move(output_data[out_idx++]);
+      }
+    }
+  }
+
+  /**
+   * maps the metrics returned by a task to the options for the following task
+   * \returns the first missing name in from_names or an empty string
+   */
+  std::string next_options(pressio_options const& metrics, pressio_options& new_options) const {
+    for (size_t i = 0; i < to_names.size(); ++i) {
+      auto option_it = metrics.find(from_names[i]);
+      if(option_it != metrics.end()){
+        new_options.set(to_names[i], option_it->second);
+      } else {
+        return from_names[i];
+      }
+    }
+    return "";
+  }
+
+  /**
+   * the current values of to_names on the compressor, used before any task has finished
+   */
+  pressio_options baseline_options() const {
+    pressio_options current = compressor->get_options(), options;
+    for (auto const& name : to_names) {
+      auto option_it = current.find(name);
+      if(option_it != current.end() && option_it->second.has_value()) {
+        options.set(name, option_it->second);
+      }
+    }
+    return options;
+  }
+
+  /**
+   * \returns true if a task launched with launched would have been launched with actual if its predecessor
+   * had finished first; numeric options only need to be within the relative tolerance
+   */
+  bool matches(pressio_options const& launched, pressio_options const& actual) const {
+    for (auto const& option : actual) {
+      auto launched_it = launched.find(option.first);
+      if(launched_it == launched.end()) return false;
+      auto expected = option.second.as(pressio_option_double_type, pressio_conversion_implicit);
+      auto used = launched_it->second.as(pressio_option_double_type, pressio_conversion_implicit);
+      if(expected.has_value() && used.has_value()) {
+        double e = expected.get_value<double>(), u = used.get_value<double>();
+        if(std::abs(e - u) > tolerance * std::max(std::abs(e), std::abs(u))) return false;
+      } else if(!(option.second == launched_it->second)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * predicts the options for task i from the most recent results available
+   */
+  pressio_options predict(std::vector<task_state> const& tasks, size_t i) const {
+    std::vector<size_t> known;
+    for (size_t j = i; j-- > 0 && known.size() < 2;) {
+      if(tasks[j].has_result) known.push_back(j);
+    }
+    if(known.empty()) return baseline;
+    pressio_options predicted = tasks[known.front()].next;
+    if(predictor != "linear" || known.size() < 2) return predicted;
+
+    //result k gives the options of task k+1; extend the trend of the last two to task i
+    const size_t k = known[0], j = known[1];
+    for (auto& option : predicted) {
+      auto older_it = tasks[j].next.find(option.first);
+      if(older_it == tasks[j].next.end()) continue;
+      auto newer = option.second.as(pressio_option_double_type, pressio_conversion_implicit);
+      auto older = older_it->second.as(pressio_option_double_type, pressio_conversion_implicit);
+      if(!newer.has_value() || !older.has_value()) continue;
+      double b = newer.get_value<double>(), a = older.get_value<double>();
+      double extrapolated = b + (b - a) * static_cast<double>(i - (k + 1)) / static_cast<double>(k - j);
+      option.second.cast_set(pressio_option(extrapolated), pressio_conversion_explicit);
+    }
+    return predicted;
+  }
+
   std::vector<std::string> from_names;
   std::vector<std::string> to_names;
 
@@ -281,6 +460,11 @@ private:
 
   pressio_compressor compressor = compressor_plugins().build("noop");
   std::string compressor_id = "noop";
+  int speculate = 0;
+  double tolerance = 0.0;
+  std::string predictor = "last";
+  pressio_options baseline;
+  unsigned int reruns = 0;
 };
 
 static pressio_register
@@ -13,6 +13,8 @@
 #include <libpressio_ext/cpp/distributed_manager.h>
 #include <libpressio_ext/cpp/serializable.h>
 #include <libpressio_ext/cpp/subgroup_manager.h>
+#include <algorithm>
+#include <map>
 #include <memory>
 #include <numeric>
 #include <random>
@@ -29,6 +31,9 @@ public:
     struct pressio_options options;
     set_meta(options, "many_independent:compressor", compressor_id, compressor);
     set(options, "many_independent:bcast_outputs", bcast_outputs);
+    set(options, "many_independent:order", order);
+    set(options, "many_independent:chunk_size", chunk_size);
+    set(options, "many_independent:reissue", reissue);
     options.copy_from(manager.get_options());
     options.copy_from(subgroups.get_options());
     return options;
@@ -39,6 +44,14 @@ public:
     struct pressio_options options;
     set_meta_docs(options, "many_independent:compressor", "compressor to parallelize using MPI", compressor);
     set(options, "many_independent:bcast_outputs", "true if all ranks have the same outputs otherwise just the root has the outputs");
+    set(options, "many_independent:order", R"(the order in which groups of buffers are handed to workers
+      + index -- in order of the group index
+      + largest_first -- in decreasing order of the total size of the group's inputs, so that the most expensive groups start first
+        and small groups fill in the gaps at the end)");
+    set(options, "many_independent:chunk_size", "the number of groups of buffers sent to a worker in each request; larger values reduce the number of messages, and give each worker its next groups before it finishes the current one");
+    set(options, "many_independent:reissue", R"(the maximum number of extra copies of an unfinished request that are sent to idle workers once
+      there are fewer unfinished requests than workers; the first result for each request is kept and the queue is stopped once every
+      request has a result, so a request on a slow rank does not set the wall time)");
     set(options, "pressio:description", R"(Uses MPI to compress multiple buffers in parallel)");
     options.copy_from(manager.get_documentation());
     options.copy_from(subgroups.get_documentation());
@@ -51,10 +64,11 @@ public:
     set_meta_configuration(options, "many_independent:compressor", compressor_plugins(), compressor);
     set(options, "pressio:thread_safe", pressio_thread_safety_multiple);
     set(options, "pressio:stability", "experimental");
+    set(options, "many_independent:order", std::vector<std::string>{"index", "largest_first"});
     options.copy_from(manager.get_configuration());
     options.copy_from(subgroups.get_configuration());
     
-        std::vector<std::string> invalidations {"many_independent:bcast_outputs"}; 
+        std::vector<std::string> invalidations {"many_independent:bcast_outputs", "many_independent:order", "many_independent:chunk_size", "many_independent:reissue"}; 
         std::vector<pressio_configurable const*> invalidation_children {&*compressor}; 
         
         set(options, "predictors:error_dependent", get_accumulate_configuration("predictors:error_dependent", invalidation_children, {}));
@@ -70,6 +84,16 @@ public:
 
     get_meta(options, "many_independent:compressor", compressor_plugins(), compressor_id, compressor);
     get(options, "many_independent:bcast_outputs", &bcast_outputs);
+    std::string tmp_order;
+    if(get(options, "many_independent:order", &tmp_order) == pressio_options_key_set) {
+      if(tmp_order != "index" && tmp_order != "largest_first") {
+        return set_error(1, "unsupported many_independent:order " + tmp_order);
+      }
+      order = tmp_order;
+    }
+    get(options, "many_independent:chunk_size", &chunk_size);
+    chunk_size = std::max(1u, chunk_size);
+    get(options, "many_independent:reissue", &reissue);
     manager.set_options(options);
     subgroups.set_options(options);
     return 0;
@@ -148,24 +172,47 @@ private:
   template <class Action>
   int common_many_impl(compat::span<const pressio_data* const> const& inputs, compat::span<pressio_data*> & outputs, Action&& action)
   {
-    using request_t = std::tuple<int>; //group_idx
-    using response_t = std::tuple<int, int, std::vector<pressio_data>, std::string>; //group_idx, status, data, err_msg
+    using request_t = std::tuple<int, std::vector<int>>; //request_idx, group_idxs
+    using response_t = std::tuple<int, int, std::vector<pressio_data>, std::string>; //request_idx, status, data, err_msg
+    using distributed::queue::TaskManager;
 
     if(subgroups.normalize_and_validate(inputs, outputs)) {
       return set_error(subgroups.error_code(), subgroups.error_msg());
     }
 
-    auto indicies = std::set<request_t>(std::begin(subgroups.effective_input_groups()),
-    std::end(subgroups.effective_input_groups()));
+    //order the groups and split them into requests
+    auto const& input_groups = subgroups.effective_input_groups();
+    std::vector<int> groups(std::begin(input_groups), std::end(input_groups));
+    std::sort(groups.begin(), groups.end());
+    groups.erase(std::unique(groups.begin(), groups.end()), groups.end());
+    if(order == "largest_first") {
+      std::map<int, size_t> group_bytes;
+      for (size_t i = 0; i < inputs.size(); ++i) {
+        group_bytes[input_groups[i]] += inputs[i]->size_in_bytes();
+      }
+      std::stable_sort(groups.begin(), groups.end(), [&group_bytes](int lhs, int rhs) {
+          return group_bytes[lhs] > group_bytes[rhs];
+      });
+    }
+    std::vector<request_t> requests;
+    for (size_t i = 0; i < groups.size(); i += chunk_size) {
+      auto last = std::min(groups.size(), i + chunk_size);
+      requests.emplace_back(static_cast<int>(requests.size()), std::vector<int>(groups.begin() + i, groups.begin() + last));
+    }
+    std::vector<char> finished(requests.size(), 0);
+    std::vector<unsigned int> copies(requests.size(), 1);
+    size_t n_finished = 0;
 
     int status = 0;
     status = manager.work_queue(
-        std::begin(indicies), std::end(indicies),
-        [this, &inputs, &outputs, &action](request_t request, distributed::queue::TaskManager<request_t, MPI_Comm>& task_manager) {
-          //setup the work groups
-          int idx = std::get<0>(request);
-          auto input_data = subgroups.get_input_group(inputs, idx);
-          auto output_data_ptrs = subgroups.get_output_group(outputs, idx);
+        std::begin(requests), std::end(requests),
+        [this, &inputs, &outputs, &action](request_t request, TaskManager<request_t, MPI_Comm>& task_manager) {
+          int request_idx = std::get<0>(request);
+          std::vector<pressio_data> output_data;
+          if(task_manager.stop_requested()) {
+            //every request already has a result, this is a late copy
+            return response_t{request_idx, 0, std::move(output_data), ""};
+          }
 
           pressio_options sub_options;
           sub_options.set(compressor->get_name(),
@@ -179,39 +226,75 @@ private:
             );
           compressor->set_options(sub_options);
 
-          //run the action: either compression or decompression
-          int status = action(
-              input_data.data(),
-              input_data.data() + input_data.size(),
-              output_data_ptrs.data(),
-              output_data_ptrs.data() + output_data_ptrs.size()
-              );
-
+          int status = 0;
+          std::string err_msg;
+          for (int idx : std::get<1>(request)) {
+            //setup the work groups
+            auto input_data = subgroups.get_input_group(inputs, idx);
+            auto output_data_ptrs = subgroups.get_output_group(outputs, idx);
+
+            //run the action: either compression or decompression
+            int group_status = action(
+                input_data.data(),
+                input_data.data() + input_data.size(),
+                output_data_ptrs.data(),
+                output_data_ptrs.data() + output_data_ptrs.size()
+                );
+            if(group_status) {
+              status = group_status;
+              err_msg = compressor->error_msg();
+            }
+            if(group_status > 0) break;
 
-          //move the compressed buffers to the response to be transferred
-          std::vector<pressio_data> output_data;
-          output_data.reserve(output_data_ptrs.size());
-          for (auto output_data_ptr : output_data_ptrs) {
-            output_data.emplace_back(std::move(*output_data_ptr));
+            //move the compressed buffers to the response to be transferred
+            for (auto output_data_ptr : output_data_ptrs) {
+              output_data.emplace_back(std::move(*output_data_ptr));
+            }
           }
 
-
-          return response_t{idx, status, std::move(output_data), compressor->error_msg()};
+          return response_t{request_idx, status, std::move(output_data), err_msg};
         },
-        [&outputs,&status, this](response_t response) {
-          //retrive data and errors
-          int idx = std::get<0>(response);
-          status |= std::get<1>(response);
-          if(std::get<1>(response)) {
-            set_error(std::get<1>(response), std::get<3>(response));
+        [&outputs, &status, &requests, &finished, &copies, &n_finished, this](response_t response, TaskManager<request_t, MPI_Comm>& task_manager) {
+          //keep only the first result for each request
+          int request_idx = std::get<0>(response);
+          if(!finished[request_idx]) {
+            finished[request_idx] = 1;
+            n_finished++;
+
+            //retrive data and errors
+            status |= std::get<1>(response);
+            if(std::get<1>(response)) {
+              set_error(std::get<1>(response), std::get<3>(response));
+            }
+
+            //store the output into the appropriate buffers
+            auto output_data = std::move(std::get<2>(response));
+            size_t out_idx=0;
+            for (int idx : std::get<1>(requests[request_idx])) {
+              for (size_t i =0; i < subgroups.effective_output_groups().size() && out_idx < output_data.size(); ++i) {
+                if(subgroups.effective_output_groups()[i] == idx) {
+                  *outputs[i] = std::move(output_data[out_idx++]);
+                }
+              }
+            }
+          }
+
+          if(n_finished == requests.size()) {
+            task_manager.request_stop();
+            return;
           }
 
-          //store the output into the appropriate buffers
-          auto output_data = std::move(std::get<2>(response));
-          size_t out_idx=0;
-          for (size_t i =0; i < subgroups.effective_output_groups().size(); ++i) {
-            if(subgroups.effective_output_groups()[i] == idx) {
-              *outputs[i] = std::move(output_data[out_idx++]);
+          //a worker is now idle; if nothing new is waiting, give it a copy of the least copied unfinished request
+          if(reissue && requests.size() - n_finished < task_manager.num_workers()) {
+            size_t best = requests.size();
+            for (size_t i = 0; i < requests.size(); ++i) {
+              if(!finished[i] && copies[i] <= reissue && (best == requests.size() || copies[i] < copies[best])) {
+                best = i;
+              }
+            }
+            if(best != requests.size()) {
+              copies[best]++;
+              task_manager.push(requests[best]);
             }
           }
         });
@@ -231,6 +314,9 @@ private:
   pressio_compressor compressor = compressor_plugins().build("noop");
   std::string compressor_id = "noop";
   int bcast_outputs = 1;
+  std::string order = "index";
+  unsigned int chunk_size = 1;
+  unsigned int reissue = 0;
 };
 
 static pressio_register compressor_many_fields_plugin(compressor_plugins(), "many_independent", []() {
@@ -8,7 +8,11 @@
 #include "pressio_options.h"
 #include <cstddef>
 #include <libpressio_ext/cpp/subgroup_manager.h>
+#include <libpressio_ext/cpp/task_runtime.h>
+#include "compressor_pool.h"
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <random>
 #include <vector>
@@ -66,11 +70,14 @@ for (auto const& child : compressors) {
     set_meta_many_docs(options, "many_independent_threaded:compressors", "the child compressor(s) to use", compressors);
     set(options, "many_independent_threaded:compressor", "the child compressor to use; if many_independent_threaded:compressors is set, this value is ignored");
     options.copy_from(subgroups.get_documentation());
-    set(options, "pressio:description", R"(Uses OpenMP to compress multiple buffers in parallel
+    set(options, "pressio:description", R"(Compresses multiple buffers in parallel using the shared task runtime
 
     On each invocation a key called "many_independent_threaded:idx" with a type of uint64_t is set with the index of the compressor
+
+    Each task slot clones the child compressor(s) on first use and reuses the clones for later buffers and calls;
+    the clones are discarded whenever options are set on this compressor.
     )");
-    set(options, "many_independent_threaded:nthreads", R"(number of threads to use for compression)");
+    set(options, "many_independent_threaded:nthreads", R"(maximum number of buffers to compress at once; threads are drawn from the budget of the shared task runtime)");
     set(options, "many_independent_threaded:collect_metrics_on_compression", R"(collect metrics after compression)");
     set(options, "many_independent_threaded:collect_metrics_on_decompression", R"(collect metrics after decompression)");
     set(options, "many_independent_threaded:preserve_metrics", R"(preserve metrics after compression, and restore them before decompression)");
@@ -81,6 +88,7 @@ for (auto const& child : compressors) {
   int set_options_impl(struct pressio_options const& options) override
   {
     pressio_data tmp;
+    pool.clear();
 
     get_meta_many(options, "many_independent_threaded:compressors", compressor_plugins(), compressor_ids, compressors);
     if(options.key_status(get_name(), "many_independent_threaded:compressor") == pressio_options_key_set) {
@@ -174,6 +182,7 @@ for (auto const& child : compressors) {
   const char* prefix() const override { return "many_independent_threaded"; }
 
   void set_name_impl(std::string const& name) override {
+    pool.clear();
     set_names_many(name, compressors, compressor_ids);
     subgroups.set_name(name);
   }
@@ -217,26 +226,24 @@ private:
     }
 
     pressio_options tmp_metrics_results;
+    std::mutex results_lock;
+    std::atomic<bool> failed{false};
+    pool.reserve(nthreads, compressors.size());
 
-#pragma omp parallel num_threads(nthreads)
-#pragma omp for schedule(dynamic)
-    for (uint64_t idx = 0; idx < static_cast<uint64_t>(indicies_vec.size()); ++idx) {
+    pressio_task_runtime::instance().parallel_for(indicies_vec.size(), nthreads, [&](size_t idx, uint32_t slot) {
+      if(failed) return;
       auto input_data = subgroups.get_input_group(inputs, indicies_vec[idx]);
       auto output_data_ptrs = subgroups.get_output_group(outputs, indicies_vec[idx]);
-      pressio_compressor thread_local_compressor;
-
-      if(compressors.size() == 1) {
-        thread_local_compressor = compressors[0]->clone();
-      } else {
-        thread_local_compressor = compressors[idx]->clone();
-      }
+      const size_t child = (compressors.size() == 1) ? 0 : idx;
+      pressio_compressor& thread_local_compressor = pool.get(slot, child, compressors[child]);
 
       if(metrics_action == MetricsAction::Restore) {
-        thread_local_compressor->set_metrics(std::move(preserve_metrics_mem.at(idx)));
+        //copy so the archive stays valid for later calls and copies of this plugin
+        thread_local_compressor->set_metrics(preserve_metrics_mem.at(idx));
       }
 
       pressio_options per_invoke_opts;
-      set(per_invoke_opts, "many_independent_threaded:idx", idx);
+      set(per_invoke_opts, "many_independent_threaded:idx", static_cast<uint64_t>(idx));
       thread_local_compressor->set_options(per_invoke_opts);
 
       //run the action: either compression or decompression
@@ -249,25 +256,22 @@ private:
           );
 
       if(collect_metrics) {
-#pragma omp critical
-        {
-          tmp_metrics_results.copy_from(thread_local_compressor->get_metrics_results(), /*ignore_empty*/true);
-        }
+        std::lock_guard<std::mutex> guard(results_lock);
+        tmp_metrics_results.copy_from(thread_local_compressor->get_metrics_results(), /*ignore_empty*/true);
       }
 
       if(metrics_action == MetricsAction::Archive) {
-        preserve_metrics_mem.at(idx) = std::move(*thread_local_compressor).get_metrics();
+        //copy rather than move so the pooled compressor keeps a metrics object for its next use
+        preserve_metrics_mem.at(idx) = thread_local_compressor->get_metrics();
       }
 
       if(local_status) {
-#pragma omp critical
-        {
-          set_error(thread_local_compressor->error_code(), thread_local_compressor->error_msg());
-          status = local_status;
-        }
-#pragma omp cancel for
+        std::lock_guard<std::mutex> guard(results_lock);
+        set_error(thread_local_compressor->error_code(), thread_local_compressor->error_msg());
+        status = local_status;
+        failed = true;
       }
-    }
+    });
 
     if(collect_metrics) {
       metrics_results.copy_from(tmp_metrics_results);
@@ -278,6 +282,7 @@ private:
   }
 
   pressio_subgroup_manager subgroups;
+  compressor_pool pool;
   pressio_options metrics_results;
   std::vector<pressio_metrics> preserve_metrics_mem;
   std::vector<std::string> compressor_ids{"noop"};
@@ -1,18 +1,327 @@
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <numeric>
 #include "std_compat/memory.h"
+#include "std_compat/functional.h"
 #include "libpressio_ext/cpp/compressor.h"
 #include "libpressio_ext/cpp/data.h"
 #include "libpressio_ext/cpp/options.h"
 #include "libpressio_ext/cpp/pressio.h"
+#include "libpressio_ext/cpp/task_runtime.h"
+#include "elementwise_transform.h"
 
 namespace libpressio { namespace pipeline_ns {
 
+/**
+ * the type and dimensions of the input to a stage
+ */
+struct stage_info {
+  pressio_dtype dtype;
+  std::vector<size_t> dims;
+};
+
+/**
+ * the two buffers that stage outputs alternate between
+ *
+ * the pipeline only keeps two intermediates alive at a time and reuses their memory across the stages of a call.
+ * A buffer is only written in place when the pipeline allocated it and every stage it was handed to wrote into it
+ * without replacing its data pointer; stages are assumed not to keep views of their buffers after they return.
+ * Copies start empty.
+ */
+class ping_pong_buffers {
+  public:
+  ping_pong_buffers()=default;
+  ping_pong_buffers(ping_pong_buffers const&) {}
+  ping_pong_buffers& operator=(ping_pong_buffers const&) {
+    return *this;
+  }
+
+  /**
+   * \returns buffer i with the type and dimensions requested
+   */
+  pressio_data* prepare(size_t i, pressio_dtype dtype, std::vector<size_t> const& dims) {
+    pressio_data& buffer = buffers[i % 2];
+    const size_t size = std::accumulate(dims.begin(), dims.end(), static_cast<size_t>(pressio_dtype_size(dtype)), compat::multiplies<>{});
+    if(owned[i % 2] && buffer.capacity_in_bytes() >= size) {
+      buffer.set_dtype(dtype);
+      buffer.set_dimensions(std::vector<size_t>(dims));
+    } else {
+      buffer = pressio_data::owning(dtype, dims);
+      owned[i % 2] = true;
+    }
+    return &buffer;
+  }
+
+  /**
+   * \returns buffer i to be passed to a stage as its output
+   */
+  pressio_data* get(size_t i) {
+    return &buffers[i % 2];
+  }
+
+  /**
+   * called before buffer is passed to a stage as its output; does nothing if it is not one of the two buffers
+   */
+  void lend(pressio_data const* buffer) {
+    for (size_t i = 0; i < buffers.size(); ++i) {
+      if(buffer == &buffers[i]) lent[i] = buffers[i].data();
+    }
+  }
+
+  /**
+   * called after the stage that buffer was lent to returns; keeps ownership only if the stage wrote in place
+   */
+  void reclaim(pressio_data const* buffer) {
+    for (size_t i = 0; i < buffers.size(); ++i) {
+      if(buffer == &buffers[i]) owned[i] = owned[i] && buffers[i].data() == lent[i];
+    }
+  }
+
+  /**
+   * frees both buffers so intermediates are not kept alive between calls
+   */
+  void release() {
+    for (auto& buffer : buffers) buffer = pressio_data();
+    owned.fill(false);
+  }
+
+  private:
+  std::array<pressio_data, 2> buffers;
+  std::array<bool, 2> owned{{false, false}};
+  std::array<void const*, 2> lent{{nullptr, nullptr}};
+};
+
+/**
+ * the number of elements each fused transform processes at a time; small enough that the intermediates stay in cache
+ */
+constexpr size_t fused_block_size = 4096;
+
+/**
+ * applies a sequence of transforms to n elements a block at a time
+ *
+ * \param[in] transforms the transforms to apply in order
+ * \param[in] types the type of the input followed by the output type of each transform
+ */
+void run_fused(std::vector<std::unique_ptr<elementwise::block_transform>> const& transforms, std::vector<pressio_dtype> const& types,
+    void const* in, void* out, size_t n) {
+  const size_t in_size = pressio_dtype_size(types.front());
+  const size_t out_size = pressio_dtype_size(types.back());
+  std::array<std::vector<uint64_t>, 2> scratch;
+  for (auto& s : scratch) {
+    s.resize(fused_block_size);
+  }
+  for (size_t begin = 0; begin < n; begin += fused_block_size) {
+    const size_t len = std::min(fused_block_size, n - begin);
+    void const* src = static_cast<uint8_t const*>(in) + begin * in_size;
+    for (size_t t = 0; t < transforms.size(); ++t) {
+      void* dst = (t + 1 == transforms.size()) ? static_cast<void*>(static_cast<uint8_t*>(out) + begin * out_size) : static_cast<void*>(scratch[t % 2].data());
+      transforms[t]->apply(src, dst, len);
+      src = dst;
+    }
+  }
+}
+
+/*
+ *   |--------------------------------|
+ *   | uint64_t format_id   =1        |
+ *   | int64_t num_metadata          |
+ *   |--------------------------------|
+ *   | struct stage_dims {            |
+ *   | uint64_t num_dim               |
+ *   | uint64_t(pressio_dtype) type   |
+ *   | uint64_t[num_dim] dim          |
+ *   | }[num_metadata];               |
+ *   |--------------------------------|
+ *   | compressed data                |
+ *   |--------------------------------|
+ */
+size_t stage_header_size(std::vector<stage_info> const& stages) {
+  size_t header_size = 2*sizeof(uint64_t); /*format_id, num_metadata*/
+  for (auto const& stage : stages) {
+    header_size += (
+        sizeof(uint64_t)+                         /*num_dim*/
+        sizeof(uint64_t)+                         /*type*/
+        sizeof(uint64_t)* stage.dims.size()       /*dim*/
+    ); /*stage_dims*/
+  }
+  return header_size;
+}
+
+void write_stage_header(uint64_t* metadata_ptr, std::vector<stage_info> const& stages) {
+  metadata_ptr[0] = 1; /*version*/
+
+  //bit_cast to int64_t
+  const uint64_t num_metadata = stages.size();
+  memcpy(&metadata_ptr[1], &num_metadata, sizeof(int64_t));
+
+  size_t output_idx = 2;
+  for (auto const& m : stages) {
+    metadata_ptr[output_idx++] = m.dims.size(); /*num_dims*/
+    metadata_ptr[output_idx++] = static_cast<uint64_t>(m.dtype); /*type*/
+    for (size_t i = 0; i < m.dims.size(); ++i) {
+      metadata_ptr[output_idx++] = m.dims[i]; /*dim*/
+    }
+  }
+}
+
+/**
+ * reads the stages of a version 1 container
+ *
+ * \returns false if the header does not fit in size_in_bytes
+ */
+bool read_stage_header(uint8_t const* ptr, size_t size_in_bytes, std::vector<stage_info>& stages, size_t& header_size) {
+  const size_t words = size_in_bytes / sizeof(uint64_t);
+  auto word = [ptr](size_t i) {
+    uint64_t value;
+    memcpy(&value, ptr + i*sizeof(uint64_t), sizeof(uint64_t));
+    return value;
+  };
+  size_t idx = 1; /*format_id*/
+  if(words < 2) return false;
+  const uint64_t num_metadata = word(idx++);
+  stages.clear();
+  for (uint64_t i = 0; i < num_metadata; ++i) {
+    if(idx + 2 > words) return false;
+    const uint64_t num_dims = word(idx++);
+    const pressio_dtype dtype = static_cast<pressio_dtype>(word(idx++));
+    if(num_dims > words - idx) return false;
+    std::vector<size_t> dims(num_dims);
+    for (size_t d = 0; d < num_dims; ++d) {
+      dims[d] = word(idx++);
+    }
+    stages.push_back({dtype, std::move(dims)});
+  }
+  header_size = idx * sizeof(uint64_t);
+  return true;
+}
+
+/**
+ * a chunk moving through the stages of a streaming pipeline
+ */
+struct stream_item {
+  size_t chunk = 0;
+  pressio_data data;
+  std::vector<stage_info> stages;
+};
+
+struct stream_status {
+  int ec = 0;
+  size_t stage = 0;
+  std::string msg;
+};
+
+/**
+ * runs nstages stages over nitems items on the shared task runtime
+ *
+ * each stage processes one item at a time in order and at most queue_size items wait between two stages, so
+ * stage k of item i overlaps with stage k+1 of item i-1.  Participants are tasks of a pressio_task_group: each
+ * claims a ready stage, preferring later stages, and queues another participant while further stages are ready
+ * and fewer than min(nstages + 1, budget) are running.  A participant that finds nothing ready returns instead
+ * of waiting; whichever participant is still running picks up the work its stage makes ready.  Participants
+ * therefore never block, so stages may themselves use the runtime.
+ * source(i, item) initializes item i as part of the first stage; stage(k, item) returns a libpressio error code;
+ * sink(item) receives finished items in order, one at a time.  The first positive error code stops every stage.
+ */
+template <class Source, class Stage, class Sink>
+stream_status run_stream(size_t nitems, size_t nstages, size_t queue_size, Source&& source, Stage&& stage, Sink&& sink) {
+  const size_t capacity = std::max<size_t>(1, queue_size);
+  const size_t max_running = std::max<size_t>(1, std::min<size_t>(nstages + 1, pressio_task_runtime::instance().budget()));
+  //queues[k] holds the items finished by stage k; stage nstages is the sink
+  std::vector<std::deque<stream_item>> queues(nstages);
+  std::vector<char> busy(nstages + 1, 0);
+  size_t next = 0, finished = 0, running = 0;
+  std::mutex lock;
+  stream_status status;
+  pressio_task_group group;
+
+  auto ready = [&](size_t k) {
+    if(busy[k]) return false;
+    if(k == nstages) return !queues[k-1].empty();
+    const bool has_input = (k == 0) ? next < nitems : !queues[k-1].empty();
+    return has_input && queues[k].size() < capacity;
+  };
+  //the latest ready stage, or nstages + 1 if none is ready
+  auto find_ready = [&]() {
+    for (size_t j = nstages + 1; j-- > 0;) {
+      if(ready(j)) return j;
+    }
+    return nstages + 1;
+  };
+
+  std::function<void()> participant = [&]() {
+    std::unique_lock<std::mutex> guard(lock);
+    while(true) {
+      const size_t k = (finished < nitems && status.ec <= 0) ? find_ready() : nstages + 1;
+      if(k > nstages) {
+        running--;
+        return;
+      }
+      busy[k] = 1;
+      stream_item item;
+      if(k == 0) {
+        item.chunk = next++;
+      } else {
+        item = std::move(queues[k-1].front());
+        queues[k-1].pop_front();
+      }
+      if(running < max_running && find_ready() <= nstages) {
+        running++;
+        group.run(participant);
+      }
+      guard.unlock();
+
+      int ec = 0;
+      std::string msg;
+      try {
+        if(k == 0) source(item.chunk, item);
+        if(k < nstages) {
+          ec = stage(k, item);
+        } else {
+          sink(item);
+        }
+      } catch(std::exception const& ex) {
+        ec = 1;
+        msg = ex.what();
+      }
+
+      guard.lock();
+      busy[k] = 0;
+      if(ec > 0) {
+        if(status.ec <= 0) status = stream_status{ec, k, std::move(msg)};
+      } else {
+        if(ec < 0 && status.ec == 0) status = stream_status{ec, k, ""};
+        if(k < nstages) {
+          queues[k].emplace_back(std::move(item));
+        } else {
+          ++finished;
+        }
+      }
+    }
+  };
+
+  running = 1;
+  group.run(participant);
+  group.wait();
+  return status;
+}
+
 class pipeline_compressor_plugin : public libpressio_compressor_plugin {
 public:
   struct pressio_options get_options_impl() const override
   {
     struct pressio_options options;
     set_meta_many(options, "pipeline:pipeline", ids, plugins);
+    set(options, "pipeline:fuse", fuse);
+    set(options, "pipeline:stream", stream);
+    set(options, "pipeline:stream_chunk_bytes", stream_chunk_bytes);
+    set(options, "pipeline:stream_queue_size", stream_queue_size);
     return options;
   }
 
@@ -26,7 +335,7 @@ public:
     std::vector<pressio_configurable const*> invalidation_children {}; 
     set(options, "predictors:error_dependent", get_accumulate_configuration("predictors:error_dependent", invalidation_children, invalidations));
     set(options, "predictors:error_agnostic", get_accumulate_configuration("predictors:error_agnostic", invalidation_children, invalidations));
-    set(options, "predictors:runtime", get_accumulate_configuration("predictors:runtime", invalidation_children, invalidations));
+    set(options, "predictors:runtime", get_accumulate_configuration("predictors:runtime", invalidation_children, std::vector<std::string>{"pipeline:fuse", "pipeline:stream", "pipeline:stream_chunk_bytes", "pipeline:stream_queue_size"}));
     set(options, "pressio:highlevel", get_accumulate_configuration("pressio:highlevel", invalidation_children, std::vector<std::string>{}));
     return options;
   }
@@ -36,7 +345,21 @@ public:
     struct pressio_options options;
     set_meta_many_docs(options, "pipeline:pipeline", "series of plugins to invoke", plugins);
     set(options, "pipeline:names", "pipeline element names");
-    set(options, "pressio:description", R"(invoke a series of compressors in a pipeline)");
+    set(options, "pipeline:fuse", R"(when true, runs of two or more adjacent delta_encoding, linear_quantizer, and log_transform stages
+    whose child compressor is noop are applied in a single pass over the data through cache sized blocks instead of one full pass and
+    allocation per stage; the output is identical, but the fused stages' own compress, decompress, metrics, and view_segment are
+    not invoked, so their metrics are missing from the results.  Defaults to false so that every stage reports its metrics)");
+    set(options, "pipeline:stream", R"(when true, the input is split into chunks along its slowest dimension and the stages run concurrently
+    on the shared task runtime, so stage k compresses chunk i while stage k+1 compresses chunk i-1; stages are connected by bounded queues
+    and at most the runtime's thread budget of stages run at once.  Each chunk is
+    stored as its own pipeline container, so every stage must be able to decompress each chunk independently.  Fusion and view_segment
+    are not used in this mode.  Containers written in this mode are decompressed the same way regardless of this option)");
+    set(options, "pipeline:stream_chunk_bytes", "the target size of each chunk in bytes when pipeline:stream is true; chunks contain at least one slice of the slowest dimension");
+    set(options, "pipeline:stream_queue_size", "the maximum number of chunks waiting between two stages when pipeline:stream is true");
+    set(options, "pressio:description", R"(invoke a series of compressors in a pipeline
+
+    stage outputs alternate between two buffers that are reused by stages that write in place and freed at the end of each call,
+    so at most two intermediates are alive at once)");
     return options;
   }
 
@@ -45,68 +368,78 @@ public:
   {
     get(options, "pipeline:names", &names);
     get_meta_many(options, "pipeline:pipeline", compressor_plugins(), ids, plugins);
+    get(options, "pipeline:fuse", &fuse);
+    get(options, "pipeline:stream", &stream);
+    get(options, "pipeline:stream_chunk_bytes", &stream_chunk_bytes);
+    get(options, "pipeline:stream_queue_size", &stream_queue_size);
     return 0;
   }
 
   int compress_impl(const pressio_data* input,
                     struct pressio_data* output) override
   {
+    if(stream && !plugins.empty() && input->num_dimensions() > 0) {
+      return compress_streaming(input, output);
+    }
     int ec = 0;
-    pressio_data tmp_in = pressio_data::nonowning(input->dtype(), input->data(), input->dimensions());
-    pressio_data tmp_out = pressio_data::empty(pressio_byte_dtype, {});
-    std::vector<pressio_data> metadata;
-
-    /*
-     *   |--------------------------------|
-     *   | uint64_t format_id   =1        |
-     *   | int64_t num_metadata          |
-     *   |--------------------------------|
-     *   | struct stage_dims {            |
-     *   | uint64_t num_dim               |
-     *   | uint64_t(pressio_dtype) type   |
-     *   | uint64_t[num_dim] dim          |
-     *   | }[num_metadata];               |
-     *   |--------------------------------|
-     */
-    uint64_t header_size = 2*sizeof(uint64_t); /*format_id, num_metadata*/
-    size_t idx = 0;
-    for (auto& i : plugins) {
-        this->view_segment(&tmp_in, ("stage-" + std::to_string(idx++)).c_str());
-        ec = i->compress(&tmp_in, &tmp_out);
-        if(ec) {
-            set_error(ec, i->error_msg());
-            if(ec > 0) return ec;
+    pressio_data input_view = pressio_data::nonowning(input->dtype(), input->data(), input->dimensions());
+    pressio_data* tmp_in = &input_view;
+    std::vector<stage_info> metadata;
+    metadata.reserve(plugins.size());
+    size_t buffer = 0;
+    for (size_t idx = 0; idx < plugins.size();) {
+        this->view_segment(tmp_in, ("stage-" + std::to_string(idx)).c_str());
+
+        //find the longest run of fusible stages starting here
+        std::vector<std::unique_ptr<elementwise::block_transform>> encoders;
+        std::vector<pressio_dtype> types{tmp_in->dtype()};
+        std::vector<stage_info> run{{tmp_in->dtype(), tmp_in->dimensions()}};
+        for (size_t j = idx; fuse && j < plugins.size(); ++j) {
+            auto* fusible = dynamic_cast<elementwise::fusible_transform*>(&*plugins[j]);
+            if(!fusible) break;
+            auto encoder = fusible->fused_encoder(run.back().dtype, run.back().dims);
+            if(!encoder) break;
+            encoders.emplace_back(std::move(encoder));
+            types.emplace_back(fusible->fused_output_dtype(run.back().dtype));
+            run.push_back({types.back(), fusible->fused_output_dims(run.back().dims)});
+        }
+
+        if(encoders.size() >= 2) {
+            pressio_data* out = buffers.prepare(buffer++, run.back().dtype, run.back().dims);
+            run_fused(encoders, types, tmp_in->data(), out->data(), tmp_in->num_elements());
+            run.pop_back();
+            idx += encoders.size();
+            tmp_in = out;
+        } else {
+            pressio_data* out = buffers.get(buffer++);
+            buffers.lend(out);
+            ec = plugins[idx]->compress(tmp_in, out);
+            buffers.reclaim(out);
+            if(ec) {
+                set_error(ec, plugins[idx]->error_msg());
+                if(ec > 0) {
+                    buffers.release();
+                    return ec;
+                }
+            }
+            run.resize(1);
+            idx++;
+            tmp_in = out;
+        }
+        for (auto& stage : run) {
+            metadata.emplace_back(std::move(stage));
         }
-        metadata.emplace_back(pressio_data::empty(tmp_in.dtype(), tmp_in.dimensions()));
-        header_size += (
-                sizeof(uint64_t)+                         /*num_dim*/
-                sizeof(uint64_t)+                         /*type*/
-                sizeof(uint64_t)* tmp_in.num_dimensions() /*dim*/
-        ); /*stage_dims*/
-        std::swap(tmp_in, tmp_out);
     }
     //tmp_in now holds the output;
 
+    const size_t header_size = stage_header_size(metadata);
     *output = pressio_data::owning(
             pressio_byte_dtype,
-            {tmp_in.size_in_bytes() + header_size}
+            {tmp_in->size_in_bytes() + header_size}
             );
-    uint64_t* metadata_ptr = static_cast<uint64_t*>(output->data());
-    metadata_ptr[0] = 1; /*version*/
-
-    //bit_cast to int64_t
-    const uint64_t num_metadata =metadata.size();
-    memcpy(&metadata_ptr[1], &num_metadata, sizeof(int64_t));
-
-    size_t output_idx = 2;
-    for (auto const& m : metadata) {
-        metadata_ptr[output_idx++] = m.num_dimensions(); /*num_dims*/
-        metadata_ptr[output_idx++] = static_cast<uint64_t>(m.dtype()); /*type*/
-        for (size_t i = 0; i < m.num_dimensions(); ++i) {
-            metadata_ptr[output_idx++] = m.get_dimension(i); /*dim*/
-        }
-    }
-    memcpy(static_cast<uint8_t*>(output->data()) + header_size, tmp_in.data(), tmp_in.size_in_bytes());
+    write_stage_header(static_cast<uint64_t*>(output->data()), metadata);
+    memcpy(static_cast<uint8_t*>(output->data()) + header_size, tmp_in->data(), tmp_in->size_in_bytes());
+    buffers.release();
 
     return 0;
   }
@@ -115,28 +448,23 @@ public:
                       struct pressio_data* output) override
   {
       //decode metadata
+      if(input->size_in_bytes() < sizeof(uint64_t)) {
+          return set_error(1, "unrecognized header version");
+      }
       const uint64_t* metadata_ptr = static_cast<uint64_t*>(input->data());
-      uint64_t idx = 0;
-      const uint64_t format_id = metadata_ptr[idx++];
-      std::vector<pressio_data> outputs;
+      const uint64_t format_id = metadata_ptr[0];
+      std::vector<stage_info> outputs;
       switch(format_id) {
           case 1:
               {
-                  const int64_t num_metadata = (reinterpret_cast<const int64_t*>(metadata_ptr))[idx++];
-                  for (int64_t i = 0; i < num_metadata; ++i) {
-                      const uint64_t num_dims = metadata_ptr[idx++];
-                      const pressio_dtype dtype = static_cast<pressio_dtype>(metadata_ptr[idx++]);
-                      std::vector<size_t> dims(num_dims);
-                      for (size_t d = 0; d < num_dims; ++d) {
-                          dims[d] = metadata_ptr[idx++];
-                      }
-                      outputs.emplace_back(
-                              pressio_data::empty(
-                                    dtype, dims
-                                  )
-                              );
+                  size_t header_size_in_bytes;
+                  if(!read_stage_header(static_cast<uint8_t const*>(input->data()), input->size_in_bytes(), outputs, header_size_in_bytes)) {
+                      return set_error(2, "invalid pipeline header");
+                  }
+                  const int64_t num_metadata = outputs.size();
+                  if(outputs.size() > plugins.size()) {
+                      return set_error(2, "pipeline has fewer stages than the container");
                   }
-                  const size_t header_size_in_bytes = sizeof(uint64_t)*idx;
                   const size_t data_size_in_bytes = input->size_in_bytes() - header_size_in_bytes;
                   pressio_data tmp_in = pressio_data::nonowning(
                       pressio_byte_dtype,
@@ -148,21 +476,66 @@ public:
                       *output = std::move(tmp_in);
                       return 0;
                   }
-                  for (int64_t i = num_metadata - 1; i >= 0; i--) {
-                      pressio_data tmp_out = pressio_data::owning(outputs[i].dtype(), outputs[i].dimensions());
-                      int ec = plugins[i]->decompress(&tmp_in, &tmp_out);
-                      if(ec) {
-                          set_error(ec, plugins[i]->error_msg());
-                          if(ec > 0) {
-                              return ec;
+                  pressio_data* tmp_in_ptr = &tmp_in;
+                  size_t buffer = 0;
+                  for (int64_t i = num_metadata - 1; i >= 0;) {
+                      //write the final stage directly into the output when it has the right shape
+                      auto stage_output = [&](int64_t stage) {
+                          if(stage == 0 && output->has_data() && output->dtype() == outputs[0].dtype && output->dimensions() == outputs[0].dims) {
+                              return output;
+                          }
+                          return buffers.prepare(buffer++, outputs[stage].dtype, outputs[stage].dims);
+                      };
+
+                      //find the longest run of fusible stages ending here
+                      std::vector<std::unique_ptr<elementwise::block_transform>> decoders;
+                      std::vector<pressio_dtype> types;
+                      for (int64_t j = i; fuse && j >= 0; --j) {
+                          auto* fusible = dynamic_cast<elementwise::fusible_transform*>(&*plugins[j]);
+                          if(!fusible) break;
+                          auto decoder = fusible->fused_decoder(outputs[j].dtype, outputs[j].dims);
+                          if(!decoder) break;
+                          if(types.empty()) types.push_back(fusible->fused_output_dtype(outputs[j].dtype));
+                          decoders.emplace_back(std::move(decoder));
+                          types.push_back(outputs[j].dtype);
+                      }
+
+                      if(decoders.size() >= 2) {
+                          const int64_t last = i - static_cast<int64_t>(decoders.size()) + 1;
+                          const size_t n = std::accumulate(outputs[i].dims.begin(), outputs[i].dims.end(), size_t{1}, compat::multiplies<>{});
+                          if(tmp_in_ptr->size_in_bytes() < n * pressio_dtype_size(types.front())) {
+                              buffers.release();
+                              return set_error(2, "compressed stage is too small");
+                          }
+                          pressio_data* tmp_out = stage_output(last);
+                          run_fused(decoders, types, tmp_in_ptr->data(), tmp_out->data(), n);
+                          tmp_in_ptr = tmp_out;
+                          i = last - 1;
+                      } else {
+                          pressio_data* tmp_out = stage_output(i);
+                          buffers.lend(tmp_out);
+                          int ec = plugins[i]->decompress(tmp_in_ptr, tmp_out);
+                          buffers.reclaim(tmp_out);
+                          if(ec) {
+                              set_error(ec, plugins[i]->error_msg());
+                              if(ec > 0) {
+                                  buffers.release();
+                                  return ec;
+                              }
                           }
+                          tmp_in_ptr = tmp_out;
+                          i--;
                       }
-                      std::swap(tmp_in, tmp_out);
                   }
-                  //now tmp_in has the final data, so move it into place
-                  *output = std::move(tmp_in);
+                  //now tmp_in_ptr has the final data, so move it into place
+                  if(tmp_in_ptr != output) {
+                      *output = std::move(*tmp_in_ptr);
+                  }
+                  buffers.release();
               }
               break;
+          case 2:
+              return decompress_streaming(input, output);
           default:
               return set_error(1, "unrecognized header version");
       }
@@ -192,8 +565,164 @@ public:
     return compat::make_unique<pipeline_compressor_plugin>(*this);
   }
 
+private:
+  /*
+   *   |-------------------------------------|
+   *   | uint64_t format_id   =2             |
+   *   | uint64_t num_chunks                 |
+   *   | uint64_t chunk_size[num_chunks]     |
+   *   |-------------------------------------|
+   *   | version 1 container[num_chunks]     |
+   *   |-------------------------------------|
+   */
+  int compress_streaming(const pressio_data* input, struct pressio_data* output) {
+    auto const& dims = input->dimensions();
+    const size_t slowest = dims.back();
+    const size_t slice_bytes = input->size_in_bytes() / std::max<size_t>(1, slowest);
+    const size_t slices_per_chunk = std::max<size_t>(1, stream_chunk_bytes / std::max<size_t>(1, slice_bytes));
+    const size_t num_chunks = std::max<size_t>(1, (slowest + slices_per_chunk - 1) / slices_per_chunk);
+
+    std::vector<stream_item> chunks(num_chunks);
+    auto status = run_stream(num_chunks, plugins.size(), stream_queue_size,
+        [&](size_t i, stream_item& item) {
+          std::vector<size_t> chunk_dims(dims);
+          chunk_dims.back() = std::min(slices_per_chunk, slowest - i * slices_per_chunk);
+          item.data = pressio_data::nonowning(input->dtype(), static_cast<uint8_t*>(input->data()) + i * slices_per_chunk * slice_bytes, chunk_dims);
+        },
+        [&](size_t k, stream_item& item) {
+          item.stages.push_back({item.data.dtype(), item.data.dimensions()});
+          pressio_data out = pressio_data::empty(pressio_byte_dtype, {});
+          int ec = plugins[k]->compress(&item.data, &out);
+          item.data = std::move(out);
+          return ec;
+        },
+        [&](stream_item& item) {
+          chunks[item.chunk] = std::move(item);
+        });
+    if(int ec = report(status, /*reversed*/false)) return ec;
+
+    std::vector<uint64_t> chunk_sizes(num_chunks);
+    for (size_t i = 0; i < num_chunks; ++i) {
+      chunk_sizes[i] = stage_header_size(chunks[i].stages) + chunks[i].data.size_in_bytes();
+    }
+    const size_t header_size = (2 + num_chunks) * sizeof(uint64_t);
+    *output = pressio_data::owning(pressio_byte_dtype, {std::accumulate(chunk_sizes.begin(), chunk_sizes.end(), header_size)});
+    uint8_t* out = static_cast<uint8_t*>(output->data());
+    uint64_t* header = static_cast<uint64_t*>(output->data());
+    header[0] = 2; /*version*/
+    header[1] = num_chunks;
+    std::copy(chunk_sizes.begin(), chunk_sizes.end(), header + 2);
+    size_t offset = header_size;
+    for (size_t i = 0; i < num_chunks; ++i) {
+      write_stage_header(reinterpret_cast<uint64_t*>(out + offset), chunks[i].stages);
+      memcpy(out + offset + stage_header_size(chunks[i].stages), chunks[i].data.data(), chunks[i].data.size_in_bytes());
+      offset += chunk_sizes[i];
+    }
+    return status.ec;
+  }
+
+  int decompress_streaming(const pressio_data* input, struct pressio_data* output) {
+    uint8_t const* in = static_cast<uint8_t const*>(input->data());
+    const size_t input_size = input->size_in_bytes();
+    const uint64_t* header = static_cast<uint64_t const*>(input->data());
+    if(input_size < 2 * sizeof(uint64_t) || header[1] > input_size / sizeof(uint64_t) - 2) {
+      return set_error(2, "invalid pipeline header");
+    }
+    const size_t num_chunks = header[1];
+    if(num_chunks == 0) {
+      return set_error(2, "invalid pipeline header");
+    }
+
+    //read the stages of every chunk to find where each one goes in the output
+    size_t offset = (2 + num_chunks) * sizeof(uint64_t);
+    std::vector<stream_item> chunks(num_chunks);
+    std::vector<size_t> output_offsets(num_chunks);
+    std::vector<size_t> output_dims;
+    size_t output_bytes = 0;
+    for (size_t i = 0; i < num_chunks; ++i) {
+      const uint64_t chunk_size = header[2 + i];
+      size_t stages_size;
+      if(chunk_size > input_size - offset ||
+          !read_stage_header(in + offset, chunk_size, chunks[i].stages, stages_size) ||
+          chunks[i].stages.empty() ||
+          chunks[i].stages.size() != plugins.size() ||
+          chunks[i].stages.front().dims.empty()) {
+        return set_error(2, "invalid pipeline header");
+      }
+      chunks[i].data = pressio_data::nonowning(pressio_byte_dtype, const_cast<uint8_t*>(in) + offset + stages_size, {chunk_size - stages_size});
+      offset += chunk_size;
+
+      stage_info const& first = chunks[i].stages.front();
+      if(i == 0) {
+        output_dims = first.dims;
+        output_dims.back() = 0;
+      } else if(first.dtype != chunks[0].stages.front().dtype ||
+          !std::equal(first.dims.begin(), first.dims.end() - 1, output_dims.begin(), output_dims.end() - 1)) {
+        return set_error(2, "pipeline chunks do not have matching dimensions");
+      }
+      output_offsets[i] = output_bytes;
+      output_dims.back() += first.dims.back();
+      output_bytes += std::accumulate(first.dims.begin(), first.dims.end(), static_cast<size_t>(pressio_dtype_size(first.dtype)), compat::multiplies<>{});
+    }
+    const pressio_dtype output_dtype = chunks[0].stages.front().dtype;
+    if(!(output->has_data() && output->dtype() == output_dtype && output->dimensions() == output_dims)) {
+      *output = pressio_data::owning(output_dtype, output_dims);
+    }
+    uint8_t* out = static_cast<uint8_t*>(output->data());
+
+    const size_t nstages = plugins.size();
+    std::string size_error;
+    auto status = run_stream(num_chunks, nstages, stream_queue_size,
+        [&](size_t i, stream_item& item) {
+          item = std::move(chunks[i]);
+          item.chunk = i;
+        },
+        [&](size_t k, stream_item& item) {
+          const size_t p = nstages - 1 - k;
+          pressio_data out = pressio_data::owning(item.stages[p].dtype, item.stages[p].dims);
+          int ec = plugins[p]->decompress(&item.data, &out);
+          item.data = std::move(out);
+          return ec;
+        },
+        [&](stream_item& item) {
+          stage_info const& first = item.stages.front();
+          const size_t expected = std::accumulate(first.dims.begin(), first.dims.end(), static_cast<size_t>(pressio_dtype_size(first.dtype)), compat::multiplies<>{});
+          if(item.data.size_in_bytes() < expected) {
+            size_error = "decompressed chunk is too small";
+            return;
+          }
+          memcpy(out + output_offsets[item.chunk], item.data.data(), expected);
+        });
+    if(int ec = report(status, /*reversed*/true)) return ec;
+    if(!size_error.empty()) {
+      return set_error(2, size_error);
+    }
+    return status.ec;
+  }
+
+  /**
+   * sets the error for a streaming run
+   *
+   * \param[in] status the result of the run
+   * \param[in] reversed true if the stages ran the plugins in reverse order
+   * \returns the error code if the run failed, otherwise 0
+   */
+  int report(stream_status const& status, bool reversed) {
+    if(status.ec == 0) return 0;
+    const size_t plugin = reversed ? plugins.size() - 1 - status.stage : status.stage;
+    set_error(status.ec, status.msg.empty() ? plugins[plugin]->error_msg() : status.msg);
+    return status.ec > 0 ? status.ec : 0;
+  }
+
+public:
+
   std::vector<std::string> ids, names;
   std::vector<pressio_compressor> plugins;
+  bool fuse = false;
+  bool stream = false;
+  uint64_t stream_chunk_bytes = uint64_t{4} << 20;
+  uint64_t stream_queue_size = 2;
+  ping_pong_buffers buffers;
 };
 
 static pressio_register compressor_many_fields_plugin(compressor_plugins(), "pipeline", []() {
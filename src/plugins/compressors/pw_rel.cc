@@ -3,57 +3,87 @@
 #include "libpressio_ext/cpp/data.h"
 #include "libpressio_ext/cpp/options.h"
 #include "libpressio_ext/cpp/pressio.h"
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <limits>
 
 namespace libpressio { namespace pw_rel_ns {
 
+  /**
+   * marks streams whose signs are a bitmap; legacy streams begin with the size of the compressed logs instead
+   */
+  constexpr uint64_t packed_magic = 0x3250574c45525750ull;
+
+  /**
+   * one pass over the input which writes log2 of each magnitude, a bitmap of negative values, and a bitmap of zeros
+   * while finding the range of the logs of the non-zero values
+   */
+  template <class T>
+  struct fused_encoder {
+    void operator()(T const* in, size_t n, T* logs, uint8_t* signs, uint8_t* zeros) {
+      for (size_t byte = 0; byte < (n + 7) / 8; ++byte) {
+        size_t const first = byte * 8;
+        size_t const count = std::min<size_t>(8, n - first);
+        uint8_t sign_bits = 0, zero_bits = 0;
+        for (size_t j = 0; j < count; ++j) {
+          T const v = in[first + j];
+          bool const zero = (v == 0);
+          T const l = std::log2(zero ? T{1} : std::fabs(v));
+          logs[first + j] = l;
+          sign_bits |= static_cast<uint8_t>(v < 0) << j;
+          zero_bits |= static_cast<uint8_t>(zero) << j;
+          min_log = zero ? min_log : std::min(min_log, l);
+          max_log = zero ? max_log : std::max(max_log, l);
+        }
+        signs[byte] = sign_bits;
+        zeros[byte] = zero_bits;
+        any_signs |= sign_bits;
+        any_zeros |= zero_bits;
+      }
+    }
+
+    /**
+     * replaces the logs of zeros with flag, visiting only the bytes of the bitmap that mark a zero
+     */
+    void fill_zeros(T* logs, size_t n, uint8_t const* zeros, T flag) const {
+      if(!any_zeros) return;
+      for (size_t byte = 0; byte < (n + 7) / 8; ++byte) {
+        for (uint8_t bits = zeros[byte]; bits; bits &= bits - 1) {
+          logs[byte * 8 + __builtin_ctz(bits)] = flag;
+        }
+      }
+    }
+
+    T min_log = std::numeric_limits<T>::max();
+    T max_log = std::numeric_limits<T>::lowest();
+    uint8_t any_signs = 0;
+    uint8_t any_zeros = 0;
+  };
+
   struct compressor {
     template <class T>
     pressio_data operator()(T* start, T* end) {
-      pressio_data signs = pressio_data::owning(pressio_bool_dtype, input.dimensions());
+      size_t size = std::distance(start, end);
+      size_t const bitmap_size = (size + 7) / 8;
+      pressio_data signs = pressio_data::owning(pressio_uint8_dtype, {bitmap_size});
+      pressio_data zeros = pressio_data::owning(pressio_uint8_dtype, {bitmap_size});
       pressio_data logs = pressio_data::owning(input.dtype(), input.dimensions());
       T* logs_ptr = static_cast<T*>(logs.data());
-      size_t size = std::distance(start, end);
-
-      T min, max;
-      min = max = start[0];
-      for (size_t i = 0; i < size; ++i) {
-        min = std::min(start[i], min);
-        max = std::max(start[i], max);
-      }
-      T max_abs_log_data = 0;
-      if(min == 0) max_abs_log_data = fabs(log2(fabs(max)));
-      else if(max == 0) max_abs_log_data = fabs(log2(fabs(min)));
-      else max_abs_log_data = std::max(fabs(log2(fabs(min))), fabs(log2(fabs(max))));
-      T min_log_data = max_abs_log_data;
-      bool save_signs = false;
-      bool* signs_ptr = static_cast<bool*>(signs.data());
-
-      for (size_t i = 0; i < size; ++i) {
-        if(start[i] < 0) {
-          signs_ptr[i] = true;
-          save_signs = true;
-          logs_ptr[i] = -start[i];
-        } else {
-          signs_ptr[i] = false;
-          logs_ptr[i] = start[i];
-        }
-
-        if(logs_ptr[i] > 0) {
-          logs_ptr[i] = log2(logs_ptr[i]);
-          if(logs_ptr[i] > max_abs_log_data) max_abs_log_data = logs_ptr[i];
-          if(logs_ptr[i] < min_log_data) min_log_data = logs_ptr[i];
-        }
+      auto zeros_ptr = static_cast<uint8_t*>(zeros.data());
+
+      fused_encoder<T> encoder;
+      encoder(start, size, logs_ptr, static_cast<uint8_t*>(signs.data()), zeros_ptr);
+      T min_log_data = 0, max_abs_log_data = 0;
+      if(encoder.min_log <= encoder.max_log) {
+        min_log_data = encoder.min_log;
+        max_abs_log_data = std::max(std::fabs(encoder.min_log), std::fabs(encoder.max_log));
       }
-      if(fabs(min_log_data) > max_abs_log_data) max_abs_log_data = fabs(min_log_data);
+      bool save_signs = encoder.any_signs;
       double abs_bound = log2(pw_rel + 1.0) - max_abs_log_data * std::numeric_limits<T>::epsilon();
       double zero_flag = min_log_data - 2.0001*abs_bound;
       double threshold = min_log_data - 1.0001*abs_bound;
-      for (size_t i = 0; i < size; ++i) {
-        if(start[i] == 0.0) {
-          logs_ptr[i] = zero_flag;
-        }
-      }
+      encoder.fill_zeros(logs_ptr, size, zeros_ptr, static_cast<T>(zero_flag));
 
       pressio_data logs_comp = pressio_data::empty(pressio_byte_dtype, {});
       pressio_data signs_comp = pressio_data::empty(pressio_byte_dtype, {});
@@ -69,28 +99,20 @@ namespace libpressio { namespace pw_rel_ns {
         }
       }
 
-      pressio_data compressed;
+      const size_t signs_size = save_signs ? signs_comp.size_in_bytes() : 0;
+      pressio_data compressed = pressio_data::owning(pressio_byte_dtype,
+          {sizeof(uint64_t) + 2*sizeof(size_t) + sizeof(double) + logs_comp.size_in_bytes() + signs_size});
+      auto compressed_ptr = static_cast<unsigned char*>(compressed.data());
+      const size_t sizes[2] = {logs_comp.size_in_bytes(), signs_size};
+      memcpy(compressed_ptr, &packed_magic, sizeof(packed_magic));
+      compressed_ptr += sizeof(packed_magic);
+      memcpy(compressed_ptr, sizes, sizeof(sizes));
+      compressed_ptr += sizeof(sizes);
+      memcpy(compressed_ptr, &threshold, sizeof(threshold));
+      compressed_ptr += sizeof(threshold);
+      memcpy(compressed_ptr, logs_comp.data(), logs_comp.size_in_bytes());
       if(save_signs) {
-        compressed = pressio_data::owning(pressio_byte_dtype,
-            {signs_comp.size_in_bytes() + 2* sizeof(size_t) + sizeof(double) + logs_comp.size_in_bytes()});
-        auto compressed_ptr_size_t = static_cast<size_t*>(compressed.data());
-        auto compressed_ptr_double = reinterpret_cast<double*>(compressed_ptr_size_t + 2);
-        auto compressed_ptr = reinterpret_cast<unsigned char*>(compressed_ptr_double+1);
-        compressed_ptr_size_t[0] = logs_comp.size_in_bytes();
-        compressed_ptr_size_t[1] = signs_comp.size_in_bytes();
-        compressed_ptr_double[0] = threshold;
-        memcpy(compressed_ptr, logs_comp.data(), logs_comp.size_in_bytes());
-        memcpy(compressed_ptr+logs_comp.size_in_bytes(), signs_comp.data(), signs_comp.size_in_bytes());
-      } else {
-        compressed = pressio_data::owning(pressio_byte_dtype,
-            {logs_comp.size_in_bytes() + 2*sizeof(size_t) + sizeof(double)});
-        auto compressed_ptr_size_t = static_cast<size_t*>(compressed.data());
-        auto compressed_ptr_double = reinterpret_cast<double*>(compressed_ptr_size_t+2);
-        auto compressed_ptr = reinterpret_cast<unsigned char*>(compressed_ptr_double+1);
-        compressed_ptr_size_t[0] = logs_comp.size_in_bytes();
-        compressed_ptr_size_t[1] = 0;
-        compressed_ptr_double[0] = threshold;
-        memcpy(compressed_ptr, logs_comp.data(), logs_comp.size_in_bytes());
+        memcpy(compressed_ptr+logs_comp.size_in_bytes(), signs_comp.data(), signs_size);
       }
 
       return compressed;
@@ -106,11 +128,14 @@ namespace libpressio { namespace pw_rel_ns {
     template <class T>
     void restore_no_sign(T* begin, size_t n, T threshold) {
       for (size_t i = 0; i < n; ++i) {
-        if(begin[i] < threshold) begin[i] = 0;
-        else begin[i] = exp2(begin[i]);
+        T const magnitude = std::exp2(begin[i]);
+        begin[i] = (begin[i] < threshold) ? T{0} : magnitude;
       }
     }
 
+    /**
+     * legacy streams store one bool per sign
+     */
     template <class T>
     void restore_signed(T* begin, bool* signs, size_t n, T threshold) {
       for (size_t i = 0; i < n; ++i) {
@@ -121,45 +146,87 @@ namespace libpressio { namespace pw_rel_ns {
       }
     }
 
-    void operator()(unsigned char* begin) {
-      const size_t* sizes = reinterpret_cast<size_t*>(begin);
+    template <class T>
+    void restore_packed(T* begin, uint8_t const* signs, size_t n, T threshold) {
+      for (size_t byte = 0; byte < (n + 7) / 8; ++byte) {
+        size_t const first = byte * 8;
+        size_t const count = std::min<size_t>(8, n - first);
+        uint8_t const sign_bits = signs[byte];
+        for (size_t j = 0; j < count; ++j) {
+          T const x = begin[first + j];
+          T const magnitude = (x < threshold) ? T{0} : std::exp2(x);
+          begin[first + j] = ((sign_bits >> j) & 1) ? -magnitude : magnitude;
+        }
+      }
+    }
+
+    /**
+     * inverts the log transform and applies the signs, if any, in one pass
+     */
+    template <class T>
+    void restore_as(pressio_data const* signs, bool packed, T threshold) {
+      auto data = static_cast<T*>(output->data());
+      const size_t n = output->num_elements();
+      if(signs == nullptr) {
+        restore_no_sign(data, n, threshold);
+      } else if(packed) {
+        restore_packed(data, static_cast<uint8_t const*>(signs->data()), n, threshold);
+      } else {
+        restore_signed(data, static_cast<bool*>(signs->data()), n, threshold);
+      }
+    }
+
+    void restore(pressio_data const* signs, bool packed, double threshold) {
+      switch(output->dtype()) {
+        case pressio_float_dtype:
+          restore_as<float>(signs, packed, static_cast<float>(threshold));
+          return;
+        case pressio_double_dtype:
+          restore_as<double>(signs, packed, threshold);
+          return;
+        default:
+          throw std::runtime_error("unsupported type");
+      }
+    }
+
+    void operator()(unsigned char* begin, size_t input_size) {
+      uint64_t magic = 0;
+      if(input_size >= sizeof(magic)) memcpy(&magic, begin, sizeof(magic));
+      const bool packed = (magic == packed_magic);
+      if(packed) {
+        begin += sizeof(magic);
+        input_size -= sizeof(magic);
+      }
+      if(input_size < 2*sizeof(size_t) + sizeof(double)) {
+        throw std::runtime_error("compressed buffer is too small");
+      }
+      size_t sizes[2];
+      double threshold;
+      memcpy(sizes, begin, sizeof(sizes));
+      memcpy(&threshold, begin + sizeof(sizes), sizeof(threshold));
       const size_t logs_size = sizes[0];
       const size_t signs_size = sizes[1];
-      const double threshold = *reinterpret_cast<double*>(begin + 2*sizeof(size_t));
-      pressio_data logs_in = pressio_data::nonowning(pressio_byte_dtype, begin+2*sizeof(size_t)+sizeof(double), {logs_size});
+      unsigned char* payload = begin + sizeof(sizes) + sizeof(threshold);
+      if(logs_size + signs_size > input_size - sizeof(sizes) - sizeof(threshold)) {
+        throw std::runtime_error("compressed buffer is truncated");
+      }
+      pressio_data logs_in = pressio_data::nonowning(pressio_byte_dtype, payload, {logs_size});
 
       if(abs_comp->decompress(&logs_in, output) > 0) {
         throw std::runtime_error(abs_comp->error_msg());
       }
-
       if(signs_size) {
         //we need to restore signs
-        pressio_data signs_in = pressio_data::nonowning(pressio_byte_dtype, begin+2*sizeof(size_t)+sizeof(double)+logs_size, {signs_size});
-        pressio_data signs_out = pressio_data::owning(pressio_bool_dtype, output->dimensions());
+        pressio_data signs_in = pressio_data::nonowning(pressio_byte_dtype, payload+logs_size, {signs_size});
+        pressio_data signs_out = packed ?
+          pressio_data::owning(pressio_uint8_dtype, {(output->num_elements() + 7) / 8}) :
+          pressio_data::owning(pressio_bool_dtype, output->dimensions());
         if(sign_comp->decompress(&signs_in, &signs_out) > 0) {
           throw std::runtime_error(sign_comp->error_msg());
         }
-        switch(output->dtype()) {
-          case pressio_float_dtype:
-            restore_signed(static_cast<float*>(output->data()), static_cast<bool*>(signs_out.data()),output->num_elements(), static_cast<float>(threshold));
-            return;
-          case pressio_double_dtype:
-            restore_signed(static_cast<double*>(output->data()), static_cast<bool*>(signs_out.data()),output->num_elements(), threshold);
-            return;
-          default:
-            throw std::runtime_error("unsupported type");
-        }
+        restore(&signs_out, packed, threshold);
       } else {
-        switch(output->dtype()) {
-          case pressio_float_dtype:
-            restore_no_sign(static_cast<float*>(output->data()), output->num_elements(), static_cast<float>(threshold));
-            return;
-          case pressio_double_dtype:
-            restore_no_sign(static_cast<double*>(output->data()),output->num_elements(), threshold);
-            return;
-          default:
-            throw std::runtime_error("unsupported type");
-        }
+        restore(nullptr, packed, threshold);
       }
     }
     pressio_data* output;
@@ -204,7 +271,7 @@ public:
   {
     struct pressio_options options;
     set_meta_docs(options, "pw_rel:abs_comp", "compressor that supports an absolute error bound", abs_comp);
-    set_meta_docs(options, "pw_rel:sign_comp", "compressor that compresses signs", signs_comp);
+    set_meta_docs(options, "pw_rel:sign_comp", "compressor that compresses signs, given as a uint8 bitmap with one bit per element", signs_comp);
     set(options, "pressio:description", R"(abstraction for adapting an absolute error bound to a pw_rel error bound
 
     Adapted for LibPressio by Robert Underwood
@@ -248,7 +315,7 @@ public:
                       struct pressio_data* output) override
   {
     try {
-      decompressor{output, abs_comp, signs_comp}(static_cast<unsigned char*>(input->data()));
+      decompressor{output, abs_comp, signs_comp}(static_cast<unsigned char*>(input->data()), input->size_in_bytes());
       return 0;
     } catch(std::exception const& ex) {
       return set_error(1, ex.what());
@@ -256,9 +323,9 @@ public:
   }
 
   int major_version() const override { return 0; }
-  int minor_version() const override { return 0; }
-  int patch_version() const override { return 1; }
-  const char* version() const override { return "0.0.1"; }
+  int minor_version() const override { return 1; }
+  int patch_version() const override { return 0; }
+  const char* version() const override { return "0.1.0"; }
   const char* prefix() const override { return "pw_rel"; }
 
   pressio_options get_metrics_results_impl() const override {
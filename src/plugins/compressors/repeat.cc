@@ -1,4 +1,10 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
 #include "std_compat/memory.h"
+#include "std_compat/optional.h"
 #include "libpressio_ext/cpp/compressor.h"
 #include "libpressio_ext/cpp/data.h"
 #include "libpressio_ext/cpp/options.h"
@@ -6,6 +12,94 @@
 
 namespace libpressio { namespace repeat_ns {
 
+/**
+ * \returns the p quantile of the standard normal distribution
+ */
+double normal_quantile(double p) {
+  double lower = -10, upper = 10;
+  for (int i = 0; i < 100; ++i) {
+    double const mid = (lower + upper) / 2;
+    if(0.5 * std::erfc(-mid / std::sqrt(2.0)) < p) lower = mid;
+    else upper = mid;
+  }
+  return (lower + upper) / 2;
+}
+
+/**
+ * \returns the p quantile of Student's t distribution using the Cornish-Fisher expansion about the normal
+ */
+double t_quantile(double p, double df) {
+  double const z = normal_quantile(p);
+  double const z3 = z * z * z, z5 = z3 * z * z, z7 = z5 * z * z;
+  return z
+    + (z3 + z) / (4 * df)
+    + (5 * z5 + 16 * z3 + 3 * z) / (96 * df * df)
+    + (3 * z7 + 19 * z5 + 17 * z3 - 15 * z) / (384 * df * df * df);
+}
+
+/**
+ * \returns the q quantile of sorted using linear interpolation between samples
+ */
+double quantile(std::vector<double> const& sorted, double q) {
+  double const pos = q * (sorted.size() - 1);
+  size_t const below = static_cast<size_t>(std::floor(pos));
+  size_t const above = std::min(below + 1, sorted.size() - 1);
+  return sorted[below] + (pos - below) * (sorted[above] - sorted[below]);
+}
+
+/**
+ * summary statistics of the timed iterations of one operation
+ */
+struct timing_stats {
+  std::vector<double> times;
+  uint64_t outliers = 0;
+  double mean = 0, median = 0, stddev = 0, min = 0, max = 0, p95 = 0, ci = 0;
+  bool converged = false;
+
+  /**
+   * recomputes the statistics of times after rejecting outliers
+   *
+   * \param[in] outlier_threshold samples whose modified z-score exceeds this are rejected; 0 disables rejection
+   * \param[in] confidence the confidence level of the interval about the mean
+   * \param[in] ci_target the relative half width of the interval at which the timing has converged
+   */
+  void update(double outlier_threshold, double confidence, double ci_target) {
+    std::vector<double> kept(times);
+    std::sort(kept.begin(), kept.end());
+    if(outlier_threshold > 0 && kept.size() > 2) {
+      double const center = quantile(kept, 0.5);
+      std::vector<double> deviations(kept.size());
+      std::transform(kept.begin(), kept.end(), deviations.begin(), [center](double t) { return std::fabs(t - center); });
+      std::sort(deviations.begin(), deviations.end());
+      double const mad = quantile(deviations, 0.5);
+      if(mad > 0) {
+        kept.erase(std::remove_if(kept.begin(), kept.end(), [=](double t) {
+          return 0.6745 * std::fabs(t - center) / mad > outlier_threshold;
+        }), kept.end());
+      }
+    }
+    outliers = times.size() - kept.size();
+    double sum = 0;
+    for (auto t : kept) sum += t;
+    mean = sum / kept.size();
+    double squares = 0;
+    for (auto t : kept) squares += (t - mean) * (t - mean);
+    size_t const n = kept.size();
+    stddev = (n > 1) ? std::sqrt(squares / (n - 1)) : 0;
+    median = quantile(kept, 0.5);
+    p95 = quantile(kept, 0.95);
+    min = kept.front();
+    max = kept.back();
+    if(n > 2) {
+      ci = t_quantile((1 + confidence) / 2, n - 1) * stddev / std::sqrt(static_cast<double>(n));
+      converged = ci_target > 0 && ci <= ci_target * mean;
+    } else {
+      ci = 0;
+      converged = false;
+    }
+  }
+};
+
 class repeat_compressor_plugin : public libpressio_compressor_plugin {
 public:
   struct pressio_options get_options_impl() const override
@@ -14,6 +108,13 @@ public:
     set_meta(options, "repeat:compressor", comp_id, comp);
     set(options, "repeat:count", count);
     set(options, "repeat:clone_output", clone_output);
+    set(options, "repeat:warmup", warmup);
+    set(options, "repeat:flush_cache", flush_cache);
+    set(options, "repeat:flush_bytes", flush_bytes);
+    set(options, "repeat:outlier_threshold", outlier_threshold);
+    set(options, "repeat:confidence", confidence);
+    set(options, "repeat:ci_target", ci_target);
+    set(options, "repeat:max_count", max_count);
 
     return options;
   }
@@ -24,11 +125,11 @@ public:
     set_meta_configuration(options, "repeat:compressor", compressor_plugins(), comp);
     set(options, "pressio:thread_safe", get_threadsafe(*comp));
     set(options, "pressio:stability", "experimental");
-    
+
         //TODO fix the list of options for each command
-        std::vector<std::string> invalidations {"repeat:count", "repeat:clone_output"}; 
-        std::vector<pressio_configurable const*> invalidation_children {&*comp}; 
-        
+        std::vector<std::string> invalidations {"repeat:count", "repeat:clone_output", "repeat:warmup", "repeat:flush_cache", "repeat:flush_bytes", "repeat:outlier_threshold", "repeat:confidence", "repeat:ci_target", "repeat:max_count"};
+        std::vector<pressio_configurable const*> invalidation_children {&*comp};
+
         set(options, "predictors:error_dependent", get_accumulate_configuration("predictors:error_dependent", invalidation_children, {}));
         set(options, "predictors:error_agnostic", get_accumulate_configuration("predictors:error_agnostic", invalidation_children, {}));
         set(options, "predictors:runtime", get_accumulate_configuration("predictors:runtime", invalidation_children, invalidations));
@@ -40,9 +141,34 @@ public:
   {
     struct pressio_options options;
     set_meta_docs(options, "repeat:compressor", "compressor to call repeatedly", comp);
-    set(options, "pressio:description", R"(call a compressor multiple times i.e. to get an average timing)");
+    set(options, "pressio:description", R"(call a compressor multiple times i.e. to get an average timing
+
+      Each operation runs repeat:warmup untimed iterations followed by at least repeat:count timed iterations.  When
+      repeat:ci_target is set, timed iterations continue until the confidence interval of the mean time is within
+      repeat:ci_target of the mean or repeat:max_count iterations have run.  Times are reported in milliseconds.)");
     set(options, "repeat:count", "how many repeats to do");
     set(options, "repeat:clone_output", "clone output or re-use existing output");
+    set(options, "repeat:warmup", "how many untimed iterations to run before the timed iterations");
+    set(options, "repeat:flush_cache", "write and read a buffer of repeat:flush_bytes before each timed iteration to evict the data from the cache");
+    set(options, "repeat:flush_bytes", "the size of the buffer used to flush the cache; should exceed the size of the last level cache");
+    set(options, "repeat:outlier_threshold", "reject times whose modified z-score, 0.6745*|t - median|/MAD, exceeds this from the statistics; 0 disables rejection");
+    set(options, "repeat:confidence", "the confidence level of the interval about the mean time");
+    set(options, "repeat:ci_target", "stop once the half width of the confidence interval is at most this fraction of the mean; 0 runs exactly repeat:count iterations");
+    set(options, "repeat:max_count", "the most timed iterations to run when repeat:ci_target is set");
+    for (auto const& op : {"compress", "decompress"}) {
+      std::string const prefix = std::string("repeat:") + op + "_";
+      set(options, prefix + "times", std::string("the time of each timed iteration of ") + op + " in ms");
+      set(options, prefix + "iterations", std::string("the number of timed iterations of ") + op);
+      set(options, prefix + "outliers", std::string("the number of times of ") + op + " rejected as outliers");
+      set(options, prefix + "mean", std::string("the mean time of ") + op + " in ms excluding outliers");
+      set(options, prefix + "median", std::string("the median time of ") + op + " in ms excluding outliers");
+      set(options, prefix + "stddev", std::string("the sample standard deviation of the time of ") + op + " in ms excluding outliers");
+      set(options, prefix + "min", std::string("the minimum time of ") + op + " in ms excluding outliers");
+      set(options, prefix + "max", std::string("the maximum time of ") + op + " in ms excluding outliers");
+      set(options, prefix + "p95", std::string("the 95th percentile time of ") + op + " in ms excluding outliers");
+      set(options, prefix + "ci", std::string("the half width of the confidence interval of the mean time of ") + op + " in ms");
+      set(options, prefix + "converged", std::string("true if the confidence interval of ") + op + " met repeat:ci_target");
+    }
     return options;
   }
 
@@ -52,59 +178,36 @@ public:
     get_meta(options, "repeat:compressor", compressor_plugins(), comp_id, comp);
     get(options, "repeat:count", &count);
     get(options, "repeat:clone_output", &clone_output);
+    get(options, "repeat:warmup", &warmup);
+    get(options, "repeat:flush_cache", &flush_cache);
+    get(options, "repeat:flush_bytes", &flush_bytes);
+    get(options, "repeat:outlier_threshold", &outlier_threshold);
+    get(options, "repeat:confidence", &confidence);
+    get(options, "repeat:ci_target", &ci_target);
+    get(options, "repeat:max_count", &max_count);
     return 0;
   }
 
   int compress_impl(const pressio_data* input,
                     struct pressio_data* output) override
   {
-      int rc = 0;
-      pressio_data out;
-      for (uint32_t i = 0; i < count; ++i) {
-          if(clone_output) {
-              rc = comp->compress(input, output);
-          } else {
-              pressio_data tmp_out(pressio_data::clone(*output));
-              rc = comp->compress(input, &tmp_out);
-              if (rc == 0 && i + 1 == count) {
-                  *output = std::move(tmp_out);
-              }
-          }
-          if(rc > 0) {
-              set_error(rc, comp->error_msg());
-              return rc;
-          }
-      }
-      return rc;
+      return run(input, output, compress_stats, [this](pressio_data const* in, pressio_data* out) {
+          return comp->compress(in, out);
+      });
   }
 
   int decompress_impl(const pressio_data* input,
                       struct pressio_data* output) override
   {
-      int rc = 0;
-      pressio_data out;
-      for (uint32_t i = 0; i < count; ++i) {
-          if(clone_output) {
-              rc = comp->compress(input, output);
-          } else {
-              pressio_data tmp_out(pressio_data::clone(*output));
-              rc = comp->decompress(input, &tmp_out);
-              if (rc == 0 && i + 1 == count) {
-                  *output = std::move(tmp_out);
-              }
-          }
-          if(rc > 0) {
-              set_error(rc, comp->error_msg());
-              return rc;
-          }
-      }
-      return rc;
+      return run(input, output, decompress_stats, [this](pressio_data const* in, pressio_data* out) {
+          return comp->decompress(in, out);
+      });
   }
 
   int major_version() const override { return 0; }
-  int minor_version() const override { return 0; }
-  int patch_version() const override { return 1; }
-  const char* version() const override { return "0.0.1"; }
+  int minor_version() const override { return 1; }
+  int patch_version() const override { return 0; }
+  const char* version() const override { return "0.1.0"; }
   const char* prefix() const override { return "repeat"; }
 
   void set_name_impl(std::string const& new_name) override {
@@ -115,7 +218,10 @@ public:
   }
 
   pressio_options get_metrics_results_impl() const override {
-    return comp->get_metrics_results();
+    pressio_options results = comp->get_metrics_results();
+    set_stats(results, "compress", compress_stats);
+    set_stats(results, "decompress", decompress_stats);
+    return results;
   }
 
   std::shared_ptr<libpressio_compressor_plugin> clone() override
@@ -123,10 +229,115 @@ public:
     return compat::make_unique<repeat_compressor_plugin>(*this);
   }
 
+private:
+  /**
+   * runs the warmup and timed iterations of an operation; the output of the final iteration is returned
+   */
+  template <class Operation>
+  int run(const pressio_data* input, pressio_data* output, compat::optional<timing_stats>& stats, Operation&& operation) {
+      timing_stats timing;
+      uint64_t const min_count = count;
+      uint64_t const limit = std::max<uint64_t>(min_count, max_count);
+      pressio_data tmp_out;
+      auto iteration = [&](bool timed) {
+          pressio_data* out = output;
+          if(!clone_output) {
+              tmp_out = pressio_data::clone(*output);
+              out = &tmp_out;
+          }
+          if(timed && flush_cache) flush();
+          auto const begin = std::chrono::steady_clock::now();
+          int rc = operation(input, out);
+          auto const end = std::chrono::steady_clock::now();
+          if(timed) {
+              timing.times.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+          }
+          if(rc > 0) {
+              set_error(rc, comp->error_msg());
+          }
+          return rc;
+      };
+
+      int rc = 0;
+      for (uint32_t i = 0; i < warmup; ++i) {
+          rc = iteration(false);
+          if(rc > 0) return rc;
+      }
+      for (uint64_t i = 0; i < limit; ++i) {
+          rc = iteration(true);
+          if(rc > 0) return rc;
+          if(i + 1 >= min_count) {
+              if(ci_target <= 0) break;
+              timing.update(outlier_threshold, confidence, ci_target);
+              if(timing.converged) break;
+          }
+      }
+      if(!clone_output && !timing.times.empty()) {
+          *output = std::move(tmp_out);
+      }
+      if(!timing.times.empty()) {
+          timing.update(outlier_threshold, confidence, ci_target);
+          stats = std::move(timing);
+      } else {
+          stats.reset();
+      }
+      return rc;
+  }
+
+  /**
+   * touches every cache line of a buffer larger than the cache so the next iteration starts cold
+   */
+  void flush() {
+      flush_buffer.resize(flush_bytes);
+      char sum = 0;
+      for (size_t i = 0; i < flush_buffer.size(); i += 64) {
+          flush_buffer[i]++;
+          sum += flush_buffer[i];
+      }
+      volatile char sink = sum;
+      (void)sink;
+  }
+
+  void set_stats(pressio_options& results, std::string const& op, compat::optional<timing_stats> const& stats) const {
+      std::string const prefix = "repeat:" + op + "_";
+      if(stats) {
+          set(results, prefix + "times", pressio_data::copy(pressio_double_dtype, stats->times.data(), {stats->times.size()}));
+          set(results, prefix + "iterations", static_cast<uint64_t>(stats->times.size()));
+          set(results, prefix + "outliers", stats->outliers);
+          set(results, prefix + "mean", stats->mean);
+          set(results, prefix + "median", stats->median);
+          set(results, prefix + "stddev", stats->stddev);
+          set(results, prefix + "min", stats->min);
+          set(results, prefix + "max", stats->max);
+          set(results, prefix + "p95", stats->p95);
+          set(results, prefix + "ci", stats->ci);
+          set(results, prefix + "converged", stats->converged);
+      } else {
+          set_type(results, prefix + "times", pressio_option_data_type);
+          set_type(results, prefix + "iterations", pressio_option_uint64_type);
+          set_type(results, prefix + "outliers", pressio_option_uint64_type);
+          for (auto const& name : {"mean", "median", "stddev", "min", "max", "p95", "ci"}) {
+              set_type(results, prefix + name, pressio_option_double_type);
+          }
+          set_type(results, prefix + "converged", pressio_option_bool_type);
+      }
+  }
+
   std::string comp_id = "noop";
   pressio_compressor comp = compressor_plugins().build(comp_id);
   uint32_t count = 1;
   bool clone_output = false;
+  uint32_t warmup = 0;
+  bool flush_cache = false;
+  uint64_t flush_bytes = 64ull * 1024 * 1024;
+  double outlier_threshold = 0;
+  double confidence = 0.95;
+  double ci_target = 0;
+  uint64_t max_count = 0;
+
+  compat::optional<timing_stats> compress_stats;
+  compat::optional<timing_stats> decompress_stats;
+  std::vector<char> flush_buffer;
 };
 
 static pressio_register compressor_many_fields_plugin(compressor_plugins(), "repeat", []() {
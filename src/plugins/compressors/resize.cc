@@ -68,11 +68,15 @@ public:
   int compress_impl(const pressio_data* input,
                     struct pressio_data* output) override
   {
-    auto tmp = pressio_data::clone(*input);
-    if(!compressed_dims.empty()) {
-      tmp.reshape(compressed_dims);
+    if(compressed_dims.empty()) {
+      return compressor->compress(input, output);
+    }
+    if(data_size_in_elements(compressed_dims.size(), compressed_dims.data()) > input->num_elements()) {
+      return set_error(1, "resize:compressed_dims has more elements than the input");
     }
-    return compressor->compress(&tmp, output);
+    //reshaping does not move the elements, so the child reads the input buffer directly
+    auto view = pressio_data::nonowning(input->dtype(), input->data(), compressed_dims);
+    return compressor->compress(&view, output);
   }
 
   int decompress_impl(const pressio_data* input,
@@ -89,10 +93,10 @@ public:
   }
 
   int major_version() const override { return 0; }
-  int minor_version() const override { return 0; }
-  int patch_version() const override { return 1; }
+  int minor_version() const override { return 1; }
+  int patch_version() const override { return 0; }
 
-  const char* version() const override { return "0.0.1"; }
+  const char* version() const override { return "0.1.0"; }
 
   const char* prefix() const override { return "resize"; }
 
@@ -62,7 +62,7 @@ public:
     )");
     set(options, "roibin:centers", "centers of the region of interest");
     set(options, "roibin:roi_size", "region of interest size");
-    set(options, "roibin:nthreads", "number of threads for region of interest");
+    set(options, "roibin:nthreads", "maximum number of threads from the shared task runtime to use for the region of interest");
     set(options, "roibin:roi_strategy", R"(ROI saving method one of
 
     + mask -- roi:centers is a mask where true indicates part of ROI
@@ -8,6 +8,7 @@
 #include <iterator>
 
 #include <libpressio_ext/cpp/data.h>
+#include <libpressio_ext/cpp/task_runtime.h>
 
 #include <std_compat/type_traits.h>
 #include <std_compat/iterator.h>
@@ -196,10 +197,9 @@ void roi_save(indexer<N> const &id,
   auto centers_width = centers_range.get_dimension(0);
   auto centers_size = centers_range.get_dimension(1);
 
-#pragma omp parallel for num_threads(n_threads)
-  for (size_t i = 0; i < centers_size; ++i) {
+  pressio_task_runtime::instance().parallel_for(centers_size, static_cast<uint32_t>(n_threads), [&](size_t i, uint32_t) {
     copy_center(id, roi_size, roi, static_cast<const uint64_t*>(centers_range.data()) + i*centers_width, i, origin, roi_mem);
-  }
+  });
 }
 
 template <std::size_t N>
@@ -346,10 +346,9 @@ void roi_restore(indexer<N> const &id,
   auto centers_size = centers_range.get_dimension(1);
   auto centers_width = centers_range.get_dimension(0);
 
-#pragma omp parallel for num_threads(n_threads)
-  for (size_t i = 0; i < centers_size; ++i) {
+  pressio_task_runtime::instance().parallel_for(centers_size, static_cast<uint32_t>(n_threads), [&](size_t i, uint32_t) {
     restore_center(id, roi_size, roi, static_cast<size_t*>(centers_range.data()) + centers_width*i, i, restored, roi_mem);
-  }
+  });
 }
 
 
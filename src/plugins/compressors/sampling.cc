@@ -2,6 +2,7 @@
 #include <memory>
 #include <random>
 #include <numeric>
+#include <algorithm>
 #include "libpressio_ext/cpp/data.h"
 #include "libpressio_ext/cpp/compressor.h"
 #include "libpressio_ext/cpp/options.h"
@@ -10,6 +11,7 @@
 #include "pressio_data.h"
 #include "pressio_compressor.h"
 #include "std_compat/memory.h"
+#include "../metrics/block_sample_impl.h"
 
 namespace libpressio { namespace sampling { 
 
@@ -20,6 +22,8 @@ class sample_compressor_plugin: public libpressio_compressor_plugin {
       set(options, "sample:mode", mode);
       set(options, "sample:seed", seed);
       set(options, "sample:rate", rate);
+      set(options, "sample:block_size", block_size);
+      set(options, "pressio:nthreads", nthreads);
       return options;
     }
 
@@ -27,9 +31,9 @@ class sample_compressor_plugin: public libpressio_compressor_plugin {
       struct pressio_options options;
       set(options,"pressio:thread_safe", pressio_thread_safety_multiple);
       set(options,"pressio:stability", "unstable");
-      set(options, "sample:mode", std::vector<std::string>{"wr", "wor", "decimate"});
+      set(options, "sample:mode", std::vector<std::string>{"wr", "wor", "decimate", "block", "stratified"});
       
-        std::vector<std::string> invalidations {"sample:mode", "sample:seed", "sample:rate"}; 
+        std::vector<std::string> invalidations {"sample:mode", "sample:seed", "sample:rate", "sample:block_size"}; 
         std::vector<pressio_configurable const*> invalidation_children {}; 
         
         set(options, "predictors:error_dependent", get_accumulate_configuration("predictors:error_dependent", invalidation_children, invalidations));
@@ -41,14 +45,22 @@ class sample_compressor_plugin: public libpressio_compressor_plugin {
 
     struct pressio_options get_documentation_impl() const override {
       struct pressio_options options;
-      set(options, "pressio:description", "A \"compressor\" which samples the data by row");
+      set(options, "pressio:description", R"(A "compressor" which samples the data by row or by block
+
+      the row modes sample along the slowest dimension.  The block modes tile the data with blocks of sample:block_size
+      elements in each dimension and return the selected blocks stacked along the slowest dimension, so a block
+      sample of 3d data is itself 3d data with the local structure of the input.)");
       set(options, "sample:mode", R"(what kind of sampling to apply
       +  wr -- with replacement
       +  wor -- without replacement
       +  decimate -- sample every kth entry
+      +  block -- a simple random sample of blocks without replacement
+      +  stratified -- divide the blocks into strata of neighboring blocks and sample one block from each
       )");
       set(options, "sample:seed", "the seed to use");
       set(options, "sample:rate", "the sampling rate to use");
+      set(options, "sample:block_size", "for the block modes, the number of elements of a block in each dimension");
+      set(options, "pressio:nthreads", "for the block modes, the maximum number of threads used to copy blocks");
       return options;
     }
 
@@ -57,10 +69,18 @@ class sample_compressor_plugin: public libpressio_compressor_plugin {
       get(options, "sample:mode", &mode);
       get(options, "sample:seed", &seed);
       get(options, "sample:rate", &rate);
+      get(options, "sample:block_size", &block_size);
+      uint32_t tmp;
+      if(get(options, "pressio:nthreads", &tmp) == pressio_options_key_set) {
+        nthreads = std::max<uint32_t>(tmp, 1);
+      }
       return 0;
     }
 
     int compress_impl(const pressio_data *input, struct pressio_data* output) override {
+      if(mode == "block" || mode == "stratified") {
+        return sample_blocks(*input, *output);
+      }
       std::vector<size_t> const& dims = input->dimensions();
       size_t sample_size;
       size_t take_rows = 0;
@@ -92,6 +112,7 @@ class sample_compressor_plugin: public libpressio_compressor_plugin {
         rows_to_sample.resize(sample_size);
         std::sort(std::begin(rows_to_sample), std::end(rows_to_sample));
       } else if (mode == "decimate") {
+        rows_to_sample.resize(sample_size);
         size_t i = 0;
         std::generate(std::begin(rows_to_sample), std::end(rows_to_sample), [=]() mutable { size_t ret = i; i += take_rows; return ret; });
       } else {
@@ -147,9 +168,30 @@ class sample_compressor_plugin: public libpressio_compressor_plugin {
 
 
   private:
+    int sample_blocks(pressio_data const& input, pressio_data& output) {
+      metrics_sampling::block_sampler sampler;
+      sampler.rate = rate;
+      sampler.seed = static_cast<uint32_t>(seed);
+      sampler.block_size = block_size;
+      sampler.stratified = (mode == "stratified");
+      auto const dims = input.normalized_dims();
+      auto sample = sampler.select(dims);
+      if(sample.blocks.empty()) {
+        output = pressio_data::owning(input.dtype(), {0});
+        return 0;
+      }
+      auto sampled_dims = sample.blocks.front().extent;
+      sampled_dims.back() *= sample.blocks.size();
+      output = metrics_sampling::gather(input, dims, sample, nthreads);
+      output.reshape(sampled_dims);
+      return 0;
+    }
+
     std::string mode;
     int seed = 0;
     double rate;
+    uint64_t block_size = 32;
+    uint32_t nthreads = 1;
     int invalid_mode(std::string const& mode) {
       return set_error(1, mode + " invalid mode");
     }
@@ -0,0 +1,607 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/hash.h"
+#include "libpressio_ext/cpp/metrics.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+#include "libpressio_ext/cpp/printers.h"
+#include "libpressio_ext/cpp/task_runtime.h"
+#include "pressio_data.h"
+#include "pressio_options.h"
+#include "std_compat/memory.h"
+#include "../metrics/block_sample_impl.h"
+
+namespace libpressio { namespace search_ns {
+
+/**
+ * metric values of evaluated points shared by every search plugin in the process, keyed by the sample and
+ * the configuration that was searched, then by the value of the searched option
+ *
+ * The cache holds at most the capacity passed to insert points; the least recently used keys are evicted first.
+ */
+struct search_cache {
+  static search_cache& instance() {
+    static search_cache cache;
+    return cache;
+  }
+
+  bool find(std::string const& key, double x, double& value) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = index.find(key);
+    if(it == index.end()) return false;
+    entries.splice(entries.begin(), entries, it->second);
+    auto const& points = it->second->points;
+    auto point = points.find(x);
+    if(point == points.end()) return false;
+    value = point->second;
+    return true;
+  }
+
+  void insert(std::string const& key, double x, double value, uint64_t capacity) {
+    std::lock_guard<std::mutex> guard(lock);
+    if(capacity == 0) return;
+    auto it = index.find(key);
+    if(it == index.end()) {
+      entries.push_front(entry{key, {}});
+      it = index.emplace(key, entries.begin()).first;
+    } else {
+      entries.splice(entries.begin(), entries, it->second);
+    }
+    if(it->second->points.emplace(x, value).second) {
+      ++size;
+    }
+    while(size > capacity) {
+      auto& oldest = entries.back();
+      if(&oldest == &entries.front()) {
+        //a single key larger than the cache keeps only its most recent point
+        oldest.points = {{x, value}};
+        size = 1;
+        break;
+      }
+      size -= oldest.points.size();
+      index.erase(oldest.key);
+      entries.pop_back();
+    }
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    entries.clear();
+    index.clear();
+    size = 0;
+  }
+
+  private:
+  struct entry {
+    std::string key;
+    std::map<double, double> points;
+  };
+  std::mutex lock;
+  std::list<entry> entries;
+  std::unordered_map<std::string, std::list<entry>::iterator> index;
+  uint64_t size = 0;
+};
+
+/**
+ * an evaluated point of the search
+ */
+struct search_point {
+  double t;
+  double x;
+  double value;
+};
+
+class search_compressor_plugin : public libpressio_compressor_plugin {
+public:
+  struct pressio_options get_options_impl() const override
+  {
+    struct pressio_options options;
+    set_meta(options, "search:compressor", compressor_id, compressor);
+    set(options, "pressio:nthreads", nthreads);
+    set(options, "search:option", option_name);
+    set(options, "search:lower", lower);
+    set(options, "search:upper", upper);
+    set(options, "search:log_scale", log_scale);
+    set(options, "search:target_metric", target_metric);
+    set(options, "search:target", target);
+    set(options, "search:constraint", constraint);
+    set(options, "search:method", method);
+    set(options, "search:max_iterations", max_iterations);
+    set(options, "search:tolerance", tolerance);
+    set(options, "search:sample_rate", sampler.rate);
+    set(options, "search:sample_block", sampler.block_size);
+    set(options, "search:sample_seed", sampler.seed);
+    set(options, "search:verify", verify);
+    set(options, "search:cache_size", cache_size);
+    set_type(options, "search:clear_cache", pressio_option_bool_type);
+    return options;
+  }
+
+  struct pressio_options get_configuration_impl() const override
+  {
+    struct pressio_options options;
+    set_meta_configuration(options, "search:compressor", compressor_plugins(), compressor);
+    set(options, "pressio:thread_safe", get_threadsafe(*compressor));
+    set(options, "pressio:stability", "experimental");
+    set(options, "search:constraint", std::vector<std::string>{"at_least", "at_most", "closest"});
+    set(options, "search:method", std::vector<std::string>{"bisection", "golden"});
+
+        std::vector<std::string> invalidations {"search:option", "search:lower", "search:upper", "search:log_scale", "search:target_metric", "search:target", "search:constraint", "search:method", "search:max_iterations", "search:tolerance", "search:sample_rate", "search:sample_block", "search:sample_seed", "search:verify"};
+        std::vector<pressio_configurable const*> invalidation_children {&*compressor};
+
+        set(options, "predictors:error_dependent", get_accumulate_configuration("predictors:error_dependent", invalidation_children, invalidations));
+        set(options, "predictors:error_agnostic", get_accumulate_configuration("predictors:error_agnostic", invalidation_children, invalidations));
+        set(options, "predictors:runtime", get_accumulate_configuration("predictors:runtime", invalidation_children, std::vector<std::string>{"pressio:nthreads", "search:option", "search:lower", "search:upper", "search:log_scale", "search:target_metric", "search:target", "search:constraint", "search:method", "search:max_iterations", "search:tolerance", "search:sample_rate", "search:sample_block", "search:sample_seed", "search:verify", "search:cache_size"}));
+
+    return options;
+  }
+
+  struct pressio_options get_documentation_impl() const override
+  {
+    struct pressio_options options;
+    set_meta_docs(options, "search:compressor", "compressor whose option is searched", compressor);
+    set(options, "pressio:description", R"(searches one numeric option of a compressor, such as an error bound, to meet a target for a metric,
+      such as a compression ratio, PSNR, or bit rate, by trial compressions of a sample of the input, then compresses the input
+      with the option that was found)");
+    set(options, "pressio:nthreads", "maximum number of trial compressions evaluated at once on the shared task runtime");
+    set(options, "search:option", "the option of search:compressor to search");
+    set(options, "search:lower", "the smallest value of search:option to consider");
+    set(options, "search:upper", "the largest value of search:option to consider");
+    set(options, "search:log_scale", "if true, search:option is searched in log space which suits error bounds; search:lower must then be positive");
+    set(options, "search:target_metric", R"(the metric to meet, e.g. size:compression_ratio, size:bit_rate, or error_stat:psnr;
+      it is computed by the metrics plugin named by its prefix)");
+    set(options, "search:target", "the target value of search:target_metric");
+    set(options, "search:constraint", R"(which values of search:target_metric are acceptable
+      + at_least -- at least search:target, e.g. a minimum compression ratio
+      + at_most -- at most search:target, e.g. a maximum bit rate
+      + closest -- any, the value closest to search:target is chosen)");
+    set(options, "search:method", R"(how the search proceeds
+      + bisection -- assumes the metric is monotonic in the option; each round evaluates pressio:nthreads points in parallel
+        and keeps the interval where the metric crosses the target
+      + golden -- golden section search minimizing the distance to the target, for metrics that are unimodal rather than monotonic;
+        evaluates one point per round)");
+    set(options, "search:max_iterations", "the maximum number of rounds of the search");
+    set(options, "search:tolerance", "the search stops once an acceptable value within this relative distance of search:target is found");
+    set(options, "search:sample_rate", R"(fraction of the blocks of the input used for the trial compressions; the sampled blocks
+      are stacked along a new slowest dimension. values outside of (0,1) use the entire input)");
+    set(options, "search:sample_block", "number of elements of a sampled block in each dimension");
+    set(options, "search:sample_seed", "seed used to choose the sampled blocks");
+    set(options, "search:verify", R"(if true and the input was sampled, the metric is measured for the full compression and if it violates
+      search:constraint the search is repeated on the full input, so that a constraint such as a storage budget is met whenever it can be)");
+    set(options, "search:clear_cache", R"(*write-only* when set to true, discards the evaluated points cached by every search plugin in
+      the process; points are cached by a hash of the sample, the configuration of search:compressor, and the searched option and metric)");
+    set(options, "search:cache_size", R"(the maximum number of evaluated points kept in the process wide cache when this plugin inserts
+      into it, the least recently used configurations are evicted first; 0 disables inserting into the cache)");
+    set(options, "search:value", "the value of search:option used for the last compression");
+    set(options, "search:metric_value", "the value of search:target_metric for the last compression, on the sample unless it was verified");
+    set(options, "search:feasible", "true if the last compression met search:constraint");
+    set(options, "search:evaluations", "the number of trial compressions performed by the last compression");
+    set(options, "search:cache_hits", "the number of points of the last search found in the cache");
+    set(options, "search:time", "time in milliseconds spent searching during the last compression");
+    return options;
+  }
+
+
+  int set_options_impl(struct pressio_options const& options) override
+  {
+    get_meta(options, "search:compressor", compressor_plugins(), compressor_id, compressor);
+    uint32_t tmp_nthreads;
+    if(get(options, "pressio:nthreads", &tmp_nthreads) == pressio_options_key_set) {
+      if(tmp_nthreads == 0) {
+        return set_error(1, "nthreads must be positive");
+      }
+      nthreads = tmp_nthreads;
+    }
+    get(options, "search:option", &option_name);
+    get(options, "search:lower", &lower);
+    get(options, "search:upper", &upper);
+    get(options, "search:log_scale", &log_scale);
+    std::string tmp_metric;
+    if(get(options, "search:target_metric", &tmp_metric) == pressio_options_key_set) {
+      auto colon = tmp_metric.find(':');
+      if(colon == std::string::npos || !metrics_plugins().contains(tmp_metric.substr(0, colon))) {
+        return set_error(1, "search:target_metric must be a metric of a metrics plugin: " + tmp_metric);
+      }
+      target_metric = tmp_metric;
+    }
+    get(options, "search:target", &target);
+    std::string tmp_constraint;
+    if(get(options, "search:constraint", &tmp_constraint) == pressio_options_key_set) {
+      if(tmp_constraint != "at_least" && tmp_constraint != "at_most" && tmp_constraint != "closest") {
+        return set_error(1, "unsupported search:constraint " + tmp_constraint);
+      }
+      constraint = tmp_constraint;
+    }
+    std::string tmp_method;
+    if(get(options, "search:method", &tmp_method) == pressio_options_key_set) {
+      if(tmp_method != "bisection" && tmp_method != "golden") {
+        return set_error(1, "unsupported search:method " + tmp_method);
+      }
+      method = tmp_method;
+    }
+    get(options, "search:max_iterations", &max_iterations);
+    get(options, "search:tolerance", &tolerance);
+    get(options, "search:sample_rate", &sampler.rate);
+    get(options, "search:sample_block", &sampler.block_size);
+    get(options, "search:sample_seed", &sampler.seed);
+    get(options, "search:verify", &verify);
+    get(options, "search:cache_size", &cache_size);
+    bool clear_cache = false;
+    if(get(options, "search:clear_cache", &clear_cache) == pressio_options_key_set && clear_cache) {
+      search_cache::instance().clear();
+    }
+    if(lower > upper || (log_scale && lower <= 0)) {
+      return set_error(1, "search:lower must be positive and at most search:upper");
+    }
+    return 0;
+  }
+
+  int compress_impl(const pressio_data* input,
+                    struct pressio_data* output) override
+  {
+    auto search_begin = std::chrono::steady_clock::now();
+    evaluations = 0;
+    cache_hits = 0;
+    const bool sampled = sampler.enabled();
+    pressio_data sample = sampled ? sample_of(*input) : pressio_data::nonowning(input->dtype(), input->data(), input->dimensions());
+
+    search_point best;
+    if(search(sample, best)) return error_code();
+    auto search_end = std::chrono::steady_clock::now();
+    search_time = std::chrono::duration_cast<std::chrono::milliseconds>(search_end - search_begin).count();
+
+    pressio_metrics metric = make_metric();
+    double value = best.value;
+    const bool measure_full = verify && sampled;
+    if(measure(measure_full ? &metric : nullptr, *input, best.x, *output, value)) {
+      return error_code();
+    }
+    if(measure_full && !acceptable(value)) {
+      //the sample misled the search; search the full input instead
+      if(search(*input, best)) return error_code();
+      if(measure(nullptr, *input, best.x, *output, value)) {
+        return error_code();
+      }
+      value = best.value;
+    }
+    chosen = best.x;
+    metric_value = value;
+    feasible = acceptable(value);
+    return 0;
+  }
+
+  int decompress_impl(const pressio_data* input,
+                      struct pressio_data* output) override
+  {
+    int rc = compressor->decompress(input, output);
+    if(rc) set_error(rc, compressor->error_msg());
+    return rc;
+  }
+
+  int major_version() const override { return 0; }
+  int minor_version() const override { return 0; }
+  int patch_version() const override { return 1; }
+  const char* version() const override { return "0.0.1"; }
+  const char* prefix() const override { return "search"; }
+
+  void set_name_impl(std::string const& new_name) override {
+    if(new_name != "") {
+      compressor->set_name(new_name + "/" + compressor->prefix());
+    } else {
+      compressor->set_name(new_name);
+    }
+  }
+  std::vector<std::string> children_impl() const final {
+      return { compressor->get_name() };
+  }
+
+  pressio_options get_metrics_results_impl() const override {
+    pressio_options results = compressor->get_metrics_results();
+    set(results, "search:value", chosen);
+    set(results, "search:metric_value", metric_value);
+    set(results, "search:feasible", feasible);
+    set(results, "search:evaluations", evaluations);
+    set(results, "search:cache_hits", cache_hits);
+    set(results, "search:time", search_time);
+    return results;
+  }
+
+  std::shared_ptr<libpressio_compressor_plugin> clone() override
+  {
+    return compat::make_unique<search_compressor_plugin>(*this);
+  }
+
+private:
+  /**
+   * \returns the sampled blocks of input stacked along a new slowest dimension
+   */
+  pressio_data sample_of(pressio_data const& input) const {
+    auto dims = input.normalized_dims();
+    auto sample = sampler.select(dims);
+    if(sample.blocks.empty()) {
+      return pressio_data::nonowning(input.dtype(), input.data(), input.dimensions());
+    }
+    auto stacked = metrics_sampling::gather(input, dims, sample);
+    auto stacked_dims = sample.blocks.front().extent;
+    stacked_dims.push_back(sample.blocks.size());
+    stacked.reshape(stacked_dims);
+    return stacked;
+  }
+
+  pressio_metrics make_metric() const {
+    return metrics_plugins().build(target_metric.substr(0, target_metric.find(':')));
+  }
+
+  bool requires_decompress(pressio_metrics const& metric) const {
+    auto config = metric->get_configuration();
+    std::vector<std::string> names;
+    if(config.get("predictors:requires_decompress", &names) == pressio_options_key_set) {
+      return std::find(names.begin(), names.end(), target_metric) != names.end();
+    }
+    bool required = true;
+    config.get("predictors:requires_decompress", &required);
+    return required;
+  }
+
+  double to_x(double t) const {
+    if(log_scale) {
+      return std::exp(std::log(lower) + t * (std::log(upper) - std::log(lower)));
+    }
+    return lower + t * (upper - lower);
+  }
+
+  /**
+   * \returns value converted to the type search:compressor uses for search:option
+   */
+  pressio_option option_value(pressio_compressor const& trial, double x) const {
+    pressio_option value(x);
+    auto current = trial->get_options();
+    auto it = current.find(option_name);
+    if(it != current.end() && it->second.type() != pressio_option_double_type) {
+      auto casted = value.as(it->second.type(), pressio_conversion_explicit);
+      if(casted.has_value()) return casted;
+    }
+    return value;
+  }
+
+  /**
+   * compresses data with trial using x for search:option and if metric is not null measures search:target_metric
+   *
+   * \param[out] msg the error message if an error occurs
+   * \returns an error code
+   */
+  int measure(pressio_compressor& trial, pressio_metrics* metric, pressio_data const& data, double x, pressio_data& compressed, double& value, std::string& msg) const {
+    pressio_options trial_options;
+    trial_options.set(option_name, option_value(trial, x));
+    if(trial->set_options(trial_options)) {
+      msg = "failed to set " + option_name + ": " + trial->error_msg();
+      return 2;
+    }
+    if(metric) (*metric)->begin_compress(&data, &compressed);
+    int rc = trial->compress(&data, &compressed);
+    if(metric) (*metric)->end_compress(&data, &compressed, rc);
+    if(rc > 0) {
+      msg = trial->error_msg();
+      return rc;
+    }
+    if(!metric) return 0;
+
+    if(requires_decompress(*metric)) {
+      auto decompressed = pressio_data::owning(data.dtype(), data.dimensions());
+      (*metric)->begin_decompress(&compressed, &decompressed);
+      rc = trial->decompress(&compressed, &decompressed);
+      (*metric)->end_decompress(&compressed, &decompressed, rc);
+      if(rc > 0) {
+        msg = trial->error_msg();
+        return rc;
+      }
+    }
+    auto results = (*metric)->get_metrics_results({});
+    auto it = results.find(target_metric);
+    if(it == results.end()) {
+      msg = "metric not computed: " + target_metric;
+      return 3;
+    }
+    auto casted = it->second.as(pressio_option_double_type, pressio_conversion_explicit);
+    if(!casted.has_value()) {
+      msg = "metric is not numeric: " + target_metric;
+      return 3;
+    }
+    value = casted.get_value<double>();
+    return 0;
+  }
+
+  int measure(pressio_metrics* metric, pressio_data const& data, double x, pressio_data& compressed, double& value) {
+    std::string msg;
+    int rc = measure(compressor, metric, data, x, compressed, value, msg);
+    if(rc) return set_error(rc, msg);
+    return 0;
+  }
+
+  bool acceptable(double value) const {
+    if(constraint == "at_least") return value >= target;
+    if(constraint == "at_most") return value <= target;
+    return true;
+  }
+
+  bool close_enough(double value) const {
+    return acceptable(value) && std::abs(value - target) <= tolerance * std::abs(target);
+  }
+
+  /**
+   * \returns true if lhs is a better choice than rhs
+   */
+  bool better(search_point const& lhs, search_point const& rhs) const {
+    const bool lhs_ok = acceptable(lhs.value), rhs_ok = acceptable(rhs.value);
+    if(lhs_ok != rhs_ok) return lhs_ok;
+    return std::abs(lhs.value - target) < std::abs(rhs.value - target);
+  }
+
+  /**
+   * evaluates search:target_metric at each t, using the cache and evaluating the rest in parallel
+   * \returns the points that could be evaluated
+   */
+  std::vector<search_point> evaluate(pressio_data const& data, std::string const& key, std::vector<double> const& ts) {
+    std::vector<search_point> points(ts.size());
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < ts.size(); ++i) {
+      points[i].t = ts[i];
+      points[i].x = to_x(ts[i]);
+      if(search_cache::instance().find(key, points[i].x, points[i].value)) {
+        cache_hits++;
+      } else {
+        pending.push_back(i);
+      }
+    }
+
+    std::vector<char> ok(ts.size(), 1);
+    if(!pending.empty()) {
+      //each participant compresses with its own copy of the compressor and metric
+      const uint32_t slots = static_cast<uint32_t>(std::min<size_t>(nthreads, pending.size()));
+      std::vector<pressio_compressor> trials;
+      std::vector<pressio_metrics> metrics;
+      for (uint32_t i = 0; i < slots; ++i) {
+        trials.emplace_back(compressor);
+        metrics.emplace_back(make_metric());
+      }
+      pressio_task_runtime::instance().parallel_for(pending.size(), slots, [&](size_t i, uint32_t slot) {
+        auto& point = points[pending[i]];
+        auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+        std::string msg;
+        ok[pending[i]] = measure(trials[slot], &metrics[slot], data, point.x, compressed, point.value, msg) == 0;
+      });
+      evaluations += pending.size();
+      for (auto i : pending) {
+        if(ok[i]) search_cache::instance().insert(key, points[i].x, points[i].value, cache_size);
+      }
+    }
+
+    std::vector<search_point> evaluated;
+    for (size_t i = 0; i < ts.size(); ++i) {
+      if(ok[i]) evaluated.push_back(points[i]);
+    }
+    return evaluated;
+  }
+
+  /**
+   * finds the best value of search:option for data
+   */
+  int search(pressio_data const& data, search_point& best) {
+    //the child's options are read now so that configuring the child directly or through a clone is not missed;
+    //the searched option is left out so setting it does not change the key
+    auto child_options = compressor->get_options();
+    child_options.erase(option_name);
+    std::ostringstream key;
+    key << compressor_id << '\n' << child_options << '\n' << option_name << ' ' << target_metric << ' ' << data.dtype();
+    for (auto dim : data.dimensions()) key << ' ' << dim;
+    auto const digest = hash::hash(data, 0, pressio_task_runtime::instance().budget());
+    key << '\n' << digest.high << ' ' << digest.low;
+
+    std::vector<search_point> all;
+    auto record = [&](std::vector<search_point> const& points) {
+      all.insert(all.end(), points.begin(), points.end());
+      for (auto const& point : points) {
+        if(close_enough(point.value)) return true;
+      }
+      return false;
+    };
+
+    bool done = record(evaluate(data, key.str(), {0.0, 1.0}));
+    if(all.size() != 2) {
+      return set_error(2, "search:compressor failed at the bounds of the search");
+    }
+    const bool below0 = all[0].value < target, below1 = all[1].value < target;
+    if(method == "bisection" && below0 != below1) {
+      double a = 0, b = 1;
+      bool below_a = below0;
+      for (uint32_t iteration = 0; iteration < max_iterations && !done; ++iteration) {
+        std::vector<double> ts;
+        for (uint32_t i = 1; i <= nthreads; ++i) {
+          ts.push_back(a + (b - a) * i / (nthreads + 1));
+        }
+        auto points = evaluate(data, key.str(), ts);
+        if(points.empty()) break;
+        done = record(points);
+        //keep the first sub-interval where the metric crosses the target
+        double next_a = a;
+        for (auto const& point : points) {
+          if((point.value < target) != below_a) {
+            b = point.t;
+            break;
+          }
+          next_a = point.t;
+        }
+        a = next_a;
+      }
+    } else if (method == "golden") {
+      const double inv_phi = (std::sqrt(5.0) - 1) / 2;
+      auto distance = [this](search_point const& point) { return std::abs(point.value - target); };
+      double a = 0, b = 1;
+      auto c = evaluate(data, key.str(), {b - inv_phi * (b - a)});
+      auto d = evaluate(data, key.str(), {a + inv_phi * (b - a)});
+      //record both points so neither is missing from the history when the other meets the target
+      const bool done_c = record(c);
+      const bool done_d = record(d);
+      done = done_c || done_d;
+      for (uint32_t iteration = 0; iteration < max_iterations && !done && !c.empty() && !d.empty(); ++iteration) {
+        if(distance(c.front()) < distance(d.front())) {
+          b = d.front().t;
+          d = c;
+          c = evaluate(data, key.str(), {b - inv_phi * (b - a)});
+          done = record(c);
+        } else {
+          a = c.front().t;
+          c = d;
+          d = evaluate(data, key.str(), {a + inv_phi * (b - a)});
+          done = record(d);
+        }
+      }
+    }
+
+    best = all.front();
+    for (auto const& point : all) {
+      if(better(point, best)) best = point;
+    }
+    return 0;
+  }
+
+  pressio_compressor compressor = compressor_plugins().build("noop");
+  std::string compressor_id = "noop";
+  uint32_t nthreads = 1;
+  std::string option_name = "pressio:abs";
+  double lower = 1e-8;
+  double upper = 1;
+  bool log_scale = true;
+  std::string target_metric = "size:compression_ratio";
+  double target = 10;
+  std::string constraint = "at_least";
+  std::string method = "bisection";
+  uint32_t max_iterations = 16;
+  double tolerance = 0.01;
+  bool verify = true;
+  uint64_t cache_size = 4096;
+  metrics_sampling::block_sampler sampler{0.1, 0, 32};
+
+  double chosen = 0;
+  double metric_value = 0;
+  bool feasible = false;
+  uint64_t evaluations = 0;
+  uint64_t cache_hits = 0;
+  uint64_t search_time = 0;
+};
+
+static pressio_register compressor_search_plugin(compressor_plugins(), "search", []() {
+  return compat::make_unique<search_compressor_plugin>();
+});
+
+} }
@@ -1,10 +1,119 @@
 #include <libpressio_ext/cpp/compressor.h>
+#include <libpressio_ext/cpp/metrics.h>
 #include <libpressio_ext/cpp/pressio.h>
 #include <std_compat/memory.h>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
 #include <sstream>
 
 namespace libpressio { namespace switch_plugin {
 
+  /**
+   * header written before the child's stream when the compressor is chosen automatically
+   */
+  struct switch_header {
+    uint32_t magic;
+    uint32_t id;
+  };
+  const uint32_t switch_magic = 0x49575350; //"PSWI"
+
+  /**
+   * one node of a decision tree over features; leaves name the compressor to use
+   */
+  struct tree_node {
+    bool leaf = false;
+    uint64_t id = 0;
+    std::string feature;
+    double threshold = 0;
+    size_t less = 0, greater_equal = 0;
+  };
+
+  /**
+   * \returns the cheap input-only metrics that are built into this copy of libpressio
+   */
+  std::vector<std::string> default_features() {
+    std::vector<std::string> ids;
+    for (std::string id : {"error_stat", "entropy", "data_gap"}) {
+      if(metrics_plugins().contains(id)) {
+        ids.emplace_back(std::move(id));
+      }
+    }
+    return ids;
+  }
+
+  pressio_metrics make_features(std::vector<std::string> const& ids) {
+    std::vector<pressio_metrics> plugins;
+    for (auto const& id : ids) {
+      plugins.emplace_back(metrics_plugins().build(id));
+    }
+    return pressio_metrics(make_m_composite(std::move(plugins)));
+  }
+
+  /**
+   * parses a decision tree with one node per line, the root is node 0:
+   *
+   *   <node> <feature> <threshold> <node if less> <node otherwise>
+   *   <node> leaf <compressor index>
+   *
+   * children must have larger node numbers than their parents so the tree has no cycles.
+   * \returns the nodes or an empty vector with msg set on error
+   */
+  std::vector<tree_node> parse_tree(std::vector<std::string> const& lines, std::string& msg) {
+    std::vector<std::pair<size_t, tree_node>> parsed;
+    for (auto const& line : lines) {
+      std::istringstream ss(line);
+      size_t idx;
+      std::string feature;
+      if(!(ss >> idx)) {
+        ss.clear();
+        std::string comment;
+        if(!(ss >> comment) || comment.front() == '#') continue;
+        msg = "invalid tree node: " + line;
+        return {};
+      }
+      tree_node node;
+      if(!(ss >> feature)) {
+        msg = "invalid tree node: " + line;
+        return {};
+      }
+      if(feature == "leaf") {
+        node.leaf = true;
+        if(!(ss >> node.id)) {
+          msg = "invalid tree leaf: " + line;
+          return {};
+        }
+      } else {
+        node.feature = feature;
+        if(!(ss >> node.threshold >> node.less >> node.greater_equal) || node.less <= idx || node.greater_equal <= idx) {
+          msg = "invalid tree node: " + line;
+          return {};
+        }
+      }
+      parsed.emplace_back(idx, std::move(node));
+    }
+
+    std::vector<tree_node> nodes(parsed.size());
+    std::vector<bool> seen(parsed.size(), false);
+    for (auto& node : parsed) {
+      if(node.first >= nodes.size() || seen[node.first]) {
+        msg = "tree nodes must be numbered 0 to n-1 without repeats";
+        return {};
+      }
+      seen[node.first] = true;
+      nodes[node.first] = std::move(node.second);
+    }
+    for (auto const& node : nodes) {
+      if(!node.leaf && (node.less >= nodes.size() || node.greater_equal >= nodes.size())) {
+        msg = "tree node refers to a missing node";
+        return {};
+      }
+    }
+    return nodes;
+  }
+
 class switch_compressor: public libpressio_compressor_plugin {
   pressio_options get_options_impl() const override {
     pressio_options opts;
@@ -12,6 +121,12 @@ class switch_compressor: public libpressio_compressor_plugin {
     set(opts, "switch:names", names);
     set(opts, "switch:active_id", active_id);
     set_type(opts, "switch:clear_invocations", pressio_option_int32_type);
+    set(opts, "switch:selector", selector);
+    set(opts, "switch:features", feature_ids);
+    set(opts, "switch:tree", tree);
+    set_type(opts, "switch:tree_file", pressio_option_charptr_type);
+    set(opts, "switch:sample_bytes", sample_bytes);
+    set(opts, "switch:throughput_weight", throughput_weight);
     return opts;
   }
   pressio_options get_documentation_impl() const override {
@@ -24,6 +139,24 @@ class switch_compressor: public libpressio_compressor_plugin {
     set(opts, "switch:clear_invocations", "*write-only* clear the invocation count metric");
     set(opts, "switch:active_id", "the compressor to actually use");
     set(opts, "switch:names", "allows naming sub-compressors");
+    set(opts, "switch:selector", R"(how the compressor is chosen for each buffer
+      + none -- always use switch:active_id
+      + tree -- evaluate switch:tree on features of a sample of the buffer
+      + trial -- compress a sample of the buffer with each compressor and use the one with the best objective
+
+      when not none, the chosen compressor is recorded in the compressed stream so decompression needs the same selector
+      but not the same choice)");
+    set(opts, "switch:features", "metrics plugins run on a sample of the buffer to provide features for switch:tree; they should not need a compressed or decompressed buffer, e.g. the predictors:error_agnostic metrics of error_stat, entropy and data_gap");
+    set(opts, "switch:tree", R"(decision tree used by the tree selector, one node per line, with node 0 as the root
+      + <node> <feature> <threshold> <node if feature is less> <node otherwise>
+      + <node> leaf <index of the compressor to use>
+
+      children must have larger node numbers than their parents; a lookup table is a tree with one level of comparisons)");
+    set(opts, "switch:tree_file", "*write-only* path to a file to read switch:tree from");
+    set(opts, "switch:sample_bytes", "the maximum size of the contiguous sample taken from the middle of the buffer to compute features and trial compressions on");
+    set(opts, "switch:throughput_weight", R"(objective used by the trial selector, between 0 and 1;
+      the compressor maximizing weight*log(throughput) + (1-weight)*log(compression ratio) on the sample is chosen)");
+    set(opts, "switch:selected_id", "the compressor used by the last compression");
     return opts;
   }
   pressio_options get_configuration_impl() const override {
@@ -37,8 +170,9 @@ class switch_compressor: public libpressio_compressor_plugin {
       set(opts, "pressio:thread_safe", pressio_thread_safety_single);
     }
     set(opts, "pressio:stability", "experimental");
+    set(opts, "switch:selector", std::vector<std::string>{"none", "tree", "trial"});
     
-        std::vector<std::string> invalidations {"switch:names", "switch:active_id", "switch:clear_invocations"}; 
+        std::vector<std::string> invalidations {"switch:names", "switch:active_id", "switch:clear_invocations", "switch:selector", "switch:features", "switch:tree", "switch:tree_file", "switch:sample_bytes", "switch:throughput_weight"}; 
         std::vector<pressio_configurable const*> invalidation_children {}; 
         
             invalidation_children.reserve(compressors.size());
@@ -56,6 +190,54 @@ for (auto const& child : compressors) {
     get(options, "switch:names", &names);
     get_meta_many(options, "switch:compressors", compressor_plugins(), compressor_ids, compressors);
     get(options, "switch:active_id", &active_id);
+    std::string tmp_selector;
+    if(get(options, "switch:selector", &tmp_selector) == pressio_options_key_set) {
+      if(tmp_selector != "none" && tmp_selector != "tree" && tmp_selector != "trial") {
+        return set_error(1, "unsupported switch:selector " + tmp_selector);
+      }
+      selector = tmp_selector;
+    }
+    std::vector<std::string> tmp_features;
+    if(get(options, "switch:features", &tmp_features) == pressio_options_key_set) {
+      for (auto const& id : tmp_features) {
+        if(!metrics_plugins().contains(id)) {
+          return set_error(1, "unknown feature metric " + id);
+        }
+      }
+      feature_ids = std::move(tmp_features);
+      features = make_features(feature_ids);
+    }
+    std::string tree_file;
+    std::vector<std::string> tmp_tree;
+    bool tree_set = get(options, "switch:tree", &tmp_tree) == pressio_options_key_set;
+    if(get(options, "switch:tree_file", &tree_file) == pressio_options_key_set) {
+      std::ifstream in(tree_file);
+      if(!in) {
+        return set_error(1, "failed to open switch:tree_file " + tree_file);
+      }
+      tmp_tree.clear();
+      for (std::string line; std::getline(in, line);) {
+        tmp_tree.emplace_back(std::move(line));
+      }
+      tree_set = true;
+    }
+    if(tree_set) {
+      std::string msg;
+      auto tmp_nodes = parse_tree(tmp_tree, msg);
+      if(!msg.empty()) {
+        return set_error(1, msg);
+      }
+      tree = std::move(tmp_tree);
+      nodes = std::move(tmp_nodes);
+    }
+    get(options, "switch:sample_bytes", &sample_bytes);
+    double tmp_weight;
+    if(get(options, "switch:throughput_weight", &tmp_weight) == pressio_options_key_set) {
+      if(tmp_weight < 0 || tmp_weight > 1) {
+        return set_error(1, "switch:throughput_weight must be between 0 and 1");
+      }
+      throughput_weight = tmp_weight;
+    }
     int32_t clear = 0;
     get(options, "switch:clear_invocations", &clear);
     if(clear) {
@@ -66,23 +248,68 @@ for (auto const& child : compressors) {
     return 0;
   }
   int compress_impl(const pressio_data *input, struct pressio_data *output) override {
-    try {
-    compression_invocations.at(active_id)++;
-    int ret = compressors.at(active_id)->compress(input, output);
-    if(ret) set_error(ret, compressors.at(active_id)->error_msg());
-    return ret;
-    } catch(std::out_of_range& ex) {
-      return set_error(1, std::string("invalid active_id: ") + ex.what());
+    if(selector == "none") {
+      try {
+      selected_id = active_id;
+      compression_invocations.at(active_id)++;
+      int ret = compressors.at(active_id)->compress(input, output);
+      if(ret) set_error(ret, compressors.at(active_id)->error_msg());
+      return ret;
+      } catch(std::out_of_range& ex) {
+        return set_error(1, std::string("invalid active_id: ") + ex.what());
+      }
+    }
+
+    if(select(*input)) return error_code();
+    auto& compressor = compressors[selected_id];
+    compression_invocations.at(selected_id)++;
+    int ret = compressor->compress(input, output);
+    if(ret) {
+      set_error(ret, compressor->error_msg());
+      if(ret > 0) return ret;
+    }
+
+    //prefix the child's stream with the chosen compressor
+    const switch_header header{switch_magic, static_cast<uint32_t>(selected_id)};
+    const size_t payload_size = output->size_in_bytes();
+    auto framed = pressio_data::owning(pressio_byte_dtype, {sizeof(header) + payload_size});
+    auto bytes = static_cast<uint8_t*>(framed.data());
+    memcpy(bytes, &header, sizeof(header));
+    if(payload_size) {
+      memcpy(bytes + sizeof(header), output->data(), payload_size);
     }
+    *output = std::move(framed);
+    return ret;
   }
   int decompress_impl(const pressio_data *input, struct pressio_data *output) override {
-    try {
-    int ret = compressors.at(active_id)->decompress(input, output);
-    if(ret) set_error(ret, compressors.at(active_id)->error_msg());
-    return ret;
-    } catch(std::out_of_range& ex) {
-      return set_error(1, std::string("invalid active_id: ") + ex.what());
+    if(selector == "none") {
+      try {
+      int ret = compressors.at(active_id)->decompress(input, output);
+      if(ret) set_error(ret, compressors.at(active_id)->error_msg());
+      return ret;
+      } catch(std::out_of_range& ex) {
+        return set_error(1, std::string("invalid active_id: ") + ex.what());
+      }
+    }
+
+    switch_header header;
+    if(input->size_in_bytes() < sizeof(header)) {
+      return set_error(1, "compressed buffer is too small for the switch header");
+    }
+    memcpy(&header, input->data(), sizeof(header));
+    if(header.magic != switch_magic) {
+      return set_error(1, "compressed buffer was not written by an automatic switch selector");
     }
+    if(header.id >= compressors.size()) {
+      return set_error(1, "compressed buffer uses compressor " + std::to_string(header.id) + " which is not configured");
+    }
+    auto payload = pressio_data::nonowning(pressio_byte_dtype,
+        static_cast<uint8_t*>(input->data()) + sizeof(header),
+        {input->size_in_bytes() - sizeof(header)});
+    auto& compressor = compressors[header.id];
+    int ret = compressor->decompress(&payload, output);
+    if(ret) set_error(ret, compressor->error_msg());
+    return ret;
   }
   void set_name_impl(std::string const& name) override {
     set_names_many(name, compressors, names);
@@ -102,6 +329,7 @@ for (auto const& child : compressors) {
       opts.copy_from(plugin->get_metrics_results());
     }
     set(opts, "switch:compression_invocations", pressio_data(compression_invocations.begin(), compression_invocations.end()));
+    set(opts, "switch:selected_id", selected_id);
     return opts;
   }
 
@@ -118,7 +346,87 @@ for (auto const& child : compressors) {
     return compat::make_unique<switch_compressor>(*this);
   }
 
+  /**
+   * \returns a contiguous view of at most sample_bytes from the middle of the slowest dimension of input
+   */
+  pressio_data sample_of(pressio_data const& input) const {
+    auto dims = input.normalized_dims();
+    if(input.size_in_bytes() <= sample_bytes || dims.empty()) {
+      return pressio_data::nonowning(input.dtype(), input.data(), dims);
+    }
+    const size_t slice_bytes = input.size_in_bytes() / dims.back();
+    const size_t slices = std::max<size_t>(1, sample_bytes / slice_bytes);
+    const size_t first = (dims.back() - slices) / 2;
+    dims.back() = slices;
+    return pressio_data::nonowning(input.dtype(), static_cast<uint8_t*>(input.data()) + first * slice_bytes, dims);
+  }
+
+  /**
+   * sets selected_id for input using the configured selector
+   */
+  int select(pressio_data const& input) {
+    if(compressors.empty()) {
+      return set_error(1, "switch:compressors must not be empty");
+    }
+    auto sample = sample_of(input);
+    if(selector == "trial") {
+      double best_score = -std::numeric_limits<double>::infinity();
+      for (size_t i = 0; i < compressors.size(); ++i) {
+        auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+        auto begin = std::chrono::steady_clock::now();
+        if(compressors[i]->compress(&sample, &compressed) > 0) continue;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        const double throughput = sample.size_in_bytes() / std::max(seconds, 1e-9);
+        const double ratio = sample.size_in_bytes() / std::max<double>(compressed.size_in_bytes(), 1);
+        const double score = throughput_weight * std::log(throughput) + (1 - throughput_weight) * std::log(ratio);
+        if(score > best_score) {
+          best_score = score;
+          selected_id = i;
+        }
+      }
+      if(best_score == -std::numeric_limits<double>::infinity()) {
+        return set_error(1, "no compressor could compress the sample");
+      }
+      return 0;
+    }
+
+    if(nodes.empty()) {
+      return set_error(1, "switch:tree must be set to use the tree selector");
+    }
+    features->begin_compress(&sample, &sample);
+    features->end_compress(&sample, &sample, 0);
+    features->begin_decompress(&sample, &sample);
+    features->end_decompress(&sample, &sample, 0);
+    auto values = features->get_metrics_results({});
+    size_t node = 0;
+    while(!nodes[node].leaf) {
+      auto const& current = nodes[node];
+      auto value_it = values.find(current.feature);
+      if(value_it == values.end()) {
+        return set_error(1, "switch:tree uses feature " + current.feature + " which switch:features does not provide");
+      }
+      auto value = value_it->second.as(pressio_option_double_type, pressio_conversion_explicit);
+      if(!value.has_value()) {
+        return set_error(1, "switch:tree feature " + current.feature + " has no numeric value");
+      }
+      node = value.get_value<double>() < current.threshold ? current.less : current.greater_equal;
+    }
+    if(nodes[node].id >= compressors.size()) {
+      return set_error(1, "switch:tree selected compressor " + std::to_string(nodes[node].id) + " which is not configured");
+    }
+    selected_id = nodes[node].id;
+    return 0;
+  }
+
   uint64_t active_id = 0;
+  uint64_t selected_id = 0;
+  std::string selector = "none";
+  std::vector<std::string> feature_ids = default_features();
+  pressio_metrics features = make_features(feature_ids);
+  std::vector<std::string> tree;
+  std::vector<tree_node> nodes;
+  uint64_t sample_bytes = 1024*1024;
+  double throughput_weight = 0.5;
   std::vector<std::string> names;
   std::vector<std::string> compressor_ids;
   std::vector<pressio_compressor> compressors;
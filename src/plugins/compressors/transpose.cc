@@ -41,7 +41,8 @@ public:
     struct pressio_options options;
     set_meta_docs(options, "transpose:compressor", "Compressor to use after transpose is applied", compressor);
     set(options, "pressio:description", "Meta-compressor that applies a transpose before compression");
-    set(options, "transpose:axis", "how to reorder the dimensions, contains indicies 0..(N_DIMS-1)");
+    set(options, "transpose:axis", "how to reorder the dimensions, contains indicies 0..(N_DIMS-1); by default the dimensions are reversed");
+    set(options, "transpose:copied", "true if the last operation copied the data to transpose it rather than passing a view of the buffer");
     return options;
   }
 
@@ -58,6 +59,15 @@ public:
   int compress_impl(const pressio_data* input,
                     struct pressio_data* output) override
   {
+    if(!valid_axis(input->num_dimensions())) {
+      return set_error(1, "transpose:axis must be a permutation of the dimensions of the input");
+    }
+    copied = !input->transpose_is_reshape(axis);
+    if(!copied) {
+      //the order of the elements is unchanged, so the child can read the input directly
+      auto view = pressio_data::nonowning(input->dtype(), input->data(), input->transposed_dims(axis));
+      return compressor->compress(&view, output);
+    }
     auto tmp = input->transpose(axis);
     return compressor->compress(&tmp, output);
   }
@@ -65,16 +75,32 @@ public:
   int decompress_impl(const pressio_data* input,
                       struct pressio_data* output) override
   {
-    auto ret = compressor->decompress(input, output);
-    output->transpose(axis);
+    const auto dims = output->dimensions();
+    if(!valid_axis(dims.size())) {
+      return set_error(1, "transpose:axis must be a permutation of the dimensions of the output");
+    }
+    copied = !output->transpose_is_reshape(axis);
+    if(!copied) {
+      output->reshape(output->transposed_dims(axis));
+      int ret = compressor->decompress(input, output);
+      output->reshape(dims);
+      return ret;
+    }
+
+    auto tmp = pressio_data::owning(output->dtype(), output->transposed_dims(axis));
+    int ret = compressor->decompress(input, &tmp);
+    if(ret > 0) {
+      return set_error(compressor->error_code(), compressor->error_msg());
+    }
+    *output = tmp.transpose(inverse_axis(tmp.num_dimensions()));
     return ret;
   }
 
   int major_version() const override { return 0; }
-  int minor_version() const override { return 0; }
-  int patch_version() const override { return 1; }
+  int minor_version() const override { return 1; }
+  int patch_version() const override { return 0; }
 
-  const char* version() const override { return "0.0.1"; }
+  const char* version() const override { return "0.1.0"; }
 
   const char* prefix() const override { return "transpose"; }
 
@@ -90,7 +116,9 @@ public:
   }
 
   pressio_options get_metrics_results_impl() const override {
-    return compressor->get_metrics_results();
+    auto options = compressor->get_metrics_results();
+    set(options, "transpose:copied", copied);
+    return options;
   }
 
   std::shared_ptr<libpressio_compressor_plugin> clone() override
@@ -99,7 +127,31 @@ public:
   }
 
 private:
+  bool valid_axis(size_t n) const {
+    if(axis.empty()) return true;
+    if(axis.size() != n) return false;
+    std::vector<bool> seen(n, false);
+    for (auto a : axis) {
+      if(a >= n || seen[a]) return false;
+      seen[a] = true;
+    }
+    return true;
+  }
+
+  /**
+   * \returns the permutation that undoes axis for data with n dimensions
+   */
+  std::vector<size_t> inverse_axis(size_t n) const {
+    if(axis.empty()) return {};
+    std::vector<size_t> inverse(n);
+    for (size_t k = 0; k < n; ++k) {
+      inverse[axis[k]] = k;
+    }
+    return inverse;
+  }
+
   std::vector<size_t> axis;
+  bool copied = false;
   pressio_compressor compressor = compressor_plugins().build("noop");
   std::string compressor_id = "noop";
 };
@@ -0,0 +1,211 @@
+#include "block_sample_impl.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <random>
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/task_runtime.h"
+
+namespace libpressio {
+namespace metrics_sampling {
+
+size_t sample_block::size() const {
+  return std::accumulate(extent.begin(), extent.end(), size_t{1}, std::multiplies<>{});
+}
+
+double block_sample::fraction() const {
+  if(population == 0) return 1.0;
+  return static_cast<double>(blocks.size()) / static_cast<double>(population);
+}
+
+namespace {
+  /**
+   * groups the tiles into strata of about 1/rate tiles and picks one tile from each
+   *
+   * \returns the linear ids of the chosen tiles in ascending order
+   */
+  std::vector<size_t> select_strata(std::vector<size_t> const& tiles, double rate, uint32_t seed) {
+    const size_t nd = tiles.size();
+    std::vector<size_t> group(nd), strata(nd);
+    double remaining = 1.0 / rate;
+    for (size_t i = 0; i < nd; ++i) {
+      const size_t d = nd - 1 - i;
+      const double edge = std::pow(remaining, 1.0 / static_cast<double>(nd - i));
+      group[d] = std::min<size_t>(tiles[d], std::max<long long>(1, std::llround(edge)));
+      remaining /= static_cast<double>(group[d]);
+      strata[d] = (tiles[d] + group[d] - 1) / group[d];
+    }
+    const size_t num_strata = std::accumulate(strata.begin(), strata.end(), size_t{1}, std::multiplies<>{});
+
+    std::vector<size_t> chosen(num_strata);
+    for (size_t s = 0; s < num_strata; ++s) {
+      std::seed_seq seed_s{seed, static_cast<uint32_t>(s), static_cast<uint32_t>(static_cast<uint64_t>(s) >> 32)};
+      std::minstd_rand gen{seed_s};
+      size_t id = 0, stride = 1, rem = s;
+      for (size_t d = 0; d < nd; ++d) {
+        const size_t lo = (rem % strata[d]) * group[d];
+        const size_t hi = std::min(lo + group[d], tiles[d]);
+        rem /= strata[d];
+        std::uniform_int_distribution<size_t> dist(lo, hi - 1);
+        id += dist(gen) * stride;
+        stride *= tiles[d];
+      }
+      chosen[s] = id;
+    }
+    std::sort(chosen.begin(), chosen.end());
+    return chosen;
+  }
+}
+
+bool block_sampler::enabled() const {
+  return rate > 0.0 && rate < 1.0;
+}
+
+block_sample block_sampler::select(std::vector<size_t> const& dims) const {
+  block_sample sample;
+  if(dims.empty()) return sample;
+  const size_t edge = std::max<uint64_t>(block_size, 1);
+
+  std::vector<size_t> extent(dims.size()), tiles(dims.size());
+  for (size_t d = 0; d < dims.size(); ++d) {
+    extent[d] = std::min(edge, dims[d]);
+    tiles[d] = (dims[d] + extent[d] - 1) / extent[d];
+  }
+  sample.population = std::accumulate(tiles.begin(), tiles.end(), size_t{1}, std::multiplies<>{});
+
+  std::vector<size_t> chosen;
+  if(enabled() && stratified) {
+    chosen = select_strata(tiles, rate, seed);
+  } else if(enabled()) {
+    chosen.resize(sample.population);
+    std::iota(chosen.begin(), chosen.end(), 0);
+    const size_t k = std::max<size_t>(1, static_cast<size_t>(std::llround(rate * static_cast<double>(sample.population))));
+    std::seed_seq seed_s{seed};
+    std::minstd_rand gen{seed_s};
+    //partial Fisher-Yates shuffle, only the first k positions are needed
+    for (size_t i = 0; i < k; ++i) {
+      std::uniform_int_distribution<size_t> dist(i, sample.population - 1);
+      std::swap(chosen[i], chosen[dist(gen)]);
+    }
+    chosen.resize(k);
+    std::sort(chosen.begin(), chosen.end());
+  } else {
+    chosen.resize(sample.population);
+    std::iota(chosen.begin(), chosen.end(), 0);
+  }
+
+  sample.blocks.reserve(chosen.size());
+  for (size_t id : chosen) {
+    sample_block block;
+    block.extent = extent;
+    block.origin.resize(dims.size());
+    for (size_t d = 0; d < dims.size(); ++d) {
+      block.origin[d] = std::min((id % tiles[d]) * extent[d], dims[d] - extent[d]);
+      id /= tiles[d];
+    }
+    sample.blocks.emplace_back(std::move(block));
+  }
+  return sample;
+}
+
+namespace {
+  /**
+   * copies block from data into out which must hold at least block.size() elements
+   *
+   * leading dimensions that the block spans completely are contiguous in data, so they are merged with the
+   * first dimension the block does not span into a single memcpy
+   */
+  void gather_into(pressio_data const& data, std::vector<size_t> const& dims, sample_block const& block, unsigned char* out) {
+    const size_t elm_size = pressio_dtype_size(data.dtype());
+    size_t merged = 0, run = 1, stride = 1;
+    while(merged < dims.size() && block.extent[merged] == dims[merged]) {
+      run *= dims[merged];
+      stride *= dims[merged];
+      ++merged;
+    }
+    size_t base = 0;
+    if(merged < dims.size()) {
+      base = block.origin[merged] * stride;
+      run *= block.extent[merged];
+      stride *= dims[merged];
+      ++merged;
+    }
+    const size_t run_bytes = run * elm_size;
+    const size_t runs = block.size() / run;
+    unsigned char const* in = static_cast<unsigned char const*>(data.data());
+    for (size_t r = 0; r < runs; ++r) {
+      size_t offset = base;
+      size_t outer_stride = stride;
+      size_t rem = r;
+      for (size_t d = merged; d < dims.size(); ++d) {
+        offset += (block.origin[d] + rem % block.extent[d]) * outer_stride;
+        rem /= block.extent[d];
+        outer_stride *= dims[d];
+      }
+      memcpy(out + r * run_bytes, in + offset * elm_size, run_bytes);
+    }
+  }
+}
+
+pressio_data gather(pressio_data const& data, std::vector<size_t> const& dims, sample_block const& block) {
+  pressio_data out = pressio_data::owning(data.dtype(), block.extent);
+  gather_into(data, dims, block, static_cast<unsigned char*>(out.data()));
+  return out;
+}
+
+pressio_data gather(pressio_data const& data, std::vector<size_t> const& dims, block_sample const& sample, uint32_t nthreads) {
+  std::vector<size_t> offsets(sample.blocks.size() + 1, 0);
+  for (size_t i = 0; i < sample.blocks.size(); ++i) {
+    offsets[i + 1] = offsets[i] + sample.blocks[i].size();
+  }
+  pressio_data out = pressio_data::owning(data.dtype(), {offsets.back()});
+  unsigned char* ptr = static_cast<unsigned char*>(out.data());
+  const size_t elm_size = pressio_dtype_size(data.dtype());
+  pressio_task_runtime::instance().parallel_for(sample.blocks.size(), nthreads, [&](size_t i, uint32_t) {
+    gather_into(data, dims, sample.blocks[i], ptr + offsets[i] * elm_size);
+  });
+  return out;
+}
+
+estimate ratio_estimate(std::vector<double> const& totals, std::vector<double> const& counts, double fraction) {
+  const size_t k = totals.size();
+  const double total = std::accumulate(totals.begin(), totals.end(), 0.0);
+  const double count = std::accumulate(counts.begin(), counts.end(), 0.0);
+  estimate e;
+  e.value = total / count;
+  if(fraction >= 1.0) {
+    e.ci = 0.0;
+  } else if (k < 2) {
+    e.ci = std::numeric_limits<double>::infinity();
+  } else {
+    double residuals = 0;
+    for (size_t i = 0; i < k; ++i) {
+      const double r = totals[i] - e.value * counts[i];
+      residuals += r * r;
+    }
+    const double mean_count = count / static_cast<double>(k);
+    const double variance = (1.0 - fraction) * residuals / (static_cast<double>(k - 1) * static_cast<double>(k) * mean_count * mean_count);
+    e.ci = z95 * std::sqrt(variance);
+  }
+  return e;
+}
+
+size_t jackknife_groups(size_t blocks) {
+  return std::min<size_t>(blocks, 10);
+}
+
+double jackknife_ci(std::vector<double> const& replicates, double fraction) {
+  const size_t g = replicates.size();
+  if(fraction >= 1.0) return 0.0;
+  if(g < 2) return std::numeric_limits<double>::infinity();
+  const double mean = std::accumulate(replicates.begin(), replicates.end(), 0.0) / static_cast<double>(g);
+  double sq = 0;
+  for (auto r : replicates) sq += (r - mean) * (r - mean);
+  const double variance = (1.0 - fraction) * static_cast<double>(g - 1) / static_cast<double>(g) * sq;
+  return z95 * std::sqrt(variance);
+}
+
+} /* metrics_sampling */
+} /* libpressio */
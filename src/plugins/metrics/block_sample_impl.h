@@ -0,0 +1,133 @@
+#ifndef LIBPRESSIO_BLOCK_SAMPLE_IMPL
+#define LIBPRESSIO_BLOCK_SAMPLE_IMPL
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct pressio_data;
+
+namespace libpressio {
+namespace metrics_sampling {
+
+/**
+ * two sided 95% quantile of the standard normal distribution
+ */
+constexpr double z95 = 1.959963984540054;
+
+/**
+ * a hyper-rectangular block of a dataset
+ */
+struct sample_block {
+  /** the first index of the block in each dimension */
+  std::vector<size_t> origin;
+  /** the number of elements of the block in each dimension */
+  std::vector<size_t> extent;
+  /** \returns the number of elements in the block */
+  size_t size() const;
+};
+
+/**
+ * the blocks chosen by a block_sampler
+ */
+struct block_sample {
+  /** the selected blocks in ascending order of their position */
+  std::vector<sample_block> blocks;
+  /** the number of blocks the sample was drawn from */
+  size_t population = 0;
+
+  /** \returns the fraction of the blocks that were sampled, used as the finite population correction */
+  double fraction() const;
+};
+
+/**
+ * selects a deterministic pseudo-random subset of blocks of a dataset so that metrics can be
+ * estimated from a fraction of the data.
+ *
+ * The dataset is tiled with blocks of block_size elements per dimension (or the full dimension if
+ * it is smaller); the last block in each dimension is shifted back to end at the boundary so that every
+ * block has the same shape.  The same seed, rate, and dimensions always select the same blocks so the
+ * input and decompressed data are sampled at the same locations.
+ *
+ * When stratified is set, neighboring blocks are grouped into strata of about 1/rate blocks and one block
+ * is drawn from each stratum using a generator seeded by the seed and the stratum, so every region of the
+ * dataset is represented.
+ */
+struct block_sampler {
+  /** \returns true if the rate requests evaluating on less than the entire dataset */
+  bool enabled() const;
+
+  /**
+   * \param[in] dims the normalized dimensions of the dataset
+   * \returns the sampled blocks
+   */
+  block_sample select(std::vector<size_t> const& dims) const;
+
+  /** fraction of the blocks to sample, values outside of (0,1) evaluate the entire dataset */
+  double rate = 1.0;
+  /** seed for the block selection */
+  uint32_t seed = 0;
+  /** the number of elements of a block in each dimension */
+  uint64_t block_size = 32;
+  /** draw one block from each stratum of neighboring blocks instead of a simple random sample of blocks */
+  bool stratified = false;
+};
+
+/**
+ * copies a block out of a dataset
+ *
+ * \param[in] data the data to copy from
+ * \param[in] dims the normalized dimensions of data
+ * \param[in] block the block to copy
+ * \returns a dataset with the dimensions of the block
+ */
+pressio_data gather(pressio_data const& data, std::vector<size_t> const& dims, sample_block const& block);
+
+/**
+ * copies a set of blocks out of a dataset one after another
+ *
+ * \param[in] data the data to copy from
+ * \param[in] dims the normalized dimensions of data
+ * \param[in] sample the blocks to copy
+ * \param[in] nthreads the maximum number of threads of the task runtime used to copy blocks
+ * \returns a 1d dataset containing each of the blocks in order
+ */
+pressio_data gather(pressio_data const& data, std::vector<size_t> const& dims, block_sample const& sample, uint32_t nthreads = 1);
+
+/**
+ * an estimate and the half width of its 95% confidence interval
+ */
+struct estimate {
+  /** the estimated value */
+  double value;
+  /** the half width of the 95% confidence interval */
+  double ci;
+};
+
+/**
+ * ratio estimator for the per element mean of a quantity from per block totals
+ *
+ * \param[in] totals the sum of the quantity over each sampled block
+ * \param[in] counts the number of elements in each sampled block
+ * \param[in] fraction the fraction of the blocks that were sampled
+ * \returns the estimated mean and its confidence interval
+ */
+estimate ratio_estimate(std::vector<double> const& totals, std::vector<double> const& counts, double fraction);
+
+/**
+ * \param[in] blocks the number of sampled blocks
+ * \returns the number of groups to use for a delete-a-group jackknife; block i belongs to group i % groups
+ */
+size_t jackknife_groups(size_t blocks);
+
+/**
+ * \param[in] replicates the statistic computed leaving out each group in turn
+ * \param[in] fraction the fraction of the blocks that were sampled
+ * \returns the half width of the 95% confidence interval of the delete-a-group jackknife
+ */
+double jackknife_ci(std::vector<double> const& replicates, double fraction);
+
+} /* metrics_sampling */
+} /* libpressio */
+
+#endif /* end of include guard: LIBPRESSIO_BLOCK_SAMPLE_IMPL */
@@ -154,6 +154,13 @@ class composite_plugin : public libpressio_metrics_plugin {
  
   }
 
+  int view_segment_impl(pressio_data const* data, const char* segment_id) override {
+    for (auto& plugin : plugins) {
+      plugin->view_segment(data, segment_id);
+    }
+    return 0;
+  }
+
   pressio_options get_metrics_results(pressio_options const &)  override {
     struct pressio_options metrics_result;
     for (auto const& plugin : plugins) {
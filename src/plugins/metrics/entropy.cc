@@ -7,8 +7,10 @@
 #include "libpressio_ext/cpp/options.h"
 #include "libpressio_ext/cpp/pressio.h"
 #include "std_compat/memory.h"
+#include "block_sample_impl.h"
 #include <vector>
 #include <map>
+#include <numeric>
 #include <cmath>
 
 namespace libpressio {
@@ -38,18 +40,95 @@ namespace entropy {
     }
   };
 
+  struct grouped_entropy {
+    double entropy;
+    std::vector<double> replicates;
+  };
+
+  /**
+   * computes the entropy of a sample made up of consecutive groups along with the entropy of
+   * the sample leaving out each group in turn for a jackknife estimate of the variance
+   */
+  struct compute_grouped_metrics{
+    template <class ForwardIt1>
+    grouped_entropy operator()(ForwardIt1 input_begin, ForwardIt1 input_end)
+    {
+      using value_type = typename std::iterator_traits<ForwardIt1>::value_type;
+      std::vector<std::map<value_type, size_t>> group_counts(group_sizes.size());
+      std::map<value_type, size_t> counts;
+      auto it = input_begin;
+      for (size_t g = 0; g < group_sizes.size(); ++g) {
+        for (size_t i = 0; i < group_sizes[g] && it != input_end; ++i, ++it) {
+          group_counts[g][*it] += 1;
+          counts[*it] += 1;
+        }
+      }
+      const size_t total = std::accumulate(group_sizes.begin(), group_sizes.end(), size_t{0});
+
+      grouped_entropy result;
+      result.entropy = entropy_of(counts, total, static_cast<decltype(&counts)>(nullptr));
+      for (size_t g = 0; g < group_sizes.size(); ++g) {
+        result.replicates.push_back(entropy_of(counts, total - group_sizes[g], &group_counts[g]));
+      }
+      return result;
+    }
+
+    template <class Map>
+    static double entropy_of(Map const& counts, size_t total, Map const* excluded) {
+      double entropy = 0;
+      for (auto const& i : counts) {
+        size_t count = i.second;
+        if(excluded) {
+          auto e = excluded->find(i.first);
+          if(e != excluded->end()) count -= e->second;
+        }
+        if(count == 0) continue;
+        double v = static_cast<double>(count) / static_cast<double>(total);
+        entropy +=  v * std::log2(v);
+      }
+      return -entropy;
+    }
+
+    std::vector<size_t> group_sizes;
+  };
+
 class entropy_plugin : public libpressio_metrics_plugin
 {
 
 public:
   int begin_compress_impl(const struct pressio_data* input, struct pressio_data const*) override
   {
-    input_entropy = pressio_data_for_each<double>(*input, entropy::compute_metrics{});
+    if(sampler.enabled()) {
+      evaluate_sampled(*input, input_entropy, input_ci);
+    } else {
+      input_entropy = pressio_data_for_each<double>(*input, entropy::compute_metrics{});
+      input_ci.reset();
+    }
     return 0;
   }
   int end_decompress_impl(struct pressio_data const*, struct pressio_data const* output, int) override
   {
-    dec_entropy = pressio_data_for_each<double>(*output, entropy::compute_metrics{});
+    if(sampler.enabled()) {
+      evaluate_sampled(*output, dec_entropy, dec_ci);
+    } else {
+      dec_entropy = pressio_data_for_each<double>(*output, entropy::compute_metrics{});
+      dec_ci.reset();
+    }
+    return 0;
+  }
+
+  pressio_options get_options() const override {
+    pressio_options opts;
+    set(opts, "pressio:metrics_sample_rate", sampler.rate);
+    set(opts, "pressio:metrics_sample_seed", sampler.seed);
+    set(opts, "pressio:metrics_sample_block", sampler.block_size);
+    return opts;
+  }
+
+  int set_options(pressio_options const& opts) override {
+    get(opts, "pressio:metrics_sample_rate", &sampler.rate);
+    get(opts, "pressio:metrics_sample_seed", &sampler.seed);
+    get(opts, "pressio:metrics_sample_block", &sampler.block_size);
     return 0;
   }
 
@@ -69,6 +148,13 @@ public:
     set(opts, "pressio:description", "computes the entropy of the input data and output data");
     set(opts, "entropy:input", "the entropy of the input data (shannon)");
     set(opts, "entropy:decompressed", "the entropy of the decompressed data (shannon)");
+    set(opts, "entropy:input_ci", "half width of the 95% confidence interval of the input entropy when sampling");
+    set(opts, "entropy:decompressed_ci", "half width of the 95% confidence interval of the decompressed entropy when sampling");
+    set(opts, "pressio:metrics_sample_rate", R"(fraction of the blocks of the data to evaluate the metrics on.
+    Values in (0,1) estimate the metrics from a deterministic pseudo-random subset of blocks; other values use the entire dataset.
+    The entropy of a sample is biased low for data with many distinct values)");
+    set(opts, "pressio:metrics_sample_seed", "seed used to choose the sampled blocks");
+    set(opts, "pressio:metrics_sample_block", "number of elements of a sampled block in each dimension");
     return opts;
   }
 
@@ -77,6 +163,8 @@ public:
     pressio_options opt;
     set(opt, "entropy:input", input_entropy);
     set(opt, "entropy:decompressed", dec_entropy);
+    set(opt, "entropy:input_ci", input_ci);
+    set(opt, "entropy:decompressed_ci", dec_ci);
     return opt;
   }
 
@@ -89,9 +177,39 @@ public:
   }
 
 private:
+  void evaluate_sampled(pressio_data const& data, compat::optional<double>& value, compat::optional<double>& ci) {
+    auto dims = data.normalized_dims();
+    auto sample = sampler.select(dims);
+    if(sample.blocks.empty()) {
+      value.reset();
+      ci.reset();
+      return;
+    }
+
+    //order the blocks by jackknife group so each group is contiguous once gathered
+    const size_t groups = metrics_sampling::jackknife_groups(sample.blocks.size());
+    metrics_sampling::block_sample grouped;
+    grouped.population = sample.population;
+    entropy::compute_grouped_metrics compute;
+    compute.group_sizes.resize(groups);
+    for (size_t g = 0; g < groups; ++g) {
+      for (size_t i = g; i < sample.blocks.size(); i += groups) {
+        compute.group_sizes[g] += sample.blocks[i].size();
+        grouped.blocks.emplace_back(sample.blocks[i]);
+      }
+    }
+
+    auto result = pressio_data_for_each<entropy::grouped_entropy>(metrics_sampling::gather(data, dims, grouped), compute);
+    value = result.entropy;
+    ci = metrics_sampling::jackknife_ci(result.replicates, sample.fraction());
+  }
+
   pressio_data input_data = pressio_data::empty(pressio_byte_dtype, {});
   compat::optional<double> input_entropy;
   compat::optional<double> dec_entropy;
+  compat::optional<double> input_ci;
+  compat::optional<double> dec_ci;
+  metrics_sampling::block_sampler sampler;
 };
 
 static pressio_register metrics_entropy_plugin(metrics_plugins(), "entropy", []() {
@@ -1,4 +1,7 @@
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <vector>
 #include "pressio_data.h"
 #include "pressio_options.h"
 #include "pressio_compressor.h"
@@ -7,6 +10,7 @@
 #include "libpressio_ext/cpp/options.h"
 #include "libpressio_ext/cpp/pressio.h"
 #include "std_compat/memory.h"
+#include "block_sample_impl.h"
 
 namespace libpressio {
 namespace error_stat {
@@ -24,6 +28,8 @@ namespace error_stat {
     double average_difference;
     double average_error;
     double difference_range;
+    double difference_min;
+    double difference_max;
     double error_range;
     double value_min;
     double value_max;
@@ -91,6 +97,8 @@ namespace error_stat {
         m.value_range = value_max-value_min;
 
         m.difference_range = diff_max - diff_min;
+        m.difference_min = diff_min;
+        m.difference_max = diff_max;
         m.error_range = error_max - error_min;
 
         m.min_error = error_min;
@@ -107,15 +115,104 @@ namespace error_stat {
     }
   };
 
+  /**
+   * combines the metrics computed on each sampled block into estimates for the entire dataset
+   */
+  metrics combine_blocks(std::vector<metrics> const& blocks, metrics_sampling::block_sample const& sample, metrics_sampling::estimate& mse, metrics_sampling::estimate& average_difference, metrics_sampling::estimate& average_error, metrics_sampling::estimate& value_mean) {
+    const size_t k = blocks.size();
+    std::vector<double> counts(k), squared_errors(k), differences(k), errors(k), values(k), squared_values(k);
+    metrics m{};
+    m.value_min = std::numeric_limits<double>::max();
+    m.value_max = std::numeric_limits<double>::lowest();
+    m.min_error = std::numeric_limits<double>::max();
+    m.max_error = std::numeric_limits<double>::lowest();
+    m.min_pw_rel_error = std::numeric_limits<double>::max();
+    m.max_pw_rel_error = std::numeric_limits<double>::lowest();
+    m.difference_min = std::numeric_limits<double>::max();
+    m.difference_max = std::numeric_limits<double>::lowest();
+    for (size_t i = 0; i < k; ++i) {
+      auto const& b = blocks[i];
+      const double n = static_cast<double>(b.num_elements);
+      counts[i] = n;
+      squared_errors[i] = b.mse * n;
+      differences[i] = b.average_difference * n;
+      errors[i] = b.average_error * n;
+      values[i] = b.value_mean * n;
+      squared_values[i] = (b.value_std * b.value_std + b.value_mean * b.value_mean) * n;
+      m.num_elements += b.num_elements;
+      m.value_min = std::min(m.value_min, b.value_min);
+      m.value_max = std::max(m.value_max, b.value_max);
+      m.min_error = std::min(m.min_error, b.min_error);
+      m.max_error = std::max(m.max_error, b.max_error);
+      m.min_pw_rel_error = std::min(m.min_pw_rel_error, b.min_pw_rel_error);
+      m.max_pw_rel_error = std::max(m.max_pw_rel_error, b.max_pw_rel_error);
+      m.difference_min = std::min(m.difference_min, b.difference_min);
+      m.difference_max = std::max(m.difference_max, b.difference_max);
+    }
+    const double fraction = sample.fraction();
+    mse = metrics_sampling::ratio_estimate(squared_errors, counts, fraction);
+    average_difference = metrics_sampling::ratio_estimate(differences, counts, fraction);
+    average_error = metrics_sampling::ratio_estimate(errors, counts, fraction);
+    value_mean = metrics_sampling::ratio_estimate(values, counts, fraction);
+    const double mean_squared_value = metrics_sampling::ratio_estimate(squared_values, counts, fraction).value;
+
+    m.mse = mse.value;
+    m.rmse = std::sqrt(m.mse);
+    m.average_difference = average_difference.value;
+    m.average_error = average_error.value;
+    m.value_mean = value_mean.value;
+    m.value_std = std::sqrt(std::max(0.0, mean_squared_value - m.value_mean * m.value_mean));
+    m.value_range = m.value_max - m.value_min;
+    m.difference_range = m.difference_max - m.difference_min;
+    m.error_range = m.max_error - m.min_error;
+    m.min_rel_error = m.min_error/m.value_range;
+    m.max_rel_error = m.max_error/m.value_range;
+    m.psnr = -20.0*log10(m.rmse/m.value_range);
+    return m;
+  }
+
 class error_stat_plugin : public libpressio_metrics_plugin {
 
   public:
     int begin_compress_impl(const struct pressio_data * input, struct pressio_data const * ) override {
-      input_data = pressio_data::clone(*input);
+      if(sampler.enabled()) {
+        dims = input->normalized_dims();
+        sample = sampler.select(dims);
+        input_blocks.clear();
+        for (auto const& block : sample.blocks) {
+          input_blocks.emplace_back(metrics_sampling::gather(*input, dims, block));
+        }
+      } else {
+        input_data = pressio_data::clone(*input);
+      }
       return 0;
     }
     int end_decompress_impl(struct pressio_data const*, struct pressio_data const* output, int ) override {
-      err_metrics = pressio_data_for_each<error_stat::metrics>(input_data, *output, error_stat::compute_metrics{});
+      if(sampler.enabled()) {
+        evaluate_sampled(*output);
+      } else {
+        err_metrics = pressio_data_for_each<error_stat::metrics>(input_data, *output, error_stat::compute_metrics{});
+        psnr_ci.reset();
+        mse_ci.reset();
+        average_difference_ci.reset();
+        average_error_ci.reset();
+        value_mean_ci.reset();
+      }
+      return 0;
+    }
+
+    pressio_options get_options() const override {
+      pressio_options opts;
+      set(opts, "pressio:metrics_sample_rate", sampler.rate);
+      set(opts, "pressio:metrics_sample_seed", sampler.seed);
+      set(opts, "pressio:metrics_sample_block", sampler.block_size);
+      return opts;
+    }
+
+    int set_options(pressio_options const& opts) override {
+      get(opts, "pressio:metrics_sample_rate", &sampler.rate);
+      get(opts, "pressio:metrics_sample_seed", &sampler.seed);
+      get(opts, "pressio:metrics_sample_block", &sampler.block_size);
       return 0;
     }
 
@@ -174,6 +271,16 @@ class error_stat_plugin : public libpressio_metrics_plugin {
       set(opt, "error_stat:difference_range", "the range of the differences");
       set(opt, "error_stat:error_range", "the range of the absolute differences");
       set(opt, "error_stat:n", "the number of input values");
+      set(opt, "error_stat:psnr_ci", "half width of the 95% confidence interval of psnr when sampling");
+      set(opt, "error_stat:mse_ci", "half width of the 95% confidence interval of mse when sampling");
+      set(opt, "error_stat:average_difference_ci", "half width of the 95% confidence interval of average_difference when sampling");
+      set(opt, "error_stat:average_error_ci", "half width of the 95% confidence interval of average_error when sampling");
+      set(opt, "error_stat:value_mean_ci", "half width of the 95% confidence interval of value_mean when sampling");
+      set(opt, "pressio:metrics_sample_rate", R"(fraction of the blocks of the data to evaluate the metrics on.
+      Values in (0,1) estimate the metrics from a deterministic pseudo-random subset of blocks; other values use the entire dataset.
+      When sampling, min and max statistics are those of the sampled blocks)");
+      set(opt, "pressio:metrics_sample_seed", "seed used to choose the sampled blocks");
+      set(opt, "pressio:metrics_sample_block", "number of elements of a sampled block in each dimension");
       return opt;
     }
     pressio_options get_metrics_results(pressio_options const &)  override {
@@ -219,6 +326,11 @@ class error_stat_plugin : public libpressio_metrics_plugin {
         set_type(opt, "error_stat:difference_range", pressio_option_double_type);
         set_type(opt, "error_stat:error_range", pressio_option_double_type);
       }
+      set(opt, "error_stat:psnr_ci", psnr_ci);
+      set(opt, "error_stat:mse_ci", mse_ci);
+      set(opt, "error_stat:average_difference_ci", average_difference_ci);
+      set(opt, "error_stat:average_error_ci", average_error_ci);
+      set(opt, "error_stat:value_mean_ci", value_mean_ci);
       return opt;
     }
     std::unique_ptr<libpressio_metrics_plugin> clone() override {
@@ -231,8 +343,35 @@ class error_stat_plugin : public libpressio_metrics_plugin {
 
 
   private:
+  void evaluate_sampled(pressio_data const& output) {
+    std::vector<error_stat::metrics> blocks(sample.blocks.size());
+    for (size_t i = 0; i < sample.blocks.size(); ++i) {
+      pressio_data const& input_block = input_blocks[i];
+      const pressio_data output_block = metrics_sampling::gather(output, dims, sample.blocks[i]);
+      blocks[i] = pressio_data_for_each<error_stat::metrics>(input_block, output_block, error_stat::compute_metrics{});
+    }
+    metrics_sampling::estimate mse, average_difference, average_error, value_mean;
+    err_metrics = error_stat::combine_blocks(blocks, sample, mse, average_difference, average_error, value_mean);
+    mse_ci = mse.ci;
+    average_difference_ci = average_difference.ci;
+    average_error_ci = average_error.ci;
+    value_mean_ci = value_mean.ci;
+    //first order propagation of the mse interval through psnr = -10 log10(mse) + 20 log10(range)
+    if(mse.value == 0) {
+      //the psnr of an exact sample is infinite, so it has no interval
+      psnr_ci.reset();
+    } else {
+      psnr_ci = 10.0 / std::log(10.0) * mse.ci / mse.value;
+    }
+  }
+
   pressio_data input_data = pressio_data::empty(pressio_byte_dtype, {});
   compat::optional<error_stat::metrics> err_metrics;
+  compat::optional<double> psnr_ci, mse_ci, average_difference_ci, average_error_ci, value_mean_ci;
+  metrics_sampling::block_sampler sampler;
+  metrics_sampling::block_sample sample;
+  std::vector<size_t> dims;
+  std::vector<pressio_data> input_blocks;
 
 };
 
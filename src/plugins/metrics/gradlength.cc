@@ -6,588 +6,89 @@
 #include "libpressio_ext/cpp/pressio.h"
 #include "libpressio_ext/cpp/options.h"
 #include "std_compat/memory.h"
+#include <algorithm>
 #include <cmath>
 
 namespace libpressio { namespace gradlength_metrics_ns {
-#define QCAT_FLOAT 0
-#define QCAT_DOUBLE 1
-#define QCAT_INT32 2
-#define QCAT_INT16 3
-#define QCAT_UINT32 4
-#define QCAT_UINT16 5
 
-
-void computeGradientLength_float(float* data, float*gradMag, size_t , size_t r4, size_t r3, size_t r2, size_t r1)
+/**
+ * gradient length as defined by qcat: central differences in the interior of each dimension and
+ * one sided differences on the boundaries.  For 1d data the signed derivative is returned,
+ * otherwise the length of the gradient vector.
+ *
+ * Each row along the contiguous dimension is independent, so rows are distributed over threads and
+ * the boundary handling for the outer dimensions is hoisted out of the inner loop.
+ */
+template <class T>
+void computeGradientLength(T const* data, T* gradMag, std::vector<size_t> const& dims, unsigned int nthreads)
 {
-	size_t i, j, k, index;
-	double gradx, grady, gradz;
-	
-	if(r2==0)
-	{
-		gradMag[0] = data[1] - data[0];
-		gradMag[r1-1] = data[r1-1]-data[r1-2];
-		for(i=1;i<r1-1;i++)
-			gradMag[i] = (data[i+1]-data[i-1])/2;
-	}
-	else if(r3==0)
-	{
-		//process four corners
-		gradx = data[1]-data[0];
-		grady = data[r1]-data[0];
-		gradMag[0] = sqrt(gradx*gradx+grady*grady);
-		index = r1-1;
-		gradx = data[index]-data[index-1];
-		grady = data[index+r1]-data[index];
-		gradMag[index] = sqrt(gradx*gradx+grady*grady);		
-		index = (r2-1)*r1;
-		gradx = data[index+1]-data[index];
-		grady = data[index]-data[index-r1];
-		gradMag[index] = sqrt(gradx*gradx+grady*grady);	
-		index = (r2-1)*r1 + r1 - 1;			
-		gradx = data[index]-data[index-1];
-		grady = data[index]-data[index-r1];
-		gradMag[index] = sqrt(gradx*gradx+grady*grady);								
-		
-		//process four edges
-		for(i=1;i<r1-1;i++)
-		{
-			index = i;
-			gradx = (data[index+1]-data[index-1])/2;
-			grady = data[index+r1]-data[index];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady);			
-		}
-		for(i=1;i<r1-1;i++)
-		{
-			index = (r2-1)*r1 + i;
-			gradx = (data[index+1]-data[index-1])/2;
-			grady = data[index]-data[index-r1];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady);			
-		}
-		
-		for(i=1;i<r2-1;i++)
-		{
-			index = i*r1;
-			gradx = (data[index+1] - data[index]);
-			grady = (data[index+r1]-data[index-r1])/2;
-			gradMag[index] = sqrt(gradx*gradx+grady*grady);						
-		}
-		for(i=1;i<r2-1;i++)
-		{
-			index = i*r1+r1-1;
-			gradx = (data[index] - data[index-1]);
-			grady = (data[index+r1]-data[index-r1])/2;
-			gradMag[index] = sqrt(gradx*gradx+grady*grady);						
-		}		
-		
-		//process all interior points
-		for(i=1;i<r2-1;i++)
-			for(j=1;j<r1-1;j++)
-			{
-				index = i*r1+j;
-				gradx = (data[index+1] - data[index-1])/2;
-				grady = (data[index+r1] - data[index-r1])/2;
-				gradMag[index] = sqrt(gradx*gradx+grady*grady);
-			}
-		
-	}else if(r4==0) //3D
-	{
-		size_t r2r1 = r2*r1;
-		//process all 8 corners
-		gradx = data[1]-data[0];
-		grady = data[r1]-data[0];
-		gradz = data[r2r1]-data[0];		
-		gradMag[0] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-		
-		index = r1-1;
-		gradx = data[index]-data[index-1];
-		grady = data[index+r1]-data[index];		
-		gradz = data[index+r2r1]-data[index];		
-		gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-		
-		index = (r2-1)*r1;
-		gradx = data[index+1]-data[index];
-		grady = data[index]-data[index-r1];		
-		gradz = data[index+r2r1]-data[index];		
-		gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-
-		index = (r2-1)*r1 + r1 - 1;
-		gradx = data[index]-data[index-1];
-		grady = data[index]-data[index-r1];		
-		gradz = data[index+r2r1]-data[index];		
-		gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-		
-		index = (r3-1)*r2r1;
-		gradx = data[index+1]-data[index];
-		grady = data[index+r1]-data[index];
-		gradz = data[index]-data[index-r2r1];		
-		gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-		
-		index = (r3-1)*r2r1+r1-1;
-		gradx = data[index]-data[index-1];
-		grady = data[index+r1]-data[index];		
-		gradz = data[index]-data[index-r2r1];		
-		gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-		
-		index = (r3-1)*r2r1 + (r2-1)*r1;
-		gradx = data[index+1]-data[index];
-		grady = data[index]-data[index-r1];		
-		gradz = data[index]-data[index-r2r1];		
-		gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-
-		index = (r3-1)*r2r1 + (r2-1)*r1 + r1 - 1;
-		gradx = data[index]-data[index-1];
-		grady = data[index]-data[index-r1];		
-		gradz = data[index]-data[index-r2r1];		
-		gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);		
-				
-		//process all 8 edges
-		for(i=1;i<r1-1;i++)
-		{
-			index = i;
-			gradx = (data[index+1]-data[index-1])/2;
-			grady = data[index+r1]-data[index];
-			gradz = data[index+r2r1] - data[index];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);			
-		}
-
-		for(i=1;i<r1-1;i++)
-		{
-			index = (r2-1)*r1 + i;
-			gradx = (data[index+1]-data[index-1])/2;
-			grady = data[index]-data[index-r1];
-			gradz = data[index+r2r1] - data[index];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);			
-		}
-		
-		for(i=1;i<r2-1;i++)
-		{
-			index = i*r1;
-			gradx = (data[index+1] - data[index]);
-			grady = (data[index+r1]-data[index-r1])/2;
-			gradz = data[index+r2r1] - data[index];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);						
-		}
-		for(i=1;i<r2-1;i++)
-		{
-			index = i*r1+r1-1;
-			gradx = (data[index] - data[index-1]);
-			grady = (data[index+r1]-data[index-r1])/2;
-			gradz = data[index+r2r1] - data[index];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);						
-		}
-		
-		for(i=1;i<r1-1;i++)
-		{
-			index = (r3-1)*r2r1 + i;
-			gradx = (data[index+1]-data[index-1])/2;
-			grady = data[index+r1]-data[index];
-			gradz = data[index] - data[index-r2r1];
-			gradMag[i] = sqrt(gradx*gradx+grady*grady+gradz*gradz);			
-		}
-
-		for(i=1;i<r1-1;i++)
-		{
-			index = (r3-1)*r2r1 + (r2-1)*r1 + i;
-			gradx = (data[index+1]-data[index-1])/2;
-			grady = data[index]-data[index-r1];
-			gradz = data[index] - data[index-r2r1];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);			
-		}
-		
-		for(i=1;i<r2-1;i++)
-		{
-			index = (r3-1)*r2r1+i*r1;
-			gradx = (data[index+1] - data[index]);
-			grady = (data[index+r1]-data[index-r1])/2;
-			gradz = data[index] - data[index-r2r1];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);						
-		}
-		
-		for(i=1;i<r2-1;i++)
-		{
-			index = (r3-1)*r2r1+i*r1+r1-1;
-			gradx = (data[index] - data[index-1]);
-			grady = (data[index+r1]-data[index-r1])/2;
-			gradz = data[index] - data[index-r2r1];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);						
-		}
-		
-		//process all 6 sides
-		for(i=1;i<r2-1;i++)
-			for(j=1;j<r1-1;j++)
-			{
-				index = i*r1+j;
-				gradx = (data[index+1] - data[index-1])/2;
-				grady = (data[index+r1] - data[index-r1])/2;
-				gradz = data[index+r2r1] - data[index];
-				gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-			}		
-
-		for(i=1;i<r2-1;i++)
-			for(j=1;j<r1-1;j++)
-			{
-				index = (r3-1)*r2r1 + i*r1 + j;
-				gradx = (data[index+1] - data[index-1])/2;
-				grady = (data[index+r1] - data[index-r1])/2;
-				gradz = data[index] - data[index-r2r1];
-				gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-			}				
-		
-		for(i=1;i<r3-1;i++)
-			for(k=1;k<r1-1;k++)
-			{
-				index = i*r2r1 + k; //j is always 0
-				gradx = (data[index+1] - data[index-1])/2;
-				grady = data[index+r1] - data[index];
-				gradz = (data[index+r2r1] - data[index-r2r1])/2;
-				gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-			}
-			
-		for(i=1;i<r3-1;i++)
-			for(k=1;k<r1-1;k++)
-			{
-				j = r2-1;
-				index = i*r2r1 + j*r1 + k;
-				gradx = (data[index+1] - data[index-1])/2;
-				grady = data[index] - data[index-r1];
-				gradz = (data[index+r2r1] - data[index-r2r1])/2;
-				gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-			}
-
-		for(i=1;i<r3-1;i++)
-			for(j=1;j<r2-1;j++)
-			{
-				index = i*r2r1 + j*r1;
-				gradx = data[index+1] - data[index];
-				grady = (data[index+r1] - data[index-r1])/2;
-				gradz = (data[index+r2r1] - data[index-r2r1])/2;
-				gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-			}
-
-		for(i=1;i<r3-1;i++)
-			for(j=1;j<r2-1;j++)
-			{
-				k = r1-1;
-				index = i*r2r1 + j*r1 + k; 
-				gradx = data[index] - data[index-1];
-				grady = (data[index+r1] - data[index-r1])/2;
-				gradz = (data[index+r2r1] - data[index-r2r1])/2;
-				gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-			}
-		
-		//process interior points
-		for(i=1;i<r3-1;i++)
-			for(j=1;j<r2-1;j++)
-				for(k=1;k<r1-1;k++)
-				{
-					size_t index = i*r2r1+j*r1+k;
-					gradx = (data[index+1] - data[index-1])/2;
-					grady = (data[index+r1] - data[index-r1])/2;
-					gradz = (data[index+r2r1] - data[index-r2r1])/2;
-					gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-				}		
-	}
-	
-}
-
-void computeGradientLength_double(double* data, double*gradMag, size_t , size_t r4, size_t r3, size_t r2, size_t r1)
-{
-	size_t i, j, k, index;
-	double gradx, grady, gradz;
-	
-	if(r2==0)
-	{
-		gradMag[0] = data[1] - data[0];
-		gradMag[r1-1] = data[r1-1]-data[r1-2];
-		for(i=1;i<r1-1;i++)
-			gradMag[i] = (data[i+1]-data[i-1])/2;
-	}
-	else if(r3==0)
-	{
-		//process four corners
-		gradx = data[1]-data[0];
-		grady = data[r1]-data[0];
-		gradMag[0] = sqrt(gradx*gradx+grady*grady);
-		index = r1-1;
-		gradx = data[index]-data[index-1];
-		grady = data[index+r1]-data[index];
-		gradMag[index] = sqrt(gradx*gradx+grady*grady);		
-		index = (r2-1)*r1;
-		gradx = data[index+1]-data[index];
-		grady = data[index]-data[index-r1];
-		gradMag[index] = sqrt(gradx*gradx+grady*grady);	
-		index = (r2-1)*r1 + r1 - 1;			
-		gradx = data[index]-data[index-1];
-		grady = data[index]-data[index-r1];
-		gradMag[index] = sqrt(gradx*gradx+grady*grady);								
-		
-		//process four edges
-		for(i=1;i<r1-1;i++)
-		{
-			index = i;
-			gradx = (data[index+1]-data[index-1])/2;
-			grady = data[index+r1]-data[index];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady);			
-		}
-		for(i=1;i<r1-1;i++)
-		{
-			index = (r2-1)*r1 + i;
-			gradx = (data[index+1]-data[index-1])/2;
-			grady = data[index]-data[index-r1];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady);			
-		}
-		
-		for(i=1;i<r2-1;i++)
-		{
-			index = i*r1;
-			gradx = (data[index+1] - data[index]);
-			grady = (data[index+r1]-data[index-r1])/2;
-			gradMag[index] = sqrt(gradx*gradx+grady*grady);						
-		}
-		for(i=1;i<r2-1;i++)
-		{
-			index = i*r1+r1-1;
-			gradx = (data[index] - data[index-1]);
-			grady = (data[index+r1]-data[index-r1])/2;
-			gradMag[index] = sqrt(gradx*gradx+grady*grady);						
-		}		
-		
-		//process all interior points
-		for(i=1;i<r2-1;i++)
-			for(j=1;j<r1-1;j++)
-			{
-				index = i*r1+j;
-				gradx = (data[index+1] - data[index-1])/2;
-				grady = (data[index+r1] - data[index-r1])/2;
-				gradMag[index] = sqrt(gradx*gradx+grady*grady);
-			}
-		
-	}else if(r4==0) //3D
-	{
-		size_t r2r1 = r2*r1;
-		//process all 8 corners
-		gradx = data[1]-data[0];
-		grady = data[r1]-data[0];
-		gradz = data[r2r1]-data[0];		
-		gradMag[0] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-		
-		index = r1-1;
-		gradx = data[index]-data[index-1];
-		grady = data[index+r1]-data[index];		
-		gradz = data[index+r2r1]-data[index];		
-		gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-		
-		index = (r2-1)*r1;
-		gradx = data[index+1]-data[index];
-		grady = data[index]-data[index-r1];		
-		gradz = data[index+r2r1]-data[index];		
-		gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-
-		index = (r2-1)*r1 + r1 - 1;
-		gradx = data[index]-data[index-1];
-		grady = data[index]-data[index-r1];		
-		gradz = data[index+r2r1]-data[index];		
-		gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-		
-		index = (r3-1)*r2r1;
-		gradx = data[index+1]-data[index];
-		grady = data[index+r1]-data[index];
-		gradz = data[index]-data[index-r2r1];		
-		gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-		
-		index = (r3-1)*r2r1+r1-1;
-		gradx = data[index]-data[index-1];
-		grady = data[index+r1]-data[index];		
-		gradz = data[index]-data[index-r2r1];		
-		gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-		
-		index = (r3-1)*r2r1 + (r2-1)*r1;
-		gradx = data[index+1]-data[index];
-		grady = data[index]-data[index-r1];		
-		gradz = data[index]-data[index-r2r1];		
-		gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-
-		index = (r3-1)*r2r1 + (r2-1)*r1 + r1 - 1;
-		gradx = data[index]-data[index-1];
-		grady = data[index]-data[index-r1];		
-		gradz = data[index]-data[index-r2r1];		
-		gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);		
-				
-		//process all 8 edges
-		for(i=1;i<r1-1;i++)
-		{
-			index = i;
-			gradx = (data[index+1]-data[index-1])/2;
-			grady = data[index+r1]-data[index];
-			gradz = data[index+r2r1] - data[index];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);			
-		}
-
-		for(i=1;i<r1-1;i++)
-		{
-			index = (r2-1)*r1 + i;
-			gradx = (data[index+1]-data[index-1])/2;
-			grady = data[index]-data[index-r1];
-			gradz = data[index+r2r1] - data[index];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);			
-		}
-		
-		for(i=1;i<r2-1;i++)
-		{
-			index = i*r1;
-			gradx = (data[index+1] - data[index]);
-			grady = (data[index+r1]-data[index-r1])/2;
-			gradz = data[index+r2r1] - data[index];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);						
-		}
-		for(i=1;i<r2-1;i++)
-		{
-			index = i*r1+r1-1;
-			gradx = (data[index] - data[index-1]);
-			grady = (data[index+r1]-data[index-r1])/2;
-			gradz = data[index+r2r1] - data[index];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);						
-		}
-		
-		for(i=1;i<r1-1;i++)
-		{
-			index = (r3-1)*r2r1 + i;
-			gradx = (data[index+1]-data[index-1])/2;
-			grady = data[index+r1]-data[index];
-			gradz = data[index] - data[index-r2r1];
-			gradMag[i] = sqrt(gradx*gradx+grady*grady+gradz*gradz);			
-		}
-
-		for(i=1;i<r1-1;i++)
-		{
-			index = (r3-1)*r2r1 + (r2-1)*r1 + i;
-			gradx = (data[index+1]-data[index-1])/2;
-			grady = data[index]-data[index-r1];
-			gradz = data[index] - data[index-r2r1];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);			
-		}
-		
-		for(i=1;i<r2-1;i++)
-		{
-			index = (r3-1)*r2r1+i*r1;
-			gradx = (data[index+1] - data[index]);
-			grady = (data[index+r1]-data[index-r1])/2;
-			gradz = data[index] - data[index-r2r1];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);						
-		}
-		
-		for(i=1;i<r2-1;i++)
-		{
-			index = (r3-1)*r2r1+i*r1+r1-1;
-			gradx = (data[index] - data[index-1]);
-			grady = (data[index+r1]-data[index-r1])/2;
-			gradz = data[index] - data[index-r2r1];
-			gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);						
-		}
-		
-		//process all 6 sides
-		for(i=1;i<r2-1;i++)
-			for(j=1;j<r1-1;j++)
-			{
-				index = i*r1+j;
-				gradx = (data[index+1] - data[index-1])/2;
-				grady = (data[index+r1] - data[index-r1])/2;
-				gradz = data[index+r2r1] - data[index];
-				gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-			}		
-
-		for(i=1;i<r2-1;i++)
-			for(j=1;j<r1-1;j++)
-			{
-				index = (r3-1)*r2r1 + i*r1 + j;
-				gradx = (data[index+1] - data[index-1])/2;
-				grady = (data[index+r1] - data[index-r1])/2;
-				gradz = data[index] - data[index-r2r1];
-				gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-			}				
-		
-		for(i=1;i<r3-1;i++)
-			for(k=1;k<r1-1;k++)
-			{
-				index = i*r2r1 + k; //j is always 0
-				gradx = (data[index+1] - data[index-1])/2;
-				grady = data[index+r1] - data[index];
-				gradz = (data[index+r2r1] - data[index-r2r1])/2;
-				gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-			}
-			
-		for(i=1;i<r3-1;i++)
-			for(k=1;k<r1-1;k++)
-			{
-				j = r2-1;
-				index = i*r2r1 + j*r1 + k;
-				gradx = (data[index+1] - data[index-1])/2;
-				grady = data[index] - data[index-r1];
-				gradz = (data[index+r2r1] - data[index-r2r1])/2;
-				gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-			}
-
-		for(i=1;i<r3-1;i++)
-			for(j=1;j<r2-1;j++)
-			{
-				index = i*r2r1 + j*r1;
-				gradx = data[index+1] - data[index];
-				grady = (data[index+r1] - data[index-r1])/2;
-				gradz = (data[index+r2r1] - data[index-r2r1])/2;
-				gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-			}
-
-		for(i=1;i<r3-1;i++)
-			for(j=1;j<r2-1;j++)
-			{
-				k = r1-1;
-				index = i*r2r1 + j*r1 + k; 
-				gradx = data[index] - data[index-1];
-				grady = (data[index+r1] - data[index-r1])/2;
-				gradz = (data[index+r2r1] - data[index-r2r1])/2;
-				gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-			}
-		
-		//process interior points
-		for(i=1;i<r3-1;i++)
-			for(j=1;j<r2-1;j++)
-				for(k=1;k<r1-1;k++)
-				{
-					size_t index = i*r2r1+j*r1+k;
-					gradx = (data[index+1] - data[index-1])/2;
-					grady = (data[index+r1] - data[index-r1])/2;
-					gradz = (data[index+r2r1] - data[index-r2r1])/2;
-					gradMag[index] = sqrt(gradx*gradx+grady*grady+gradz*gradz);
-				}		
-	}
-	
-}
+  const size_t N = dims.size();
+  const size_t r1 = dims[0];
+  if(N == 1) {
+    gradMag[0] = data[1] - data[0];
+    gradMag[r1-1] = data[r1-1]-data[r1-2];
+    #pragma omp parallel for simd num_threads(nthreads)
+    for(size_t i=1;i<r1-1;i++)
+      gradMag[i] = (data[i+1]-data[i-1])/2;
+    return;
+  }
 
-int computeGradientLength(void* data, void*gradMag, int dataType, size_t r5, size_t r4, size_t r3, size_t r2, size_t r1)
-{
-	if(dataType==QCAT_FLOAT)
-		computeGradientLength_float((float*)data, (float*)gradMag, r5, r4, r3, r2, r1);
-	else if(dataType==QCAT_DOUBLE)
-		computeGradientLength_double((double*)data, (double*)gradMag, r5, r4, r3, r2, r1);
-	else
-	{
-		printf("Error: support only float or double.\n");
-		return -1;	
-	}
-	return 0;
+  std::vector<size_t> stride(N, 1);
+  for (size_t d = 1; d < N; ++d) stride[d] = stride[d-1] * dims[d-1];
+  const size_t rows = stride[N-1] * dims[N-1] / r1;
+
+  #pragma omp parallel num_threads(nthreads)
+  {
+    //sum of the squared partials along the outer dimensions for the current row
+    std::vector<double> outer(r1);
+    #pragma omp for
+    for (size_t row = 0; row < rows; ++row) {
+      const size_t base = row * r1;
+      std::fill(outer.begin(), outer.end(), 0.0);
+      size_t rem = row;
+      for (size_t d = 1; d < N; ++d) {
+        const size_t c = rem % dims[d];
+        rem /= dims[d];
+        T const* up = data + base + ((c + 1 < dims[d]) ? stride[d] : 0);
+        T const* down = data + base - ((c > 0) ? stride[d] : 0);
+        const T scale = (c > 0 && c + 1 < dims[d]) ? T(.5) : T(1);
+        #pragma omp simd
+        for (size_t i = 0; i < r1; ++i) {
+          const double g = (up[i] - down[i]) * scale;
+          outer[i] += g*g;
+        }
+      }
+
+      T const* row_data = data + base;
+      T* row_grad = gradMag + base;
+      {
+        const double gradx = row_data[1] - row_data[0];
+        row_grad[0] = std::sqrt(gradx*gradx+outer[0]);
+      }
+      #pragma omp simd
+      for (size_t i = 1; i < r1-1; ++i) {
+        const double gradx = (row_data[i+1]-row_data[i-1])/2;
+        row_grad[i] = std::sqrt(gradx*gradx+outer[i]);
+      }
+      {
+        const double gradx = row_data[r1-1] - row_data[r1-2];
+        row_grad[r1-1] = std::sqrt(gradx*gradx+outer[r1-1]);
+      }
+    }
+  }
 }
 
 class gradlength_plugin : public libpressio_metrics_plugin {
     void evaluate(pressio_data const& input, pressio_data& output) {
-        int datatype;
         output = pressio_data::owning(input.dtype(), input.dimensions());
         memset(output.data(), 0, output.size_in_bytes());
-        if(input.dtype() == pressio_float_dtype) datatype=QCAT_FLOAT;
-        else if(input.dtype() == pressio_double_dtype) datatype=QCAT_DOUBLE;
-        else return;
-        auto dims = input.normalized_dims(4);
-
-        computeGradientLength(input.data(), output.data(), datatype, 0, dims[3], dims[2], dims[1], dims[0]);
+        auto dims = input.normalized_dims();
+        if(dims.empty()) return;
+        if(input.dtype() == pressio_float_dtype) {
+          computeGradientLength(static_cast<float const*>(input.data()), static_cast<float*>(output.data()), dims, nthreads);
+        } else if(input.dtype() == pressio_double_dtype) {
+          computeGradientLength(static_cast<double const*>(input.data()), static_cast<double*>(output.data()), dims, nthreads);
+        }
     }
   public:
     int begin_compress_impl(struct pressio_data const* input, pressio_data const*) override {
@@ -605,11 +106,16 @@ class gradlength_plugin : public libpressio_metrics_plugin {
       pressio_options opt;
       set(opt, "gradlength:run_input", run_input);
       set(opt, "gradlength:run_decompressed", run_output);
+      set(opt, "gradlength:nthreads", nthreads);
       return opt;
   }
   int set_options(pressio_options const& opt) override {
       get(opt, "gradlength:run_input", &run_input);
       get(opt, "gradlength:run_decompressed", &run_output);
+      uint32_t tmp;
+      if(get(opt, "gradlength:nthreads", &tmp) == pressio_options_key_set) {
+        if(tmp > 0) nthreads = tmp;
+      }
       return 0;
   }
 
@@ -632,6 +138,7 @@ class gradlength_plugin : public libpressio_metrics_plugin {
     set(opt, "gradlength:decompressed", "gradient magnitude of the decompressed data");
     set(opt, "gradlength:run_input", "run gradient on input");
     set(opt, "gradlength:run_decompressed", "run gradient on output");
+    set(opt, "gradlength:nthreads", "number of threads to use to compute the gradient");
     return opt;
   }
 
@@ -652,6 +159,7 @@ class gradlength_plugin : public libpressio_metrics_plugin {
   private:
   bool run_input = true;
   bool run_output = true;
+  uint32_t nthreads = 1;
   pressio_data input_gradmag;
   pressio_data decompressed_gradmag;
 
@@ -659,4 +167,3 @@ class gradlength_plugin : public libpressio_metrics_plugin {
 
 static pressio_register metrics_gradlength_plugin(metrics_plugins(), "gradlength", [](){ return compat::make_unique<gradlength_plugin>(); });
 }}
-
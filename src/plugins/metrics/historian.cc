@@ -1,12 +1,274 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <limits>
+#include <memory>
 #include <mutex>
 #include <sstream>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "libpressio_ext/cpp/metrics.h"
+#include "libpressio_ext/cpp/options.h"
 #include "libpressio_ext/cpp/pressio.h"
 #include "std_compat/memory.h"
 #include "std_compat/string_view.h"
 
 namespace libpressio { namespace historian {
 
+/**
+ * appends recorded metrics to a file from a background thread
+ *
+ * Records are queued by the caller and serialized by the writer thread so that compression is not
+ * stalled by I/O; if the queue is full, callers wait for space.  Serialized records are buffered in
+ * memory and appended to the file, then synced to disk, at least every flush_ms while records are
+ * pending, after every batch when flush_ms is 0, and when the writer is destroyed.  Only whole
+ * records are ever written, so an interrupted run keeps every record synced before it stopped and
+ * loses the ones still queued or buffered, but never leaves a partial record behind.
+ */
+class historian_writer {
+  public:
+  historian_writer(std::string const& path, std::string const& format, uint64_t queue_size, uint64_t flush_ms):
+    fd(open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644)),
+    csv(format == "csv"),
+    queue_size(std::max<uint64_t>(queue_size, 1)),
+    flush_interval(flush_ms),
+    last_flush(std::chrono::steady_clock::now()),
+    ok(fd != -1)
+  {
+    struct stat st;
+    if(csv && ok && fstat(fd, &st) == 0 && st.st_size == 0) {
+      buffer = "idx,name,key,value\n";
+    }
+    worker = std::thread([this]{ run(); });
+  }
+  ~historian_writer() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      done = true;
+    }
+    has_work.notify_one();
+    worker.join();
+    if(fd != -1) close(fd);
+  }
+  historian_writer(historian_writer const&)=delete;
+  historian_writer& operator=(historian_writer const&)=delete;
+
+  /**
+   * \returns false if the file could not be opened or a write to it failed
+   */
+  bool good() const {
+    return ok;
+  }
+
+  void push(std::string name, uint64_t idx, pressio_options results) {
+    std::unique_lock<std::mutex> guard(lock);
+    has_space.wait(guard, [this]{ return queue.size() < queue_size; });
+    queue.push_back(entry{std::move(name), idx, std::move(results)});
+    guard.unlock();
+    has_work.notify_one();
+  }
+
+  private:
+  struct entry {
+    std::string name;
+    uint64_t idx;
+    pressio_options results;
+  };
+
+  void run() {
+    std::deque<entry> batch;
+    std::unique_lock<std::mutex> guard(lock);
+    while(true) {
+      if(flush_interval.count() == 0) {
+        has_work.wait(guard, [this]{ return done || !queue.empty(); });
+      } else {
+        has_work.wait_for(guard, flush_interval, [this]{ return done || !queue.empty(); });
+      }
+      batch.swap(queue);
+      const bool stop = done;
+      guard.unlock();
+      has_space.notify_all();
+
+      for (auto const& e : batch) {
+        write(e);
+      }
+      batch.clear();
+      const auto now = std::chrono::steady_clock::now();
+      if(!buffer.empty() && (stop || now - last_flush >= flush_interval)) {
+        flush();
+        last_flush = now;
+      }
+
+      guard.lock();
+      if(stop && queue.empty()) break;
+    }
+  }
+
+  /**
+   * appends the buffered records to the file and syncs it; the buffer only ever holds whole records
+   */
+  void flush() {
+    if(ok) {
+      size_t written = 0;
+      while(written < buffer.size()) {
+        ssize_t rc = ::write(fd, buffer.data() + written, buffer.size() - written);
+        if(rc < 0 && errno == EINTR) continue;
+        if(rc <= 0) {
+          ok = false;
+          break;
+        }
+        written += static_cast<size_t>(rc);
+      }
+#if defined(_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0
+      if(ok && fdatasync(fd) != 0) ok = false;
+#else
+      if(ok && fsync(fd) != 0) ok = false;
+#endif
+    }
+    buffer.clear();
+  }
+
+  /**
+   * records share the name and idx columns, so strip the record name from the keys
+   */
+  static std::string relative_key(std::string const& key, std::string const& name) {
+    for (std::string const& prefix : {name + ':', '/' + name + ':'}) {
+      if(key.compare(0, prefix.size(), prefix) == 0) return key.substr(prefix.size());
+    }
+    return key;
+  }
+
+  void write(entry const& e) {
+    std::ostringstream ss;
+    ss << std::setprecision(std::numeric_limits<double>::max_digits10);
+    if(csv) {
+      for (auto const& result : e.results) {
+        if(!result.second.has_value()) continue;
+        ss << e.idx << ',' << csv_quote(e.name) << ',' << csv_quote(relative_key(result.first, e.name)) << ',';
+        format_value(ss, result.second, /*json*/false);
+        ss << '\n';
+      }
+    } else {
+      ss << "{\"idx\":" << e.idx << ",\"name\":" << json_quote(e.name);
+      for (auto const& result : e.results) {
+        if(!result.second.has_value()) continue;
+        ss << ',' << json_quote(relative_key(result.first, e.name)) << ':';
+        format_value(ss, result.second, /*json*/true);
+      }
+      ss << "}\n";
+    }
+    buffer += ss.str();
+  }
+
+  static std::string json_quote(std::string const& str) {
+    std::ostringstream ss;
+    ss << '"';
+    for (char c : str) {
+      switch(c) {
+        case '"': ss << "\\\""; break;
+        case '\\': ss << "\\\\"; break;
+        case '\n': ss << "\\n"; break;
+        case '\t': ss << "\\t"; break;
+        default:
+          if(static_cast<unsigned char>(c) < 0x20) {
+            ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+          } else {
+            ss << c;
+          }
+      }
+    }
+    ss << '"';
+    return ss.str();
+  }
+
+  static std::string csv_quote(std::string const& str) {
+    if(str.find_first_of(",\"\n") == std::string::npos) return str;
+    std::string quoted = "\"";
+    for (char c : str) {
+      if(c == '"') quoted += '"';
+      quoted += c;
+    }
+    return quoted + '"';
+  }
+
+  static void format_value(std::ostream& ss, pressio_option const& option, bool json) {
+    switch(option.type()) {
+      case pressio_option_bool_type:
+        ss << (option.get_value<bool>() ? "true" : "false");
+        break;
+      case pressio_option_int8_type:
+      case pressio_option_int16_type:
+      case pressio_option_int32_type:
+      case pressio_option_int64_type:
+        ss << option.as(pressio_option_int64_type, pressio_conversion_special).get_value<int64_t>();
+        break;
+      case pressio_option_uint8_type:
+      case pressio_option_uint16_type:
+      case pressio_option_uint32_type:
+      case pressio_option_uint64_type:
+        ss << option.as(pressio_option_uint64_type, pressio_conversion_special).get_value<uint64_t>();
+        break;
+      case pressio_option_float_type:
+      case pressio_option_double_type:
+        {
+          const double value = option.as(pressio_option_double_type, pressio_conversion_special).get_value<double>();
+          if(json && !std::isfinite(value)) ss << "null";
+          else ss << value;
+        }
+        break;
+      case pressio_option_charptr_type:
+        if(json) ss << json_quote(option.get_value<std::string>());
+        else ss << csv_quote(option.get_value<std::string>());
+        break;
+      case pressio_option_charptr_array_type:
+        {
+          auto const& values = option.get_value<std::vector<std::string>>();
+          if(json) {
+            ss << '[';
+            for (size_t i = 0; i < values.size(); ++i) {
+              if(i) ss << ',';
+              ss << json_quote(values[i]);
+            }
+            ss << ']';
+          } else {
+            std::string joined;
+            for (size_t i = 0; i < values.size(); ++i) {
+              if(i) joined += ';';
+              joined += values[i];
+            }
+            ss << csv_quote(joined);
+          }
+        }
+        break;
+      default:
+        //data, userptr, and other opaque types are not serialized
+        ss << (json ? "null" : "");
+    }
+  }
+
+  const int fd;
+  const bool csv;
+  const uint64_t queue_size;
+  const std::chrono::milliseconds flush_interval;
+  std::chrono::steady_clock::time_point last_flush;
+  std::string buffer;
+  std::atomic<bool> ok;
+
+  std::mutex lock;
+  std::condition_variable has_work;
+  std::condition_variable has_space;
+  std::deque<entry> queue;
+  bool done = false;
+  std::thread worker;
+};
+
 class pressio_historian_metric: public libpressio_metrics_plugin {
 
   //these methods are "private" outside of this file, but need to be public
@@ -23,19 +285,26 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
   //that we need to default construct a new one, and then copy all of the other state.
   pressio_historian_metric(pressio_historian_metric const& lhs):
     lock(), opts(lhs.opts), idx(lhs.idx), metrics_id(lhs.metrics_id),
-    metrics(lhs.metrics), events(lhs.events)
+    metrics(lhs.metrics), file(lhs.file), format(lhs.format), queue_size(lhs.queue_size),
+    flush_ms(lhs.flush_ms), records(lhs.records), writer(lhs.writer), events(lhs.events)
   {
     //I don't think we need to lock here because we guarantee that we lock elsewhere
     //before calling this method
   }
   pressio_historian_metric& operator=(pressio_historian_metric const& lhs) {
-    if(&lhs != this) return *this;
+    if(&lhs == this) return *this;
     //I don't think we need to lock here because we guarantee that we lock elsewhere
     //before calling this method
     opts = lhs.opts;
     idx = lhs.idx;
     metrics_id = lhs.metrics_id;
     metrics = lhs.metrics;
+    file = lhs.file;
+    format = lhs.format;
+    queue_size = lhs.queue_size;
+    flush_ms = lhs.flush_ms;
+    records = lhs.records;
+    writer = lhs.writer;
     events = lhs.events;
     return *this;
   }
@@ -51,7 +320,7 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
   int end_get_options_impl(pressio_options const* opts) override {
     int ret = metrics->end_get_options(opts);
     if(events.on_get_options) {
-      record();
+      if(int rc = record()) return rc;
     }
     return ret;
   }
@@ -62,7 +331,7 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
   int end_get_documentation_impl(pressio_options const& opts) override {
     int ret = metrics->end_get_documentation(opts);
     if(events.on_get_documentation) {
-      record();
+      if(int rc = record()) return rc;
     }
     return ret;
   }
@@ -73,7 +342,7 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
   int end_get_configuration_impl(pressio_options const& opts) override {
     int ret = metrics->end_get_configuration(opts);
     if(events.on_get_configuration) {
-      record();
+      if(int rc = record()) return rc;
     }
     return ret;
   }
@@ -85,7 +354,7 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
   int end_check_options_impl(pressio_options const* opts, int rc) override {
     int ret = metrics->end_check_options(opts, rc);
     if(events.on_check_options) {
-      record();
+      if(int rc = record()) return rc;
     }
     return ret;
   }
@@ -97,7 +366,7 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
   int end_set_options_impl(pressio_options const& opts, int rc) override {
     int ret = metrics->end_set_options(opts, rc);
     if(events.on_set_options) {
-      record();
+      if(int rc = record()) return rc;
     }
     return ret;
   }
@@ -109,7 +378,7 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
   int end_decompress_impl(pressio_data const* input, pressio_data const* output, int rc) override {
     int ret = metrics->end_decompress(input, output, rc);
     if(events.on_decompress) {
-      record();
+      if(int rc = record()) return rc;
     }
     return ret;
   }
@@ -124,7 +393,7 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
                                    compat::span<const pressio_data* const> const& outputs, int rc) override {
     int ret = metrics->end_decompress_many(inputs, outputs, rc);
     if(events.on_decompress_many) {
-      record();
+      if(int rc = record()) return rc;
     }
     return ret;
   }
@@ -136,7 +405,7 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
   int end_compress_impl(pressio_data const* input, pressio_data const* output, int rc) override {
     int ret = metrics->end_compress(input, output, rc);
     if(events.on_compress) {
-      record();
+      if(int rc = record()) return rc;
     }
     return ret;
   }
@@ -151,12 +420,12 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
                                    compat::span<const pressio_data* const> const& outputs, int rc) override {
     int ret = metrics->end_compress_many(inputs, outputs, rc);
     if(events.on_compress_many) {
-      record();
+      if(int rc = record()) return rc;
     }
     return ret;
   }
 
-  void record() {
+  int record() {
     std::lock_guard<std::mutex> guard(lock);
     std::stringstream ss;
     if(!name.empty()) {
@@ -164,8 +433,21 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
     }
     ss << idx;
     metrics->set_name(ss.str());
-    opts.copy_from(metrics->get_metrics_results({}));
+    if(file.empty()) {
+      opts.copy_from(metrics->get_metrics_results({}));
+    } else {
+      if(!writer) {
+        writer = std::make_shared<historian_writer>(file, format, queue_size, flush_ms);
+      }
+      if(!writer->good()) {
+        writer.reset();
+        return set_error(2, "failed to write historian:file " + file);
+      }
+      writer->push(ss.str(), idx, metrics->get_metrics_results({}));
+    }
+    records++;
     idx++;
+    return 0;
   }
 
 
@@ -182,6 +464,31 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
     if (get(opts, "historian:events", &events_str) == pressio_options_key_set) {
       events = event_hooks(events_str);
     }
+    std::string new_file = file, new_format = format;
+    uint64_t new_queue_size = queue_size, new_flush_ms = flush_ms;
+    get(opts, "historian:file", &new_file);
+    get(opts, "historian:format", &new_format);
+    get(opts, "historian:queue_size", &new_queue_size);
+    get(opts, "historian:flush_ms", &new_flush_ms);
+    if(new_format != "jsonl" && new_format != "csv") {
+      return set_error(1, "unsupported historian:format " + new_format);
+    }
+    if(new_file != file || new_format != format || new_queue_size != queue_size || new_flush_ms != flush_ms) {
+      //the previous writer drains its queue when the last clone releases it
+      std::lock_guard<std::mutex> guard(lock);
+      writer.reset();
+      file = new_file;
+      format = new_format;
+      queue_size = new_queue_size;
+      flush_ms = new_flush_ms;
+      if(!file.empty()) {
+        writer = std::make_shared<historian_writer>(file, format, queue_size, flush_ms);
+        if(!writer->good()) {
+          writer.reset();
+          return set_error(2, "failed to open historian:file " + file);
+        }
+      }
+    }
     return 0;
   }
   pressio_options get_options() const override {
@@ -190,6 +497,10 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
     set(opts, "historian:idx", idx);
     std::vector<std::string> events_str = static_cast<std::vector<std::string>>(events);
     set(opts, "historian:events", events_str);
+    set(opts, "historian:file", file);
+    set(opts, "historian:format", format);
+    set(opts, "historian:queue_size", queue_size);
+    set(opts, "historian:flush_ms", flush_ms);
     return opts;
   }
   pressio_options get_configuration_impl() const override {
@@ -210,6 +521,7 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
        "clone"
     };
     set(opts, "historian:events", events_types);
+    set(opts, "historian:format", std::vector<std::string>{"jsonl", "csv"});
     set(opts, "predictors:requires_decompress", events.on_decompress || events.on_decompress_many);
     set(opts, "predictors:invalidate", std::vector<std::string>{});
 
@@ -221,11 +533,23 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
     set(opts, "pressio:description", "records metrics results after designated events");
     set(opts, "historian:idx", "the current index for this repetition");
     set(opts, "historian:events", "what events should trigger a record event");
+    set(opts, "historian:file", R"(if non-empty, records are appended to this file by a background thread instead of being kept in memory.
+    Records are written whole and the file is synced to disk on each flush, so an interrupted run keeps every record flushed
+    before it stopped and loses only the records still queued or buffered)");
+    set(opts, "historian:format", R"(the format for historian:file
+      + jsonl -- one JSON object per record with the idx, name, and each metric
+      + csv -- one idx,name,key,value row per metric
+    )");
+    set(opts, "historian:queue_size", "maximum number of records waiting to be written before recording blocks");
+    set(opts, "historian:flush_ms", "maximum time in ms that records may remain buffered before they are written and synced to disk; 0 syncs as soon as records are written");
+    set(opts, "historian:records", "the number of records taken");
 
     return opts;
   };
   pressio_options get_metrics_results(pressio_options const&)  override {
-    return opts;
+    pressio_options results = opts;
+    set(results, "historian:records", records);
+    return results;
   }
   void set_name_impl(std::string const& new_name) override {
     metrics->set_name(new_name);
@@ -239,6 +563,12 @@ class pressio_historian_metric: public libpressio_metrics_plugin {
   uint64_t idx = 0;
   std::string metrics_id = "noop";
   pressio_metrics metrics = metrics_plugins().build("noop");
+  std::string file;
+  std::string format = "jsonl";
+  uint64_t queue_size = 1024;
+  uint64_t flush_ms = 1000;
+  uint64_t records = 0;
+  std::shared_ptr<historian_writer> writer;
 
   struct event_hooks {
     bool on_check_options = false;
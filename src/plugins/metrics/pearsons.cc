@@ -1,4 +1,5 @@
 #include <cmath>
+#include <vector>
 #include "pressio_data.h"
 #include "pressio_options.h"
 #include "pressio_compressor.h"
@@ -7,6 +8,7 @@
 #include "libpressio_ext/cpp/options.h"
 #include "libpressio_ext/cpp/pressio.h"
 #include "std_compat/memory.h"
+#include "block_sample_impl.h"
 
 namespace libpressio {
 namespace pearson {
@@ -66,6 +68,64 @@ namespace pearson {
     }
   };
 
+  /**
+   * centered moments of a pair of datasets which can be merged pairwise
+   */
+  struct moments {
+    double n = 0;
+    double x_mean = 0;
+    double y_mean = 0;
+    double xx = 0;
+    double yy = 0;
+    double xy = 0;
+
+    moments& operator+=(moments const& rhs) {
+      if(rhs.n == 0) return *this;
+      const double total = n + rhs.n;
+      const double dx = rhs.x_mean - x_mean;
+      const double dy = rhs.y_mean - y_mean;
+      const double w = n * rhs.n / total;
+      x_mean += dx * rhs.n / total;
+      y_mean += dy * rhs.n / total;
+      xx += rhs.xx + dx * dx * w;
+      yy += rhs.yy + dy * dy * w;
+      xy += rhs.xy + dx * dy * w;
+      n = total;
+      return *this;
+    }
+
+    double r() const {
+      return xy / (sqrt(xx) * sqrt(yy));
+    }
+  };
+
+  struct compute_moments{
+    template <class ForwardIt1, class ForwardIt2>
+    moments operator()(ForwardIt1 input_begin, ForwardIt1 input_end,
+                             ForwardIt2 decomp_begin, ForwardIt2 decomp_end)
+    {
+      moments m;
+      double input_sum = 0;
+      double decomp_sum = 0;
+      for(auto input_it = input_begin, decomp_it = decomp_begin; input_it != input_end && decomp_it != decomp_end; ++input_it, ++decomp_it) {
+        input_sum += *input_it;
+        decomp_sum += *decomp_it;
+        m.n += 1;
+      }
+      if(m.n == 0) return m;
+      m.x_mean = input_sum / m.n;
+      m.y_mean = decomp_sum / m.n;
+      for(auto input_it = input_begin, decomp_it = decomp_begin; input_it != input_end && decomp_it != decomp_end; ++input_it, ++decomp_it) {
+        double x_xbar = *input_it - m.x_mean;
+        double y_ybar = *decomp_it - m.y_mean;
+        m.xx += x_xbar * x_xbar;
+        m.yy += y_ybar * y_ybar;
+        m.xy += x_xbar * y_ybar;
+      }
+      return m;
+    }
+  };
+
 class pearsons_plugin : public libpressio_metrics_plugin
 {
 
@@ -73,14 +133,44 @@ public:
   int begin_compress_impl(const struct pressio_data* input,
                       struct pressio_data const*) override
   {
-    input_data = pressio_data::clone(*input);
+    if(sampler.enabled()) {
+      dims = input->normalized_dims();
+      sample = sampler.select(dims);
+      input_blocks.clear();
+      for (auto const& block : sample.blocks) {
+        input_blocks.emplace_back(metrics_sampling::gather(*input, dims, block));
+      }
+    } else {
+      input_data = pressio_data::clone(*input);
+    }
     return 0;
   }
   int end_decompress_impl(struct pressio_data const*,
                       struct pressio_data const* output, int) override
   {
-    err_metrics = pressio_data_for_each<pearson::pearson_metrics>(input_data, *output,
-                                                       pearson::compute_metrics{});
+    if(sampler.enabled()) {
+      evaluate_sampled(*output);
+    } else {
+      err_metrics = pressio_data_for_each<pearson::pearson_metrics>(input_data, *output,
+                                                         pearson::compute_metrics{});
+      r_ci.reset();
+      r2_ci.reset();
+    }
+    return 0;
+  }
+
+  pressio_options get_options() const override {
+    pressio_options opts;
+    set(opts, "pressio:metrics_sample_rate", sampler.rate);
+    set(opts, "pressio:metrics_sample_seed", sampler.seed);
+    set(opts, "pressio:metrics_sample_block", sampler.block_size);
+    return opts;
+  }
+
+  int set_options(pressio_options const& opts) override {
+    get(opts, "pressio:metrics_sample_rate", &sampler.rate);
+    get(opts, "pressio:metrics_sample_seed", &sampler.seed);
+    get(opts, "pressio:metrics_sample_block", &sampler.block_size);
     return 0;
   }
 
@@ -99,6 +189,12 @@ public:
     set(opts, "pressio:description", "computes the Pearson's coefficient of correlation and determination");
     set(opts, "pearson:r", "the Pearson's coefficient of correlation");
     set(opts, "pearson:r2", "the Pearson's coefficient of determination");
+    set(opts, "pearson:r_ci", "half width of the 95% confidence interval of r when sampling");
+    set(opts, "pearson:r2_ci", "half width of the 95% confidence interval of r2 when sampling");
+    set(opts, "pressio:metrics_sample_rate", R"(fraction of the blocks of the data to evaluate the metrics on.
+    Values in (0,1) estimate the metrics from a deterministic pseudo-random subset of blocks; other values use the entire dataset)");
+    set(opts, "pressio:metrics_sample_seed", "seed used to choose the sampled blocks");
+    set(opts, "pressio:metrics_sample_block", "number of elements of a sampled block in each dimension");
     return opts;
   }
 
@@ -112,6 +208,8 @@ public:
       set_type(opt, "pearson:r", pressio_option_double_type);
       set_type(opt, "pearson:r2", pressio_option_double_type);
     }
+    set(opt, "pearson:r_ci", r_ci);
+    set(opt, "pearson:r2_ci", r2_ci);
     return opt;
   }
 
@@ -124,8 +222,42 @@ public:
   }
 
 private:
+  void evaluate_sampled(pressio_data const& output) {
+    const size_t groups = metrics_sampling::jackknife_groups(sample.blocks.size());
+    std::vector<pearson::moments> group_moments(groups);
+    for (size_t i = 0; i < sample.blocks.size(); ++i) {
+      pressio_data const& input_block = input_blocks[i];
+      const pressio_data output_block = metrics_sampling::gather(output, dims, sample.blocks[i]);
+      group_moments[i % groups] += pressio_data_for_each<pearson::moments>(input_block, output_block, pearson::compute_moments{});
+    }
+
+    pearson::moments total;
+    for (auto const& m : group_moments) total += m;
+    std::vector<double> r_replicates(groups), r2_replicates(groups);
+    for (size_t g = 0; g < groups; ++g) {
+      pearson::moments replicate;
+      for (size_t h = 0; h < groups; ++h) {
+        if(h != g) replicate += group_moments[h];
+      }
+      r_replicates[g] = replicate.r();
+      r2_replicates[g] = r_replicates[g] * r_replicates[g];
+    }
+
+    pearson::pearson_metrics m;
+    m.r = total.r();
+    m.r2 = m.r * m.r;
+    err_metrics = m;
+    r_ci = metrics_sampling::jackknife_ci(r_replicates, sample.fraction());
+    r2_ci = metrics_sampling::jackknife_ci(r2_replicates, sample.fraction());
+  }
+
   pressio_data input_data = pressio_data::empty(pressio_byte_dtype, {});
   compat::optional<pearson::pearson_metrics> err_metrics;
+  compat::optional<double> r_ci, r2_ci;
+  metrics_sampling::block_sampler sampler;
+  metrics_sampling::block_sample sample;
+  std::vector<size_t> dims;
+  std::vector<pressio_data> input_blocks;
 };
 
 static pressio_register metrics_pearson_plugin(metrics_plugins(), "pearson", []() {
@@ -0,0 +1,384 @@
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "pressio_data.h"
+#include "pressio_options.h"
+#include "pressio_compressor.h"
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/metrics.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+#include "std_compat/memory.h"
+
+namespace libpressio {
+namespace perf_counters_metrics {
+  using std::chrono::steady_clock;
+
+  enum counter_id {
+    cycles,
+    instructions,
+    cache_misses,
+    branch_misses,
+    n_counters
+  };
+  const char* const counter_names[n_counters] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+  const uint64_t counter_configs[n_counters] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+  };
+
+  /**
+   * a raw reading of a counter including the time it was enabled and running to correct for multiplexing
+   */
+  struct counter_reading {
+    uint64_t value = 0;
+    uint64_t enabled = 0;
+    uint64_t running = 0;
+    bool valid = false;
+  };
+
+  struct snapshot {
+    steady_clock::time_point time;
+    std::array<counter_reading, n_counters> counters;
+  };
+
+  /**
+   * the change between two snapshots
+   */
+  struct measurement {
+    uint64_t ns = 0;
+    uint64_t bytes = 0;
+    std::array<compat::optional<uint64_t>, n_counters> counters;
+
+    measurement() = default;
+    measurement(snapshot const& begin, snapshot const& end, uint64_t bytes):
+      ns(std::chrono::duration_cast<std::chrono::nanoseconds>(end.time - begin.time).count()),
+      bytes(bytes)
+    {
+      for (size_t i = 0; i < n_counters; ++i) {
+        auto const& b = begin.counters[i];
+        auto const& e = end.counters[i];
+        if(!b.valid || !e.valid) continue;
+        const uint64_t running = e.running - b.running;
+        const uint64_t enabled = e.enabled - b.enabled;
+        const uint64_t value = e.value - b.value;
+        if(running == 0) {
+          counters[i] = 0;
+        } else {
+          //scale to account for time the counter was multiplexed off of the pmu
+          counters[i] = static_cast<uint64_t>(static_cast<double>(value) * static_cast<double>(enabled) / static_cast<double>(running));
+        }
+      }
+    }
+
+    double bytes_per_second() const {
+      if(ns == 0) return 0;
+      return static_cast<double>(bytes) / (static_cast<double>(ns) * 1e-9);
+    }
+  };
+
+  /**
+   * owns the perf_event file descriptors for the hardware counters.
+   *
+   * The counters are opened lazily on the first read so that a plugin that is constructed but
+   * never used does not consume counters, and copies open their own descriptors.  Counters that
+   * can not be opened (no PMU, virtualized hosts, perf_event_paranoid, seccomp, ...) are skipped.
+   */
+  class perf_events {
+    public:
+    perf_events()=default;
+    perf_events(perf_events const&) {}
+    perf_events& operator=(perf_events const& rhs) {
+      if(this != &rhs) close_all();
+      return *this;
+    }
+    ~perf_events() {
+      close_all();
+    }
+
+    snapshot read(bool use_hardware) {
+      snapshot s;
+      if(use_hardware) {
+        if(!opened) open_all();
+        for (size_t i = 0; i < n_counters; ++i) {
+          if(fds[i] == -1) continue;
+          uint64_t buf[3];
+          if(::read(fds[i], buf, sizeof(buf)) == static_cast<ssize_t>(sizeof(buf))) {
+            s.counters[i].value = buf[0];
+            s.counters[i].enabled = buf[1];
+            s.counters[i].running = buf[2];
+            s.counters[i].valid = true;
+          }
+        }
+      }
+      s.time = steady_clock::now();
+      return s;
+    }
+
+    bool available() const {
+      for (auto fd : fds) {
+        if(fd != -1) return true;
+      }
+      return false;
+    }
+
+    private:
+    void open_all() {
+      opened = true;
+      for (size_t i = 0; i < n_counters; ++i) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = counter_configs[i];
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;
+        fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      }
+    }
+    void close_all() {
+      for (auto& fd : fds) {
+        if(fd != -1) close(fd);
+        fd = -1;
+      }
+      opened = false;
+    }
+
+    bool opened = false;
+    std::array<int, n_counters> fds{{-1, -1, -1, -1}};
+  };
+
+  /**
+   * a measured operation and the segments viewed during it
+   */
+  struct phase {
+    compat::optional<measurement> total;
+    std::map<std::string, measurement> segments;
+  };
+
+  uint64_t bytes_of(pressio_data const* data) {
+    return (data) ? data->size_in_bytes() : 0;
+  }
+  uint64_t bytes_of(compat::span<const pressio_data* const> const& data) {
+    uint64_t bytes = 0;
+    for (auto const* d : data) bytes += bytes_of(d);
+    return bytes;
+  }
+
+class perf_counters_plugin : public libpressio_metrics_plugin {
+  public:
+
+  int begin_compress_impl(const struct pressio_data * , struct pressio_data const * ) override {
+    begin(&perf_counters_plugin::compress);
+    return 0;
+  }
+
+  int end_compress_impl(struct pressio_data const* input, pressio_data const * , int ) override {
+    end(&perf_counters_plugin::compress, bytes_of(input));
+    return 0;
+  }
+
+  int begin_decompress_impl(struct pressio_data const* , pressio_data const* ) override {
+    begin(&perf_counters_plugin::decompress);
+    return 0;
+  }
+
+  int end_decompress_impl(struct pressio_data const* , pressio_data const* output, int ) override {
+    end(&perf_counters_plugin::decompress, bytes_of(output));
+    return 0;
+  }
+
+  int begin_compress_many_impl(compat::span<const pressio_data* const> const&,
+                                   compat::span<const pressio_data* const> const&) override {
+    begin(&perf_counters_plugin::compress_many);
+    return 0;
+  }
+
+  int end_compress_many_impl(compat::span<const pressio_data* const> const& inputs,
+                                   compat::span<const pressio_data* const> const& , int ) override {
+    end(&perf_counters_plugin::compress_many, bytes_of(inputs));
+    return 0;
+  }
+
+  int begin_decompress_many_impl(compat::span<const pressio_data* const> const& ,
+                                   compat::span<const pressio_data* const> const& ) override {
+    begin(&perf_counters_plugin::decompress_many);
+    return 0;
+  }
+
+  int end_decompress_many_impl(compat::span<const pressio_data* const> const& ,
+                                   compat::span<const pressio_data* const> const& outputs, int ) override {
+    end(&perf_counters_plugin::decompress_many, bytes_of(outputs));
+    return 0;
+  }
+
+  int view_segment_impl(pressio_data const* data, const char* segment_id) override {
+    if(active == nullptr) return 0;
+    close_segment(events.read(use_hardware));
+    segment_id_ = segment_id;
+    segment_bytes = bytes_of(data);
+    segment_begin = events.read(use_hardware);
+    return 0;
+  }
+
+  pressio_options get_options() const override {
+    pressio_options opts;
+    set(opts, "perf_counters:use_hardware", use_hardware);
+    return opts;
+  }
+
+  int set_options(pressio_options const& opts) override {
+    get(opts, "perf_counters:use_hardware", &use_hardware);
+    return 0;
+  }
+
+  struct pressio_options get_metrics_results(pressio_options const&) override {
+    struct pressio_options opt;
+    set(opt, "perf_counters:available", events.available());
+    set_phase(opt, "compress", compress);
+    set_phase(opt, "decompress", decompress);
+    set_phase(opt, "compress_many", compress_many);
+    set_phase(opt, "decompress_many", decompress_many);
+    return opt;
+  }
+
+  struct pressio_options get_configuration_impl() const override {
+    pressio_options opts;
+    set(opts, "pressio:stability", "experimental");
+    set(opts, "pressio:thread_safe", pressio_thread_safety_multiple);
+    std::vector<std::string> decompress_metrics;
+    for (auto const& op : {"decompress", "decompress_many"}) {
+      for (auto const& m : measured()) {
+        decompress_metrics.emplace_back(std::string("perf_counters:") + op + "_" + m);
+      }
+    }
+    set(opts, "predictors:requires_decompress", decompress_metrics);
+    set(opts, "predictors:invalidate", std::vector<std::string>{"predictors:runtime", "predictors:nondeterministc"});
+    return opts;
+  }
+
+
+  struct pressio_options get_documentation_impl() const override {
+    pressio_options opts;
+
+    set(opts, "pressio:description", R"(uses perf_event_open to record hardware counters and nanosecond timings
+
+    Hardware counters are counted in user space for the calling thread; threads created after the first
+    measurement are included once they exit.  If a counter can not be opened, it is omitted from the results
+    and only the timings are reported.  Segments passed to view_segment are reported as
+    perf_counters:<operation>:segment:<segment_id>_<metric> and measure the work from the view_segment
+    call until the next segment or the end of the operation; bytes_per_second uses the size of the viewed data)");
+    set(opts, "perf_counters:use_hardware", "use perf_event_open to read hardware counters, otherwise only timings are recorded");
+    set(opts, "perf_counters:available", "true if at least one hardware counter could be opened");
+    for (auto const& op : {"compress", "decompress", "compress_many", "decompress_many"}) {
+      const std::string prefix = std::string("perf_counters:") + op;
+      set(opts, prefix + "_ns", std::string("time in ") + op + " in nanoseconds");
+      set(opts, prefix + "_bytes_per_second", std::string("uncompressed bytes processed per second by ") + op);
+      for (size_t i = 0; i < perf_counters_metrics::n_counters; ++i) {
+        set(opts, prefix + "_" + perf_counters_metrics::counter_names[i], std::string("hardware ") + perf_counters_metrics::counter_names[i] + " during " + op);
+      }
+    }
+
+    return opts;
+  }
+
+  std::unique_ptr<libpressio_metrics_plugin> clone() override {
+    auto copy = compat::make_unique<perf_counters_plugin>(*this);
+    //a clone taken during an operation does not continue it
+    copy->active = nullptr;
+    copy->segment_id_.reset();
+    copy->segment_bytes = 0;
+    return copy;
+  }
+
+  const char* prefix() const override {
+    return "perf_counters";
+  }
+
+  private:
+  static std::vector<std::string> measured() {
+    std::vector<std::string> names{"ns", "bytes_per_second"};
+    for (auto const* name: perf_counters_metrics::counter_names) {
+      names.emplace_back(name);
+    }
+    return names;
+  }
+
+  /**
+   * the phase being measured, a member pointer so that copies refer to their own phases
+   */
+  using phase_ptr = perf_counters_metrics::phase perf_counters_plugin::*;
+
+  void begin(phase_ptr p) {
+    (this->*p).segments.clear();
+    active = p;
+    segment_id_.reset();
+    begin_snapshot = events.read(use_hardware);
+  }
+  void end(phase_ptr p, uint64_t bytes) {
+    auto now = events.read(use_hardware);
+    (this->*p).total = perf_counters_metrics::measurement(begin_snapshot, now, bytes);
+    close_segment(now);
+    active = nullptr;
+  }
+  /**
+   * a segment runs from its view_segment call to the next view_segment or the end of the operation
+   */
+  void close_segment(perf_counters_metrics::snapshot const& now) {
+    if(!segment_id_) return;
+    (this->*active).segments[*segment_id_] = perf_counters_metrics::measurement(segment_begin, now, segment_bytes);
+    segment_id_.reset();
+  }
+
+  void set_measurement(pressio_options& opt, std::string const& prefix, compat::optional<perf_counters_metrics::measurement> const& m) const {
+    if(m) {
+      set(opt, prefix + "_ns", m->ns);
+      set(opt, prefix + "_bytes_per_second", m->bytes_per_second());
+    } else {
+      set_type(opt, prefix + "_ns", pressio_option_uint64_type);
+      set_type(opt, prefix + "_bytes_per_second", pressio_option_double_type);
+    }
+    for (size_t i = 0; i < perf_counters_metrics::n_counters; ++i) {
+      if(m && m->counters[i]) {
+        set(opt, prefix + "_" + perf_counters_metrics::counter_names[i], *m->counters[i]);
+      } else {
+        set_type(opt, prefix + "_" + perf_counters_metrics::counter_names[i], pressio_option_uint64_type);
+      }
+    }
+  }
+
+  void set_phase(pressio_options& opt, std::string const& name, perf_counters_metrics::phase const& p) const {
+    set_measurement(opt, "perf_counters:" + name, p.total);
+    for (auto const& segment : p.segments) {
+      set_measurement(opt, "perf_counters:" + name + ":segment:" + segment.first, segment.second);
+    }
+  }
+
+  bool use_hardware = true;
+  perf_counters_metrics::perf_events events;
+  perf_counters_metrics::snapshot begin_snapshot;
+  perf_counters_metrics::snapshot segment_begin;
+  compat::optional<std::string> segment_id_;
+  uint64_t segment_bytes = 0;
+  phase_ptr active = nullptr;
+  perf_counters_metrics::phase compress;
+  perf_counters_metrics::phase decompress;
+  perf_counters_metrics::phase compress_many;
+  perf_counters_metrics::phase decompress_many;
+};
+
+static pressio_register metrics_perf_counters_plugin(metrics_plugins(), "perf_counters", [](){ return compat::make_unique<perf_counters_plugin>(); });
+
+}
+}
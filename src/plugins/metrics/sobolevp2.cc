@@ -6,442 +6,167 @@
 #include "libpressio_ext/cpp/pressio.h"
 #include "libpressio_ext/cpp/options.h"
 #include "std_compat/memory.h"
+#include "std_compat/functional.h"
 #include <cmath>
+#include <numeric>
 
 namespace libpressio { namespace qcatsobolevp2_metrics_ns {
-#define QCAT_FLOAT 0
-#define QCAT_DOUBLE 1
-#define QCAT_INT32 2
-#define QCAT_INT16 3
-#define QCAT_UINT32 4
-#define QCAT_UINT16 5
-size_t computeDataLength(size_t r5, size_t r4, size_t r3, size_t r2, size_t r1)
-{
-	size_t dataLength;
-	if(r1==0) 
-	{
-		dataLength = 0;
-	}
-	else if(r2==0) 
-	{
-		dataLength = r1;
-	}
-	else if(r3==0) 
-	{
-		dataLength = r1*r2;
-	}
-	else if(r4==0) 
-	{
-		dataLength = r1*r2*r3;
-	}
-	else if(r5==0) 
-	{
-		dataLength = r1*r2*r3*r4;
-	}
-	else 
-	{
-		dataLength = r1*r2*r3*r4*r5;
-	}
-	return dataLength;
-}
-int computeDimension(size_t r5, size_t r4, size_t r3, size_t r2, size_t r1)
-{
-	if(r1==0)
-		return 0;
-	else if(r2 == 0)
-		return 1;
-	else if(r3 == 0)
-		return 2;
-	else if(r4 == 0)
-		return 3;
-	else if(r5 == 0)
-		return 4;
-	return 5;
+/**
+ * visits the rows of data along the contiguous dimension which are interior in every other dimension,
+ * rows are distributed over threads.
+ *
+ * \param[in] fn called as fn(base, count, strides) for the interior points [base, base+count) of a row and
+ * returns their contribution to the sum
+ * \returns the sum of the contributions and the number of points visited
+ */
+template <class Fn>
+std::pair<double,size_t> interior_sum(std::vector<size_t> const& dims, unsigned int nthreads, Fn&& fn) {
+  const size_t N = dims.size();
+  std::vector<size_t> stride(N, 1);
+  for (size_t d = 1; d < N; ++d) stride[d] = stride[d-1] * dims[d-1];
+  for (size_t d = 0; d < N; ++d) {
+    if(dims[d] < 3) return {0.0, 0};
+  }
+  const size_t r1 = dims[0];
+  const size_t rows = stride[N-1] * dims[N-1] / r1;
+
+  double sum = 0;
+  size_t counter = 0;
+  #pragma omp parallel for num_threads(nthreads) reduction(+:sum,counter)
+  for (size_t row = 0; row < rows; ++row) {
+    size_t rem = row;
+    bool interior = true;
+    for (size_t d = 1; d < N; ++d) {
+      const size_t c = rem % dims[d];
+      rem /= dims[d];
+      interior &= (c > 0 && c + 1 < dims[d]);
+    }
+    if(!interior) continue;
+    sum += fn(row * r1 + 1, r1 - 2, stride);
+    counter += r1 - 2;
+  }
+  return {sum, counter};
 }
 
 //the sum of square / nbEle
-double calculateSobolevNorm_s0_p2_float(float *data, size_t r5, size_t r4, size_t r3, size_t r2, size_t r1)
+template <class T>
+double calculateSobolevNorm_s0_p2(T const* data, std::vector<size_t> const& dims, unsigned int nthreads)
 {
-	double result = 0;
-	size_t i;
-	size_t nbEle = computeDataLength(r5, r4, r3, r2, r1);
+	const size_t nbEle = std::accumulate(dims.begin(), dims.end(), size_t{1}, compat::multiplies<>{});
 	double sum = 0;
-	for(i=0;i<nbEle;i++)
+	#pragma omp parallel for simd num_threads(nthreads) reduction(+:sum)
+	for(size_t i=0;i<nbEle;i++)
 		sum += data[i]*data[i];
-	result = sqrt(sum/(double)nbEle);
-	return result;
+	return sqrt(sum/(double)nbEle);
 }
 
 //sqrt((||f(0)||^2+||f(1)||^2)/nbEle), where f(i) means i-th derivative
-double calculateSobolevNorm_s1_p2_float(float *data, size_t r5, size_t r4, size_t r3, size_t r2, size_t r1)
+template <class T>
+double calculateSobolevNorm_s1_p2(T const* data, std::vector<size_t> const& dims, unsigned int nthreads)
 {
-	size_t i, j, k;
-	int dim = computeDimension(r5, r4, r3, r2, r1);
-	//size_t nbEle = computeDataLength(r5, r4, r3, r2, r1);
-	double sum = 0;
-	size_t counter =  0;
-	if(dim==1)
-	{
-		for(i=1;i<r1-1;i++)
-		{
-			sum += data[i]*data[i];
-			sum += (data[i+1]-data[i-1])*(data[i+1]-data[i-1])/4;
-			counter ++;
+	auto result = interior_sum(dims, nthreads, [data](size_t base, size_t count, std::vector<size_t> const& stride) {
+		T const* row = data + base;
+		double sum = 0;
+		#pragma omp simd reduction(+:sum)
+		for (size_t i = 0; i < count; ++i) {
+			sum += row[i]*row[i];
 		}
-		return sqrt(sum/counter);
-	}
-	else if(dim==2)
-	{
-		for(i=1;i<r2-1;i++)
-		{	
-			for(j=1;j<r1-1;j++)
-			{
-				size_t index = i*r1+j;
-				sum += data[index]*data[index];
-				sum += (data[index+1]-data[index-1])*(data[index+1]-data[index-1])/4;
-				sum += (data[index+r1]-data[index-r1])*(data[index+r1]-data[index-r1])/4;
-				counter ++;
+		for (size_t s : stride) {
+			T const* up = row + s;
+			T const* down = row - s;
+			#pragma omp simd reduction(+:sum)
+			for (size_t i = 0; i < count; ++i) {
+				sum += (up[i]-down[i])*(up[i]-down[i])/4;
 			}
-		}				
-		
-		return sqrt(sum/counter);
-	}
-	else if(dim==3)
-	{
-		size_t r2r1 = r2*r1;
-		for(i=1;i<r3-1;i++)
-		{	
-			for(j=1;j<r2-1;j++)
-			{
-				for(k=1;k<r1-1;k++)
-				{
-					size_t index = i*r2r1+j*r1+k;
-					sum += data[index]*data[index];
-					sum += (data[index+1]-data[index-1])*(data[index+1]-data[index-1])/4;
-					sum += (data[index+r1]-data[index-r1])*(data[index+r1]-data[index-r1])/4;
-					sum += (data[index+r2r1]-data[index-r2r1])*(data[index+r2r1]-data[index-r2r1])/4;		
-					counter ++;			
-				}
-			}
-		}			
-		
-		return sqrt(sum/counter);
-	}
-	
-	return -1; //error or does not support dim>3
+		}
+		return sum;
+	});
+	return sqrt(result.first/result.second);
 }
 
  //sqrt((||f(0)||^2+||f(1)||^2+||f(2)||^2)/nbEle), where f(i) means i-th derivative (including mixed partial if possible)
-double calculateSobolevNorm_s2_p2_float(float *data, size_t r5, size_t r4, size_t r3, size_t r2, size_t r1)
+template <class T>
+double calculateSobolevNorm_s2_p2(T const* data, std::vector<size_t> const& dims, unsigned int nthreads)
 {
-	size_t i, j, k;
-	int dim = computeDimension(r5, r4, r3, r2, r1);
-	//size_t nbEle = computeDataLength(r5, r4, r3, r2, r1);
-	size_t counter = 0;
-	double sum = 0;
-	if(dim==1)
-	{
-		for(i=1;i<r1-1;i++)
-		{
-			float x1_dev = (data[i+1]-data[i-1])/2; //x1_dev1 means along x, 1st-order partial
-			float x2_dev = (data[i+1]-data[i])-(data[i]-data[i-1]); //second order partial
-		
-			sum += data[i]*data[i];
-			sum += x1_dev*x1_dev;
-			sum += x2_dev*x2_dev;
-			counter ++;
+	auto result = interior_sum(dims, nthreads, [data](size_t base, size_t count, std::vector<size_t> const& stride) {
+		T const* row = data + base;
+		double sum = 0;
+		#pragma omp simd reduction(+:sum)
+		for (size_t i = 0; i < count; ++i) {
+			sum += row[i]*row[i];
 		}
-		
-		return sqrt(sum/counter);
-	}	
-	else if(dim==2)
-	{
-		for(i=1;i<r2-1;i++)
-			for(j=1;j<r1-1;j++)
-			{
-				size_t index = i*r1+j;
-				float x1_dev = (data[index+1]-data[index-1])/2;
-				float x2_dev = (data[index+1]-data[index])-(data[index]-data[index-1]);
-				float y1_dev = (data[index+r1]-data[index-r1])/2;
-				float y2_dev = (data[index+r1]-data[index])-(data[index]-data[index-r1]);
-				float xy_dev = (data[index-r1-1]+data[index+r1+1]-data[index-r1+1]-data[index+r1-1])/4;
-				
-				sum += data[index]*data[index];
-				sum += x1_dev*x1_dev;
-				sum += x2_dev*x2_dev;
-				sum += y1_dev*y1_dev;
-				sum += y2_dev*y2_dev;
-				sum += xy_dev*xy_dev;
-				counter ++;
+		for (size_t s : stride) {
+			T const* up = row + s;
+			T const* down = row - s;
+			#pragma omp simd reduction(+:sum)
+			for (size_t i = 0; i < count; ++i) {
+				T d1_dev = (up[i]-down[i])/2; //first order partial
+				T d2_dev = (up[i]-row[i])-(row[i]-down[i]); //second order partial
+				sum += d1_dev*d1_dev;
+				sum += d2_dev*d2_dev;
 			}
-			
-		return sqrt(sum/counter);
-	}
-	else if(dim==3)
-	{
-		size_t r2r1 = r2*r1;
-		for(i=1;i<r3-1;i++)
-			for(j=1;j<r2-1;j++)
-				for(k=1;k<r1-1;k++)
-				{
-					size_t index = i*r2r1+j*r1+k;
-					float x1_dev = (data[index+1]-data[index-1])/2;
-					float x2_dev = (data[index+1]-data[index])-(data[index]-data[index-1]);
-					float y1_dev = (data[index+r1]-data[index-r1])/2;
-					float y2_dev = (data[index+r1]-data[index])-(data[index]-data[index-r1]);
-					float z1_dev = (data[index+r2r1]-data[index-r2r1])/2;
-					float z2_dev = (data[index+r2r1]-data[index])-(data[index]-data[index-r2r1]);										
-					float xy_dev = (data[index-r1-1]+data[index+r1+1] - data[index-r1+1] - data[index+r1-1])/4;
-					float yz_dev = (data[index-r2r1-r1]+data[index+r2r1+r1] - data[index-r2r1+r1] - data[index+r2r1-r1])/4;
-					float xz_dev = (data[index-r2r1-1]+data[index+r2r1+1]-data[index-r2r1+1]-data[index+r2r1-1])/4;
-					sum += data[index]*data[index];
-					sum += x1_dev*x1_dev;
-					sum += x2_dev*x2_dev;
-					sum += y1_dev*y1_dev;
-					sum += y2_dev*y2_dev;
-					sum += z1_dev*z1_dev;
-					sum += z2_dev*z2_dev;
-					sum += xy_dev*xy_dev;
-					sum += yz_dev*yz_dev;
-					sum += xz_dev*xz_dev;
-					counter ++;
-				}
-				
-		return sqrt(sum/counter);
-	}
-	
-	return -1;
-}
-
-//the sum of square / nbEle
-double calculateSobolevNorm_s0_p2_double(double *data, size_t r5, size_t r4, size_t r3, size_t r2, size_t r1)
-{
-	double result = 0;
-	size_t i;
-	size_t nbEle = computeDataLength(r5, r4, r3, r2, r1);
-	double sum = 0;
-	for(i=0;i<nbEle;i++)
-		sum += data[i]*data[i];
-	result = sqrt(sum/nbEle);
-	return result;
-}
-
-//sqrt((||f(0)||^2+||f(1)||^2)/nbEle), where f(i) means i-th derivative
-double calculateSobolevNorm_s1_p2_double(double *data, size_t r5, size_t r4, size_t r3, size_t r2, size_t r1)
-{
-	size_t i, j, k;
-	int dim = computeDimension(r5, r4, r3, r2, r1);
-	//size_t nbEle = computeDataLength(r5, r4, r3, r2, r1);
-	size_t counter = 0;
-	double sum = 0;
-	if(dim==1)
-	{
-		for(i=1;i<r1-1;i++)
-		{
-			sum += data[i]*data[i];
-			sum += (data[i+1]-data[i-1])*(data[i+1]-data[i-1])/4;
-			counter ++;
 		}
-		
-		return sqrt(sum/counter);
-	}
-	else if(dim==2)
-	{
-		for(i=1;i<r2-1;i++)
-		{	
-			for(j=1;j<r1-1;j++)
-			{
-				size_t index = i*r1+j;
-				sum += data[index]*data[index];
-				sum += (data[index+1]-data[index-1])*(data[index+1]-data[index-1])/4;
-				sum += (data[index+r1]-data[index-r1])*(data[index+r1]-data[index-r1])/4;
-				counter ++;
-			}
-		}				
-		
-		return sqrt(sum/counter);
-	}
-	else if(dim==3)
-	{
-		size_t r2r1 = r2*r1;
-		for(i=1;i<r3-1;i++)
-		{	
-			for(j=1;j<r2-1;j++)
-			{
-				for(k=1;k<r1-1;k++)
-				{
-					size_t index = i*r2r1+j*r1+k;
-					sum += data[index]*data[index];
-					sum += (data[index+1]-data[index-1])*(data[index+1]-data[index-1])/4;
-					sum += (data[index+r1]-data[index-r1])*(data[index+r1]-data[index-r1])/4;
-					sum += (data[index+r2r1]-data[index-r2r1])*(data[index+r2r1]-data[index-r2r1])/4;				
-					counter ++;	
+		for (size_t d = 0; d < stride.size(); ++d) {
+			for (size_t e = d+1; e < stride.size(); ++e) {
+				const size_t sd = stride[d], se = stride[e];
+				T const* down_down = row - se - sd;
+				T const* up_up = row + se + sd;
+				T const* down_up = row - se + sd;
+				T const* up_down = row + se - sd;
+				#pragma omp simd reduction(+:sum)
+				for (size_t i = 0; i < count; ++i) {
+					T mixed_dev = (down_down[i]+up_up[i]-down_up[i]-up_down[i])/4;
+					sum += mixed_dev*mixed_dev;
 				}
 			}
-		}			
-		
-		return sqrt(sum/counter);
-	}
-	
-	return -1; //error or does not support dim>3
-}
-
- //sqrt((||f(0)||^2+||f(1)||^2+||f(2)||^2)/nbEle), where f(i) means i-th derivative (including mixed partial if possible)
-double calculateSobolevNorm_s2_p2_double(double *data, size_t r5, size_t r4, size_t r3, size_t r2, size_t r1)
-{
-	size_t i, j, k;
-	int dim = computeDimension(r5, r4, r3, r2, r1);
-	//size_t nbEle = computeDataLength(r5, r4, r3, r2, r1);
-	size_t counter = 0;
-	double sum = 0;
-	if(dim==1)
-	{
-		for(i=1;i<r1-1;i++)
-		{
-			float x1_dev = (data[i+1]-data[i-1])/2; //x1_dev1 means along x, 1st-order partial
-			float x2_dev = (data[i+1]-data[i])-(data[i]-data[i-1]); //second order partial
-		
-			sum += data[i]*data[i];
-			sum += x1_dev*x1_dev;
-			sum += x2_dev*x2_dev;
-			counter ++;
 		}
-		
-		return sqrt(sum/counter);
-	}	
-	else if(dim==2)
-	{
-		for(i=1;i<r2-1;i++)
-			for(j=1;j<r1-1;j++)
-			{
-				size_t index = i*r1+j;
-				float x1_dev = (data[index+1]-data[index-1])/2;
-				float x2_dev = (data[index+1]-data[index])-(data[index]-data[index-1]);
-				float y1_dev = (data[index+r1]-data[index-r1])/2;
-				float y2_dev = (data[index+r1]-data[index])-(data[index]-data[index-r1]);
-				float xy_dev = (data[index-r1-1]+data[index+r1+1]-data[index-r1+1]-data[index+r1-1])/4;
-				
-				sum += data[index]*data[index];
-				sum += x1_dev*x1_dev;
-				sum += x2_dev*x2_dev;
-				sum += y1_dev*y1_dev;
-				sum += y2_dev*y2_dev;
-				sum += xy_dev*xy_dev;
-				counter ++;
-			}
-			
-		return sqrt(sum/counter);
-	}
-	else if(dim==3)
-	{
-		size_t r2r1 = r2*r1;
-		for(i=1;i<r3-1;i++)
-			for(j=1;j<r2-1;j++)
-				for(k=1;k<r1-1;k++)
-				{
-					size_t index = i*r2r1+j*r1+k;
-					float x1_dev = (data[index+1]-data[index-1])/2;
-					float x2_dev = (data[index+1]-data[index])-(data[index]-data[index-1]);
-					float y1_dev = (data[index+r1]-data[index-r1])/2;
-					float y2_dev = (data[index+r1]-data[index])-(data[index]-data[index-r1]);
-					float z1_dev = (data[index+r2r1]-data[index-r2r1])/2;
-					float z2_dev = (data[index+r2r1]-data[index])-(data[index]-data[index-r2r1]);										
-					float xy_dev = (data[index-r1-1]+data[index+r1+1] - data[index-r1+1] - data[index+r1-1])/4;
-					float yz_dev = (data[index-r2r1-r1]+data[index+r2r1+r1] - data[index-r2r1+r1] - data[index+r2r1-r1])/4;
-					float xz_dev = (data[index-r2r1-1]+data[index+r2r1+1]-data[index-r2r1+1]-data[index+r2r1-1])/4;
-					sum += data[index]*data[index];
-					sum += x1_dev*x1_dev;
-					sum += x2_dev*x2_dev;
-					sum += y1_dev*y1_dev;
-					sum += y2_dev*y2_dev;
-					sum += z1_dev*z1_dev;
-					sum += z2_dev*z2_dev;
-					sum += xy_dev*xy_dev;
-					sum += yz_dev*yz_dev;
-					sum += xz_dev*xz_dev;
-					counter ++;
-				}
-				
-		return sqrt(sum/counter);
-	}
-	
-	return -1;
+		return sum;
+	});
+	return sqrt(result.first/result.second);
 }
 
 
-double calculateSobolevNorm_p2(void *data, int dataType, int order, size_t , size_t r4, size_t r3, size_t r2, size_t r1)
+template <class T>
+double calculateSobolevNorm_p2(T const* data, int order, std::vector<size_t> const& dims, unsigned int nthreads)
 {
-	double result = 0;
-	if(dataType==QCAT_FLOAT)
-	{
-		float* d = (float*) data;
-		switch(order)
-		{
-			case 0: 
-				result = calculateSobolevNorm_s0_p2_float(d, 0, r4, r3, r2, r1);
-				break;
-			case 1:
-				result = calculateSobolevNorm_s1_p2_float(d, 0, r4, r3, r2, r1);
-				break;
-			case 2:
-				result = calculateSobolevNorm_s2_p2_float(d, 0, r4, r3, r2, r1);
-				break;				
-			default:
-				printf("Error: wrong order: %d\n", order);
-		}
+	switch(order)
+	{
+		case 0:
+			return calculateSobolevNorm_s0_p2(data, dims, nthreads);
+		case 1:
+			return calculateSobolevNorm_s1_p2(data, dims, nthreads);
+		case 2:
+			return calculateSobolevNorm_s2_p2(data, dims, nthreads);
+		default:
+			printf("Error: wrong order: %d\n", order);
+			return 0;
 	}
-	else
-	{
-		double* d = (double*) data;
-		switch(order)
-		{
-			case 0: 
-				result = calculateSobolevNorm_s0_p2_double(d, 0, r4, r3, r2, r1);
-				break;
-			case 1:
-				result = calculateSobolevNorm_s1_p2_double(d, 0, r4, r3, r2, r1);
-				break;
-			case 2:
-				result = calculateSobolevNorm_s2_p2_double(d, 0, r4, r3, r2, r1);
-				break;				
-			default:
-				printf("Error: wrong order: %d\n", order);
-		}	
-	}
-	
-	return result;
 }
 
 class qcatsobolevp2_plugin : public libpressio_metrics_plugin {
+    compat::optional<double> evaluate(pressio_data const& data) const {
+      auto dims = data.normalized_dims();
+      if(dims.empty()) return compat::nullopt;
+      if(data.dtype() == pressio_float_dtype) {
+        return calculateSobolevNorm_p2(static_cast<float const*>(data.data()), order, dims, nthreads);
+      } else if(data.dtype() == pressio_double_dtype) {
+        return calculateSobolevNorm_p2(static_cast<double const*>(data.data()), order, dims, nthreads);
+      }
+      return compat::nullopt;
+    }
   public:
     int begin_compress_impl(struct pressio_data const* input, pressio_data const*) override {
       if(run_input) {
-          int datatype;
           if(input == nullptr) return 0;
-          if(input->dtype() == pressio_float_dtype) datatype = QCAT_FLOAT;
-          else if(input->dtype() == pressio_double_dtype) datatype = QCAT_DOUBLE;
-          else {
-              return 0;
-          }
-          auto dims = input->normalized_dims(4);
-
-          uncompressed_result = calculateSobolevNorm_p2(input->data(), datatype, order, 0, dims[3], dims[2], dims[1], dims[0]);
+          uncompressed_result = evaluate(*input);
       }
       return 0;
     }
 
     int end_decompress_impl(struct pressio_data const* , pressio_data const* output, int rc) override {
       if(run_output) {
-          int datatype;
           if(rc > 0 || output == nullptr) return 0;
-          if(output->dtype() == pressio_float_dtype) datatype = QCAT_FLOAT;
-          else if(output->dtype() == pressio_double_dtype) datatype = QCAT_DOUBLE;
-          else {
-              return 0;
-          }
-          auto dims = output->normalized_dims(4);
-
-          decompressed_result = calculateSobolevNorm_p2(output->data(), datatype, order, 0, dims[3], dims[2], dims[1], dims[0]);
+          decompressed_result = evaluate(*output);
       }
       return 0;
     }
@@ -460,12 +185,17 @@ class qcatsobolevp2_plugin : public libpressio_metrics_plugin {
       set(opt, "qcatsobolevp2:run_uncompressed", run_input);
       set(opt, "qcatsobolevp2:run_decompressed", run_output);
       set(opt, "qcatsobolevp2:order", order);
+      set(opt, "qcatsobolevp2:nthreads", nthreads);
       return opt;
   }
   int set_options(pressio_options const& opt) override {
       get(opt, "qcatsobolevp2:run_uncompressed", &run_input);
       get(opt, "qcatsobolevp2:run_decompressed", &run_output);
       get(opt, "qcatsobolevp2:order", &order);
+      uint32_t tmp;
+      if(get(opt, "qcatsobolevp2:nthreads", &tmp) == pressio_options_key_set) {
+        if(tmp > 0) nthreads = tmp;
+      }
       return 0;
   }
 
@@ -481,6 +211,7 @@ class qcatsobolevp2_plugin : public libpressio_metrics_plugin {
     set(opt, "qcatsobolevp2:run_uncompressed", "run sobolev norm on input");
     set(opt, "qcatsobolevp2:run_decompressed", "run sobolev norm on output");
     set(opt, "qcatsobolevp2:order", "order of the norm {0,1,2}");
+    set(opt, "qcatsobolevp2:nthreads", "number of threads to use to compute the norm");
     return opt;
   }
 
@@ -507,6 +238,7 @@ class qcatsobolevp2_plugin : public libpressio_metrics_plugin {
   compat::optional<double> uncompressed_result;
   compat::optional<double> decompressed_result;
   int32_t order = 0;
+  uint32_t nthreads = 1;
   bool run_input = true;
   bool run_output = true;
 
@@ -6,994 +6,371 @@
 #include "libpressio_ext/cpp/pressio.h"
 #include "libpressio_ext/cpp/options.h"
 #include "std_compat/memory.h"
+#include "block_sample_impl.h"
+#include <algorithm>
+#include <numeric>
 #include <sstream>
 #include <cmath>
+#include <exception>
 
 namespace libpressio { namespace ssim_metrics_ns {
 
- /* Code taken from CODARCode/qcat
+ /* Windowed SSIM as defined by CODARCode/qcat
  *  (C) 2015 by Mathematics and Computer Science (MCS), Argonne National Laboratory.
  *      See COPYRIGHT in top-level directory.
+ *
+ *  The per-window statistics are computed separably: a summed-area (prefix sum) pass along the
+ *  contiguous dimension followed by running box sums over a ring of reduced planes for each outer
+ *  dimension so that each input value is read once instead of once per overlapping window.
  */
-#define K1 0.01
-#define K2 0.03
-#define QCAT_FLOAT 0
-#define QCAT_DOUBLE 1
-#define QCAT_INT32 2
-#define QCAT_INT16 3
-#define QCAT_UINT32 4
-#define QCAT_UINT16 5
-    namespace ssim {
+namespace ssim {
+constexpr double K1 = 0.01;
+constexpr double K2 = 0.03;
+constexpr size_t windowSize = 7;
+constexpr size_t windowShift = 2;
+
 void throw_size_error(size_t a, size_t b) {
     std::stringstream ss;
     ss << "ERROR windowSize = " << a << " > " << b;
     throw std::runtime_error(ss.str());
-
-}
-double SSIM_1d_calcWindow_float(float* data, float* other, size_t offset0, size_t windowSize0);
-double SSIM_1d_calcWindow_double(double* data, double* other, size_t offset0, size_t windowSize0);
-double SSIM_1d_windowed_float(float* oriData, float* decData, size_t size0, size_t windowSize0, size_t windowShift0);
-double SSIM_1d_windowed_double(double* oriData, double* decData, size_t size0, size_t windowSize0, size_t windowShift0);
-
-double SSIM_2d_calcWindow_float(float* data, float *other, size_t size0, size_t offset0, size_t offset1, size_t windowSize0, size_t windowSize1);
-double SSIM_2d_calcWindow_double(double* data, double *other, size_t size0, size_t offset0, size_t offset1, size_t windowSize0, size_t windowSize1);
-double SSIM_2d_windowed_float(float* oriData, float* decData, size_t size1, size_t size0, size_t windowSize0, size_t windowSize1, size_t windowShift0, size_t windowShift1);double SSIM_2d_windowed_double(double* oriData, double* decData, size_t size1, size_t size0, size_t windowSize0, size_t windowSize1, size_t windowShift0, size_t windowShift1);
-
-double SSIM_3d_calcWindow_float(float* data, float* other, size_t size1, size_t size0, size_t offset0, size_t offset1, size_t offset2, size_t windowSize0, size_t windowSize1, size_t windowSize2);
-double SSIM_3d_calcWindow_double(double* data, double* other, size_t size1, size_t size0, size_t offset0, size_t offset1, size_t offset2, size_t windowSize0, size_t windowSize1, size_t windowSize2);
-double SSIM_3d_windowed_float(float* oriData, float* decData, size_t size2, size_t size1, size_t size0, size_t windowSize0, size_t windowSize1, size_t windowSize2, size_t windowShift0, size_t windowShift1, size_t windowShift2);
-double SSIM_3d_windowed_double(double* oriData, double* decData, size_t size2, size_t size1, size_t size0, size_t windowSize0, size_t windowSize1, size_t windowSize2, size_t windowShift0, size_t windowShift1, size_t windowShift2);
-
-double SSIM_4d_calcWindow_float(float* data, float* other, size_t size2, size_t size1, size_t size0, size_t offset0, size_t offset1, size_t offset2, size_t offset3,size_t windowSize0, size_t windowSize1, size_t windowSize2, size_t windowSize3);
-double SSIM_4d_calcWindow_double(double* data, double* other, size_t size2, size_t size1, size_t size0, size_t offset0, size_t offset1, size_t offset2, size_t offset3,size_t windowSize0, size_t windowSize1, size_t windowSize2, size_t windowSize3);
-double SSIM_4d_windowed_float(float* oriData, float* decData, size_t size3, size_t size2, size_t size1, size_t size0, size_t windowSize0, size_t windowSize1, size_t windowSize2, size_t windowSize3, size_t windowShift0, size_t windowShift1, size_t windowShift2, size_t windowShift3);
-double SSIM_4d_windowed_double(double* oriData, double* decData, size_t size3, size_t size2, size_t size1, size_t size0, size_t windowSize0, size_t windowSize1, size_t windowSize2, size_t windowSize3, size_t windowShift0, size_t windowShift1, size_t windowShift2, size_t windowShift3);
-
-double SSIM_1d_calcWindow_float(float* data, float* other, size_t offset0, size_t windowSize0)
-{
-    size_t i0;
-    size_t np=0; //Number of points
-
-    float xMin=data[offset0];
-    float xMax=data[offset0];
-    float yMin=other[offset0];
-    float yMax=other[offset0];
-    double xSum=0;
-    double ySum=0;
-
-    for(i0=offset0; i0<offset0+windowSize0; i0++) {
-        np++;
-        if(xMin>data[i0])
-            xMin=data[i0];
-        if(xMax<data[i0])
-            xMax=data[i0];
-        if(yMin>other[i0])
-            yMin=other[i0];
-        if(yMax<other[i0])
-            yMax=other[i0];
-        xSum+=data[i0];
-        ySum+=other[i0];
-    }
-
-
-    double xMean=xSum/(double)np;
-    double yMean=ySum/(double)np;
-
-    double var_x = 0, var_y = 0, var_xy = 0;
-
-    for(i0=offset0; i0<offset0+windowSize0; i0++) {
-        var_x += (data[i0] - xMean)*(data[i0] - xMean);
-        var_y += (other[i0] - yMean)*(other[i0] - yMean);
-        var_xy += (data[i0] - xMean)*(other[i0] - yMean);
-    }
-
-    var_x /= (double)np;
-    var_y /= (double)np;
-    var_xy /= (double)np;
-
-    double xSigma=sqrt(var_x);
-    double ySigma=sqrt(var_y);
-    double xyCov = var_xy;
-
-    double c1,c2;
-    if(xMax-xMin==0) {
-        c1=K1*K1;
-        c2=K2*K2;
-    } else {
-        c1=K1*K1*(xMax-xMin)*(xMax-xMin);
-        c2=K2*K2*(xMax-xMin)*(xMax-xMin);
-    }
-    double c3=c2/2;
-
-    double luminance=(2*xMean*yMean+c1)/(xMean*xMean+yMean*yMean+c1);
-    double contrast=(2*xSigma*ySigma+c2)/(xSigma*xSigma+ySigma*ySigma+c2);
-    double structure=(xyCov+c3)/(xSigma*ySigma+c3);
-    double ssim=luminance*contrast*structure;
-    return ssim;
-}
-
-double SSIM_1d_calcWindow_double(double* oriData, double* decData, size_t offset0, size_t windowSize0)
-{
-    size_t i0;
-    size_t np=0; //Number of points
-
-    double* data = oriData;
-    double* other = decData;
-
-    double xMin=data[offset0];
-    double xMax=data[offset0];
-    double yMin=other[offset0];
-    double yMax=other[offset0];
-    double xSum=0;
-    double ySum=0;
-
-    for(i0=offset0; i0<offset0+windowSize0; i0++) {
-        np++;
-        if(xMin>data[i0])
-            xMin=data[i0];
-        if(xMax<data[i0])
-            xMax=data[i0];
-        if(yMin>other[i0])
-            yMin=other[i0];
-        if(yMax<other[i0])
-            yMax=other[i0];
-        xSum+=data[i0];
-        ySum+=other[i0];
-    }
-
-
-    double xMean=xSum/(double)np;
-    double yMean=ySum/(double)np;
-
-    double var_x = 0, var_y = 0, var_xy = 0;
-
-    for(i0=offset0; i0<offset0+windowSize0; i0++) {
-        var_x += (data[i0] - xMean)*(data[i0] - xMean);
-        var_y += (other[i0] - yMean)*(other[i0] - yMean);
-        var_xy += (data[i0] - xMean)*(other[i0] - yMean);
-    }
-
-    var_x /= (double)np;
-    var_y /= (double)np;
-    var_xy /= (double)np;
-
-    double xSigma=sqrt(var_x);
-    double ySigma=sqrt(var_y);
-    double xyCov = var_xy;
-
-    double c1,c2;
-    if(xMax-xMin==0) {
-        c1=K1*K1;
-        c2=K2*K2;
-    } else {
-        c1=K1*K1*(xMax-xMin)*(xMax-xMin);
-        c2=K2*K2*(xMax-xMin)*(xMax-xMin);
-    }
-    double c3=c2/2;
-
-    double luminance=(2*xMean*yMean+c1)/(xMean*xMean+yMean*yMean+c1);
-    double contrast=(2*xSigma*ySigma+c2)/(xSigma*xSigma+ySigma*ySigma+c2);
-    double structure=(xyCov+c3)/(xSigma*ySigma+c3);
-    double ssim=luminance*contrast*structure;
-    return ssim;
-}
-
-double SSIM_1d_windowed_float(float* oriData, float* decData, size_t size0, size_t windowSize0, size_t windowShift0) {
-    size_t offset0;
-    size_t nw=0; //Number of windows
-    double ssimSum=0;
-    size_t offsetInc0;
-
-    if(windowSize0>size0) {
-         throw_size_error(windowSize0, size0);
-    }
-
-    //offsetInc0=windowSize0/2;
-    offsetInc0=windowShift0;
-
-
-    for(offset0=0; offset0+windowSize0<=size0; offset0+=offsetInc0) { //MOVING WINDOW
-        nw++;
-        ssimSum+=SSIM_1d_calcWindow_float(oriData, decData, offset0, windowSize0);
-    }
-
-    return ssimSum/nw;
-}
-
-double SSIM_1d_windowed_double(double* oriData, double* decData, size_t size0, size_t windowSize0, size_t windowShift0)
-{
-    size_t offset0;
-    int nw=0; //Number of windows
-    double ssimSum=0;
-    size_t offsetInc0;
-
-    if(windowSize0>size0) {
-         throw_size_error(windowSize0, size0);
-    }
-
-    //offsetInc0=windowSize0/2;
-    offsetInc0=windowShift0;
-
-
-    for(offset0=0; offset0+windowSize0<=size0; offset0+=offsetInc0) { //MOVING WINDOW
-        nw++;
-        ssimSum+=SSIM_1d_calcWindow_double(oriData, decData, offset0, windowSize0);
-    }
-
-    return ssimSum/nw;
-}
-
-//////////////////// 2D
-
-double SSIM_2d_windowed_float(float* oriData, float* decData, size_t size1, size_t size0, size_t windowSize0, size_t windowSize1, size_t windowShift0, size_t windowShift1)
-{
-    size_t offset0,offset1;
-    int nw=0; //Number of windows
-    double ssimSum=0;
-    size_t offsetInc0,offsetInc1;
-
-    float* data = oriData;
-    float* other = decData;
-
-    if(windowSize0>size0) {
-         throw_size_error(windowSize0, size0);
-    }
-    if(windowSize1>size1) {
-         throw_size_error(windowSize1, size1);
-    }
-
-    //offsetInc0=windowSize0/2;
-    //offsetInc1=windowSize1/2;
-    offsetInc0=windowShift0;
-    offsetInc1=windowShift1;
-
-    for(offset1=0; offset1+windowSize1<=size1; offset1+=offsetInc1) { //MOVING WINDOW
-
-        for(offset0=0; offset0+windowSize0<=size0; offset0+=offsetInc0) { //MOVING WINDOW
-            nw++;
-            double ssim = SSIM_2d_calcWindow_float(data, other, size0, offset0, offset1, windowSize0, windowSize1);
-            ssimSum+=ssim;
-        }
-    }
-
-    return ssimSum/nw;
-}
-
-double SSIM_2d_calcWindow_float(float* data, float *other, size_t size0, size_t offset0, size_t offset1, size_t windowSize0, size_t windowSize1)
-{
-    size_t i0,i1,index;
-    size_t np=0; //Number of points
-    float xMin=data[offset0+size0*offset1];
-    float xMax=data[offset0+size0*offset1];
-    float yMin=other[offset0+size0*offset1];
-    float yMax=other[offset0+size0*offset1];
-    double xSum=0;
-    double ySum=0;
-
-    for(i1=offset1; i1<offset1+windowSize1; i1++) {
-        for(i0=offset0; i0<offset0+windowSize0; i0++) {
-            np++;
-            index=i0+size0*i1;
-            if(xMin>data[index])
-                xMin=data[index];
-            if(xMax<data[index])
-                xMax=data[index];
-            if(yMin>other[index])
-                yMin=other[index];
-            if(yMax<other[index])
-                yMax=other[index];
-            xSum+=data[index];
-            ySum+=other[index];
-        }
-    }
-
-    double xMean=xSum/np;
-    double yMean=ySum/np;
-
-    double var_x = 0, var_y = 0, var_xy = 0;
-
-    for(i1=offset1; i1<offset1+windowSize1; i1++) {
-        for(i0=offset0; i0<offset0+windowSize0; i0++) {
-            index=i0+size0*i1;
-            var_x += (data[index] - xMean)*(data[index] - xMean);
-            var_y += (other[index] - yMean)*(other[index] - yMean);
-            var_xy += (data[index] - xMean)*(other[index] - yMean);
-        }
-    }
-
-    var_x /= np;
-    var_y /= np;
-    var_xy /= np;
-
-    double xSigma=sqrt(var_x);
-    double ySigma=sqrt(var_y);
-    double xyCov = var_xy;
-
-
-    double c1,c2;
-    if(xMax-xMin==0) {
-        c1=K1*K1;
-        c2=K2*K2;
-    } else {
-        c1=K1*K1*(xMax-xMin)*(xMax-xMin);
-        c2=K2*K2*(xMax-xMin)*(xMax-xMin);
-    }
-    double c3=c2/2;
-
-    double luminance=(2*xMean*yMean+c1)/(xMean*xMean+yMean*yMean+c1);
-    double contrast=(2*xSigma*ySigma+c2)/(xSigma*xSigma+ySigma*ySigma+c2);
-    double structure=(xyCov+c3)/(xSigma*ySigma+c3);
-    double ssim=luminance*contrast*structure;
-    return ssim;
-}
-
-double SSIM_2d_windowed_double(double* oriData, double* decData, size_t size1, size_t size0, size_t windowSize0, size_t windowSize1, size_t windowShift0, size_t windowShift1)
-{
-    size_t offset0,offset1;
-    size_t nw=0; //Number of windows
-    double ssimSum=0;
-    size_t offsetInc0,offsetInc1;
-
-    double* data = oriData;
-    double* other = decData;
-
-    if(windowSize0>size0) {
-         throw_size_error(windowSize0, size0);
-    }
-    if(windowSize1>size1) {
-         throw_size_error(windowSize1, size1);
-    }
-
-    //offsetInc0=windowSize0/2;
-    //offsetInc1=windowSize1/2;
-    offsetInc0=windowShift0;
-    offsetInc1=windowShift1;
-
-    for(offset1=0; offset1+windowSize1<=size1; offset1+=offsetInc1) { //MOVING WINDOW
-
-        for(offset0=0; offset0+windowSize0<=size0; offset0+=offsetInc0) { //MOVING WINDOW
-            nw++;
-            ssimSum+=SSIM_2d_calcWindow_double(data, other, size0, offset0, offset1, windowSize0, windowSize1);
-        }
-    }
-
-    return ssimSum/nw;
-}
-
-double SSIM_2d_calcWindow_double(double* data, double *other, size_t size0, size_t offset0, size_t offset1, size_t windowSize0, size_t windowSize1) {
-    size_t i0,i1,index;
-    size_t np=0; //Number of points
-    double xMin=data[offset0+size0*offset1];
-    double xMax=data[offset0+size0*offset1];
-    double yMin=other[offset0+size0*offset1];
-    double yMax=other[offset0+size0*offset1];
-    double xSum=0;
-    double ySum=0;
-
-    for(i1=offset1; i1<offset1+windowSize1; i1++) {
-        for(i0=offset0; i0<offset0+windowSize0; i0++) {
-            np++;
-            index=i0+size0*i1;
-            if(xMin>data[index])
-                xMin=data[index];
-            if(xMax<data[index])
-                xMax=data[index];
-            if(yMin>other[index])
-                yMin=other[index];
-            if(yMax<other[index])
-                yMax=other[index];
-            xSum+=data[index];
-            ySum+=other[index];
-        }
-    }
-
-    double xMean=xSum/np;
-    double yMean=ySum/np;
-
-    double var_x = 0, var_y = 0, var_xy = 0;
-
-    for(i1=offset1; i1<offset1+windowSize1; i1++) {
-        for(i0=offset0; i0<offset0+windowSize0; i0++) {
-            index=i0+size0*i1;
-            var_x += (data[index] - xMean)*(data[index] - xMean);
-            var_y += (other[index] - yMean)*(other[index] - yMean);
-            var_xy += (data[index] - xMean)*(other[index] - yMean);
-        }
-    }
-
-    var_x /= np;
-    var_y /= np;
-    var_xy /= np;
-
-    double xSigma=sqrt(var_x);
-    double ySigma=sqrt(var_y);
-    double xyCov = var_xy;
-
-    double c1,c2;
-    if(xMax-xMin==0) {
-        c1=K1*K1;
-        c2=K2*K2;
-    } else {
-        c1=K1*K1*(xMax-xMin)*(xMax-xMin);
-        c2=K2*K2*(xMax-xMin)*(xMax-xMin);
-    }
-    double c3=c2/2;
-
-    double luminance=(2*xMean*yMean+c1)/(xMean*xMean+yMean*yMean+c1);
-    double contrast=(2*xSigma*ySigma+c2)/(xSigma*xSigma+ySigma*ySigma+c2);
-    double structure=(xyCov+c3)/(xSigma*ySigma+c3);
-    double ssim=luminance*contrast*structure;
-    
-    if(ssim<0)
-		printf("ssim=%f", ssim);
-
-    return ssim;
-}
-
-
-//////////////////////// 3D
-
-double SSIM_3d_windowed_float(float* oriData, float* decData, size_t size2, size_t size1, size_t size0, size_t windowSize0, size_t windowSize1, size_t windowSize2, size_t windowShift0, size_t windowShift1, size_t windowShift2)
-{
-    size_t offset0,offset1,offset2;
-    size_t nw=0; //Number of windows
-    double ssimSum=0;
-    size_t offsetInc0,offsetInc1,offsetInc2;
-
-    if(windowSize0>size0) {
-         throw_size_error(windowSize0, size0);
-    }
-    if(windowSize1>size1) {
-         throw_size_error(windowSize1, size1);
-    }
-    if(windowSize2>size2) {
-         throw_size_error(windowSize2, size2);
-    }
-
-    //offsetInc0=windowSize0/2;
-    //offsetInc1=windowSize1/2;
-    //offsetInc2=windowSize2/2;
-    offsetInc0=windowShift0;
-    offsetInc1=windowShift1;
-    offsetInc2=windowShift2;
-
-    for(offset2=0; offset2+windowSize2<=size2; offset2+=offsetInc2) { //MOVING WINDOW
-
-        for(offset1=0; offset1+windowSize1<=size1; offset1+=offsetInc1) { //MOVING WINDOW
-
-            for(offset0=0; offset0+windowSize0<=size0; offset0+=offsetInc0) { //MOVING WINDOW
-                nw++;
-                ssimSum+=SSIM_3d_calcWindow_float(oriData, decData, size1, size0, offset0, offset1, offset2, windowSize0, windowSize1, windowSize2);
-
-            }
-        }
-    }
-
-    return ssimSum/nw;
-}
-
-double SSIM_3d_calcWindow_float(float* data, float* other, size_t size1, size_t size0, size_t offset0, size_t offset1, size_t offset2, size_t windowSize0, size_t windowSize1, size_t windowSize2) {
-    size_t i0,i1,i2,index;
-    size_t np=0; //Number of points
-    float xMin=data[offset0+size0*(offset1+size1*offset2)];
-    float xMax=data[offset0+size0*(offset1+size1*offset2)];
-    float yMin=other[offset0+size0*(offset1+size1*offset2)];
-    float yMax=other[offset0+size0*(offset1+size1*offset2)];
-    double xSum=0;
-    double ySum=0;
-
-    for(i2=offset2; i2<offset2+windowSize2; i2++) {
-        for(i1=offset1; i1<offset1+windowSize1; i1++) {
-            for(i0=offset0; i0<offset0+windowSize0; i0++) {
-                np++;
-                index=i0+size0*(i1+size1*i2);
-                if(xMin>data[index])
-                    xMin=data[index];
-                if(xMax<data[index])
-                    xMax=data[index];
-                if(yMin>other[index])
-                    yMin=other[index];
-                if(yMax<other[index])
-                    yMax=other[index];
-                xSum+=data[index];
-                ySum+=other[index];
-            }
-        }
-    }
-
-
-    double xMean=xSum/np;
-    double yMean=ySum/np;
-    double var_x = 0, var_y = 0, var_xy = 0;
-
-    for(i2=offset2; i2<offset2+windowSize2; i2++) {
-        for(i1=offset1; i1<offset1+windowSize1; i1++) {
-            for(i0=offset0; i0<offset0+windowSize0; i0++) {
-                index=i0+size0*(i1+size1*i2);
-                var_x += (data[index] - xMean)*(data[index] - xMean);
-                var_y += (other[index] - yMean)*(other[index] - yMean);
-                var_xy += (data[index] - xMean)*(other[index] - yMean);
-            }
-        }
-    }
-
-    var_x /= np;
-    var_y /= np;
-    var_xy /= np;
-
-    double xSigma=sqrt(var_x);
-    double ySigma=sqrt(var_y);
-    double xyCov = var_xy;
-
-
-    double c1,c2;
-    if(xMax-xMin==0) {
-        c1=K1*K1;
-        c2=K2*K2;
-    } else {
-        c1=K1*K1*(xMax-xMin)*(xMax-xMin);
-        c2=K2*K2*(xMax-xMin)*(xMax-xMin);
-    }
-    double c3=c2/2;
-
-    double luminance=(2*xMean*yMean+c1)/(xMean*xMean+yMean*yMean+c1);
-    double contrast=(2*xSigma*ySigma+c2)/(xSigma*xSigma+ySigma*ySigma+c2);
-    double structure=(xyCov+c3)/(xSigma*ySigma+c3);
-    double ssim=luminance*contrast*structure;
-
-    return ssim;
 }
 
+/**
+ * sums of the shifted values, their squares and cross products, and the extrema of the
+ * original data for a set of windows stored as a structure of arrays
+ */
+template <class T>
+struct window_moments {
+  void resize(size_t n) {
+    sx.resize(n);
+    sy.resize(n);
+    sxx.resize(n);
+    syy.resize(n);
+    sxy.resize(n);
+    xmin.resize(n);
+    xmax.resize(n);
+  }
+  std::vector<double> sx, sy, sxx, syy, sxy;
+  std::vector<T> xmin, xmax;
+};
 
-double SSIM_3d_windowed_double(double* oriData, double* decData, size_t size2, size_t size1, size_t size0, size_t windowSize0, size_t windowSize1, size_t windowSize2, size_t windowShift0, size_t windowShift1, size_t windowShift2)
-{
-    size_t offset0,offset1,offset2;
-    size_t nw=0; //Number of windows
-    double ssimSum=0;
-    size_t offsetInc0,offsetInc1,offsetInc2;
-
-    if(windowSize0>size0) {
-         throw_size_error(windowSize0, size0);
-    }
-    if(windowSize1>size1) {
-         throw_size_error(windowSize1, size1);
-    }
-    if(windowSize2>size2) {
-         throw_size_error(windowSize2, size2);
-    }
-
-    //offsetInc0=windowSize0/2;
-    //offsetInc1=windowSize1/2;
-    //offsetInc2=windowSize2/2;
-    offsetInc0=windowShift0;
-    offsetInc1=windowShift1;
-    offsetInc2=windowShift2;
-
-    for(offset2=0; offset2+windowSize2<=size2; offset2+=offsetInc2) { //MOVING WINDOW
-
-        for(offset1=0; offset1+windowSize1<=size1; offset1+=offsetInc1) { //MOVING WINDOW
+template <class T>
+class ssim_kernel {
+  public:
+  ssim_kernel(T const* x, T const* y, std::vector<size_t> const& dims, size_t window, size_t shift):
+    x(x), y(y), dims(dims), window(window), shift(shift), nwin(dims.size()), stride(dims.size()+1, 1), sub_count(dims.size()+1, 1)
+  {
+    for (size_t d = 0; d < dims.size(); ++d) {
+      if(window > dims[d]) throw_size_error(window, dims[d]);
+      nwin[d] = (dims[d] - window) / shift + 1;
+      stride[d+1] = stride[d] * dims[d];
+      sub_count[d+1] = sub_count[d] * nwin[d];
+    }
+    points = std::pow(static_cast<double>(window), static_cast<double>(dims.size()));
+  }
 
-            for(offset0=0; offset0+windowSize0<=size0; offset0+=offsetInc0) { //MOVING WINDOW
-                nw++;
-                ssimSum+=SSIM_3d_calcWindow_double(oriData, decData, size1, size0, offset0, offset1, offset2, windowSize0, windowSize1, windowSize2);
+  double operator()(unsigned int nthreads) {
+    const size_t n = stride.back();
+    const size_t N = dims.size();
+    //shift by the global mean so the moment sums do not lose precision for data with a large offset
+    double sum_x = 0, sum_y = 0;
+    #pragma omp parallel for num_threads(nthreads) reduction(+:sum_x,sum_y)
+    for (size_t i = 0; i < n; ++i) {
+      sum_x += x[i];
+      sum_y += y[i];
+    }
+    x_ref = sum_x / static_cast<double>(n);
+    y_ref = sum_y / static_cast<double>(n);
+
+    const size_t top = nwin[N-1];
+    const size_t nchunks = std::max<size_t>(1, std::min<size_t>(nthreads, top));
+    std::vector<double> partial(nchunks, 0.0);
+    #pragma omp parallel for num_threads(nthreads) schedule(static,1)
+    for (size_t c = 0; c < nchunks; ++c) {
+      const size_t o_begin = top * c / nchunks;
+      const size_t o_end = top * (c+1) / nchunks;
+      workspace ws(*this);
+      partial[c] = reduce_top(o_begin, o_end, ws);
+    }
+    const double ssim_sum = std::accumulate(partial.begin(), partial.end(), 0.0);
+    return ssim_sum / static_cast<double>(sub_count[N]);
+  }
 
-            }
-        }
+  private:
+  struct workspace {
+    workspace(ssim_kernel const& k): level(k.dims.size()+1), acc(),
+      px(k.dims[0]+1), py(k.dims[0]+1), pxx(k.dims[0]+1), pyy(k.dims[0]+1), pxy(k.dims[0]+1)
+    {
+      for (size_t m = 2; m <= k.dims.size(); ++m) {
+        level[m].resize(k.window);
+        for (auto& slot : level[m]) slot.resize(k.sub_count[m-1]);
+      }
+      acc.resize(k.sub_count[k.dims.size()-1]);
+    }
+    //ring of reduced planes for each level
+    std::vector<std::vector<window_moments<T>>> level;
+    window_moments<T> acc;
+    //prefix sums along the contiguous dimension
+    std::vector<double> px, py, pxx, pyy, pxy;
+  };
+
+  /**
+   * computes the window moments along dimension 0 for windows [o_begin, o_end) of the line starting at offset
+   */
+  void reduce_line(size_t offset, size_t o_begin, size_t o_end, window_moments<T>& out, size_t out_first, workspace& ws) const {
+    T const* lx = x + offset;
+    T const* ly = y + offset;
+    const size_t first = o_begin * shift;
+    const size_t last = (o_end - 1) * shift + window;
+    ws.px[first] = ws.py[first] = ws.pxx[first] = ws.pyy[first] = ws.pxy[first] = 0;
+    for (size_t i = first; i < last; ++i) {
+      const double vx = lx[i] - x_ref;
+      const double vy = ly[i] - y_ref;
+      ws.px[i+1] = ws.px[i] + vx;
+      ws.py[i+1] = ws.py[i] + vy;
+      ws.pxx[i+1] = ws.pxx[i] + vx*vx;
+      ws.pyy[i+1] = ws.pyy[i] + vy*vy;
+      ws.pxy[i+1] = ws.pxy[i] + vx*vy;
+    }
+    for (size_t o = o_begin; o < o_end; ++o) {
+      const size_t b = o * shift, e = b + window, j = out_first + (o - o_begin);
+      out.sx[j] = ws.px[e] - ws.px[b];
+      out.sy[j] = ws.py[e] - ws.py[b];
+      out.sxx[j] = ws.pxx[e] - ws.pxx[b];
+      out.syy[j] = ws.pyy[e] - ws.pyy[b];
+      out.sxy[j] = ws.pxy[e] - ws.pxy[b];
+      auto mm = std::minmax_element(lx + b, lx + e);
+      out.xmin[j] = *mm.first;
+      out.xmax[j] = *mm.second;
     }
+  }
 
-    return ssimSum/nw;
-}
-
-double SSIM_3d_calcWindow_double(double* data, double* other, size_t size1, size_t size0, size_t offset0, size_t offset1, size_t offset2, size_t windowSize0, size_t windowSize1, size_t windowSize2)
-{
-    size_t i0,i1,i2,index;
-    size_t np=0; //Number of points
-    double xMin=data[offset0+size0*(offset1+size1*offset2)];
-    double xMax=data[offset0+size0*(offset1+size1*offset2)];
-    double yMin=other[offset0+size0*(offset1+size1*offset2)];
-    double yMax=other[offset0+size0*(offset1+size1*offset2)];
-    double xSum=0;
-    double ySum=0;
-
-    for(i2=offset2; i2<offset2+windowSize2; i2++) {
-        for(i1=offset1; i1<offset1+windowSize1; i1++) {
-            for(i0=offset0; i0<offset0+windowSize0; i0++) {
-                np++;
-                index=i0+size0*(i1+size1*i2);
-                if(xMin>data[index])
-                    xMin=data[index];
-                if(xMax<data[index])
-                    xMax=data[index];
-                if(yMin>other[index])
-                    yMin=other[index];
-                if(yMax<other[index])
-                    yMax=other[index];
-                xSum+=data[index];
-                ySum+=other[index];
-            }
-        }
+  /**
+   * combines the `window` ring slots that make up the window starting at plane `first_plane`
+   */
+  void sum_slots(std::vector<window_moments<T>> const& slots, size_t first_plane, size_t count, window_moments<T>& out, size_t out_first) const {
+    auto const& s0 = slots[first_plane % window];
+    std::copy_n(s0.sx.begin(), count, out.sx.begin() + out_first);
+    std::copy_n(s0.sy.begin(), count, out.sy.begin() + out_first);
+    std::copy_n(s0.sxx.begin(), count, out.sxx.begin() + out_first);
+    std::copy_n(s0.syy.begin(), count, out.syy.begin() + out_first);
+    std::copy_n(s0.sxy.begin(), count, out.sxy.begin() + out_first);
+    std::copy_n(s0.xmin.begin(), count, out.xmin.begin() + out_first);
+    std::copy_n(s0.xmax.begin(), count, out.xmax.begin() + out_first);
+    for (size_t k = 1; k < window; ++k) {
+      auto const& s = slots[(first_plane + k) % window];
+      double* sx = out.sx.data() + out_first;
+      double* sy = out.sy.data() + out_first;
+      double* sxx = out.sxx.data() + out_first;
+      double* syy = out.syy.data() + out_first;
+      double* sxy = out.sxy.data() + out_first;
+      T* xmin = out.xmin.data() + out_first;
+      T* xmax = out.xmax.data() + out_first;
+      #pragma omp simd
+      for (size_t i = 0; i < count; ++i) {
+        sx[i] += s.sx[i];
+        sy[i] += s.sy[i];
+        sxx[i] += s.sxx[i];
+        syy[i] += s.syy[i];
+        sxy[i] += s.sxy[i];
+        xmin[i] = std::min(xmin[i], s.xmin[i]);
+        xmax[i] = std::max(xmax[i], s.xmax[i]);
+      }
     }
+  }
 
-    double xMean=xSum/np;
-    double yMean=ySum/np;
-    double var_x = 0, var_y = 0, var_xy = 0;
-
-    for(i2=offset2; i2<offset2+windowSize2; i2++) {
-        for(i1=offset1; i1<offset1+windowSize1; i1++) {
-            for(i0=offset0; i0<offset0+windowSize0; i0++) {
-                index=i0+size0*(i1+size1*i2);
-                var_x += (data[index] - xMean)*(data[index] - xMean);
-                var_y += (other[index] - yMean)*(other[index] - yMean);
-                var_xy += (data[index] - xMean)*(other[index] - yMean);
-            }
-        }
+  /**
+   * computes the window moments for all windows of the slab of dimensions [0, m) starting at offset
+   */
+  void reduce(size_t m, size_t offset, window_moments<T>& out, size_t out_first, workspace& ws) const {
+    if(m == 1) {
+      reduce_line(offset, 0, nwin[0], out, out_first, ws);
+      return;
+    }
+    auto& slots = ws.level[m];
+    const size_t count = sub_count[m-1];
+    const size_t planes = (nwin[m-1] - 1) * shift + window;
+    for (size_t p = 0; p < planes; ++p) {
+      reduce(m-1, offset + p * stride[m-1], slots[p % window], 0, ws);
+      if(p + 1 >= window && (p + 1 - window) % shift == 0) {
+        const size_t o = (p + 1 - window) / shift;
+        sum_slots(slots, o * shift, count, out, out_first + o * count);
+      }
     }
+  }
 
-    var_x /= np;
-    var_y /= np;
-    var_xy /= np;
-
-    double xSigma=sqrt(var_x);
-    double ySigma=sqrt(var_y);
-    double xyCov = var_xy;
-
-
-    double c1,c2;
-    if(xMax-xMin==0) {
-        c1=K1*K1;
-        c2=K2*K2;
+  double window_ssim(window_moments<T> const& m, size_t i) const {
+    const double xMean = m.sx[i] / points;
+    const double yMean = m.sy[i] / points;
+    const double var_x = std::max(0.0, m.sxx[i] / points - xMean * xMean);
+    const double var_y = std::max(0.0, m.syy[i] / points - yMean * yMean);
+    const double xyCov = m.sxy[i] / points - xMean * yMean;
+    const double xSigma = std::sqrt(var_x);
+    const double ySigma = std::sqrt(var_y);
+    const double mx = xMean + x_ref;
+    const double my = yMean + y_ref;
+
+    const double range = static_cast<T>(m.xmax[i] - m.xmin[i]);
+    double c1, c2;
+    if(range == 0) {
+        c1 = K1*K1;
+        c2 = K2*K2;
     } else {
-        c1=K1*K1*(xMax-xMin)*(xMax-xMin);
-        c2=K2*K2*(xMax-xMin)*(xMax-xMin);
-    }
-    double c3=c2/2;
-
-    double luminance=(2*xMean*yMean+c1)/(xMean*xMean+yMean*yMean+c1);
-    double contrast=(2*xSigma*ySigma+c2)/(xSigma*xSigma+ySigma*ySigma+c2);
-    double structure=(xyCov+c3)/(xSigma*ySigma+c3);
-    double ssim=luminance*contrast*structure;
-
-    return ssim;
-}
-
-double SSIM_4d_windowed_float(float* oriData, float* decData, size_t size3, size_t size2, size_t size1, size_t size0, size_t windowSize0, size_t windowSize1, size_t windowSize2, size_t windowSize3, size_t windowShift0, size_t windowShift1, size_t windowShift2, size_t windowShift3)
-{
-    size_t offset0,offset1,offset2,offset3;
-    size_t nw=0; //Number of windows
-    double ssimSum=0;
-    size_t offsetInc0,offsetInc1,offsetInc2,offsetInc3;
-
-    if(windowSize0>size0) {
-         throw_size_error(windowSize0, size0);
-    }
-    if(windowSize1>size1) {
-         throw_size_error(windowSize1, size1);
-    }
-    if(windowSize2>size2) {
-         throw_size_error(windowSize2, size2);
-    }
-    if(windowSize3>size3) {
-         throw_size_error(windowSize3, size3);
-    }
-
-    //offsetInc0=windowSize0/2;
-    //offsetInc1=windowSize1/2;
-    //offsetInc2=windowSize2/2;
-    //offsetInc3=windowSize3/2;
-    offsetInc0=windowShift0;
-    offsetInc1=windowShift1;
-    offsetInc2=windowShift2;
-    offsetInc3=windowShift3;
-
-    for(offset3=0; offset3+windowSize3<=size3; offset3+=offsetInc3) { //MOVING WINDOW
-
-        for(offset2=0; offset2+windowSize2<=size2; offset2+=offsetInc2) { //MOVING WINDOW
-
-            for(offset1=0; offset1+windowSize1<=size1; offset1+=offsetInc1) { //MOVING WINDOW
-
-                for(offset0=0; offset0+windowSize0<=size0; offset0+=offsetInc0) { //MOVING WINDOW
-                    nw++;
-                    ssimSum+=SSIM_4d_calcWindow_float(oriData, decData, size2, size1, size0, offset0, offset1, offset2, offset3, windowSize0, windowSize1, windowSize2, windowSize3);
-                }
-            }
-        }
+        c1 = K1*K1*range*range;
+        c2 = K2*K2*range*range;
     }
+    const double c3 = c2/2;
 
-    return ssimSum/nw;
-    return 0;
-}
+    const double luminance = (2*mx*my+c1)/(mx*mx+my*my+c1);
+    const double contrast = (2*xSigma*ySigma+c2)/(xSigma*xSigma+ySigma*ySigma+c2);
+    const double structure = (xyCov+c3)/(xSigma*ySigma+c3);
+    return luminance*contrast*structure;
+  }
 
-double SSIM_4d_calcWindow_float(float* data, float* other, size_t size2, size_t size1, size_t size0, size_t offset0, size_t offset1, size_t offset2, size_t offset3,size_t windowSize0, size_t windowSize1, size_t windowSize2, size_t windowSize3)
-{
-    size_t i0,i1,i2,i3,index;
-    size_t np=0; //Number of points
-    float xMin=data[offset0+size0*(offset1+size1*(offset2+size2*offset3))];
-    float xMax=data[offset0+size0*(offset1+size1*(offset2+size2*offset3))];
-    float yMin=other[offset0+size0*(offset1+size1*(offset2+size2*offset3))];
-    float yMax=other[offset0+size0*(offset1+size1*(offset2+size2*offset3))];
-    double xSum=0;
-    double ySum=0;
-    for(i3=offset3; i3<offset3+windowSize3; i3++) {
-        for(i2=offset2; i2<offset2+windowSize2; i2++) {
-            for(i1=offset1; i1<offset1+windowSize1; i1++) {
-                for(i0=offset0; i0<offset0+windowSize0; i0++) {
-                    np++;
-                    index=i0+size0*(i1+size1*(i2+size2*i3));
-                    if(xMin>data[index])
-                        xMin=data[index];
-                    if(xMax<data[index])
-                        xMax=data[index];
-                    if(yMin>other[index])
-                        yMin=other[index];
-                    if(yMax<other[index])
-                        yMax=other[index];
-                    xSum+=data[index];
-                    ySum+=other[index];
-                }
-            }
-        }
+  double sum_ssim(window_moments<T> const& m, size_t count) const {
+    double sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+      sum += window_ssim(m, i);
     }
+    return sum;
+  }
 
-    double xMean=xSum/np;
-    double yMean=ySum/np;
-    double var_x = 0, var_y = 0, var_xy = 0;
-
-    for(i3=offset3; i3<offset3+windowSize3; i3++) {
-        for(i2=offset2; i2<offset2+windowSize2; i2++) {
-            for(i1=offset1; i1<offset1+windowSize1; i1++) {
-                for(i0=offset0; i0<offset0+windowSize0; i0++) {
-                    index=i0+size0*(i1+size1*(i2+size2*i3));
-                    var_x += (data[index] - xMean)*(data[index] - xMean);
-                    var_y += (other[index] - yMean)*(other[index] - yMean);
-                    var_xy += (data[index] - xMean)*(other[index] - yMean);
-                }
-            }
-        }
-    }
-
-    var_x /= np;
-    var_y /= np;
-    var_xy /= np;
-
-    double xSigma=sqrt(var_x);
-    double ySigma=sqrt(var_y);
-    double xyCov = var_xy;
-
-    double c1,c2;
-    if(xMax-xMin==0) {
-        c1=K1*K1;
-        c2=K2*K2;
-    } else {
-        c1=K1*K1*(xMax-xMin)*(xMax-xMin);
-        c2=K2*K2*(xMax-xMin)*(xMax-xMin);
-    }
-    double c3=c2/2;
+  /**
+   * sums the ssim of windows [o_begin, o_end) along the slowest dimension
+   */
+  double reduce_top(size_t o_begin, size_t o_end, workspace& ws) const {
+    const size_t N = dims.size();
+    if(N == 1) {
+      ws.acc.resize(o_end - o_begin);
+      reduce_line(0, o_begin, o_end, ws.acc, 0, ws);
+      return sum_ssim(ws.acc, o_end - o_begin);
+    }
+    auto& slots = ws.level[N];
+    const size_t count = sub_count[N-1];
+    const size_t first = o_begin * shift;
+    const size_t last = (o_end - 1) * shift + window;
+    double sum = 0;
+    for (size_t p = first; p < last; ++p) {
+      reduce(N-1, p * stride[N-1], slots[p % window], 0, ws);
+      if(p + 1 >= first + window && (p + 1 - window) % shift == 0) {
+        sum_slots(slots, p + 1 - window, count, ws.acc, 0);
+        sum += sum_ssim(ws.acc, count);
+      }
+    }
+    return sum;
+  }
 
-    double luminance=(2*xMean*yMean+c1)/(xMean*xMean+yMean*yMean+c1);
-    double contrast=(2*xSigma*ySigma+c2)/(xSigma*xSigma+ySigma*ySigma+c2);
-    double structure=(xyCov+c3)/(xSigma*ySigma+c3);
-    double ssim=luminance*contrast*structure;
-    return ssim;
-}
+  T const* x;
+  T const* y;
+  std::vector<size_t> const& dims;
+  size_t window, shift;
+  std::vector<size_t> nwin;
+  std::vector<size_t> stride;
+  std::vector<size_t> sub_count;
+  double points;
+  double x_ref = 0, y_ref = 0;
+};
 
-double SSIM_4d_windowed_double(double* oriData, double* decData, size_t size3, size_t size2, size_t size1, size_t size0, size_t windowSize0, size_t windowSize1, size_t windowSize2, size_t windowSize3, size_t windowShift0, size_t windowShift1, size_t windowShift2, size_t windowShift3)
+template <class T>
+double calculateSSIM(T const* oriData, T const* decData, std::vector<size_t> const& dims, unsigned int nthreads)
 {
-    size_t offset0,offset1,offset2,offset3;
-    size_t nw=0; //Number of windows
-    double ssimSum=0;
-    size_t offsetInc0,offsetInc1,offsetInc2,offsetInc3;
-
-    if(windowSize0>size0) {
-         throw_size_error(windowSize0, size0);
-    }
-    if(windowSize1>size1) {
-         throw_size_error(windowSize1, size1);
-    }
-    if(windowSize2>size2) {
-         throw_size_error(windowSize2, size2);
-    }
-    if(windowSize3>size3) {
-         throw_size_error(windowSize3, size3);
-    }
-
-    //offsetInc0=windowSize0/2;
-    //offsetInc1=windowSize1/2;
-    //offsetInc2=windowSize2/2;
-    //offsetInc3=windowSize3/2;
-    offsetInc0=windowShift0;
-    offsetInc1=windowShift1;
-    offsetInc2=windowShift2;
-    offsetInc3=windowShift3;
-
-    for(offset3=0; offset3+windowSize3<=size3; offset3+=offsetInc3) { //MOVING WINDOW
-
-        for(offset2=0; offset2+windowSize2<=size2; offset2+=offsetInc2) { //MOVING WINDOW
-
-            for(offset1=0; offset1+windowSize1<=size1; offset1+=offsetInc1) { //MOVING WINDOW
-
-                for(offset0=0; offset0+windowSize0<=size0; offset0+=offsetInc0) { //MOVING WINDOW
-                    nw++;
-                    ssimSum+=SSIM_4d_calcWindow_double(oriData, decData, size2, size1, size0, offset0, offset1, offset2, offset3, windowSize0, windowSize1, windowSize2, windowSize3);
-                }
-            }
-        }
-    }
-
-    return ssimSum/nw;
-    return 0;
+  return ssim_kernel<T>(oriData, decData, dims, windowSize, windowShift)(nthreads);
 }
 
-double SSIM_4d_calcWindow_double(double* data, double* other, size_t size2, size_t size1, size_t size0, size_t offset0, size_t offset1, size_t offset2, size_t offset3,size_t windowSize0, size_t windowSize1, size_t windowSize2, size_t windowSize3)
+/**
+ * estimates the SSIM from the mean of the SSIM of equally sized blocks; blocks are evaluated in parallel
+ */
+template <class T>
+metrics_sampling::estimate calculateSampledSSIM(std::vector<pressio_data> const& oriBlocks, pressio_data const& decData, std::vector<size_t> const& dims, metrics_sampling::block_sample const& sample, unsigned int nthreads)
 {
-    size_t i0,i1,i2,i3,index;
-    size_t np=0; //Number of points
-    double xMin=data[offset0+size0*(offset1+size1*(offset2+size2*offset3))];
-    double xMax=data[offset0+size0*(offset1+size1*(offset2+size2*offset3))];
-    double yMin=other[offset0+size0*(offset1+size1*(offset2+size2*offset3))];
-    double yMax=other[offset0+size0*(offset1+size1*(offset2+size2*offset3))];
-    double xSum=0;
-    double ySum=0;
-    for(i3=offset3; i3<offset3+windowSize3; i3++) {
-        for(i2=offset2; i2<offset2+windowSize2; i2++) {
-            for(i1=offset1; i1<offset1+windowSize1; i1++) {
-                for(i0=offset0; i0<offset0+windowSize0; i0++) {
-                    np++;
-                    index=i0+size0*(i1+size1*(i2+size2*i3));
-                    if(xMin>data[index])
-                        xMin=data[index];
-                    if(xMax<data[index])
-                        xMax=data[index];
-                    if(yMin>other[index])
-                        yMin=other[index];
-                    if(yMax<other[index])
-                        yMax=other[index];
-                    xSum+=data[index];
-                    ySum+=other[index];
-                }
-            }
-        }
+  const size_t k = sample.blocks.size();
+  std::vector<double> block_ssim(k), counts(k, 1.0);
+  std::exception_ptr error;
+  #pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+  for (size_t i = 0; i < k; ++i) {
+    try {
+      auto decBlock = metrics_sampling::gather(decData, dims, sample.blocks[i]);
+      block_ssim[i] = ssim_kernel<T>(static_cast<T const*>(oriBlocks[i].data()), static_cast<T const*>(decBlock.data()), sample.blocks[i].extent, windowSize, windowShift)(1);
+    } catch(...) {
+      #pragma omp critical
+      error = std::current_exception();
     }
-
-    double xMean=xSum/np;
-    double yMean=ySum/np;
-    double var_x = 0, var_y = 0, var_xy = 0;
-
-    for(i3=offset3; i3<offset3+windowSize3; i3++) {
-        for(i2=offset2; i2<offset2+windowSize2; i2++) {
-            for(i1=offset1; i1<offset1+windowSize1; i1++) {
-                for(i0=offset0; i0<offset0+windowSize0; i0++) {
-                    index=i0+size0*(i1+size1*(i2+size2*i3));
-                    var_x += (data[index] - xMean)*(data[index] - xMean);
-                    var_y += (other[index] - yMean)*(other[index] - yMean);
-                    var_xy += (data[index] - xMean)*(other[index] - yMean);
-                }
-            }
-        }
-    }
-    var_x /= np;
-    var_y /= np;
-    var_xy /= np;
-
-    double xSigma=sqrt(var_x);
-    double ySigma=sqrt(var_y);
-    double xyCov = var_xy;
-
-    double c1,c2;
-    if(xMax-xMin==0) {
-        c1=K1*K1;
-        c2=K2*K2;
-    } else {
-        c1=K1*K1*(xMax-xMin)*(xMax-xMin);
-        c2=K2*K2*(xMax-xMin)*(xMax-xMin);
-    }
-    double c3=c2/2;
-
-    double luminance=(2*xMean*yMean+c1)/(xMean*xMean+yMean*yMean+c1);
-    double contrast=(2*xSigma*ySigma+c2)/(xSigma*xSigma+ySigma*ySigma+c2);
-    double structure=(xyCov+c3)/(xSigma*ySigma+c3);
-    double ssim=luminance*contrast*structure;
-    return ssim;
-}
-
-int computeDimension(size_t r5, size_t r4, size_t r3, size_t r2, size_t r1)
-{
-	if(r1==0)
-		return 0;
-	else if(r2 == 0)
-		return 1;
-	else if(r3 == 0)
-		return 2;
-	else if(r4 == 0)
-		return 3;
-	else if(r5 == 0)
-		return 4;
-	return 5;
+  }
+  if(error) std::rethrow_exception(error);
+  return metrics_sampling::ratio_estimate(block_ssim, counts, sample.fraction());
 }
 
-double calculateSSIM(void* oriData, void* decData, int dataType, size_t r4, size_t r3, size_t r2, size_t r1)
-{
-	int dim = computeDimension(0, r4, r3, r2, r1);
-	
-	size_t windowSize0 = 7;
-	size_t windowSize1 = 7;
-	size_t windowSize2 = 7;
-	size_t windowSize3 = 7;
-	
-	size_t windowShift0 = 2;
-	size_t windowShift1 = 2;
-	size_t windowShift2 = 2;
-	size_t windowShift3 = 2;
-	
-	double result = -1;
-	if(dataType==QCAT_FLOAT) //float type
-	{
-		switch(dim)
-		{
-		case 1:
-			result = SSIM_1d_windowed_float((float*)oriData, (float*)decData, r1, windowSize0, windowShift0);
-			break;
-		case 2:
-			result = SSIM_2d_windowed_float((float*)oriData, (float*)decData, r2, r1, windowSize0, windowSize1, windowShift0, windowShift1);
-			break;
-		case 3:
-			result = SSIM_3d_windowed_float((float*)oriData, (float*)decData, r3, r2, r1, windowSize0, windowSize1, windowSize2, windowShift0, windowShift1, windowShift2);
-			break;
-		case 4:
-			result = SSIM_4d_windowed_float((float*)oriData, (float*)decData, r4, r3, r2, r1, windowSize0, windowSize1, windowSize2, windowSize3, windowShift0, windowShift1, windowShift2, windowShift3);
-			break;
-		}
-	}
-	else //double type
-	{
-		switch(dim)
-		{
-		case 1:
-			result = SSIM_1d_windowed_double((double*)oriData, (double*)decData, r1, windowSize0, windowShift0);
-			break;
-		case 2:
-			result = SSIM_2d_windowed_double((double*)oriData, (double*)decData, r2, r1, windowSize0, windowSize1, windowShift0, windowShift1);
-			break;
-		case 3:
-			result = SSIM_3d_windowed_double((double*)oriData, (double*)decData, r3, r2, r1, windowSize0, windowSize1, windowSize2, windowShift0, windowShift1, windowShift2);
-			break;
-		case 4:
-			result = SSIM_4d_windowed_double((double*)oriData, (double*)decData, r4, r3, r2, r1, windowSize0, windowSize1, windowSize2, windowSize3, windowShift0, windowShift1, windowShift2, windowShift3);
-			break;
-		}		
-	}
-	return result;
-}
-
-
-
-
-
 }
 
 
 class ssim_plugin : public libpressio_metrics_plugin {
   public:
     int begin_compress_impl(struct pressio_data const* input, pressio_data const*) override {
-      input_data = pressio_data::clone(*input);
+      if(sampler.enabled()) {
+        dims = ssim_dims(*input);
+        //each block must fit at least one window
+        auto windowed = sampler;
+        windowed.block_size = std::max<uint64_t>(windowed.block_size, ssim::windowSize);
+        sample = windowed.select(dims);
+        input_blocks.clear();
+        for (auto const& block : sample.blocks) {
+          input_blocks.emplace_back(metrics_sampling::gather(*input, dims, block));
+        }
+      } else {
+        input_data = pressio_data::clone(*input);
+      }
       return 0;
     }
 
     int end_decompress_impl(struct pressio_data const* , pressio_data const* output, int rc) override {
 
       if(rc > 0 || output == nullptr) return 0;
-      int datatype = 0;
-      if(output->dtype() == pressio_float_dtype) datatype = QCAT_FLOAT;
-      else if(output->dtype() == pressio_double_dtype) datatype = QCAT_DOUBLE;
-      else return 0;
-
-      auto norm_dims = output->normalized_dims(4);
-      result = ssim::calculateSSIM(input_data.data(), output->data(), datatype, norm_dims[3], norm_dims[2], norm_dims[1], norm_dims[0]);
+      auto norm_dims = ssim_dims(*output);
+      if(norm_dims.empty()) return 0;
+      if(sampler.enabled()) {
+        metrics_sampling::estimate e{0, 0};
+        if(output->dtype() == pressio_float_dtype) {
+          e = ssim::calculateSampledSSIM<float>(input_blocks, *output, norm_dims, sample, nthreads);
+        } else if(output->dtype() == pressio_double_dtype) {
+          e = ssim::calculateSampledSSIM<double>(input_blocks, *output, norm_dims, sample, nthreads);
+        } else {
+          return 0;
+        }
+        result = e.value;
+        result_ci = e.ci;
+        return 0;
+      }
+      result_ci.reset();
+      if(output->dtype() == pressio_float_dtype) {
+        result = ssim::calculateSSIM(static_cast<float const*>(input_data.data()), static_cast<float const*>(output->data()), norm_dims, nthreads);
+      } else if(output->dtype() == pressio_double_dtype) {
+        result = ssim::calculateSSIM(static_cast<double const*>(input_data.data()), static_cast<double const*>(output->data()), norm_dims, nthreads);
+      }
 
       return 0;
     }
 
 
-  
+  pressio_options get_options() const override {
+    pressio_options opts;
+    set(opts, "ssim:nthreads", nthreads);
+    set(opts, "pressio:metrics_sample_rate", sampler.rate);
+    set(opts, "pressio:metrics_sample_seed", sampler.seed);
+    set(opts, "pressio:metrics_sample_block", sampler.block_size);
+    return opts;
+  }
+
+  int set_options(pressio_options const& opts) override {
+    uint32_t tmp;
+    if(get(opts, "ssim:nthreads", &tmp) == pressio_options_key_set) {
+      if(tmp > 0) nthreads = tmp;
+    }
+    get(opts, "pressio:metrics_sample_rate", &sampler.rate);
+    get(opts, "pressio:metrics_sample_seed", &sampler.seed);
+    get(opts, "pressio:metrics_sample_block", &sampler.block_size);
+    return 0;
+  }
+
   struct pressio_options get_configuration_impl() const override {
     pressio_options opts;
     set(opts, "pressio:stability", "stable");
@@ -1008,16 +385,23 @@ class ssim_plugin : public libpressio_metrics_plugin {
     set(opt, "pressio:description", R"(computes the SSIM as implmemented in in QCAT
 
     SSIM the structual similar image metric
-    
+
     https://github.com/szcompressor/qcat
     )");
     set(opt, "ssim:ssim", "the structual image similarity metric, between 0 and 1, 1 is good");
+    set(opt, "ssim:nthreads", "number of threads to use to compute the SSIM");
+    set(opt, "ssim:ssim_ci", "half width of the 95% confidence interval of the SSIM when sampling");
+    set(opt, "pressio:metrics_sample_rate", R"(fraction of the blocks of the data to evaluate the metrics on.
+    Values in (0,1) estimate the SSIM from the windows contained in a deterministic pseudo-random subset of blocks; other values use the entire dataset)");
+    set(opt, "pressio:metrics_sample_seed", "seed used to choose the sampled blocks");
+    set(opt, "pressio:metrics_sample_block", "number of elements of a sampled block in each dimension, at least the window size");
     return opt;
   }
 
   pressio_options get_metrics_results(pressio_options const &) override {
     pressio_options opt;
     set(opt, "ssim:ssim", result);
+    set(opt, "ssim:ssim_ci", result_ci);
     return opt;
   }
 
@@ -1029,9 +413,20 @@ class ssim_plugin : public libpressio_metrics_plugin {
   }
 
   private:
+  static std::vector<size_t> ssim_dims(pressio_data const& data) {
+    auto norm_dims = data.normalized_dims(4);
+    norm_dims.erase(std::find(norm_dims.begin(), norm_dims.end(), 0), norm_dims.end());
+    return norm_dims;
+  }
 
   compat::optional<double> result;
+  compat::optional<double> result_ci;
   pressio_data input_data;
+  uint32_t nthreads = 1;
+  metrics_sampling::block_sampler sampler;
+  metrics_sampling::block_sample sample;
+  std::vector<size_t> dims;
+  std::vector<pressio_data> input_blocks;
 };
 
 static pressio_register metrics_ssim_plugin(metrics_plugins(), "ssim", [](){ return compat::make_unique<ssim_plugin>(); });
@@ -0,0 +1,403 @@
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pressio_options.h"
+#include "pressio_compressor.h"
+#include "libpressio_ext/cpp/metrics.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+#include "std_compat/memory.h"
+
+namespace libpressio {
+namespace trace_metrics {
+  using std::chrono::steady_clock;
+
+  struct span {
+    std::string name;
+    std::string op;
+    uint64_t begin_ns;
+    uint64_t duration_ns;
+    uint32_t tid;
+    bool instant;
+  };
+
+  /**
+   * the origin of the timestamps; it is shared by every log so that spans from logs written side by side line up
+   */
+  steady_clock::time_point trace_epoch() {
+    static const steady_clock::time_point epoch = steady_clock::now();
+    return epoch;
+  }
+
+  uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now() - trace_epoch()).count();
+  }
+
+  struct summary_entry {
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+  };
+  using summary_t = std::map<std::pair<std::string, std::string>, summary_entry>;
+
+  std::string json_escape(std::string const& str);
+  void write_chrome(std::ostream& out, std::deque<span> const& spans);
+  void write_summary(std::ostream& out, summary_t const& summary);
+
+  /**
+   * log of spans shared by a trace plugin and its clones, or by every plugin in the same trace:session
+   *
+   * The log keeps at most max_spans spans, dropping the oldest ones first; the summary counts every span
+   * recorded including the dropped ones.  The log is written to its file when it is flushed and when the last
+   * plugin using it is destroyed.
+   */
+  class trace_log {
+    public:
+    static const uint64_t default_max_spans = 1 << 20;
+
+    ~trace_log() {
+      try {
+        write();
+      } catch(...) {
+        //never throw from a destructor
+      }
+    }
+
+    uint32_t thread_index() {
+      std::lock_guard<std::mutex> guard(lock);
+      auto it = threads.find(std::this_thread::get_id());
+      if(it == threads.end()) {
+        it = threads.emplace(std::this_thread::get_id(), static_cast<uint32_t>(threads.size())).first;
+      }
+      return it->second;
+    }
+
+    void record(span s) {
+      std::lock_guard<std::mutex> guard(lock);
+      if(!s.instant) {
+        auto& entry = summary_[{s.name, s.op}];
+        entry.count++;
+        entry.total_ns += s.duration_ns;
+      }
+      spans_.emplace_back(std::move(s));
+      trim();
+    }
+
+    void clear() {
+      std::lock_guard<std::mutex> guard(lock);
+      spans_.clear();
+      summary_.clear();
+      dropped_ = 0;
+    }
+
+    void configure(std::string const& file, std::string const& format, uint64_t max_spans) {
+      std::lock_guard<std::mutex> guard(lock);
+      if(!file.empty()) file_ = file;
+      format_ = format;
+      max_spans_ = max_spans;
+      trim();
+    }
+
+    /**
+     * writes the log to its file, replacing the previous contents
+     * \returns false if the file could not be written
+     */
+    bool write() const {
+      std::lock_guard<std::mutex> guard(lock);
+      if(file_.empty()) return true;
+      std::ofstream out(file_, std::ios::trunc);
+      if(format_ == "summary") {
+        write_summary(out, summary_);
+      } else {
+        write_chrome(out, spans_);
+      }
+      return static_cast<bool>(out);
+    }
+
+    uint64_t size() const {
+      std::lock_guard<std::mutex> guard(lock);
+      return spans_.size();
+    }
+    uint64_t dropped() const {
+      std::lock_guard<std::mutex> guard(lock);
+      return dropped_;
+    }
+    summary_t summary() const {
+      std::lock_guard<std::mutex> guard(lock);
+      return summary_;
+    }
+
+    private:
+    void trim() {
+      while(spans_.size() > max_spans_) {
+        spans_.pop_front();
+        ++dropped_;
+      }
+    }
+
+    mutable std::mutex lock;
+    std::deque<span> spans_;
+    summary_t summary_;
+    uint64_t dropped_ = 0;
+    uint64_t max_spans_ = default_max_spans;
+    std::string file_;
+    std::string format_ = "chrome";
+    std::map<std::thread::id, uint32_t> threads;
+  };
+
+  /**
+   * the logs of the named trace sessions; a log lives as long as some plugin in the session does
+   */
+  class trace_sessions {
+    public:
+    static trace_sessions& instance() {
+      static trace_sessions sessions;
+      return sessions;
+    }
+
+    std::shared_ptr<trace_log> get(std::string const& session) {
+      std::lock_guard<std::mutex> guard(lock);
+      for (auto it = logs.begin(); it != logs.end();) {
+        if(it->second.expired()) it = logs.erase(it);
+        else ++it;
+      }
+      auto& entry = logs[session];
+      auto log = entry.lock();
+      if(!log) {
+        log = std::make_shared<trace_log>();
+        entry = log;
+      }
+      return log;
+    }
+
+    private:
+    std::mutex lock;
+    std::map<std::string, std::weak_ptr<trace_log>> logs;
+  };
+
+  std::string json_escape(std::string const& str) {
+    std::ostringstream ss;
+    for (char c : str) {
+      switch(c) {
+        case '"': ss << "\\\""; break;
+        case '\\': ss << "\\\\"; break;
+        case '\n': ss << "\\n"; break;
+        case '\t': ss << "\\t"; break;
+        default:
+          if(static_cast<unsigned char>(c) < 0x20) {
+            ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+          } else {
+            ss << c;
+          }
+      }
+    }
+    return ss.str();
+  }
+
+  /**
+   * writes the spans in the Chrome trace event format which can be loaded by chrome://tracing and Perfetto
+   */
+  void write_chrome(std::ostream& out, std::deque<span> const& spans) {
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    out << std::fixed << std::setprecision(3);
+    for (auto const& s : spans) {
+      if(!first) out << ',';
+      first = false;
+      out << "\n{\"name\":\"" << json_escape(s.instant ? s.op : s.name + " " + s.op) << '"'
+          << ",\"cat\":\"" << json_escape(s.instant ? "segment" : s.op) << '"'
+          << ",\"ph\":\"" << (s.instant ? "i" : "X") << '"'
+          << ",\"ts\":" << static_cast<double>(s.begin_ns) / 1e3;
+      if(s.instant) {
+        out << ",\"s\":\"t\"";
+      } else {
+        out << ",\"dur\":" << static_cast<double>(s.duration_ns) / 1e3;
+      }
+      out << ",\"pid\":0,\"tid\":" << s.tid
+          << ",\"args\":{\"path\":\"" << json_escape(s.name) << "\"}}";
+    }
+    out << "\n]}\n";
+  }
+
+  void write_summary(std::ostream& out, summary_t const& summary) {
+    out << "name,operation,count,total_ns,mean_ns\n";
+    for (auto const& entry : summary) {
+      out << entry.first.first << ',' << entry.first.second << ',' << entry.second.count << ','
+          << entry.second.total_ns << ',' << entry.second.total_ns / entry.second.count << '\n';
+    }
+  }
+
+class trace_plugin : public libpressio_metrics_plugin {
+  public:
+  int begin_compress_impl(const struct pressio_data * , struct pressio_data const * ) override {
+    begin();
+    return 0;
+  }
+  int end_compress_impl(struct pressio_data const* , pressio_data const * , int ) override {
+    end("compress");
+    return 0;
+  }
+  int begin_decompress_impl(struct pressio_data const* , pressio_data const* ) override {
+    begin();
+    return 0;
+  }
+  int end_decompress_impl(struct pressio_data const* , pressio_data const* , int ) override {
+    end("decompress");
+    return 0;
+  }
+  int begin_compress_many_impl(compat::span<const pressio_data* const> const&,
+                                   compat::span<const pressio_data* const> const&) override {
+    begin();
+    return 0;
+  }
+  int end_compress_many_impl(compat::span<const pressio_data* const> const& ,
+                                   compat::span<const pressio_data* const> const& , int ) override {
+    end("compress_many");
+    return 0;
+  }
+  int begin_decompress_many_impl(compat::span<const pressio_data* const> const& ,
+                                   compat::span<const pressio_data* const> const& ) override {
+    begin();
+    return 0;
+  }
+  int end_decompress_many_impl(compat::span<const pressio_data* const> const& ,
+                                   compat::span<const pressio_data* const> const& , int ) override {
+    end("decompress_many");
+    return 0;
+  }
+  int view_segment_impl(pressio_data const* , const char* segment_id) override {
+    log->record(span{path(), segment_id, now(), 0, log->thread_index(), true});
+    return 0;
+  }
+
+  pressio_options get_options() const override {
+    pressio_options opts;
+    set(opts, "trace:file", file);
+    set(opts, "trace:format", format);
+    set(opts, "trace:session", session);
+    set(opts, "trace:max_spans", max_spans);
+    set_type(opts, "trace:clear", pressio_option_bool_type);
+    set_type(opts, "trace:flush", pressio_option_bool_type);
+    return opts;
+  }
+
+  int set_options(pressio_options const& opts) override {
+    get(opts, "trace:file", &file);
+    get(opts, "trace:format", &format);
+    get(opts, "trace:max_spans", &max_spans);
+    std::string new_session = session;
+    get(opts, "trace:session", &new_session);
+    if(new_session != session) {
+      session = new_session;
+      log = session.empty() ? std::make_shared<trace_log>() : trace_sessions::instance().get(session);
+    }
+    log->configure(file, format, max_spans);
+    bool clear = false;
+    if(get(opts, "trace:clear", &clear) == pressio_options_key_set && clear) {
+      log->clear();
+    }
+    bool flush = false;
+    if(get(opts, "trace:flush", &flush) == pressio_options_key_set && flush) {
+      if(!log->write()) {
+        return set_error(1, "failed to write " + file);
+      }
+    }
+    return 0;
+  }
+
+  struct pressio_options get_metrics_results(pressio_options const&) override {
+    pressio_options opt;
+    std::vector<std::string> summary;
+    for (auto const& entry : log->summary()) {
+      summary.emplace_back(entry.first.first + " " + entry.first.second + " " + std::to_string(entry.second.count) + " " + std::to_string(entry.second.total_ns));
+    }
+    set(opt, "trace:spans", log->size());
+    set(opt, "trace:dropped", log->dropped());
+    set(opt, "trace:summary", summary);
+    return opt;
+  }
+
+  struct pressio_options get_configuration_impl() const override {
+    pressio_options opts;
+    set(opts, "pressio:stability", "experimental");
+    set(opts, "pressio:thread_safe", pressio_thread_safety_multiple);
+    set(opts, "trace:format", std::vector<std::string>{"chrome", "summary"});
+    set(opts, "predictors:requires_decompress", true);
+    set(opts, "predictors:invalidate", std::vector<std::string>{"predictors:runtime", "predictors:nondeterministc"});
+    return opts;
+  }
+
+  struct pressio_options get_documentation_impl() const override {
+    pressio_options opts;
+    set(opts, "pressio:description", R"(records nested spans for compress and decompress calls
+
+    A trace plugin and its clones record into one log, so the per-thread clones made by meta-compressors share a
+    timeline.  Plugins that set the same trace:session also share a log, so setting pressio:metric to trace with a
+    common session for each compressor in a tree of meta-compressors records a span for every level named by the
+    compressor's path along with the thread that ran it; calls to view_segment are recorded as instant events.)");
+    set(opts, "trace:file", "if non-empty, the log is written to this file when trace:flush is set and when the last plugin using the log is destroyed; the last non-empty file set in a session is used");
+    set(opts, "trace:format", R"(format of trace:file
+      + chrome -- Chrome trace event JSON which can be opened with chrome://tracing or Perfetto
+      + summary -- CSV with the count and total time of each span name and operation
+    )");
+    set(opts, "trace:session", "if non-empty, plugins with the same session share a log; otherwise the log is private to this plugin and its clones");
+    set(opts, "trace:max_spans", "the maximum number of events kept in the log; the oldest events are dropped first");
+    set(opts, "trace:clear", "when set to true, clears the log");
+    set(opts, "trace:flush", "when set to true, writes the log to trace:file");
+    set(opts, "trace:spans", "the number of events in the log");
+    set(opts, "trace:dropped", "the number of events dropped from the log because of trace:max_spans");
+    set(opts, "trace:summary", "for each span name and operation including dropped spans: the name, operation, count, and total time in ns separated by spaces");
+    return opts;
+  }
+
+  std::unique_ptr<libpressio_metrics_plugin> clone() override {
+    return compat::make_unique<trace_plugin>(*this);
+  }
+
+  const char* prefix() const override {
+    return "trace";
+  }
+
+  private:
+  /**
+   * the name of the compressor that owns this plugin
+   */
+  std::string path() const {
+    std::string name = get_name();
+    for (std::string suffix : {"/trace", "/composite"}) {
+      if(name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        name.erase(name.size() - suffix.size());
+      }
+    }
+    return name.empty() ? "/" : name;
+  }
+
+  void begin() {
+    begin_ns.push_back(now());
+  }
+  void end(const char* op) {
+    if(begin_ns.empty()) return;
+    const uint64_t end_ns = now();
+    log->record(span{path(), op, begin_ns.back(), end_ns - begin_ns.back(), log->thread_index(), false});
+    begin_ns.pop_back();
+  }
+
+  std::string file;
+  std::string format = "chrome";
+  std::string session;
+  uint64_t max_spans = trace_log::default_max_spans;
+  std::shared_ptr<trace_log> log = std::make_shared<trace_log>();
+  std::vector<uint64_t> begin_ns;
+};
+
+static pressio_register metrics_trace_plugin(metrics_plugins(), "trace", [](){ return compat::make_unique<trace_plugin>(); });
+
+}
+}
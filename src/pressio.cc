@@ -9,6 +9,7 @@
 #include "libpressio_ext/cpp/metrics.h"
 #include "libpressio_ext/cpp/pressio.h"
 #include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/task_runtime.h"
 
 
 
@@ -96,6 +97,14 @@ unsigned int pressio_patch_version() {
   return pressio::patch_version();
 }
 
+void pressio_set_thread_budget(unsigned int nthreads) {
+  pressio::set_thread_budget(nthreads);
+}
+
+unsigned int pressio_thread_budget() {
+  return pressio::thread_budget();
+}
+
 }
 
 
@@ -143,3 +152,10 @@ unsigned int pressio::patch_version() {
   return LIBPRESSIO_PATCH_VERSION;
 }
 
+void pressio::set_thread_budget(unsigned int nthreads) {
+  pressio_task_runtime::instance().set_budget(nthreads);
+}
+
+unsigned int pressio::thread_budget() {
+  return pressio_task_runtime::instance().budget();
+}
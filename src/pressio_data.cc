@@ -225,61 +225,128 @@ pressio_data pressio_data::select(std::vector<size_t> const& start,
 }
 
 namespace {
-  struct transpose_impl {
-    template <class RandomIt1, class RandomIt2>
-    bool operator()(RandomIt1 r1_begin, RandomIt1, RandomIt2 r2_begin, RandomIt2) {
-      std::vector<size_t> iter(dimensions.size(), 0);
-      std::vector<size_t> strides(dimensions.size(), 0);
-      size_t max_idx = std::accumulate(std::begin(dimensions), std::end(dimensions), 1, compat::multiplies<>{});
-      compat::exclusive_scan(compat::rbegin(iter_max), compat::rend(iter_max), compat::rbegin(strides), 1, compat::multiplies<>{});
-      for (size_t src_idx = 0; src_idx < max_idx; ++src_idx) {
-        size_t dst_idx = compat::transform_reduce(std::begin(iter), std::end(iter), std::begin(strides), 0, compat::plus<>{}, compat::multiplies<>{});
-        //clang-tidy treats this line as bugprone conversion since
-        //it can cause unintended behavior in switch-case statements 
-        //matching against character codes.  Since we aren't doing
-        //that here, ignore this warning.
-        r2_begin[src_idx] = r1_begin[dst_idx]; //NOLINT
-
-        size_t idx = 0;
-        bool updating = true;
-        while(updating) {
-          ++iter[idx];
-          if(iter[idx] == iter_max[idx]) {
-            iter[idx] = 0;
-            if(++idx ==  iter_max.size()) {
-              updating = false;
-            } else {
-              updating = true;
+  /**
+   * edge of the square tiles used when the fastest dimension changes; a tile of 8 byte elements from both
+   * the source and the destination fits in the L1 cache
+   */
+  constexpr size_t transpose_tile = 32;
+
+  /**
+   * copies the elements of src with dimensions dims to dst permuting the axes by axis, one tile at a time
+   *
+   * When the fastest dimension is unchanged each contiguous row is copied with memcpy, otherwise the fastest
+   * dimensions of the source and destination are tiled so that both the reads and the writes stay in cache.
+   */
+  template <class T>
+  void transpose_blocked(T const* src, T* dst, std::vector<size_t> const& dims, std::vector<size_t> const& axis) {
+    const size_t n = dims.size();
+    std::vector<size_t> in_stride(n, 1), out_stride_of(n, 1);
+    for (size_t d = 1; d < n; ++d) {
+      in_stride[d] = in_stride[d-1] * dims[d-1];
+    }
+    size_t stride = 1;
+    for (size_t k = 0; k < n; ++k) {
+      out_stride_of[axis[k]] = stride;
+      stride *= dims[axis[k]];
+    }
+
+    //the source dimension that is fastest in the destination
+    const size_t p = axis[0];
+    std::vector<size_t> outer;
+    for (size_t d = 1; d < n; ++d) {
+      if(d != p) outer.push_back(d);
+    }
+    size_t outer_count = 1;
+    for (auto d : outer) outer_count *= dims[d];
+
+    std::vector<size_t> pos(outer.size(), 0);
+    for (size_t o = 0; o < outer_count; ++o) {
+      size_t in_base = 0, out_base = 0;
+      for (size_t i = 0; i < outer.size(); ++i) {
+        in_base += pos[i] * in_stride[outer[i]];
+        out_base += pos[i] * out_stride_of[outer[i]];
+      }
+
+      if(p == 0) {
+        memcpy(dst + out_base, src + in_base, dims[0] * sizeof(T));
+      } else {
+        const size_t out_s0 = out_stride_of[0], in_sp = in_stride[p];
+        for (size_t jp = 0; jp < dims[p]; jp += transpose_tile) {
+          const size_t jp_end = std::min(jp + transpose_tile, dims[p]);
+          for (size_t j0 = 0; j0 < dims[0]; j0 += transpose_tile) {
+            const size_t j0_end = std::min(j0 + transpose_tile, dims[0]);
+            for (size_t ip = jp; ip < jp_end; ++ip) {
+              T const* s = src + in_base + ip * in_sp;
+              T* t = dst + out_base + ip;
+              for (size_t i0 = j0; i0 < j0_end; ++i0) {
+                t[i0 * out_s0] = s[i0];
+              }
             }
-          } else {
-            updating = false;
           }
         }
       }
-      
-      return 0;
+
+      for (size_t i = 0; i < pos.size(); ++i) {
+        if(++pos[i] < dims[outer[i]]) break;
+        pos[i] = 0;
+      }
     }
+  }
 
-    std::vector<size_t> const iter_max;
-    std::vector<size_t> const dimensions;
-  };
+  std::vector<size_t> normalize_axis(std::vector<size_t> const& axis, size_t n) {
+    if(!axis.empty()) return axis;
+    std::vector<size_t> reversed(n);
+    for (size_t i = 0; i < n; ++i) {
+      reversed[i] = n - 1 - i;
+    }
+    return reversed;
+  }
+}
+
+std::vector<size_t> pressio_data::transposed_dims(std::vector<size_t> const& axis) const {
+  auto const full_axis = normalize_axis(axis, dims.size());
+  std::vector<size_t> pos(dims.size());
+  for (size_t i = 0; i < dims.size(); ++i) {
+    pos[i] = dims[full_axis[i]];
+  }
+  return pos;
+}
+
+bool pressio_data::transpose_is_reshape(std::vector<size_t> const& axis) const {
+  auto const full_axis = normalize_axis(axis, dims.size());
+  size_t last = 0;
+  bool first = true;
+  for (auto d : full_axis) {
+    if(dims[d] == 1) continue;
+    if(!first && d < last) return false;
+    last = d;
+    first = false;
+  }
+  return true;
 }
 
 pressio_data pressio_data::transpose(std::vector<size_t> const& axis) const {
-  auto ret = pressio_data::clone(*this);
-  auto const iter_max = [&, this](){
-    std::vector<size_t> pos(dims.size());
-    if(axis.empty()) {
-      std::copy(compat::rbegin(dims), compat::rend(dims), std::begin(pos));
-    } else {
-      for (size_t i = 0; i < dims.size(); ++i) {
-        pos[i] = dims[axis[i]];
-      }
-    }
-    return pos;
-  }();
-  ret.reshape(iter_max);
-  pressio_data_for_each<int>(*this, ret, transpose_impl{iter_max, dimensions()});
+  auto ret = pressio_data::owning(dtype(), transposed_dims(axis));
+  if(transpose_is_reshape(axis)) {
+    memcpy(ret.data(), data(), size_in_bytes());
+    return ret;
+  }
+  auto const full_axis = normalize_axis(axis, dims.size());
+  switch(pressio_dtype_size(dtype())) {
+    case 1:
+      transpose_blocked(static_cast<uint8_t const*>(data()), static_cast<uint8_t*>(ret.data()), dims, full_axis);
+      break;
+    case 2:
+      transpose_blocked(static_cast<uint16_t const*>(data()), static_cast<uint16_t*>(ret.data()), dims, full_axis);
+      break;
+    case 4:
+      transpose_blocked(static_cast<uint32_t const*>(data()), static_cast<uint32_t*>(ret.data()), dims, full_axis);
+      break;
+    case 8:
+    default:
+      transpose_blocked(static_cast<uint64_t const*>(data()), static_cast<uint64_t*>(ret.data()), dims, full_axis);
+      break;
+  }
   return ret;
 }
 
@@ -1,88 +1,308 @@
 #include "libpressio_ext/hash/libpressio_hash.h"
+#include <libpressio_ext/cpp/data.h>
+#include <libpressio_ext/cpp/hash.h>
 #include <libpressio_ext/cpp/options.h>
 #include <libpressio_ext/cpp/pressio.h>
+#include <libpressio_ext/cpp/task_runtime.h>
+#include <algorithm>
 #include <cstddef>
-#include <openssl/evp.h>
+#include <cstring>
+#include <stdexcept>
 
-class hasher {
-    public:
-    uint8_t* bytes(size_t* size){
-        if(size==nullptr) {
-            return nullptr;
-        }
+namespace libpressio { namespace hash {
 
-        auto ossl_b = (uint8_t*)OPENSSL_malloc(EVP_MD_size(EVP_md5()));
-        if(ossl_b == nullptr) {
-            return nullptr;
-        }
+namespace {
+  constexpr uint64_t prime1 = 0x9E3779B185EBCA87ull;
+  constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+  constexpr uint64_t prime3 = 0x165667B19E3779F9ull;
+  constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ull;
+  constexpr uint64_t prime5 = 0x27D4EB2F165667C5ull;
+  /** separates the seeds of the two halves of a 128 bit digest */
+  constexpr uint64_t high_seed = 0x9E3779B97F4A7C15ull;
 
-        unsigned int digest_len;
-        EVP_DigestFinal_ex(mdctx, (unsigned char*)ossl_b, &digest_len);
-        *size = digest_len;
+  inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+  inline uint64_t read64(uint8_t const* p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+  inline uint32_t read32(uint8_t const* p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+  inline uint64_t round(uint64_t acc, uint64_t input) {
+    return rotl(acc + input * prime2, 31) * prime1;
+  }
+  inline uint64_t merge(uint64_t acc, uint64_t lane) {
+    return (acc ^ round(0, lane)) * prime1 + prime4;
+  }
 
-        EVP_MD_CTX_free(mdctx);
-        mdctx=nullptr;
-        uint8_t* b = (uint8_t*)malloc(*size);
-        memcpy((char*)b, (char*)ossl_b, *size);
-        OPENSSL_free(ossl_b);
-        return b;
+  /**
+   * runs the four independent XXH64 lanes over a leaf; the lanes have no dependencies on each other so the
+   * multiplies of consecutive stripes overlap in the pipeline.  A short final stripe is zero padded, which is
+   * unambiguous because the length of the stream is part of the root.
+   */
+  void hash_leaf(uint8_t const* p, size_t n, uint64_t seed, uint64_t* lanes) {
+    uint64_t v1 = seed + prime1 + prime2, v2 = seed + prime2, v3 = seed, v4 = seed - prime1;
+    size_t const stripes = n / 32;
+    for (size_t i = 0; i < stripes; ++i, p += 32) {
+      v1 = round(v1, read64(p));
+      v2 = round(v2, read64(p + 8));
+      v3 = round(v3, read64(p + 16));
+      v4 = round(v4, read64(p + 24));
+    }
+    if(n % 32) {
+      uint8_t last[32] = {0};
+      memcpy(last, p, n % 32);
+      v1 = round(v1, read64(last));
+      v2 = round(v2, read64(last + 8));
+      v3 = round(v3, read64(last + 16));
+      v4 = round(v4, read64(last + 24));
     }
+    lanes[0] = v1;
+    lanes[1] = v2;
+    lanes[2] = v3;
+    lanes[3] = v4;
+  }
+
+  digest128 digest_words(std::vector<uint64_t> const& words, uint64_t seed) {
+    auto const n = words.size() * sizeof(uint64_t);
+    return {xxh64(words.data(), n, seed), xxh64(words.data(), n, seed ^ high_seed)};
+  }
+
+  /**
+   * serializes the entries of options into a tree_hasher
+   */
+  class options_hasher {
+    public:
+    explicit options_hasher(uint64_t seed): seed(seed), hasher(seed) {}
+
     void operator()(std::string const& s) {
-        if(EVP_DigestUpdate(mdctx, s.data(), s.size()) != 1) {
-            throw std::runtime_error("failed to update hash");
-        }
+      (*this)(static_cast<uint64_t>(s.size()));
+      hasher.update(s.data(), s.size());
     }
-    void operator()(pressio_option_type& s) {
-        if(EVP_DigestUpdate(mdctx, &s, sizeof(s)) != 1) {
-            throw std::runtime_error("failed to update hash");
-        }
+    template <class T>
+    void operator()(T const& value) {
+      hasher.update(&value, sizeof(T));
     }
-    void operator()(bool b) {
-        if(EVP_DigestUpdate(mdctx, &b, sizeof(b)) != 1) {
-            throw std::runtime_error("failed to update hash");
-        }
+    void operator()(pressio_data const& data) {
+      (*this)(hash(data, seed));
     }
-    void operator()(const void* s, size_t size) {
-        if(EVP_DigestUpdate(mdctx, s, size) != 1) {
-            throw std::runtime_error("failed to update hash");
-        }
+    void entry(pressio_option const& option) {
+      (*this)(option.type());
+      (*this)(option.has_value());
+      if(!option.has_value()) return;
+      switch(option.type()) {
+        case pressio_option_userptr_type:
+        case pressio_option_unset_type:
+          return;
+        case pressio_option_data_type:
+          (*this)(option.get_value<pressio_data>());
+          return;
+        case pressio_option_uint8_type:
+          (*this)(option.get_value<uint8_t>());
+          return;
+        case pressio_option_uint16_type:
+          (*this)(option.get_value<uint16_t>());
+          return;
+        case pressio_option_uint32_type:
+          (*this)(option.get_value<uint32_t>());
+          return;
+        case pressio_option_uint64_type:
+          (*this)(option.get_value<uint64_t>());
+          return;
+        case pressio_option_int8_type:
+          (*this)(option.get_value<int8_t>());
+          return;
+        case pressio_option_int16_type:
+          (*this)(option.get_value<int16_t>());
+          return;
+        case pressio_option_int32_type:
+          (*this)(option.get_value<int32_t>());
+          return;
+        case pressio_option_int64_type:
+          (*this)(option.get_value<int64_t>());
+          return;
+        case pressio_option_float_type:
+          (*this)(option.get_value<float>());
+          return;
+        case pressio_option_double_type:
+          (*this)(option.get_value<double>());
+          return;
+        case pressio_option_charptr_type:
+          (*this)(option.get_value<std::string>());
+          return;
+        case pressio_option_charptr_array_type:
+          {
+            auto const& strings = option.get_value<std::vector<std::string>>();
+            (*this)(static_cast<uint64_t>(strings.size()));
+            for (auto const& s : strings) {
+              (*this)(s);
+            }
+            return;
+          }
+        case pressio_option_bool_type:
+          (*this)(option.get_value<bool>());
+          return;
+        case pressio_option_dtype_type:
+          (*this)(option.get_value<pressio_dtype>());
+          return;
+        case pressio_option_threadsafety_type:
+          (*this)(option.get_value<pressio_thread_safety>());
+          return;
+      }
     }
-    ~hasher() {
-        if(mdctx != nullptr) {
-            EVP_MD_CTX_free(mdctx);
-            mdctx=nullptr;
-        }
+    digest128 digest() const { return hasher.digest(); }
+
+    private:
+    uint64_t seed;
+    tree_hasher hasher;
+  };
+}
+
+uint64_t xxh64(void const* data, size_t n, uint64_t seed) {
+  auto p = static_cast<uint8_t const*>(data);
+  auto const end = p + n;
+  uint64_t h;
+  if(n >= 32) {
+    uint64_t v1 = seed + prime1 + prime2, v2 = seed + prime2, v3 = seed, v4 = seed - prime1;
+    for (auto const limit = end - 32; p <= limit; p += 32) {
+      v1 = round(v1, read64(p));
+      v2 = round(v2, read64(p + 8));
+      v3 = round(v3, read64(p + 16));
+      v4 = round(v4, read64(p + 24));
     }
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge(h, v1);
+    h = merge(h, v2);
+    h = merge(h, v3);
+    h = merge(h, v4);
+  } else {
+    h = seed + prime5;
+  }
+  h += n;
+  for (; p + 8 <= end; p += 8) {
+    h = rotl(h ^ round(0, read64(p)), 27) * prime1 + prime4;
+  }
+  if(p + 4 <= end) {
+    h = rotl(h ^ (read32(p) * prime1), 23) * prime2 + prime3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h = rotl(h ^ (*p * prime5), 11) * prime1;
+  }
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  h *= prime3;
+  h ^= h >> 32;
+  return h;
+}
 
-    hasher() : mdctx(EVP_MD_CTX_new()) {
-        if(mdctx == nullptr) {
-            throw std::runtime_error("failed to create OpenSSL EVP");
-        }
-        if(EVP_DigestInit_ex(mdctx, EVP_md5(), NULL) != 1) {
-            throw std::runtime_error("failed to inialize OpenSSL EVP");
-        }
+constexpr size_t tree_hasher::leaf_size;
+
+tree_hasher::tree_hasher(uint64_t seed): seed(seed) {}
+
+tree_hasher& tree_hasher::update(void const* data, size_t n, uint32_t nthreads) {
+  auto p = static_cast<uint8_t const*>(data);
+  bytes += n;
+  if(!partial.empty()) {
+    size_t const take = std::min(n, leaf_size - partial.size());
+    partial.insert(partial.end(), p, p + take);
+    p += take;
+    n -= take;
+    if(partial.size() == leaf_size) {
+      leaves.resize(leaves.size() + 4);
+      hash_leaf(partial.data(), leaf_size, seed, leaves.data() + leaves.size() - 4);
+      partial.clear();
     }
-    hasher(hasher const&)=delete;
-    hasher(hasher &&)=delete;
-    hasher& operator=(hasher const&)=delete;
-    hasher& operator=(hasher &&)=delete;
+  }
+  size_t const full = n / leaf_size;
+  if(full) {
+    size_t const first = leaves.size();
+    leaves.resize(first + 4 * full);
+    pressio_task_runtime::instance().parallel_for(full, nthreads, [&](size_t i, uint32_t) {
+      hash_leaf(p + i * leaf_size, leaf_size, seed, leaves.data() + first + 4 * i);
+    });
+    p += full * leaf_size;
+    n -= full * leaf_size;
+  }
+  partial.insert(partial.end(), p, p + n);
+  return *this;
+}
 
-    private:
-    EVP_MD_CTX* mdctx = nullptr;
-};
+tree_hasher& tree_hasher::append(tree_hasher const& other) {
+  if(!partial.empty()) {
+    throw std::logic_error("tree_hasher::append requires a stream that ends on a leaf boundary");
+  }
+  if(seed != other.seed) {
+    throw std::logic_error("tree_hasher::append requires hashers with the same seed");
+  }
+  leaves.insert(leaves.end(), other.leaves.begin(), other.leaves.end());
+  partial = other.partial;
+  bytes += other.bytes;
+  return *this;
+}
+
+std::vector<uint64_t> tree_hasher::root() const {
+  std::vector<uint64_t> words;
+  words.reserve(leaves.size() + 5);
+  words.insert(words.end(), leaves.begin(), leaves.end());
+  if(!partial.empty()) {
+    words.resize(words.size() + 4);
+    hash_leaf(partial.data(), partial.size(), seed, words.data() + words.size() - 4);
+  }
+  words.push_back(bytes);
+  return words;
+}
+
+uint64_t tree_hasher::digest64() const {
+  auto const words = root();
+  return xxh64(words.data(), words.size() * sizeof(uint64_t), seed);
+}
+
+digest128 tree_hasher::digest() const {
+  return digest_words(root(), seed);
+}
+
+digest128 hash(pressio_data const& data, uint64_t seed, uint32_t nthreads) {
+  tree_hasher contents(seed);
+  contents.update(data.data(), data.size_in_bytes(), nthreads);
+  auto const digest = contents.digest();
+  std::vector<uint64_t> words{static_cast<uint64_t>(data.dtype()), data.num_dimensions()};
+  for (auto dim : data.dimensions()) {
+    words.push_back(dim);
+  }
+  words.push_back(digest.low);
+  words.push_back(digest.high);
+  return digest_words(words, seed);
+}
+
+digest128 hash(pressio_options const& options, uint64_t seed) {
+  options_hasher h(seed);
+  for (auto const& i : options) {
+    h(i.first);
+    h.entry(i.second);
+  }
+  return h.digest();
+}
+
+digest128 hash_keys(pressio_options const& options, uint64_t seed) {
+  options_hasher h(seed);
+  for (auto const& i : options) {
+    h(i.first);
+  }
+  return h.digest();
+}
+
+} }
 
 template <class Func>
 static uint8_t* libpressio_options_hashimpl(struct pressio* library, struct pressio_options const* options, size_t* output_size, Func func) {
     try {
         if(options == nullptr) throw std::runtime_error("options is nullptr");
-        hasher h;
-
-        for (auto const& i : *options) {
-           func(h, i);
-        }
-
-        return h.bytes(output_size);
-    } catch(std::runtime_error const& ex) { 
+        if(output_size == nullptr) throw std::runtime_error("output_size is nullptr");
+        auto const digest = func(*options);
+        auto b = static_cast<uint8_t*>(malloc(sizeof(digest)));
+        if(b == nullptr) throw std::runtime_error("failed to allocate the hash");
+        memcpy(b, &digest.low, sizeof(digest.low));
+        memcpy(b + sizeof(digest.low), &digest.high, sizeof(digest.high));
+        *output_size = sizeof(digest);
+        return b;
+    } catch(std::runtime_error const& ex) {
         if(library) {
             library->set_error(1, ex.what());
         }
@@ -92,125 +312,24 @@ static uint8_t* libpressio_options_hashimpl(struct pressio* library, struct pres
 
 extern "C" {
     uint8_t* libpressio_options_hashkeys(struct pressio* library, struct pressio_options const* options, size_t* output_size) {
-        return libpressio_options_hashimpl(library, options, output_size, [](hasher& h, pressio_options::value_type const& i){
-                h(i.first);
+        return libpressio_options_hashimpl(library, options, output_size, [](pressio_options const& o){
+                return libpressio::hash::hash_keys(o);
         });
     }
 
     uint8_t* libpressio_options_hashentries(struct pressio* library, struct pressio_options const* options, size_t* output_size) {
-        return libpressio_options_hashimpl(library, options, output_size, [](hasher& h, pressio_options::value_type const& i){
-                h(i.first);
-                h(i.second.type());
-                h(i.second.has_value());
-                if(i.second.has_value()) {
-                    switch(i.second.type()) {
-                        case pressio_option_userptr_type:
-                        case pressio_option_unset_type:
-                            return;
-                        case pressio_option_data_type:
-                            {
-                                auto& data = i.second.get_value<pressio_data>();
-                                h(data.dtype());
-                                h(data.dimensions().data(), data.dimensions().size()*sizeof(size_t));
-                                h(data.data(), data.size_in_bytes());
-                                return;
-                            }
-                        case pressio_option_uint8_type:
-                            {
-                                auto& d = i.second.get_value<uint8_t>();
-                                h(&d, sizeof(uint8_t));
-                                return;
-                            }
-                        case pressio_option_uint16_type:
-                            {
-                                auto& d = i.second.get_value<uint16_t>();
-                                h(&d, sizeof(uint16_t));
-                                return;
-                            }
-                        case pressio_option_uint32_type:
-                            {
-                                auto& d = i.second.get_value<uint32_t>();
-                                h(&d, sizeof(uint32_t));
-                                return;
-                            }
-                        case pressio_option_uint64_type:
-                            {
-                                auto& d = i.second.get_value<uint64_t>();
-                                h(&d, sizeof(uint64_t));
-                                return;
-                            }
-                        case pressio_option_int8_type:
-                            {
-                                auto& d = i.second.get_value<int8_t>();
-                                h(&d, sizeof(int8_t));
-                                return;
-                            }
-                        case pressio_option_int16_type:
-                            {
-                                auto& d = i.second.get_value<int16_t>();
-                                h(&d, sizeof(int16_t));
-                                return;
-                            }
-                        case pressio_option_int32_type:
-                            {
-                                auto& d = i.second.get_value<int32_t>();
-                                h(&d, sizeof(int32_t));
-                                return;
-                            }
-                        case pressio_option_int64_type:
-                            {
-                                auto& d = i.second.get_value<int64_t>();
-                                h(&d, sizeof(int64_t));
-                                return;
-                            }
-                        case pressio_option_float_type:
-                            {
-                                auto& d = i.second.get_value<float>();
-                                h(&d, sizeof(float));
-                                return;
-                            }
-                        case pressio_option_double_type:
-                            {
-                                auto& d = i.second.get_value<double>();
-                                h(&d, sizeof(double));
-                                return;
-                            }
-                        case pressio_option_charptr_type:
-                            {
-                                auto& d = i.second.get_value<std::string>();
-                                h(d);
-                                return;
-                            }
-                        case pressio_option_charptr_array_type:
-                            {
-                                auto& d = i.second.get_value<std::vector<std::string>>();
-                                h(d.size());
-                                for (auto const& e : d) {
-                                    h(e);
-                                }
-                                return;
-                            }
-                        case pressio_option_bool_type:
-                            {
-                                auto& d = i.second.get_value<bool>();
-                                h(d);
-                                return;
-                            }
-                        case pressio_option_dtype_type:
-                            {
-                                auto& d = i.second.get_value<pressio_dtype>();
-                                h(d);
-                                return;
-                            }
-                        case pressio_option_threadsafety_type:
-                            {
-                                auto& d = i.second.get_value<pressio_thread_safety>();
-                                h(d);
-                                return;
-                            }
-
-                    }
-                }
+        return libpressio_options_hashimpl(library, options, output_size, [](pressio_options const& o){
+                return libpressio::hash::hash(o);
         });
     }
+
+    uint64_t libpressio_data_hash64(struct pressio_data const* data, uint64_t seed) {
+        return libpressio::hash::hash(*data, seed, pressio_task_runtime::instance().budget()).low;
+    }
+
+    void libpressio_data_hash128(struct pressio_data const* data, uint64_t seed, uint64_t digest[2]) {
+        auto const d = libpressio::hash::hash(*data, seed, pressio_task_runtime::instance().budget());
+        digest[0] = d.low;
+        digest[1] = d.high;
+    }
 }
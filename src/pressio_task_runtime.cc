@@ -0,0 +1,350 @@
+#include "libpressio_ext/cpp/task_runtime.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+  /**
+   * the shared state of one call to parallel_for
+   *
+   * helpers hold a shared_ptr so a helper that is dequeued after the call returns only observes that the
+   * iterations are exhausted; body is only dereferenced while an iteration is claimed, and the caller does not
+   * return until every claimed iteration has finished.
+   */
+  struct job {
+    job(size_t n, size_t grain, std::function<void(size_t, uint32_t)> const* body): n(n), grain(grain), body(body) {}
+    /**
+     * a single iteration job that owns its body, used for the tasks of a pressio_task_group
+     */
+    explicit job(std::function<void(size_t, uint32_t)>&& owned): n(1), grain(1), owned_body(std::move(owned)), body(&owned_body) {}
+
+    void participate(uint32_t slot) {
+      active++;
+      while(true) {
+        const size_t begin = next.fetch_add(grain);
+        if(begin >= n) break;
+        const size_t end = std::min(n, begin + grain);
+        try {
+          for (size_t i = begin; i < end; ++i) {
+            (*body)(i, slot);
+          }
+        } catch(...) {
+          std::lock_guard<std::mutex> guard(lock);
+          if(!error) error = std::current_exception();
+          next.store(n);
+        }
+      }
+      if(--active == 0) {
+        std::lock_guard<std::mutex> guard(lock);
+        finished.notify_all();
+      }
+    }
+
+    bool done() const {
+      return next.load() >= n && active.load() == 0;
+    }
+
+    /**
+     * \returns true if this job is scope or was queued, directly or transitively, by a task of scope
+     */
+    bool spawned_by(const void* scope) const {
+      for (job const* j = this; j != nullptr; j = j->parent.get()) {
+        if(j->scope == scope) return true;
+      }
+      return false;
+    }
+
+    const size_t n;
+    const size_t grain;
+    //the job whose body queued this one, and what a waiter waits on when waiting for this job
+    std::shared_ptr<job> parent;
+    const void* scope = this;
+    std::function<void(size_t, uint32_t)> owned_body;
+    std::function<void(size_t, uint32_t)> const* body;
+    std::atomic<size_t> next{0};
+    std::atomic<uint32_t> active{0};
+    std::atomic<uint32_t> next_slot{1};
+    std::mutex lock;
+    std::condition_variable finished;
+    std::exception_ptr error;
+  };
+
+  using task = std::shared_ptr<job>;
+
+  struct task_queue {
+    std::mutex lock;
+    std::deque<task> tasks;
+  };
+
+  /**
+   * the index of the worker running on this thread, or -1 for threads not owned by the runtime
+   */
+  thread_local int current_worker = -1;
+
+  /**
+   * the job whose body is running on this thread, if any
+   */
+  thread_local task current_job;
+
+  uint32_t default_budget() {
+    if(const char* env = std::getenv("LIBPRESSIO_NTHREADS")) {
+      try {
+        return static_cast<uint32_t>(std::max(1l, std::stol(env)));
+      } catch(...) {}
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+}
+
+struct pressio_task_runtime::impl {
+  impl(): budget(default_budget()) {}
+  ~impl() {
+    stop();
+  }
+
+  void start() {
+    std::lock_guard<std::mutex> guard(lifecycle);
+    if(started) return;
+    const uint32_t nworkers = budget.load() - 1;
+    queues.clear();
+    for (uint32_t i = 0; i < nworkers + 1; ++i) {
+      queues.emplace_back(new task_queue);
+    }
+    stopping = false;
+    for (uint32_t i = 0; i < nworkers; ++i) {
+      workers.emplace_back([this, i]{ work(static_cast<int>(i)); });
+    }
+    started = true;
+  }
+
+  void stop() {
+    std::lock_guard<std::mutex> guard(lifecycle);
+    if(!started) return;
+    {
+      std::lock_guard<std::mutex> sleep_guard(sleep_lock);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    workers.clear();
+    queues.clear();
+    started = false;
+  }
+
+  /**
+   * workers push to the back of their own queue; other threads share the final queue
+   */
+  void push(task t, size_t copies) {
+    t->parent = current_job;
+    task_queue& queue = *queues[current_worker >= 0 ? current_worker : queues.size() - 1];
+    {
+      std::lock_guard<std::mutex> guard(queue.lock);
+      for (size_t i = 0; i < copies; ++i) {
+        queue.tasks.push_back(t);
+      }
+    }
+    {
+      std::lock_guard<std::mutex> guard(sleep_lock);
+      pending += copies;
+    }
+    if(copies == 1) wake.notify_one();
+    else wake.notify_all();
+  }
+
+  /**
+   * take the newest task from our own queue, otherwise steal the oldest task from another queue
+   *
+   * if scope is not null, only tasks spawned by scope are taken
+   */
+  bool try_pop(task& t, std::minstd_rand& gen, const void* scope = nullptr) {
+    auto eligible = [scope](task const& candidate) { return scope == nullptr || candidate->spawned_by(scope); };
+    const size_t nqueues = queues.size();
+    if(current_worker >= 0) {
+      task_queue& own = *queues[current_worker];
+      std::lock_guard<std::mutex> guard(own.lock);
+      auto found = std::find_if(own.tasks.rbegin(), own.tasks.rend(), eligible);
+      if(found != own.tasks.rend()) {
+        t = std::move(*found);
+        own.tasks.erase(std::next(found).base());
+        return taken();
+      }
+    }
+    const size_t first = gen() % nqueues;
+    for (size_t i = 0; i < nqueues; ++i) {
+      const size_t victim = (first + i) % nqueues;
+      if(static_cast<int>(victim) == current_worker) continue;
+      task_queue& queue = *queues[victim];
+      std::lock_guard<std::mutex> guard(queue.lock);
+      auto found = std::find_if(queue.tasks.begin(), queue.tasks.end(), eligible);
+      if(found != queue.tasks.end()) {
+        t = std::move(*found);
+        queue.tasks.erase(found);
+        return taken();
+      }
+    }
+    return false;
+  }
+
+  bool taken() {
+    std::lock_guard<std::mutex> guard(sleep_lock);
+    pending--;
+    return true;
+  }
+
+  static void run(task const& t) {
+    participate(t, t->next_slot.fetch_add(1));
+  }
+
+  static void participate(task const& t, uint32_t slot) {
+    task outer = std::move(current_job);
+    current_job = t;
+    t->participate(slot);
+    current_job = std::move(outer);
+  }
+
+  void work(int id) {
+    current_worker = id;
+    std::minstd_rand gen(static_cast<uint32_t>(id) + 1);
+    task t;
+    while(true) {
+      if(try_pop(t, gen)) {
+        run(t);
+        t.reset();
+        continue;
+      }
+      std::unique_lock<std::mutex> guard(sleep_lock);
+      wake.wait(guard, [this]{ return stopping || pending > 0; });
+      if(stopping) break;
+    }
+    current_worker = -1;
+  }
+
+  void parallel_for(size_t n, uint32_t max_parallelism, std::function<void(size_t, uint32_t)> const& body) {
+    start();
+    const size_t participants = std::min<size_t>({max_parallelism, budget.load(), n});
+    const size_t grain = std::max<size_t>(1, n / (participants * 16));
+    auto shared = std::make_shared<job>(n, grain, &body);
+    push(shared, participants - 1);
+    participate(shared, 0);
+
+    //help with work queued by the remaining iterations while they finish elsewhere
+    help_until(shared.get(), shared->lock, shared->finished, [&]{ return shared->done(); });
+    if(shared->error) {
+      std::rethrow_exception(shared->error);
+    }
+  }
+
+  /**
+   * run work spawned by scope until done() returns true, sleeping on finished between attempts when there is none
+   *
+   * Unrelated work is left to other threads: a waiter that ran it could block in that work's own wait while
+   * holding up whatever it is waiting for, and a chain of such waiters across threads never finishes.  Work
+   * spawned by scope never waits on anything below the waiter, so the wait always completes.
+   */
+  template <class Done>
+  void help_until(const void* scope, std::mutex& lock, std::condition_variable& finished, Done&& done) {
+    std::minstd_rand gen(static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id())));
+    task t;
+    while(!done()) {
+      if(try_pop(t, gen, scope)) {
+        run(t);
+        t.reset();
+        continue;
+      }
+      std::unique_lock<std::mutex> guard(lock);
+      finished.wait_for(guard, std::chrono::microseconds(100), done);
+    }
+  }
+
+  std::atomic<uint32_t> budget;
+
+  std::mutex lifecycle;
+  bool started = false;
+  std::vector<std::unique_ptr<task_queue>> queues;
+  std::vector<std::thread> workers;
+
+  std::mutex sleep_lock;
+  std::condition_variable wake;
+  size_t pending = 0;
+  bool stopping = false;
+};
+
+pressio_task_runtime::pressio_task_runtime(): pimpl(new impl) {}
+pressio_task_runtime::~pressio_task_runtime()=default;
+
+pressio_task_runtime& pressio_task_runtime::instance() {
+  static pressio_task_runtime runtime;
+  return runtime;
+}
+
+void pressio_task_runtime::set_budget(uint32_t budget) {
+  pimpl->stop();
+  pimpl->budget = std::max(1u, budget);
+}
+
+uint32_t pressio_task_runtime::budget() const {
+  return pimpl->budget;
+}
+
+void pressio_task_runtime::parallel_for_impl(size_t n, uint32_t max_parallelism, std::function<void(size_t, uint32_t)> const& body) {
+  pimpl->parallel_for(n, max_parallelism, body);
+}
+
+struct pressio_task_group::impl {
+  std::atomic<size_t> pending{0};
+  std::mutex lock;
+  std::condition_variable finished;
+  std::exception_ptr error;
+};
+
+pressio_task_group::pressio_task_group(): pimpl(std::make_shared<impl>()) {}
+
+pressio_task_group::~pressio_task_group() {
+  try {
+    wait();
+  } catch(...) {}
+}
+
+void pressio_task_group::run(std::function<void()> task) {
+  auto& runtime = *pressio_task_runtime::instance().pimpl;
+  runtime.start();
+  pimpl->pending++;
+  auto state = pimpl;
+  auto queued = std::make_shared<job>([state, task](size_t, uint32_t) {
+    try {
+      task();
+    } catch(...) {
+      std::lock_guard<std::mutex> guard(state->lock);
+      if(!state->error) state->error = std::current_exception();
+    }
+    if(--state->pending == 0) {
+      std::lock_guard<std::mutex> guard(state->lock);
+      state->finished.notify_all();
+    }
+  });
+  queued->scope = state.get();
+  runtime.push(queued, 1);
+}
+
+void pressio_task_group::wait() {
+  auto& runtime = *pressio_task_runtime::instance().pimpl;
+  runtime.help_until(pimpl.get(), pimpl->lock, pimpl->finished, [this]{ return pimpl->pending.load() == 0; });
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> guard(pimpl->lock);
+    std::swap(error, pimpl->error);
+  }
+  if(error) std::rethrow_exception(error);
+}
@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+
+namespace {
+  std::string compress_tier(std::shared_ptr<libpressio_compressor_plugin> const& compressor, pressio_data const& input, pressio_data& compressed) {
+    compressed = pressio_data::empty(pressio_byte_dtype, {});
+    EXPECT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+    std::string tier;
+    EXPECT_EQ(compressor->get_metrics_results().get("cache:tier", &tier), pressio_options_key_set);
+    return tier;
+  }
+
+  /**
+   * a temporary directory for the disk tier, removed with its files when the test ends
+   */
+  struct temp_directory {
+    temp_directory(): path(testing::TempDir() + "libpressio-cache-XXXXXX") {
+      if(mkdtemp(&path[0]) == nullptr) path.clear();
+    }
+    ~temp_directory() {
+      if(path.empty()) return;
+      for (auto const& file : files()) unlink(file.c_str());
+      rmdir(path.c_str());
+    }
+    std::vector<std::string> files() const {
+      std::vector<std::string> found;
+      if(DIR* dir = opendir(path.c_str())) {
+        while(auto entry = readdir(dir)) {
+          std::string name = entry->d_name;
+          if(name != "." && name != "..") found.push_back(path + '/' + name);
+        }
+        closedir(dir);
+      }
+      return found;
+    }
+    std::string path;
+  };
+}
+
+TEST(Cache, ReusesResultsFromMemoryAndDisk) {
+  pressio library;
+  auto input = pressio_data::owning(pressio_int32_dtype, {64, 33});
+  auto ptr = static_cast<int32_t*>(input.data());
+  for (size_t i = 0; i < input.num_elements(); ++i) {
+    ptr[i] = static_cast<int32_t>(i * i % 97);
+  }
+
+  temp_directory directory;
+  ASSERT_FALSE(directory.path.empty());
+
+  auto compressor = library.get_compressor("cache");
+  ASSERT_TRUE(compressor);
+  ASSERT_EQ(compressor->set_options({
+    {"cache:compressor", std::string("delta_encoding")},
+    {"cache:directory", directory.path},
+    {"cache:clear", true},
+  }), 0);
+  pressio_data expected, compressed;
+  EXPECT_EQ(compress_tier(compressor, input, expected), "miss");
+  EXPECT_EQ(compress_tier(compressor, input, compressed), "memory");
+  ASSERT_EQ(compressed.size_in_bytes(), expected.size_in_bytes());
+  EXPECT_EQ(memcmp(compressed.data(), expected.data(), expected.size_in_bytes()), 0);
+
+  //different contents are a different key
+  ptr[100]++;
+  EXPECT_EQ(compress_tier(compressor, input, compressed), "miss");
+  ptr[100]--;
+
+  //the directory outlives the memory tier
+  compressor->set_options({{"cache:clear", true}});
+  EXPECT_EQ(compress_tier(compressor, input, compressed), "disk");
+  ASSERT_EQ(compressed.size_in_bytes(), expected.size_in_bytes());
+  EXPECT_EQ(memcmp(compressed.data(), expected.data(), expected.size_in_bytes()), 0);
+
+  auto output = pressio_data::owning(pressio_int32_dtype, {64, 33});
+  ASSERT_EQ(compressor->decompress(&compressed, &output), 0) << compressor->error_msg();
+  EXPECT_EQ(memcmp(output.data(), input.data(), input.size_in_bytes()), 0);
+  output = pressio_data::owning(pressio_int32_dtype, {64, 33});
+  void* const preallocated = output.data();
+  ASSERT_EQ(compressor->decompress(&compressed, &output), 0) << compressor->error_msg();
+  std::string tier;
+  compressor->get_metrics_results().get("cache:tier", &tier);
+  EXPECT_EQ(tier, "memory");
+  EXPECT_EQ(output.data(), preallocated) << "hits are copied into a preallocated output";
+  EXPECT_EQ(memcmp(output.data(), input.data(), input.size_in_bytes()), 0);
+
+  //a caller provided buffer that is larger than the result is kept and resized
+  std::vector<uint8_t> storage(expected.size_in_bytes() * 2);
+  auto provided = pressio_data::nonowning(pressio_byte_dtype, storage.data(), {storage.size()});
+  ASSERT_EQ(compressor->compress(&input, &provided), 0) << compressor->error_msg();
+  compressor->get_metrics_results().get("cache:tier", &tier);
+  EXPECT_EQ(tier, "memory");
+  EXPECT_EQ(provided.data(), static_cast<void*>(storage.data()));
+  ASSERT_EQ(provided.size_in_bytes(), expected.size_in_bytes());
+  EXPECT_EQ(memcmp(provided.data(), expected.data(), expected.size_in_bytes()), 0);
+}
+
+TEST(Cache, KeysOnTheChildVersion) {
+  pressio library;
+  auto input = pressio_data::owning(pressio_int32_dtype, {16, 8});
+  auto ptr = static_cast<int32_t*>(input.data());
+  for (size_t i = 0; i < input.num_elements(); ++i) {
+    ptr[i] = static_cast<int32_t>(i);
+  }
+
+  temp_directory directory;
+  ASSERT_FALSE(directory.path.empty());
+  auto compressor = library.get_compressor("cache");
+  ASSERT_EQ(compressor->set_options({
+    {"cache:compressor", std::string("delta_encoding")},
+    {"cache:directory", directory.path},
+    {"cache:clear", true},
+  }), 0);
+  pressio_data compressed;
+  EXPECT_EQ(compress_tier(compressor, input, compressed), "miss");
+
+  //each stored result records its full key, which names the versions of libpressio and of the child
+  std::vector<std::string> files;
+  for (auto const& file : directory.files()) {
+    if(file.find(".bin") != std::string::npos) files.push_back(file);
+  }
+  ASSERT_EQ(files.size(), 1u);
+  std::ifstream in(files.front(), std::ios::binary);
+  std::stringstream contents;
+  contents << in.rdbuf();
+  std::string child_version;
+  ASSERT_EQ(library.get_compressor("delta_encoding")->get_configuration().get("pressio:version", &child_version), pressio_options_key_set);
+  EXPECT_NE(contents.str().find(pressio::version()), std::string::npos);
+  auto version_entry = contents.str().find("pressio:version=");
+  ASSERT_NE(version_entry, std::string::npos);
+  EXPECT_NE(contents.str().find('"' + child_version + '"', version_entry), std::string::npos);
+}
@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+
+namespace {
+  pressio_data make_input(std::vector<size_t> const& dims) {
+    auto input = pressio_data::owning(pressio_float_dtype, dims);
+    auto ptr = static_cast<float*>(input.data());
+    for (size_t i = 0; i < input.num_elements(); ++i) {
+      ptr[i] = static_cast<float>(i);
+    }
+    return input;
+  }
+
+  void expect_region(pressio_data const& input, pressio_data const& region, std::vector<size_t> const& start) {
+    auto const& dims = input.dimensions();
+    auto const& size = region.dimensions();
+    auto in = static_cast<float const*>(input.data());
+    auto out = static_cast<float const*>(region.data());
+    for (size_t i = 0; i < region.num_elements(); ++i) {
+      size_t rest = i, global = 0, stride = 1;
+      for (size_t d = 0; d < size.size(); ++d) {
+        global += (rest % size[d] + start[d]) * stride;
+        rest /= size[d];
+        stride *= dims[d];
+      }
+      ASSERT_EQ(out[i], in[global]) << "at " << i;
+    }
+  }
+
+  class ChunkingRegion: public testing::TestWithParam<bool> {};
+}
+
+TEST_P(ChunkingRegion, DecompressesOnlyTheRegion) {
+  pressio library;
+  auto compressor = library.get_compressor("chunking");
+  ASSERT_TRUE(compressor);
+  const std::vector<size_t> dims{37, 29, 11}, start{5, 3, 2}, size{20, 17, 6};
+  ASSERT_EQ(compressor->set_options({
+    {"chunking:compressor", std::string("noop")},
+    {"chunking:size", pressio_data{8, 8, 4}},
+    {"chunking:stream", GetParam()},
+  }), 0);
+  auto input = make_input(dims);
+  auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+  ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+
+  ASSERT_EQ(compressor->set_options({
+    {"chunking:region_start", pressio_data(start.begin(), start.end())},
+    {"chunking:region_size", pressio_data(size.begin(), size.end())},
+  }), 0);
+  auto region = pressio_data::empty(pressio_float_dtype, {});
+  ASSERT_EQ(compressor->decompress(&compressed, &region), 0) << compressor->error_msg();
+  ASSERT_EQ(region.dimensions(), size);
+  expect_region(input, region, start);
+
+  const std::vector<size_t> out_of_bounds{30, 0, 0};
+  compressor->set_options({{"chunking:region_start", pressio_data(out_of_bounds.begin(), out_of_bounds.end())}});
+  EXPECT_NE(compressor->decompress(&compressed, &region), 0);
+}
+
+INSTANTIATE_TEST_SUITE_P(Chunking, ChunkingRegion, testing::Bool());
+
+TEST(ChunkingEdges, RoundTripsRaggedHigherDimensionalChunks) {
+  pressio library;
+  const std::vector<size_t> dims{12, 10, 6, 5};
+  auto input = make_input(dims);
+  std::vector<size_t> compressed_sizes;
+  for (std::string mode : {"pad", "exact"}) {
+    auto compressor = library.get_compressor("chunking");
+    ASSERT_TRUE(compressor);
+    ASSERT_EQ(compressor->set_options({
+      {"chunking:compressor", std::string("noop")},
+      {"chunking:size", pressio_data{4, 4, 3, 2}},
+      {"chunking:edge_mode", mode},
+    }), 0);
+    auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+    ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+    compressed_sizes.push_back(compressed.size_in_bytes());
+
+    auto output = pressio_data::owning(pressio_float_dtype, dims);
+    ASSERT_EQ(compressor->decompress(&compressed, &output), 0) << compressor->error_msg();
+    expect_region(input, output, {0, 0, 0, 0});
+  }
+  EXPECT_LT(compressed_sizes[1], compressed_sizes[0]);
+}
+
+TEST(ChunkingEdges, DecompressesWithTheRecordedEdgeMode) {
+  pressio library;
+  const std::vector<size_t> dims{12, 10, 6};
+  auto input = make_input(dims);
+  for (std::string mode : {"pad", "exact"}) {
+    auto compressor = library.get_compressor("chunking");
+    ASSERT_TRUE(compressor);
+    ASSERT_EQ(compressor->set_options({
+      {"chunking:compressor", std::string("noop")},
+      {"chunking:size", pressio_data{5, 4, 6}},
+      {"chunking:edge_mode", mode},
+    }), 0);
+    auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+    ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+
+    ASSERT_EQ(compressor->set_options({{"chunking:edge_mode", std::string(mode == "pad" ? "exact" : "pad")}}), 0);
+    auto output = pressio_data::owning(pressio_float_dtype, dims);
+    ASSERT_EQ(compressor->decompress(&compressed, &output), 0) << compressor->error_msg();
+    expect_region(input, output, {0, 0, 0});
+  }
+}
+
+TEST(ChunkingTune, ChoosesAndCachesAChunkSize) {
+  pressio library;
+  const std::vector<size_t> dims{64, 64, 8};
+  auto input = make_input(dims);
+  for (bool expect_cached : {false, true}) {
+    auto compressor = library.get_compressor("chunking");
+    ASSERT_TRUE(compressor);
+    ASSERT_EQ(compressor->set_options({
+      {"chunking:compressor", std::string("noop")},
+      {"chunking:tune", true},
+      {"chunking:tune_clear_cache", !expect_cached},
+    }), 0);
+    auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+    ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+
+    pressio_data size;
+    ASSERT_EQ(compressor->get_options().get("chunking:size", &size), pressio_options_key_set);
+    EXPECT_EQ(size.num_elements(), dims.size());
+    bool cache_hit = !expect_cached;
+    ASSERT_EQ(compressor->get_metrics_results().get("chunking:tune_cache_hit", &cache_hit), pressio_options_key_set);
+    EXPECT_EQ(cache_hit, expect_cached);
+
+    auto output = pressio_data::owning(pressio_float_dtype, dims);
+    ASSERT_EQ(compressor->decompress(&compressed, &output), 0) << compressor->error_msg();
+    expect_region(input, output, {0, 0, 0});
+  }
+}
+
+TEST(ChunkingTune, FreshInstancesDecompressTunedContainers) {
+  pressio library;
+  const std::vector<size_t> dims{48, 40, 6};
+  auto input = make_input(dims);
+  for (bool stream : {false, true}) {
+    auto compressor = library.get_compressor("chunking");
+    ASSERT_EQ(compressor->set_options({
+      {"chunking:compressor", std::string("noop")},
+      {"chunking:tune", true},
+      {"chunking:stream", stream},
+      {"chunking:edge_mode", std::string("exact")},
+    }), 0);
+    auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+    ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+    pressio_data tuned;
+    ASSERT_EQ(compressor->get_options().get("chunking:size", &tuned), pressio_options_key_set);
+
+    //a chunk size that differs from the tuned one is overridden by the one in the container without changing the option
+    for (auto const& size : std::vector<std::vector<size_t>>{{}, {1, 1, 1}}) {
+      auto decompressor = library.get_compressor("chunking");
+      pressio_options options{
+        {"chunking:compressor", std::string("noop")},
+        {"chunking:edge_mode", std::string("exact")},
+      };
+      if(!size.empty()) options.set("chunking:size", pressio_data(size.begin(), size.end()));
+      ASSERT_EQ(decompressor->set_options(options), 0);
+      auto output = pressio_data::owning(pressio_float_dtype, dims);
+      ASSERT_EQ(decompressor->decompress(&compressed, &output), 0) << decompressor->error_msg();
+      expect_region(input, output, {0, 0, 0});
+      pressio_data used;
+      ASSERT_EQ(decompressor->get_options().get("chunking:size", &used), pressio_options_key_set);
+      EXPECT_EQ(used, pressio_data(size.begin(), size.end()));
+    }
+  }
+}
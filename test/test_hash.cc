@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/hash.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/task_runtime.h"
+#include "libpressio_ext/hash/libpressio_hash.h"
+
+using namespace libpressio::hash;
+
+namespace {
+  std::vector<uint8_t> make_bytes(size_t n) {
+    std::vector<uint8_t> bytes(n);
+    uint64_t state = 0x243F6A8885A308D3ull;
+    for (auto& byte : bytes) {
+      state = state * 6364136223846793005ull + 1442695040888963407ull;
+      byte = static_cast<uint8_t>(state >> 56);
+    }
+    return bytes;
+  }
+}
+
+TEST(Hash, MatchesXXH64) {
+  EXPECT_EQ(xxh64("", 0), 0xef46db3751d8e999ull);
+  EXPECT_EQ(xxh64("abc", 3), 0x44bc2cf5ad770999ull);
+  std::string const s = "Nobody inspects the spammish repetition";
+  EXPECT_EQ(xxh64(s.data(), s.size()), 0xfbcea83c8a378bf1ull);
+}
+
+TEST(Hash, TreeDigestIsIndependentOfHowTheStreamIsSplit) {
+  auto const bytes = make_bytes(3 * tree_hasher::leaf_size + 12345);
+  tree_hasher whole;
+  whole.update(bytes.data(), bytes.size());
+
+  tree_hasher threaded;
+  threaded.update(bytes.data(), bytes.size(), pressio_task_runtime::instance().budget());
+  EXPECT_EQ(whole.digest(), threaded.digest());
+
+  tree_hasher pieces;
+  size_t offset = 0;
+  for (size_t step : {size_t{7}, tree_hasher::leaf_size, size_t{100000}, 2 * tree_hasher::leaf_size}) {
+    step = std::min(step, bytes.size() - offset);
+    pieces.update(bytes.data() + offset, step);
+    offset += step;
+  }
+  pieces.update(bytes.data() + offset, bytes.size() - offset);
+  EXPECT_EQ(whole.digest(), pieces.digest());
+  EXPECT_EQ(whole.digest64(), pieces.digest64());
+
+  tree_hasher first, second;
+  first.update(bytes.data(), 2 * tree_hasher::leaf_size);
+  second.update(bytes.data() + 2 * tree_hasher::leaf_size, bytes.size() - 2 * tree_hasher::leaf_size);
+  EXPECT_EQ(whole.digest(), first.append(second).digest());
+
+  tree_hasher unaligned;
+  unaligned.update(bytes.data(), 5);
+  EXPECT_THROW(unaligned.append(second), std::logic_error);
+
+  auto changed = bytes;
+  changed.back() ^= 1;
+  tree_hasher other;
+  other.update(changed.data(), changed.size());
+  EXPECT_NE(whole.digest(), other.digest());
+  EXPECT_NE(whole.digest(), tree_hasher(1).update(bytes.data(), bytes.size()).digest());
+}
+
+TEST(Hash, DataHashCoversTypeDimensionsAndContents) {
+  auto data = pressio_data::owning(pressio_float_dtype, {16, 8});
+  auto bytes = make_bytes(data.size_in_bytes());
+  memcpy(data.data(), bytes.data(), bytes.size());
+  auto const digest = hash(data);
+
+  auto reshaped = pressio_data::clone(data);
+  reshaped.reshape({8, 16});
+  EXPECT_NE(digest, hash(reshaped));
+  auto retyped = pressio_data::clone(data);
+  retyped.set_dtype(pressio_int32_dtype);
+  EXPECT_NE(digest, hash(retyped));
+  auto copy = pressio_data::clone(data);
+  EXPECT_EQ(digest, hash(copy));
+  static_cast<uint8_t*>(copy.data())[21] ^= 1;
+  EXPECT_NE(digest, hash(copy));
+
+  uint64_t c_digest[2];
+  libpressio_data_hash128(&data, 0, c_digest);
+  EXPECT_EQ(c_digest[0], digest.low);
+  EXPECT_EQ(c_digest[1], digest.high);
+  EXPECT_EQ(libpressio_data_hash64(&data, 0), digest.low);
+}
+
+TEST(Hash, OptionsHashCoversKeysAndValues) {
+  pressio_options options{
+    {"a:double", 1.5},
+    {"a:string", std::string("value")},
+    {"a:strings", std::vector<std::string>{"x", "y"}},
+  };
+  auto const digest = hash(options);
+  auto const keys = hash_keys(options);
+  EXPECT_EQ(digest, hash(pressio_options(options)));
+
+  auto changed = options;
+  changed.set("a:double", 2.5);
+  EXPECT_NE(digest, hash(changed));
+  EXPECT_EQ(keys, hash_keys(changed));
+
+  changed = options;
+  changed.set("a:strings", std::vector<std::string>{"xy"});
+  EXPECT_NE(digest, hash(changed));
+
+  size_t size = 0;
+  uint8_t* bytes = libpressio_options_hashentries(nullptr, &options, &size);
+  ASSERT_NE(bytes, nullptr);
+  ASSERT_EQ(size, sizeof(digest));
+  EXPECT_EQ(memcmp(bytes, &digest.low, sizeof(uint64_t)), 0);
+  free(bytes);
+}
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/metrics.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+
+namespace {
+  size_t count_lines(std::string const& file) {
+    std::ifstream in(file);
+    size_t lines = 0;
+    std::string line;
+    while(std::getline(in, line)) {
+      if(!line.empty()) ++lines;
+    }
+    return lines;
+  }
+
+  void record_compressions(libpressio_metrics_plugin& metric, size_t n) {
+    auto input = pressio_data::owning(pressio_float_dtype, {16});
+    auto output = pressio_data::owning(pressio_byte_dtype, {8});
+    for (size_t i = 0; i < n; ++i) {
+      metric.begin_compress(&input, nullptr);
+      ASSERT_EQ(metric.end_compress(&input, &output, 0), 0) << metric.error_msg();
+    }
+  }
+}
+
+class HistorianFile: public testing::TestWithParam<uint64_t> {};
+
+TEST_P(HistorianFile, WritesEveryRecord) {
+  const std::string file = "test_historian_" + std::to_string(GetParam()) + ".jsonl";
+  std::remove(file.c_str());
+  const size_t n = 100;
+  {
+    pressio library;
+    auto metric = library.get_metric("historian");
+    ASSERT_EQ(metric->set_options({
+      {"historian:metrics", std::string("size")},
+      {"historian:events", std::vector<std::string>{"compress"}},
+      {"historian:queue_size", uint64_t{8}},
+      {"historian:flush_ms", GetParam()},
+      {"historian:file", file},
+    }), 0) << metric->error_msg();
+    record_compressions(*metric, n);
+    uint64_t records = 0;
+    metric->get_metrics_results({}).get("historian:records", &records);
+    EXPECT_EQ(records, n);
+
+    if(GetParam() == 0) {
+      //with flush_ms=0 records are flushed as soon as they are written
+      auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+      while(count_lines(file) < n && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      EXPECT_EQ(count_lines(file), n);
+    }
+  }
+  EXPECT_EQ(count_lines(file), n);
+  std::remove(file.c_str());
+}
+INSTANTIATE_TEST_SUITE_P(FlushMs, HistorianFile, testing::Values(uint64_t{0}, uint64_t{1000}));
+
+TEST_P(HistorianFile, InterruptedRunsOnlyKeepWholeRecords) {
+  const std::string file = "test_historian_interrupted_" + std::to_string(GetParam()) + ".jsonl";
+  std::remove(file.c_str());
+  GTEST_FLAG_SET(death_test_style, "threadsafe");
+  EXPECT_EXIT({
+    pressio library;
+    auto metric = library.get_metric("historian");
+    metric->set_options({
+      {"historian:metrics", std::string("size")},
+      {"historian:events", std::vector<std::string>{"compress"}},
+      {"historian:queue_size", uint64_t{8}},
+      {"historian:flush_ms", GetParam()},
+      {"historian:file", file},
+    });
+    //enough records to overflow any stream buffer, then stop without destroying the writer
+    record_compressions(*metric, 2000);
+    _exit(0);
+  }, testing::ExitedWithCode(0), "");
+
+  std::ifstream in(file, std::ios::binary);
+  std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  EXPECT_TRUE(contents.empty() || contents.back() == '\n');
+  std::istringstream lines(contents);
+  for (std::string line; std::getline(lines, line);) {
+    ASSERT_FALSE(line.empty());
+    EXPECT_EQ(line.front(), '{') << line;
+    EXPECT_EQ(line.back(), '}') << line;
+  }
+  std::remove(file.c_str());
+}
+
+TEST(Historian, ReportsUnwritableFiles) {
+  pressio library;
+  auto metric = library.get_metric("historian");
+  EXPECT_NE(metric->set_options({
+    {"historian:events", std::vector<std::string>{"compress"}},
+    {"historian:file", std::string("/nonexistent_directory/test_historian.jsonl")},
+  }), 0);
+  EXPECT_NE(metric->error_code(), 0);
+}
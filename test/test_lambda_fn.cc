@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <cstring>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/lambda_fn.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+#include "pressio_version.h"
+
+using libpressio::lambda_fn::lambda_fn_context;
+using libpressio::lambda_fn::lambda_fn_event;
+
+TEST(LambdaFn, NativeHookReconfiguresTheChild) {
+  pressio library;
+  auto compressor = library.get_compressor("lambda_fn");
+  ASSERT_TRUE(compressor);
+
+  int set_options_calls = 0;
+  auto hook = libpressio::lambda_fn::make_native_hook([&set_options_calls](lambda_fn_context const& ctx, pressio_options& options) {
+    if(ctx.event == lambda_fn_event::set_options) {
+      ASSERT_NE(ctx.set_options, nullptr);
+      EXPECT_TRUE(ctx.inputs.empty());
+      ++set_options_calls;
+      return;
+    }
+    ASSERT_EQ(ctx.inputs.size(), 1u);
+    ASSERT_EQ(ctx.outputs.size(), 1u);
+    uint64_t calls = 0;
+    ctx.persist.get("calls", &calls);
+    ctx.persist.set("calls", calls + 1);
+
+    const pressio_dtype dtype = (ctx.event == lambda_fn_event::compress) ? ctx.inputs[0]->dtype() : ctx.outputs[0]->dtype();
+    options.set("switch:active_id", uint64_t{dtype == pressio_float_dtype ? 0u : 1u});
+  });
+
+  ASSERT_EQ(compressor->set_options({
+    {"lambda_fn:compressor", "switch"},
+    {"switch:compressors", std::vector<std::string>{"noop", "noop"}},
+    {"lambda_fn:on_set_options", int32_t{1}},
+    {"lambda_fn:native", hook},
+  }), 0) << compressor->error_msg();
+  EXPECT_EQ(set_options_calls, 1);
+
+  for (auto dtype : {pressio_float_dtype, pressio_int32_dtype}) {
+    auto input = pressio_data::owning(dtype, {16, 4});
+    memset(input.data(), 7, input.size_in_bytes());
+    auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+    auto output = pressio_data::owning(dtype, {16, 4});
+    ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+    uint64_t active_id = 2;
+    ASSERT_EQ(compressor->get_options().get("switch:active_id", &active_id), pressio_options_key_set);
+    EXPECT_EQ(active_id, dtype == pressio_float_dtype ? 0u : 1u);
+    ASSERT_EQ(compressor->decompress(&compressed, &output), 0) << compressor->error_msg();
+    EXPECT_EQ(memcmp(output.data(), input.data(), input.size_in_bytes()), 0);
+  }
+
+  //clones keep a copy of the hook
+  auto clone = compressor->clone();
+  auto input = pressio_data::owning(pressio_int32_dtype, {8});
+  auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+  ASSERT_EQ(clone->compress(&input, &compressed), 0) << clone->error_msg();
+  uint64_t active_id = 2;
+  ASSERT_EQ(clone->get_options().get("switch:active_id", &active_id), pressio_options_key_set);
+  EXPECT_EQ(active_id, 1u);
+}
+
+TEST(LambdaFn, NativeHookErrorsAreReported) {
+  pressio library;
+  auto compressor = library.get_compressor("lambda_fn");
+  ASSERT_EQ(compressor->set_options({
+    {"lambda_fn:native", libpressio::lambda_fn::make_native_hook([](lambda_fn_context const&, pressio_options&) {
+      throw std::runtime_error("rejected by hook");
+    })},
+  }), 0);
+  auto input = pressio_data::owning(pressio_float_dtype, {8});
+  auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+  EXPECT_NE(compressor->compress(&input, &compressed), 0);
+  EXPECT_EQ(std::string(compressor->error_msg()), "rejected by hook");
+}
+
+#if LIBPRESSIO_HAS_LUA
+namespace {
+  template <class Compressor>
+  uint64_t compress_and_get_active_id(Compressor& compressor) {
+    auto input = pressio_data::owning(pressio_float_dtype, {8});
+    auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+    EXPECT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+    uint64_t active_id = 2;
+    EXPECT_EQ(compressor->get_options().get("switch:active_id", &active_id), pressio_options_key_set);
+    return active_id;
+  }
+}
+
+TEST(LambdaFn, ScriptGlobalsPersistBetweenCalls) {
+  //calls is an ordinary global, so it only keeps counting if the lua state is kept between calls
+  const std::string script = R"(
+    calls = (calls or 0) + 1
+    local active_id = pressio_option.new()
+    active_id:set_uint64(calls % 2)
+    options:set("switch:active_id", active_id)
+  )";
+  pressio library;
+  auto compressor = library.get_compressor("lambda_fn");
+  ASSERT_EQ(compressor->set_options({
+    {"lambda_fn:compressor", "switch"},
+    {"switch:compressors", std::vector<std::string>{"noop", "noop"}},
+    {"lambda_fn:script", script},
+  }), 0) << compressor->error_msg();
+
+  EXPECT_EQ(compress_and_get_active_id(compressor), 1u);
+  EXPECT_EQ(compress_and_get_active_id(compressor), 0u);
+  EXPECT_EQ(compress_and_get_active_id(compressor), 1u);
+
+  //a second compressor with the same script loads the cached bytecode into a state of its own
+  auto other = library.get_compressor("lambda_fn");
+  ASSERT_EQ(other->set_options({
+    {"lambda_fn:compressor", "switch"},
+    {"switch:compressors", std::vector<std::string>{"noop", "noop"}},
+    {"lambda_fn:script", script},
+  }), 0) << other->error_msg();
+  EXPECT_EQ(compress_and_get_active_id(other), 1u);
+  EXPECT_EQ(compress_and_get_active_id(other), 0u);
+
+  //clones start with a fresh state, and the original keeps its own
+  auto clone = compressor->clone();
+  EXPECT_EQ(compress_and_get_active_id(clone), 1u);
+  EXPECT_EQ(compress_and_get_active_id(compressor), 0u);
+
+  //changing the script reloads it in the same state, so globals survive the change
+  ASSERT_EQ(compressor->set_options({
+    {"lambda_fn:script", script + "\n"},
+  }), 0) << compressor->error_msg();
+  EXPECT_EQ(compress_and_get_active_id(compressor), 1u);
+}
+
+TEST(LambdaFn, ScriptErrorsAreReported) {
+  pressio library;
+  auto compressor = library.get_compressor("lambda_fn");
+  ASSERT_EQ(compressor->set_options({
+    {"lambda_fn:script", "this is not lua"},
+  }), 0) << compressor->error_msg();
+  auto input = pressio_data::owning(pressio_float_dtype, {8});
+  auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+  EXPECT_NE(compressor->compress(&input, &compressed), 0);
+  //the failed compile is not cached, so the second call reports the same error
+  EXPECT_NE(compressor->compress(&input, &compressed), 0);
+}
+#endif
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+
+class ManifestTest: public testing::TestWithParam<bool> {
+  protected:
+  void SetUp() override {
+    input = pressio_data::owning(pressio_float_dtype, {30, 20});
+    auto ptr = static_cast<float*>(input.data());
+    for (size_t i = 0; i < input.num_elements(); ++i) {
+      ptr[i] = static_cast<float>(i) * .5f;
+    }
+  }
+
+  pressio_compressor manifest(bool binary) {
+    auto compressor = library.get_compressor("manifest");
+    EXPECT_EQ(compressor->set_options({
+      {"manifest:compressor", "noop"},
+      {"manifest:binary", binary},
+      {"manifest:record_lineage_on_decompress", true},
+    }), 0);
+    return compressor;
+  }
+
+  pressio library;
+  pressio_data input;
+};
+
+TEST_P(ManifestTest, RoundTripsAndReusesConfiguredCompressors) {
+  const bool binary = GetParam();
+  auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+  auto writer = manifest(binary);
+  ASSERT_EQ(writer->compress(&input, &compressed), 0) << writer->error_msg();
+
+  for (int i = 0; i < 2; ++i) {
+    auto reader = library.get_compressor("manifest");
+    auto output = pressio_data::empty(pressio_byte_dtype, {});
+    ASSERT_EQ(reader->decompress(&compressed, &output), 0) << reader->error_msg();
+    ASSERT_EQ(output.dtype(), pressio_float_dtype);
+    ASSERT_EQ(output.dimensions(), input.dimensions());
+    EXPECT_EQ(memcmp(output.data(), input.data(), input.size_in_bytes()), 0);
+
+    auto results = reader->get_metrics_results();
+    bool cache_hit = false;
+    uint64_t header_size = 0;
+    ASSERT_EQ(results.get("manifest:cache_hit", &cache_hit), pressio_options_key_set);
+    ASSERT_EQ(results.get("manifest:header_size", &header_size), pressio_options_key_set);
+    EXPECT_GT(header_size, 0u);
+    //the msgpack header is always reapplied, the binary header is cached after the first decompression
+    EXPECT_EQ(cache_hit, binary && i > 0);
+
+    std::string lineage;
+    ASSERT_EQ(reader->get_options().get("manifest:lineage", &lineage), pressio_options_key_set);
+    EXPECT_EQ(lineage.size() + sizeof(uint32_t) + sizeof(uint64_t), header_size);
+  }
+}
+
+TEST_P(ManifestTest, RejectsTruncatedHeaders) {
+  auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+  auto writer = manifest(GetParam());
+  ASSERT_EQ(writer->compress(&input, &compressed), 0) << writer->error_msg();
+
+  auto truncated = pressio_data::copy(pressio_byte_dtype, compressed.data(), {sizeof(uint32_t) + sizeof(uint64_t) + 4});
+  auto output = pressio_data::empty(pressio_byte_dtype, {});
+  auto reader = library.get_compressor("manifest");
+  EXPECT_NE(reader->decompress(&truncated, &output), 0);
+}
+
+TEST_F(ManifestTest, SurvivesCorruptBinaryConfigs) {
+  auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+  auto writer = manifest(true);
+  ASSERT_EQ(writer->compress(&input, &compressed), 0) << writer->error_msg();
+  uint64_t header_size = 0;
+  ASSERT_EQ(writer->get_metrics_results().get("manifest:header_size", &header_size), pressio_options_key_set);
+
+  //skip the dtype, dimensions, and config size; corrupt dimensions are trusted by the child compressor
+  auto bytes = static_cast<uint8_t const*>(compressed.data());
+  size_t config_begin = sizeof(uint32_t) + sizeof(uint64_t);
+  auto skip_varint = [&]{ while(bytes[config_begin++] & 0x80); };
+  skip_varint();
+  const size_t ndims = bytes[config_begin];
+  ASSERT_EQ(ndims, input.num_dimensions());
+  for (size_t i = 0; i < ndims + 2; ++i) skip_varint();
+
+  //every corrupted config must either decode or be rejected without reading past the header
+  for (size_t i = config_begin; i < header_size; ++i) {
+    for (uint8_t value : {uint8_t{0x00}, uint8_t{0x7f}, uint8_t{0xff}}) {
+      auto corrupt = pressio_data::clone(compressed);
+      static_cast<uint8_t*>(corrupt.data())[i] = value;
+      auto output = pressio_data::empty(pressio_byte_dtype, {});
+      auto reader = library.get_compressor("manifest");
+      //decode every header rather than sharing the process wide decoder cache with the other tests
+      ASSERT_EQ(reader->set_options({{"manifest:cache_size", uint64_t{0}}}), 0);
+      reader->decompress(&corrupt, &output);
+    }
+  }
+}
+
+TEST(Manifest, WritesMsgpackHeadersByDefault) {
+  pressio library;
+  auto compressor = library.get_compressor("manifest");
+  bool binary = true;
+  ASSERT_EQ(compressor->get_options().get("manifest:binary", &binary), pressio_options_key_set);
+  EXPECT_FALSE(binary);
+}
+
+INSTANTIATE_TEST_SUITE_P(Formats, ManifestTest, testing::Values(true, false));
@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include <mpi.h>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+#include "std_compat/memory.h"
+
+namespace {
+  int comm_rank() {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    return rank;
+  }
+  int comm_size() {
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    return size;
+  }
+
+  /**
+   * outputs doubling:value and reports doubling:next = 2*doubling:value + input[0] so that each
+   * buffer's options depend on every buffer before it in a way neither predictor can guess
+   */
+  class doubling_compressor : public libpressio_compressor_plugin {
+    public:
+    int compress_impl(pressio_data const* input, pressio_data* output) override {
+      *output = pressio_data::owning(pressio_double_dtype, {1});
+      *static_cast<double*>(output->data()) = value;
+      next = 2 * value + *static_cast<double const*>(input->data());
+      return 0;
+    }
+    int decompress_impl(pressio_data const*, pressio_data*) override {
+      return set_error(1, "doubling does not decompress");
+    }
+    pressio_options get_options_impl() const override {
+      pressio_options options;
+      set(options, "doubling:value", value);
+      return options;
+    }
+    int set_options_impl(pressio_options const& options) override {
+      get(options, "doubling:value", &value);
+      return 0;
+    }
+    pressio_options get_metrics_results_impl() const override {
+      pressio_options results;
+      set(results, "doubling:next", next);
+      return results;
+    }
+    pressio_options get_documentation_impl() const override { return {}; }
+    pressio_options get_configuration_impl() const override { return {}; }
+    const char* prefix() const override { return "doubling"; }
+    const char* version() const override { return "0.0.1"; }
+    std::shared_ptr<libpressio_compressor_plugin> clone() override {
+      return compat::make_unique<doubling_compressor>(*this);
+    }
+
+    double value = 1.0;
+    double next = 0.0;
+  };
+  pressio_register doubling_plugin(compressor_plugins(), "doubling", [](){ return compat::make_unique<doubling_compressor>(); });
+
+  class ManyDependent: public testing::Test {
+    protected:
+    void SetUp() override {
+      for (size_t i = 0; i < 9; ++i) {
+        inputs.emplace_back(pressio_data::owning(pressio_double_dtype, {1}));
+        *static_cast<double*>(inputs.back().data()) = static_cast<double>(i * i);
+      }
+    }
+
+    std::vector<double> compress(pressio_options const& options) {
+      pressio_compressor compressor = library.get_compressor("many_dependent");
+      EXPECT_EQ(compressor->set_options({
+        {"many_dependent:compressor", std::string("doubling")},
+        {"many_dependent:to_names", std::vector<std::string>{"doubling:value"}},
+        {"many_dependent:from_names", std::vector<std::string>{"doubling:next"}},
+        {"doubling:value", 1.0},
+      }), 0) << compressor->error_msg();
+      EXPECT_EQ(compressor->set_options(options), 0) << compressor->error_msg();
+
+      std::vector<pressio_data> outputs(inputs.size(), pressio_data::empty(pressio_byte_dtype, {}));
+      std::vector<pressio_data const*> in;
+      std::vector<pressio_data*> out;
+      for (size_t i = 0; i < inputs.size(); ++i) {
+        in.push_back(&inputs[i]);
+        out.push_back(&outputs[i]);
+      }
+      EXPECT_EQ(compressor->compress_many(in.begin(), in.end(), out.begin(), out.end()), 0) << compressor->error_msg();
+      compressor->get_metrics_results().get("many_dependent:reruns", &reruns);
+
+      std::vector<double> values;
+      for (auto const& output : outputs) {
+        values.push_back(output.num_elements() == 1 ? *static_cast<double const*>(output.data()) : -1.0);
+      }
+      return values;
+    }
+
+    pressio library;
+    std::vector<pressio_data> inputs;
+    unsigned int reruns = 0;
+  };
+}
+
+TEST_F(ManyDependent, MispredictedBuffersAreRerunWithTheirPredecessorsOptions) {
+  //with one worker buffers run one at a time, so this is also the strictly sequential answer
+  std::vector<double> expected{1};
+  for (size_t i = 0; i + 1 < inputs.size(); ++i) {
+    expected.push_back(2 * expected.back() + static_cast<double>(i * i));
+  }
+
+  auto baseline = compress({{"many_dependent:speculate", 0}});
+  if(comm_rank() == 0 && comm_size() <= 2) {
+    EXPECT_EQ(baseline, expected);
+  }
+
+  for (auto predictor : {"last", "linear"}) {
+    auto speculated = compress({
+      {"many_dependent:speculate", 1},
+      {"many_dependent:predictor", std::string(predictor)},
+    });
+    if(comm_rank() != 0) continue;
+    EXPECT_EQ(speculated, expected) << predictor;
+    if(comm_size() <= 2) {
+      EXPECT_EQ(speculated, baseline) << predictor;
+    } else {
+      //with more than one worker, buffers start before their predecessor finishes and are guessed wrong
+      EXPECT_GT(reruns, 0u) << predictor;
+    }
+  }
+}
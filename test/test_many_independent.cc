@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+#include <mpi.h>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+#include "std_compat/memory.h"
+
+namespace {
+  int comm_size() {
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    return size;
+  }
+
+  /**
+   * replaces each buffer with the number of buffers this process compressed before it
+   */
+  class sequence_compressor : public libpressio_compressor_plugin {
+    public:
+    int compress_impl(pressio_data const*, pressio_data* output) override {
+      *output = pressio_data::owning(pressio_uint64_dtype, {1});
+      *static_cast<uint64_t*>(output->data()) = next++;
+      return 0;
+    }
+    int decompress_impl(pressio_data const*, pressio_data*) override {
+      return set_error(1, "sequence does not decompress");
+    }
+    pressio_options get_options_impl() const override { return {}; }
+    int set_options_impl(pressio_options const&) override { return 0; }
+    pressio_options get_documentation_impl() const override { return {}; }
+    pressio_options get_configuration_impl() const override { return {}; }
+    const char* prefix() const override { return "sequence"; }
+    const char* version() const override { return "0.0.1"; }
+    std::shared_ptr<libpressio_compressor_plugin> clone() override {
+      return compat::make_unique<sequence_compressor>(*this);
+    }
+
+    static uint64_t next;
+  };
+  uint64_t sequence_compressor::next = 0;
+  pressio_register sequence_plugin(compressor_plugins(), "sequence", [](){ return compat::make_unique<sequence_compressor>(); });
+
+  class ManyIndependent: public testing::Test {
+    protected:
+    void SetUp() override {
+      for (size_t size : {4, 32, 8, 64, 16, 24, 12}) {
+        inputs.emplace_back(pressio_data::owning(pressio_int32_dtype, {size}));
+        auto ptr = static_cast<int32_t*>(inputs.back().data());
+        for (size_t j = 0; j < size; ++j) ptr[j] = static_cast<int32_t>(size * 100 + j);
+        outputs.emplace_back(pressio_data::empty(pressio_byte_dtype, {}));
+      }
+    }
+
+    int compress(pressio_compressor& compressor) {
+      std::vector<pressio_data const*> in;
+      std::vector<pressio_data*> out;
+      for (size_t i = 0; i < inputs.size(); ++i) {
+        in.push_back(&inputs[i]);
+        out.push_back(&outputs[i]);
+      }
+      return compressor->compress_many(in.begin(), in.end(), out.begin(), out.end());
+    }
+
+    std::vector<uint64_t> sequence() const {
+      std::vector<uint64_t> order;
+      for (auto const& output : outputs) {
+        order.push_back(output.num_elements() == 1 ? *static_cast<uint64_t const*>(output.data()) : ~uint64_t{0});
+      }
+      return order;
+    }
+
+    pressio library;
+    std::vector<pressio_data> inputs, outputs;
+  };
+}
+
+TEST_F(ManyIndependent, SendsTheLargestGroupsFirstInChunks) {
+  if(comm_size() > 2) GTEST_SKIP() << "the order is only defined with at most one worker";
+  pressio_compressor compressor = library.get_compressor("many_independent");
+  ASSERT_TRUE(compressor);
+
+  ASSERT_EQ(compressor->set_options({
+    {"many_independent:compressor", std::string("sequence")},
+    {"many_independent:chunk_size", 3u},
+  }), 0) << compressor->error_msg();
+  sequence_compressor::next = 0;
+  ASSERT_EQ(compress(compressor), 0) << compressor->error_msg();
+  EXPECT_EQ(sequence(), (std::vector<uint64_t>{0, 1, 2, 3, 4, 5, 6}));
+
+  ASSERT_EQ(compressor->set_options({
+    {"many_independent:order", std::string("largest_first")},
+  }), 0) << compressor->error_msg();
+  sequence_compressor::next = 0;
+  ASSERT_EQ(compress(compressor), 0) << compressor->error_msg();
+  //sizes 4, 32, 8, 64, 16, 24, 12 in decreasing order
+  EXPECT_EQ(sequence(), (std::vector<uint64_t>{6, 1, 5, 0, 3, 2, 4}));
+
+  EXPECT_NE(compressor->set_options({{"many_independent:order", std::string("smallest_first")}}), 0);
+}
+
+TEST_F(ManyIndependent, ReissuedRequestsKeepOneResultPerGroup) {
+  auto reference = library.get_compressor("delta_encoding");
+  std::vector<pressio_data> expected;
+  for (auto const& input : inputs) {
+    expected.emplace_back(pressio_data::empty(pressio_byte_dtype, {}));
+    ASSERT_EQ(reference->compress(&input, &expected.back()), 0) << reference->error_msg();
+  }
+
+  pressio_compressor compressor = library.get_compressor("many_independent");
+  ASSERT_TRUE(compressor);
+  ASSERT_EQ(compressor->set_options({
+    {"many_independent:compressor", std::string("delta_encoding")},
+    {"many_independent:chunk_size", 2u},
+    {"many_independent:reissue", 2u},
+  }), 0) << compressor->error_msg();
+  for (int call = 0; call < 3; ++call) {
+    ASSERT_EQ(compress(compressor), 0) << compressor->error_msg();
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      ASSERT_EQ(outputs[i].size_in_bytes(), expected[i].size_in_bytes()) << i;
+      EXPECT_EQ(memcmp(outputs[i].data(), expected[i].data(), expected[i].size_in_bytes()), 0) << i;
+    }
+  }
+}
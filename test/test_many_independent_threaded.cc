@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+#include "std_compat/memory.h"
+
+namespace {
+  std::atomic<int> clones{0};
+}
+
+/**
+ * copies its input and counts how many times it has been cloned
+ */
+class counting_compressor : public libpressio_compressor_plugin {
+  public:
+  int compress_impl(pressio_data const* input, pressio_data* output) override {
+    *output = pressio_data::clone(*input);
+    return 0;
+  }
+  int decompress_impl(pressio_data const* input, pressio_data* output) override {
+    *output = pressio_data::clone(*input);
+    return 0;
+  }
+  pressio_options get_options_impl() const override {
+    return {};
+  }
+  int set_options_impl(pressio_options const&) override {
+    return 0;
+  }
+  pressio_options get_documentation_impl() const override {
+    pressio_options options;
+    set(options, "pressio:description", "copies its input and counts its clones");
+    return options;
+  }
+  pressio_options get_configuration_impl() const override {
+    pressio_options options;
+    set(options, "pressio:thread_safe", pressio_thread_safety_multiple);
+    return options;
+  }
+  const char* prefix() const override {
+    return "counting";
+  }
+  const char* version() const override {
+    return "0.0.1";
+  }
+  std::shared_ptr<libpressio_compressor_plugin> clone() override {
+    clones++;
+    return compat::make_unique<counting_compressor>(*this);
+  }
+};
+
+static pressio_register counting_plugin(compressor_plugins(), "counting", [](){ return compat::make_unique<counting_compressor>();});
+
+class ManyIndependentThreaded: public testing::Test {
+  protected:
+  void SetUp() override {
+    for (size_t i = 0; i < 8; ++i) {
+      inputs.emplace_back(pressio_data::owning(pressio_int32_dtype, {64}));
+      auto ptr = static_cast<int32_t*>(inputs.back().data());
+      for (size_t j = 0; j < 64; ++j) ptr[j] = static_cast<int32_t>(i * 64 + j);
+      compressed.emplace_back(pressio_data::empty(pressio_byte_dtype, {}));
+      decompressed.emplace_back(pressio_data::owning(pressio_int32_dtype, {64}));
+    }
+    compressor = library.get_compressor("many_independent_threaded");
+    ASSERT_EQ(compressor->set_options({
+      {"many_independent_threaded:compressor", std::string("counting")},
+      {"many_independent_threaded:nthreads", 2u},
+      {"many_independent_threaded:preserve_metrics", int32_t{1}},
+      {"many_independent_threaded:collect_metrics_on_compression", int32_t{1}},
+    }), 0) << compressor->error_msg();
+  }
+
+  void round_trip(pressio_compressor& c) {
+    std::vector<pressio_data const*> in;
+    std::vector<pressio_data*> comp, dec;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      in.push_back(&inputs[i]);
+      comp.push_back(&compressed[i]);
+    }
+    ASSERT_EQ(c->compress_many(in.begin(), in.end(), comp.begin(), comp.end()), 0) << c->error_msg();
+    std::vector<pressio_data const*> comp_in(comp.begin(), comp.end());
+    for (auto& d : decompressed) dec.push_back(&d);
+    ASSERT_EQ(c->decompress_many(comp_in.begin(), comp_in.end(), dec.begin(), dec.end()), 0) << c->error_msg();
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      ASSERT_EQ(decompressed[i].size_in_bytes(), inputs[i].size_in_bytes());
+      EXPECT_EQ(memcmp(decompressed[i].data(), inputs[i].data(), inputs[i].size_in_bytes()), 0) << i;
+    }
+  }
+
+  pressio library;
+  pressio_compressor compressor;
+  std::vector<pressio_data> inputs, compressed, decompressed;
+};
+
+TEST_F(ManyIndependentThreaded, ReusesClonesAcrossItemsAndCalls) {
+  clones = 0;
+  round_trip(compressor);
+  //at most one clone per thread, not one per buffer
+  const int first = clones;
+  EXPECT_GE(first, 1);
+  EXPECT_LE(first, 2);
+
+  round_trip(compressor);
+  EXPECT_EQ(clones, first);
+}
+
+TEST_F(ManyIndependentThreaded, ReconfiguringDiscardsThePool) {
+  round_trip(compressor);
+  clones = 0;
+  ASSERT_EQ(compressor->set_options({{"many_independent_threaded:nthreads", 2u}}), 0);
+  round_trip(compressor);
+  EXPECT_GE(clones, 1);
+}
+
+TEST_F(ManyIndependentThreaded, CopiesStartWithAnEmptyPool) {
+  round_trip(compressor);
+  pressio_compressor copy = compressor->clone();
+  clones = 0;
+  round_trip(copy);
+  EXPECT_GE(clones, 1);
+  //the original keeps its own clones
+  clones = 0;
+  round_trip(compressor);
+  EXPECT_EQ(clones, 0);
+}
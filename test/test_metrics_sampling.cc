@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include <string>
+
+#include "std_compat/memory.h"
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/metrics.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+
+namespace {
+  struct sampling_data {
+    /**
+     * \param[in] levels if non-zero, the values are rounded to this many levels per unit
+     */
+    explicit sampling_data(double levels = 0): input(pressio_data::owning(pressio_double_dtype, {64, 64, 32})), output(pressio_data::owning(pressio_double_dtype, {64, 64, 32})) {
+      std::minstd_rand gen{42};
+      std::normal_distribution<double> noise(0, .01);
+      auto in = static_cast<double*>(input.data());
+      auto out = static_cast<double*>(output.data());
+      auto quantize = [levels](double value) { return levels ? std::round(value * levels) / levels : value; };
+      for (size_t i = 0; i < input.num_elements(); ++i) {
+        in[i] = std::sin(static_cast<double>(i) / 100.0);
+        out[i] = quantize(in[i] + noise(gen));
+        in[i] = quantize(in[i]);
+      }
+    }
+    pressio_data input, output;
+  };
+
+  pressio_options evaluate(pressio_options const& opts, std::string const& metric_id = "error_stat", bool quantized = false) {
+    static sampling_data continuous;
+    static sampling_data levels(32);
+    auto const& data = quantized ? levels : continuous;
+    pressio library;
+    auto metric = library.get_metric(metric_id);
+    if(!metric) return {};
+    metric->set_options(opts);
+    metric->begin_compress(&data.input, nullptr);
+    metric->end_decompress(nullptr, &data.output, 0);
+    return metric->get_metrics_results({});
+  }
+}
+
+TEST(MetricsSampling, ErrorStatEstimatesWithinInterval) {
+  auto full = evaluate({});
+  double full_mse = 0;
+  ASSERT_EQ(full.get("error_stat:mse", &full_mse), pressio_options_key_set);
+  double full_ci = 0;
+  EXPECT_NE(full.get("error_stat:mse_ci", &full_ci), pressio_options_key_set);
+
+  pressio_options sampled_opts{
+    {"pressio:metrics_sample_rate", .1},
+    {"pressio:metrics_sample_seed", uint32_t{3}},
+    {"pressio:metrics_sample_block", uint64_t{8}},
+  };
+  auto sampled = evaluate(sampled_opts);
+  double mse = 0, ci = 0;
+  uint64_t n = 0;
+  ASSERT_EQ(sampled.get("error_stat:mse", &mse), pressio_options_key_set);
+  ASSERT_EQ(sampled.get("error_stat:mse_ci", &ci), pressio_options_key_set);
+  ASSERT_EQ(sampled.get("error_stat:n", &n), pressio_options_key_set);
+  EXPECT_LT(n, 64u*64u*32u/5u);
+  EXPECT_GT(ci, 0.0);
+  //a 95% interval, but with a fixed seed this is deterministic
+  EXPECT_NEAR(mse, full_mse, 2*ci);
+
+  auto again = evaluate(sampled_opts);
+  double mse_again = 0;
+  again.get("error_stat:mse", &mse_again);
+  EXPECT_EQ(mse, mse_again);
+}
+
+TEST(MetricsSampling, ErrorStatExactSampleHasNoPsnrInterval) {
+  sampling_data data;
+  pressio library;
+  auto metric = library.get_metric("error_stat");
+  ASSERT_TRUE(metric);
+  metric->set_options({
+    {"pressio:metrics_sample_rate", .1},
+    {"pressio:metrics_sample_seed", uint32_t{3}},
+    {"pressio:metrics_sample_block", uint64_t{8}},
+  });
+  metric->begin_compress(&data.input, nullptr);
+  metric->end_decompress(nullptr, &data.input, 0);
+  auto results = metric->get_metrics_results({});
+  double mse = 1, psnr_ci = 0;
+  ASSERT_EQ(results.get("error_stat:mse", &mse), pressio_options_key_set);
+  EXPECT_EQ(mse, 0.0);
+  EXPECT_NE(results.get("error_stat:psnr_ci", &psnr_ci), pressio_options_key_set);
+}
+
+namespace {
+  const pressio_options sampled_opts{
+    {"pressio:metrics_sample_rate", .1},
+    {"pressio:metrics_sample_seed", uint32_t{3}},
+    {"pressio:metrics_sample_block", uint64_t{8}},
+  };
+
+  /**
+   * checks that the sampled estimate of key is within its reported confidence interval of the full-data value
+   */
+  void expect_within_interval(std::string const& metric_id, std::string const& key, bool quantized = false) {
+    SCOPED_TRACE(key);
+    auto full = evaluate({}, metric_id, quantized);
+    auto sampled = evaluate(sampled_opts, metric_id, quantized);
+    double full_value = 0, value = 0, ci = 0;
+    ASSERT_EQ(full.get(key, &full_value), pressio_options_key_set);
+    EXPECT_NE(full.get(key + "_ci", &ci), pressio_options_key_set);
+    ASSERT_EQ(sampled.get(key, &value), pressio_options_key_set);
+    ASSERT_EQ(sampled.get(key + "_ci", &ci), pressio_options_key_set);
+    EXPECT_GT(ci, 0.0);
+    EXPECT_NEAR(value, full_value, ci);
+  }
+}
+
+TEST(MetricsSampling, EntropyEstimatesWithinInterval) {
+  if(!metrics_plugins().contains("entropy")) GTEST_SKIP() << "entropy is not built";
+  //the entropy of a sample is biased low when most values are distinct, so estimate it on data with few distinct values
+  expect_within_interval("entropy", "entropy:input", true);
+  expect_within_interval("entropy", "entropy:decompressed", true);
+}
+
+TEST(MetricsSampling, PearsonEstimatesWithinInterval) {
+  if(!metrics_plugins().contains("pearson")) GTEST_SKIP() << "pearson is not built";
+  expect_within_interval("pearson", "pearson:r");
+  expect_within_interval("pearson", "pearson:r2");
+}
+
+TEST(MetricsSampling, SsimEstimatesWithinInterval) {
+  if(!metrics_plugins().contains("ssim")) GTEST_SKIP() << "ssim is not built";
+  expect_within_interval("ssim", "ssim:ssim");
+}
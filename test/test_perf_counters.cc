@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/metrics.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+
+namespace {
+  /**
+   * some work for the timings to measure
+   */
+  double busy(pressio_data const& data) {
+    auto ptr = static_cast<float const*>(data.data());
+    double sum = 0;
+    for (int r = 0; r < 100; ++r) {
+      for (size_t i = 0; i < data.num_elements(); ++i) sum += std::sqrt(ptr[i] + r);
+    }
+    return sum;
+  }
+
+  void run_compress(libpressio_metrics_plugin& metric, pressio_data const& input, pressio_data const& output) {
+    metric.begin_compress(&input, nullptr);
+    EXPECT_GT(busy(input), 0);
+    metric.view_segment(&input, "stage");
+    EXPECT_GT(busy(input), 0);
+    metric.end_compress(&input, &output, 0);
+  }
+
+  class PerfCounters: public testing::Test {
+    protected:
+    void SetUp() override {
+      auto ptr = static_cast<float*>(input.data());
+      for (size_t i = 0; i < input.num_elements(); ++i) ptr[i] = static_cast<float>(i);
+    }
+    pressio library;
+    pressio_data input = pressio_data::owning(pressio_float_dtype, {1024, 16});
+    pressio_data output = pressio_data::owning(pressio_byte_dtype, {1024});
+  };
+}
+
+TEST_F(PerfCounters, RecordsTimingsAndSegments) {
+  auto metric = library.get_metric("perf_counters");
+  ASSERT_EQ(metric->set_options({{"perf_counters:use_hardware", false}}), 0);
+  run_compress(*metric, input, output);
+
+  auto results = metric->get_metrics_results({});
+  uint64_t ns = 0, segment_ns = 0;
+  double bytes_per_second = 0;
+  bool available = true;
+  ASSERT_EQ(results.get("perf_counters:compress_ns", &ns), pressio_options_key_set);
+  ASSERT_EQ(results.get("perf_counters:compress_bytes_per_second", &bytes_per_second), pressio_options_key_set);
+  ASSERT_EQ(results.get("perf_counters:compress:segment:stage_ns", &segment_ns), pressio_options_key_set);
+  EXPECT_GT(ns, 0u);
+  EXPECT_GT(bytes_per_second, 0.0);
+  EXPECT_GT(segment_ns, 0u);
+  EXPECT_LE(segment_ns, ns);
+  //without hardware counters only the timings are reported
+  EXPECT_EQ(results.key_status("perf_counters:compress_cycles"), pressio_options_key_exists);
+  ASSERT_EQ(results.get("perf_counters:available", &available), pressio_options_key_set);
+  EXPECT_FALSE(available);
+
+  //operations that have not run are reported as empty
+  EXPECT_EQ(results.key_status("perf_counters:decompress_ns"), pressio_options_key_exists);
+}
+
+TEST_F(PerfCounters, ReportsCountersWhenAvailable) {
+  auto metric = library.get_metric("perf_counters");
+  run_compress(*metric, input, output);
+  auto results = metric->get_metrics_results({});
+  bool available = false;
+  uint64_t ns = 0, cycles = 0;
+  ASSERT_EQ(results.get("perf_counters:available", &available), pressio_options_key_set);
+  ASSERT_EQ(results.get("perf_counters:compress_ns", &ns), pressio_options_key_set);
+  //the counters depend on the PMU and perf_event_paranoid, but the timings are always reported
+  if(available) {
+    EXPECT_EQ(results.get("perf_counters:compress_cycles", &cycles), pressio_options_key_set);
+  }
+}
+
+TEST_F(PerfCounters, CompositeForwardsSegments) {
+  std::vector<std::string> ids{"perf_counters"};
+  auto metrics = library.get_metrics(ids.begin(), ids.end());
+  ASSERT_EQ(metrics->set_options({{"perf_counters:use_hardware", false}}), 0);
+  run_compress(*metrics, input, output);
+  uint64_t segment_ns = 0;
+  EXPECT_EQ(metrics->get_metrics_results({}).get("perf_counters:compress:segment:stage_ns", &segment_ns), pressio_options_key_set);
+  EXPECT_GT(segment_ns, 0u);
+}
+
+TEST_F(PerfCounters, ClonesDoNotRecordIntoTheOriginal) {
+  auto metric = library.get_metric("perf_counters");
+  ASSERT_EQ(metric->set_options({{"perf_counters:use_hardware", false}}), 0);
+  metric->begin_compress(&input, nullptr);
+  auto copy = metric->clone();
+  copy->view_segment(&input, "from_clone");
+  copy->view_segment(&input, "again");
+  metric->end_compress(&input, &output, 0);
+  copy.reset();
+
+  auto results = metric->get_metrics_results({});
+  uint64_t segment_ns = 0;
+  EXPECT_NE(results.get("perf_counters:compress:segment:from_clone_ns", &segment_ns), pressio_options_key_set);
+}
@@ -0,0 +1,213 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+#include "libpressio_ext/cpp/task_runtime.h"
+#include "std_compat/memory.h"
+
+namespace {
+  class PipelineFusion: public testing::TestWithParam<std::vector<std::string>> {};
+  class PipelineStream: public testing::TestWithParam<uint32_t> {};
+
+  struct budget_guard {
+    budget_guard(uint32_t budget): old(pressio_task_runtime::instance().budget()) {
+      pressio_task_runtime::instance().set_budget(budget);
+    }
+    ~budget_guard() {
+      pressio_task_runtime::instance().set_budget(old);
+    }
+    uint32_t old;
+  };
+
+  /**
+   * copies its input in blocks on the task runtime, writing into the output buffer it is given whenever that
+   * buffer is large enough
+   */
+  class in_place_copy: public libpressio_compressor_plugin {
+    public:
+    int compress_impl(pressio_data const* input, pressio_data* output) override {
+      return copy(*input, input->dtype(), input->dimensions(), output);
+    }
+    int decompress_impl(pressio_data const* input, pressio_data* output) override {
+      return copy(*input, output->dtype(), output->dimensions(), output);
+    }
+    pressio_options get_options_impl() const override { return {}; }
+    pressio_options get_documentation_impl() const override { return {}; }
+    pressio_options get_configuration_impl() const override { return {}; }
+    int set_options_impl(pressio_options const&) override { return 0; }
+    const char* prefix() const override { return "in_place_copy"; }
+    const char* version() const override { return "0.0.0"; }
+    int major_version() const override { return 0; }
+    int minor_version() const override { return 0; }
+    int patch_version() const override { return 0; }
+    std::shared_ptr<libpressio_compressor_plugin> clone() override {
+      return compat::make_unique<in_place_copy>(*this);
+    }
+
+    /** the output buffer written by each call, in order */
+    static std::vector<void*> written;
+    static std::mutex written_lock;
+
+    private:
+    int copy(pressio_data const& input, pressio_dtype dtype, std::vector<size_t> const& dims, pressio_data* output) {
+      if(output->has_data() && output->capacity_in_bytes() >= input.size_in_bytes()) {
+        output->set_dtype(dtype);
+        output->set_dimensions(std::vector<size_t>(dims));
+      } else {
+        *output = pressio_data::owning(dtype, dims);
+      }
+      const size_t blocks = 8, block_size = (input.size_in_bytes() + blocks - 1) / blocks;
+      auto in = static_cast<uint8_t const*>(input.data());
+      auto out = static_cast<uint8_t*>(output->data());
+      pressio_task_runtime::instance().parallel_for(blocks, blocks, [&](size_t i, uint32_t) {
+        const size_t begin = std::min(i * block_size, input.size_in_bytes());
+        std::memcpy(out + begin, in + begin, std::min(block_size, input.size_in_bytes() - begin));
+        //slow enough that other threads steal blocks while this stage is running
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      });
+      std::lock_guard<std::mutex> guard(written_lock);
+      written.push_back(output->data());
+      return 0;
+    }
+  };
+  std::vector<void*> in_place_copy::written;
+  std::mutex in_place_copy::written_lock;
+  pressio_register in_place_copy_plugin(compressor_plugins(), "in_place_copy", [](){ return compat::make_unique<in_place_copy>(); });
+}
+
+TEST_P(PipelineFusion, FusedStagesMatchUnfusedStages) {
+  pressio library;
+  const std::vector<size_t> dims{300, 50};
+  auto input = pressio_data::owning(pressio_double_dtype, dims);
+  auto ptr = static_cast<double*>(input.data());
+  for (size_t i = 0; i < input.num_elements(); ++i) {
+    ptr[i] = 1.5 + std::sin(i * 0.01);
+  }
+
+  std::vector<pressio_data> compressed, decompressed;
+  for (bool fuse : {false, true}) {
+    auto compressor = library.get_compressor("pipeline");
+    ASSERT_TRUE(compressor);
+    ASSERT_EQ(compressor->set_options({
+      {"pipeline:pipeline", GetParam()},
+      {"pipeline:fuse", fuse},
+    }), 0);
+    ASSERT_EQ(compressor->set_options({{"linear_quantizer:step", 1e-4}}), 0);
+    compressed.emplace_back(pressio_data::empty(pressio_byte_dtype, {}));
+    ASSERT_EQ(compressor->compress(&input, &compressed.back()), 0) << compressor->error_msg();
+    decompressed.emplace_back(pressio_data::owning(pressio_double_dtype, dims));
+    ASSERT_EQ(compressor->decompress(&compressed.back(), &decompressed.back()), 0) << compressor->error_msg();
+  }
+
+  ASSERT_EQ(compressed[0].size_in_bytes(), compressed[1].size_in_bytes());
+  EXPECT_EQ(std::memcmp(compressed[0].data(), compressed[1].data(), compressed[0].size_in_bytes()), 0);
+  ASSERT_EQ(decompressed[0].num_elements(), decompressed[1].num_elements());
+  EXPECT_EQ(std::memcmp(decompressed[0].data(), decompressed[1].data(), decompressed[0].size_in_bytes()), 0);
+}
+
+INSTANTIATE_TEST_SUITE_P(Pipeline, PipelineFusion, testing::Values(
+  std::vector<std::string>{"log_transform", "delta_encoding", "linear_quantizer"},
+  std::vector<std::string>{"delta_encoding", "linear_quantizer", "delta_encoding"},
+  std::vector<std::string>{"delta_encoding", "noop", "log_transform", "delta_encoding"}
+));
+
+TEST(PipelineBuffers, ReusesBuffersWithoutFusion) {
+  pressio library;
+  const std::vector<size_t> dims{64, 32};
+  auto input = pressio_data::owning(pressio_float_dtype, dims);
+  auto ptr = static_cast<float*>(input.data());
+  for (size_t i = 0; i < input.num_elements(); ++i) {
+    ptr[i] = static_cast<float>(i);
+  }
+
+  auto compressor = library.get_compressor("pipeline");
+  ASSERT_TRUE(compressor);
+  ASSERT_EQ(compressor->set_options({
+    {"pipeline:pipeline", std::vector<std::string>(4, "in_place_copy")},
+    {"pipeline:fuse", false},
+  }), 0);
+  in_place_copy::written.clear();
+  auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+  ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+  ASSERT_EQ(in_place_copy::written.size(), 4u);
+  EXPECT_EQ(in_place_copy::written[0], in_place_copy::written[2]);
+  EXPECT_EQ(in_place_copy::written[1], in_place_copy::written[3]);
+
+  in_place_copy::written.clear();
+  auto output = pressio_data::owning(pressio_float_dtype, dims);
+  ASSERT_EQ(compressor->decompress(&compressed, &output), 0) << compressor->error_msg();
+  ASSERT_EQ(in_place_copy::written.size(), 4u);
+  EXPECT_EQ(in_place_copy::written[0], in_place_copy::written[2]);
+  EXPECT_EQ(in_place_copy::written[3], output.data());
+  EXPECT_EQ(std::memcmp(output.data(), input.data(), input.size_in_bytes()), 0);
+}
+
+TEST_P(PipelineStream, RoundTripsRaggedChunks) {
+  budget_guard budget(GetParam());
+  pressio library;
+  const std::vector<size_t> dims{40, 30, 17};
+  auto input = pressio_data::owning(pressio_float_dtype, dims);
+  auto ptr = static_cast<float*>(input.data());
+  for (size_t i = 0; i < input.num_elements(); ++i) {
+    ptr[i] = 1.5f + std::sin(i * 0.01f);
+  }
+
+  auto compressor = library.get_compressor("pipeline");
+  ASSERT_TRUE(compressor);
+  ASSERT_EQ(compressor->set_options({
+    {"pipeline:pipeline", std::vector<std::string>{"log_transform", "noop", "delta_encoding"}},
+    {"pipeline:stream", true},
+    {"pipeline:stream_chunk_bytes", uint64_t{40 * 30 * 4 * 4}},
+    {"pipeline:stream_queue_size", uint64_t{1}},
+  }), 0);
+  auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+  ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+
+  auto output = pressio_data::empty(pressio_float_dtype, {});
+  ASSERT_EQ(compressor->decompress(&compressed, &output), 0) << compressor->error_msg();
+  ASSERT_EQ(output.dimensions(), dims);
+  auto out = static_cast<float*>(output.data());
+  for (size_t i = 0; i < input.num_elements(); ++i) {
+    ASSERT_NEAR(out[i], ptr[i], 1e-5) << "at " << i;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Pipeline, PipelineStream, testing::Values(1u, 4u));
+
+TEST(PipelineStream, StagesMayUseTheRuntimeInsideParallelLoops) {
+  budget_guard budget(4);
+  const std::vector<size_t> dims{16, 8, 24};
+  auto input = pressio_data::owning(pressio_float_dtype, dims);
+  auto ptr = static_cast<float*>(input.data());
+  for (size_t i = 0; i < input.num_elements(); ++i) {
+    ptr[i] = static_cast<float>(i);
+  }
+
+  for (int round = 0; round < 10; ++round) {
+    std::vector<int> matches(8, 0);
+    pressio_task_runtime::instance().parallel_for(matches.size(), 4, [&](size_t i, uint32_t) {
+      pressio library;
+      auto compressor = library.get_compressor("pipeline");
+      compressor->set_options({
+        {"pipeline:pipeline", std::vector<std::string>(3, "in_place_copy")},
+        {"pipeline:stream", true},
+        {"pipeline:stream_chunk_bytes", uint64_t{16 * 8 * 4 * 2}},
+      });
+      auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+      auto output = pressio_data::owning(pressio_float_dtype, dims);
+      matches[i] = compressor->compress(&input, &compressed) == 0 &&
+        compressor->decompress(&compressed, &output) == 0 &&
+        std::memcmp(output.data(), input.data(), input.size_in_bytes()) == 0;
+    });
+    EXPECT_EQ(matches, std::vector<int>(8, 1)) << "in round " << round;
+  }
+}
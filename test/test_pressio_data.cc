@@ -81,6 +81,45 @@ TEST_F(PressioDataTests, Transpose) {
   pressio_data_free(transposed);
 }
 
+TEST_F(PressioDataTests, TransposeAxes) {
+  //dimensions larger than a tile so that partial tiles are exercised
+  const std::vector<size_t> in_dims{37, 5, 41};
+  auto original = pressio_data::owning(pressio_double_dtype, in_dims);
+  auto in = static_cast<double*>(original.data());
+  std::iota(in, in + original.num_elements(), 0.0);
+
+  for (auto const& axis : std::vector<std::vector<size_t>>{{2, 0, 1}, {1, 0, 2}, {0, 2, 1}, {2, 1, 0}}) {
+    auto transposed = original.transpose(axis);
+    std::vector<size_t> out_dims{in_dims[axis[0]], in_dims[axis[1]], in_dims[axis[2]]};
+    ASSERT_EQ(transposed.dimensions(), out_dims);
+    ASSERT_EQ(original.transposed_dims(axis), out_dims);
+    EXPECT_FALSE(original.transpose_is_reshape(axis));
+
+    auto out = static_cast<double*>(transposed.data());
+    size_t mismatches = 0;
+    std::array<size_t, 3> i;
+    for (i[2] = 0; i[2] < in_dims[2]; ++i[2]) {
+      for (i[1] = 0; i[1] < in_dims[1]; ++i[1]) {
+        for (i[0] = 0; i[0] < in_dims[0]; ++i[0]) {
+          const size_t src = i[0] + in_dims[0] * (i[1] + in_dims[1] * i[2]);
+          const size_t dst = i[axis[0]] + out_dims[0] * (i[axis[1]] + out_dims[1] * i[axis[2]]);
+          mismatches += out[dst] != in[src];
+        }
+      }
+    }
+    EXPECT_EQ(mismatches, 0u);
+
+    std::vector<size_t> inverse(3);
+    for (size_t k = 0; k < 3; ++k) inverse[axis[k]] = k;
+    EXPECT_EQ(transposed.transpose(inverse), original);
+  }
+
+  auto with_unit = pressio_data::owning(pressio_float_dtype, {4, 1, 3});
+  EXPECT_TRUE(with_unit.transpose_is_reshape({1, 0, 2}));
+  EXPECT_TRUE(with_unit.transpose_is_reshape({0, 2, 1}));
+  EXPECT_FALSE(with_unit.transpose_is_reshape({2, 1, 0}));
+}
+
 TEST_F(PressioDataTests, MakePressioData) {
   pressio_data* d = pressio_data_new_nonowning(pressio_int32_dtype, data.data(), 2, dims);
   EXPECT_NE(d, nullptr);
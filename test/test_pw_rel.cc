@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+
+template <class T>
+class PwRel : public testing::Test {};
+using PwRelTypes = testing::Types<float, double>;
+TYPED_TEST_SUITE(PwRel, PwRelTypes);
+
+TYPED_TEST(PwRel, RoundTripsSignsZerosAndMagnitudes) {
+  pressio library;
+  //odd sizes leave a partial byte at the end of the sign bitmap
+  auto input = pressio_data::owning(pressio_dtype_from_type<TypeParam>(), {37, 11});
+  auto ptr = static_cast<TypeParam*>(input.data());
+  for (size_t i = 0; i < input.num_elements(); ++i) {
+    TypeParam const magnitude = static_cast<TypeParam>(std::pow(10.0, static_cast<double>(i % 13) - 6) * (1 + 0.01 * (i % 7)));
+    ptr[i] = (i % 5 == 0) ? TypeParam{0} : ((i % 3 == 0) ? -magnitude : magnitude);
+  }
+
+  auto compressor = library.get_compressor("pw_rel");
+  ASSERT_TRUE(compressor);
+  const double bound = 1e-3;
+  ASSERT_EQ(compressor->set_options({{"pressio:pw_rel", bound}}), 0);
+
+  auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+  auto output = pressio_data::owning(input.dtype(), input.dimensions());
+  ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+  ASSERT_EQ(compressor->decompress(&compressed, &output), 0) << compressor->error_msg();
+
+  auto out = static_cast<TypeParam*>(output.data());
+  for (size_t i = 0; i < input.num_elements(); ++i) {
+    if(ptr[i] == 0) {
+      EXPECT_EQ(out[i], 0) << i;
+    } else {
+      EXPECT_EQ(std::signbit(out[i]), std::signbit(ptr[i])) << i;
+      EXPECT_LE(std::fabs(out[i] - ptr[i]), bound * std::fabs(ptr[i])) << i;
+    }
+  }
+}
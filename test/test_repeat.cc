@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+
+TEST(Repeat, ReportsTimingStatistics) {
+  pressio library;
+  auto input = pressio_data::owning(pressio_double_dtype, {128, 64});
+  auto ptr = static_cast<double*>(input.data());
+  for (size_t i = 0; i < input.num_elements(); ++i) {
+    ptr[i] = static_cast<double>(i % 17);
+  }
+
+  auto compressor = library.get_compressor("repeat");
+  ASSERT_TRUE(compressor);
+  ASSERT_EQ(compressor->set_options({
+    {"repeat:count", uint32_t{5}},
+    {"repeat:warmup", uint32_t{2}},
+    {"repeat:ci_target", 0.5},
+    {"repeat:max_count", uint64_t{50}},
+    {"repeat:outlier_threshold", 3.5},
+    {"repeat:flush_cache", true},
+    {"repeat:flush_bytes", uint64_t{1} << 20},
+  }), 0);
+
+  auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+  auto output = pressio_data::owning(pressio_double_dtype, {128, 64});
+  ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+  ASSERT_EQ(compressor->decompress(&compressed, &output), 0) << compressor->error_msg();
+  EXPECT_EQ(memcmp(output.data(), input.data(), input.size_in_bytes()), 0);
+
+  auto results = compressor->get_metrics_results();
+  for (std::string op : {"compress", "decompress"}) {
+    uint64_t iterations = 0, outliers = 0;
+    double min = 0, median = 0, max = 0, ci = 0, mean = 0;
+    bool converged = false;
+    pressio_data times;
+    ASSERT_EQ(results.get("repeat:" + op + "_iterations", &iterations), pressio_options_key_set);
+    ASSERT_EQ(results.get("repeat:" + op + "_times", &times), pressio_options_key_set);
+    ASSERT_EQ(results.get("repeat:" + op + "_outliers", &outliers), pressio_options_key_set);
+    ASSERT_EQ(results.get("repeat:" + op + "_min", &min), pressio_options_key_set);
+    ASSERT_EQ(results.get("repeat:" + op + "_median", &median), pressio_options_key_set);
+    ASSERT_EQ(results.get("repeat:" + op + "_max", &max), pressio_options_key_set);
+    ASSERT_EQ(results.get("repeat:" + op + "_mean", &mean), pressio_options_key_set);
+    ASSERT_EQ(results.get("repeat:" + op + "_ci", &ci), pressio_options_key_set);
+    ASSERT_EQ(results.get("repeat:" + op + "_converged", &converged), pressio_options_key_set);
+
+    EXPECT_GE(iterations, 5u);
+    EXPECT_LE(iterations, 50u);
+    EXPECT_EQ(times.num_elements(), iterations);
+    EXPECT_LT(outliers, iterations);
+    EXPECT_LE(min, median);
+    EXPECT_LE(median, max);
+    if(converged) {
+      EXPECT_LE(ci, 0.5 * mean);
+    } else {
+      EXPECT_EQ(iterations, 50u);
+    }
+  }
+}
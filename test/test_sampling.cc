@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <set>
+#include <string>
+#include <tuple>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+
+class SampleBlocks: public testing::TestWithParam<std::tuple<std::string, uint64_t>> {};
+
+TEST_P(SampleBlocks, GathersWholeBlocksOfTheInput) {
+  std::string mode;
+  uint64_t block_size;
+  std::tie(mode, block_size) = GetParam();
+  const std::vector<size_t> dims{24, 40, 20};
+  auto input = pressio_data::owning(pressio_uint32_dtype, dims);
+  auto in = static_cast<uint32_t*>(input.data());
+  for (size_t i = 0; i < input.num_elements(); ++i) {
+    in[i] = static_cast<uint32_t>(i);
+  }
+
+  pressio library;
+  auto compressor = library.get_compressor("sample");
+  ASSERT_EQ(compressor->set_options({
+    {"sample:mode", mode},
+    {"sample:rate", 0.25},
+    {"sample:seed", 7},
+    {"sample:block_size", block_size},
+    {"pressio:nthreads", 4u},
+  }), 0);
+  pressio_data output;
+  ASSERT_EQ(compressor->compress(&input, &output), 0) << compressor->error_msg();
+
+  std::vector<size_t> extent;
+  for (auto dim : dims) extent.push_back(std::min<size_t>(dim, block_size));
+  auto const& out_dims = output.dimensions();
+  ASSERT_EQ(out_dims.size(), 3u);
+  EXPECT_EQ(out_dims[0], extent[0]);
+  EXPECT_EQ(out_dims[1], extent[1]);
+  ASSERT_EQ(out_dims[2] % extent[2], 0u);
+  const size_t blocks = out_dims[2] / extent[2];
+  EXPECT_GT(blocks, 0u);
+
+  const size_t block_elements = extent[0] * extent[1] * extent[2];
+  auto out = static_cast<uint32_t const*>(output.data());
+  std::set<uint32_t> origins;
+  for (size_t b = 0; b < blocks; ++b) {
+    const uint32_t origin = out[b * block_elements];
+    EXPECT_TRUE(origins.insert(origin).second) << "block sampled twice";
+    const size_t ox = origin % dims[0], oy = origin / dims[0] % dims[1], oz = origin / dims[0] / dims[1];
+    for (size_t z = 0; z < extent[2]; ++z) {
+      for (size_t y = 0; y < extent[1]; ++y) {
+        for (size_t x = 0; x < extent[0]; ++x) {
+          const size_t expected = (ox + x) + dims[0] * ((oy + y) + dims[1] * (oz + z));
+          ASSERT_EQ(out[b * block_elements + x + extent[0] * (y + extent[1] * z)], expected);
+        }
+      }
+    }
+  }
+
+  pressio_data again;
+  ASSERT_EQ(compressor->compress(&input, &again), 0);
+  ASSERT_EQ(again.size_in_bytes(), output.size_in_bytes());
+  EXPECT_EQ(memcmp(again.data(), output.data(), output.size_in_bytes()), 0);
+}
+
+INSTANTIATE_TEST_SUITE_P(Sampling, SampleBlocks, testing::Values(
+  std::make_tuple(std::string("block"), uint64_t{8}),
+  std::make_tuple(std::string("stratified"), uint64_t{8}),
+  std::make_tuple(std::string("block"), uint64_t{24})
+));
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+
+namespace {
+  class SearchMethods: public testing::TestWithParam<std::tuple<std::string, unsigned int>> {};
+}
+
+TEST_P(SearchMethods, MeetsARatioTargetAndCachesPoints) {
+  pressio library;
+  auto input = pressio_data::owning(pressio_float_dtype, {100000});
+  auto ptr = static_cast<float*>(input.data());
+  for (size_t i = 0; i < input.num_elements(); ++i) {
+    ptr[i] = static_cast<float>(i);
+  }
+
+  //sample:rate controls the compression ratio of the sample compressor
+  for (bool expect_cached : {false, true}) {
+    auto compressor = library.get_compressor("search");
+    ASSERT_TRUE(compressor);
+    ASSERT_EQ(compressor->set_options({
+      {"search:compressor", std::string("sample")},
+      {"sample:mode", std::string("wor")},
+      {"search:option", std::string("sample:rate")},
+      {"search:lower", 0.05},
+      {"search:upper", 1.0},
+      {"search:target_metric", std::string("size:compression_ratio")},
+      {"search:target", 4.0},
+      {"search:tolerance", 0.02},
+      {"search:method", std::get<0>(GetParam())},
+      {"pressio:nthreads", std::get<1>(GetParam())},
+      {"search:clear_cache", !expect_cached},
+    }), 0) << compressor->error_msg();
+    auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+    ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+
+    auto results = compressor->get_metrics_results();
+    bool feasible = false;
+    double ratio = 0;
+    uint64_t evaluations = 0;
+    ASSERT_EQ(results.get("search:feasible", &feasible), pressio_options_key_set);
+    ASSERT_EQ(results.get("search:metric_value", &ratio), pressio_options_key_set);
+    ASSERT_EQ(results.get("search:evaluations", &evaluations), pressio_options_key_set);
+    EXPECT_TRUE(feasible);
+    EXPECT_GE(ratio, 4.0);
+    EXPECT_LT(ratio, 4.2);
+    EXPECT_DOUBLE_EQ(static_cast<double>(input.size_in_bytes()) / compressed.size_in_bytes(), ratio);
+    if(expect_cached) {
+      EXPECT_EQ(evaluations, 0u);
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Search, SearchMethods, testing::Combine(
+      testing::Values("bisection", "golden"),
+      testing::Values(1u, 4u)
+      ));
+
+namespace {
+  class SearchCache: public testing::Test {
+    protected:
+    void SetUp() override {
+      input = pressio_data::owning(pressio_float_dtype, {100000});
+      auto ptr = static_cast<float*>(input.data());
+      for (size_t i = 0; i < input.num_elements(); ++i) {
+        ptr[i] = static_cast<float>(i);
+      }
+    }
+
+    pressio_compressor make_search(uint64_t cache_size) {
+      auto compressor = library.get_compressor("search");
+      EXPECT_EQ(compressor->set_options({
+        {"search:compressor", std::string("sample")},
+        {"sample:mode", std::string("wor")},
+        {"search:option", std::string("sample:rate")},
+        {"search:lower", 0.05},
+        {"search:upper", 1.0},
+        {"search:target_metric", std::string("size:compression_ratio")},
+        {"search:target", 4.0},
+        {"search:tolerance", 0.02},
+        {"search:cache_size", cache_size},
+        {"search:clear_cache", true},
+      }), 0) << compressor->error_msg();
+      return compressor;
+    }
+
+    void compress(pressio_compressor& compressor, uint64_t& evaluations, uint64_t& cache_hits) {
+      auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+      ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+      auto results = compressor->get_metrics_results();
+      ASSERT_EQ(results.get("search:evaluations", &evaluations), pressio_options_key_set);
+      ASSERT_EQ(results.get("search:cache_hits", &cache_hits), pressio_options_key_set);
+    }
+
+    pressio library;
+    pressio_data input;
+  };
+}
+
+TEST_F(SearchCache, IsBoundedBySearchCacheSize) {
+  auto compressor = make_search(2);
+  uint64_t evaluations = 0, cache_hits = 0;
+  compress(compressor, evaluations, cache_hits);
+  ASSERT_GT(evaluations, 2u);
+  EXPECT_EQ(cache_hits, 0u);
+
+  compress(compressor, evaluations, cache_hits);
+  EXPECT_LE(cache_hits, 2u);
+  EXPECT_GT(evaluations, 0u);
+}
+
+TEST_F(SearchCache, KeysOnTheCurrentChildOptions) {
+  auto compressor = make_search(4096);
+  uint64_t evaluations = 0, cache_hits = 0;
+  compress(compressor, evaluations, cache_hits);
+  ASSERT_GT(evaluations, 0u);
+
+  //a clone whose child is configured differently does not reuse the points of the original configuration
+  pressio_compressor clone = compressor->clone();
+  ASSERT_EQ(clone->set_options({{"sample:seed", 7}}), 0) << clone->error_msg();
+  compress(clone, evaluations, cache_hits);
+  EXPECT_GT(evaluations, 0u);
+  EXPECT_EQ(cache_hits, 0u);
+
+  //while the original configuration still finds its own points
+  compress(compressor, evaluations, cache_hits);
+  EXPECT_EQ(evaluations, 0u);
+  EXPECT_GT(cache_hits, 0u);
+}
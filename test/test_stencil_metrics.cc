@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/metrics.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+
+/*
+ * the reference values were computed by the implementations of ssim, gradlength, and qcatsobolevp2 that
+ * preceded the stencil kernels, on the same inputs
+ */
+
+namespace {
+  pressio_data make_data(std::vector<size_t> const& dims, bool noisy) {
+    auto data = pressio_data::owning(pressio_float_dtype, dims);
+    auto ptr = static_cast<float*>(data.data());
+    for (size_t i = 0; i < data.num_elements(); ++i) {
+      ptr[i] = static_cast<float>(std::sin(i * .1) * 10 + std::cos(i * .037) * 3);
+      if(noisy) ptr[i] += static_cast<float>(std::sin(i * 1.7) * .25);
+    }
+    return data;
+  }
+
+  pressio_options evaluate(std::string const& metric_id, std::vector<size_t> const& dims, pressio_options const& opts) {
+    pressio library;
+    auto input = make_data(dims, false);
+    auto output = make_data(dims, true);
+    auto metric = library.get_metric(metric_id);
+    EXPECT_EQ(metric->set_options(opts), 0) << metric->error_msg();
+    metric->begin_compress(&input, nullptr);
+    metric->end_decompress(nullptr, &output, 0);
+    return metric->get_metrics_results({});
+  }
+
+  double get_double(pressio_options const& results, std::string const& key) {
+    double value = 0;
+    EXPECT_EQ(results.get(key, &value), pressio_options_key_set) << key;
+    return value;
+  }
+
+  /**
+   * sums the gradient magnitudes, skipping the boundary in every dimension when interior is true
+   */
+  double sum_gradient(pressio_options const& results, std::string const& key, bool interior) {
+    pressio_data gradient;
+    EXPECT_EQ(results.get(key, &gradient), pressio_options_key_set) << key;
+    auto const& dims = gradient.dimensions();
+    auto ptr = static_cast<float const*>(gradient.data());
+    double sum = 0;
+    for (size_t i = 0; i < gradient.num_elements(); ++i) {
+      bool on_boundary = false;
+      size_t rest = i;
+      for (auto dim : dims) {
+        const size_t idx = rest % dim;
+        rest /= dim;
+        on_boundary |= idx == 0 || idx + 1 == dim;
+      }
+      if(!interior || !on_boundary) sum += ptr[i];
+    }
+    return sum;
+  }
+
+  class StencilMetrics: public testing::TestWithParam<unsigned int> {};
+}
+
+TEST_P(StencilMetrics, SsimMatchesReference) {
+  const unsigned int nthreads = GetParam();
+  EXPECT_NEAR(get_double(evaluate("ssim", {24, 20}, {{"ssim:nthreads", nthreads}}), "ssim:ssim"), 0.99969934395634075, 1e-12);
+  EXPECT_NEAR(get_double(evaluate("ssim", {12, 10, 8}, {{"ssim:nthreads", nthreads}}), "ssim:ssim"), 0.99970669876259921, 1e-12);
+}
+
+TEST_P(StencilMetrics, GradlengthMatchesReference) {
+  const unsigned int nthreads = GetParam();
+  auto results = evaluate("gradlength", {24, 20}, {{"gradlength:nthreads", nthreads}});
+  EXPECT_NEAR(sum_gradient(results, "gradlength:input", false), 2544.948611214757, 1e-6);
+  EXPECT_NEAR(sum_gradient(results, "gradlength:decompressed", false), 2547.8992701135576, 1e-6);
+
+  //the previous implementation skipped the boundary planes of 3d data, so only the interior is comparable
+  results = evaluate("gradlength", {12, 10, 8}, {{"gradlength:nthreads", nthreads}});
+  EXPECT_NEAR(sum_gradient(results, "gradlength:input", true), 3435.1382223814726, 1e-6);
+  EXPECT_NEAR(sum_gradient(results, "gradlength:decompressed", true), 3439.1078241765499, 1e-6);
+}
+
+TEST_P(StencilMetrics, Sobolevp2MatchesReference) {
+  const unsigned int nthreads = GetParam();
+  struct reference {
+    std::vector<size_t> dims;
+    int order;
+    double input, decompressed;
+  };
+  for (auto const& ref : std::vector<reference>{
+      {{24, 20}, 0, 7.4407318601020114, 7.4429068015398983},
+      {{24, 20}, 1, 9.0178773219432191, 9.0207578561495776},
+      {{24, 20}, 2, 26.051327484879533, 26.06243830672053},
+      {{12, 10, 8}, 0, 7.4489768683815507, 7.4512683457739266},
+      {{12, 10, 8}, 1, 10.838163919965963, 10.845267780544525},
+      {{12, 10, 8}, 2, 15.685278007991283, 15.720245424246439},
+      }) {
+    auto results = evaluate("qcatsobolevp2", ref.dims, {{"qcatsobolevp2:order", ref.order}, {"qcatsobolevp2:nthreads", nthreads}});
+    EXPECT_NEAR(get_double(results, "qcatsobolevp2:input"), ref.input, 1e-9) << ref.dims.size() << "d order " << ref.order;
+    EXPECT_NEAR(get_double(results, "qcatsobolevp2:decompressed"), ref.decompressed, 1e-9) << ref.dims.size() << "d order " << ref.order;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Threads, StencilMetrics, testing::Values(1u, 4u));
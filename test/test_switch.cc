@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+
+namespace {
+  pressio_data make_input(size_t n, float range) {
+    auto input = pressio_data::owning(pressio_float_dtype, {n});
+    auto ptr = static_cast<float*>(input.data());
+    for (size_t i = 0; i < n; ++i) {
+      ptr[i] = range * static_cast<float>(i) / static_cast<float>(n);
+    }
+    return input;
+  }
+
+  pressio_compressor make_switch(pressio& library, std::string const& selector) {
+    auto compressor = library.get_compressor("switch");
+    compressor->set_options({
+      {"switch:compressors", std::vector<std::string>{"noop", "noop"}},
+      {"switch:names", std::vector<std::string>{"small", "large"}},
+      {"switch:features", std::vector<std::string>{"error_stat"}},
+      {"switch:tree", std::vector<std::string>{
+        "# choose by the range of the values",
+        "0 error_stat:value_range 100 1 2",
+        "1 leaf 0",
+        "2 leaf 1",
+      }},
+      {"switch:selector", selector},
+    });
+    return compressor;
+  }
+}
+
+TEST(SwitchAuto, SelectsPerBufferAndRecordsTheChoice) {
+  pressio library;
+  auto compressor = make_switch(library, "tree");
+  ASSERT_TRUE(compressor);
+  for (float range : {10.0f, 1000.0f}) {
+    auto input = make_input(4096, range);
+    auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+    ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+    uint64_t selected = 2;
+    ASSERT_EQ(compressor->get_metrics_results().get("switch:selected_id", &selected), pressio_options_key_set);
+    EXPECT_EQ(selected, range < 100 ? 0u : 1u);
+
+    //decompression reads the choice from the stream rather than the selector
+    auto decompressor = make_switch(library, "trial");
+    auto output = pressio_data::owning(pressio_float_dtype, {4096});
+    ASSERT_EQ(decompressor->decompress(&compressed, &output), 0) << decompressor->error_msg();
+    EXPECT_EQ(memcmp(output.data(), input.data(), input.size_in_bytes()), 0);
+  }
+
+  EXPECT_NE(compressor->set_options({{"switch:tree", std::vector<std::string>{"0 error_stat:value_range 100 0 1"}}}), 0);
+}
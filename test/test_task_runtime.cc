@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include "libpressio_ext/cpp/task_runtime.h"
+#include "pressio.h"
+
+namespace {
+  struct budget_guard {
+    budget_guard(uint32_t budget): old(pressio_task_runtime::instance().budget()) {
+      pressio_task_runtime::instance().set_budget(budget);
+    }
+    ~budget_guard() {
+      pressio_task_runtime::instance().set_budget(old);
+    }
+    uint32_t old;
+  };
+}
+
+TEST(TaskRuntime, RunsEachIterationOnce) {
+  budget_guard budget(4);
+  std::vector<std::atomic<int>> counts(1000);
+  std::mutex lock;
+  std::set<uint32_t> slots;
+  pressio_task_runtime::instance().parallel_for(counts.size(), 3, [&](size_t i, uint32_t slot) {
+    counts[i]++;
+    std::lock_guard<std::mutex> guard(lock);
+    slots.insert(slot);
+  });
+  for (auto const& count : counts) {
+    EXPECT_EQ(count, 1);
+  }
+  EXPECT_LT(*slots.rbegin(), 3u);
+}
+
+TEST(TaskRuntime, NestedLoopsStayWithinBudget) {
+  budget_guard budget(4);
+  std::atomic<uint32_t> running{0}, max_running{0};
+  std::atomic<size_t> total{0};
+  pressio_task_runtime::instance().parallel_for(16, 16, [&](size_t, uint32_t) {
+    pressio_task_runtime::instance().parallel_for(64, 16, [&](size_t, uint32_t) {
+      uint32_t now = ++running;
+      uint32_t seen = max_running;
+      while(now > seen && !max_running.compare_exchange_weak(seen, now)) {}
+      total++;
+      running--;
+    });
+  });
+  EXPECT_EQ(total, 16u*64u);
+  EXPECT_LE(max_running, 4u);
+}
+
+TEST(TaskRuntime, PropagatesExceptions) {
+  budget_guard budget(4);
+  EXPECT_THROW(
+    pressio_task_runtime::instance().parallel_for(100, 4, [](size_t i, uint32_t) {
+      if(i == 42) throw std::runtime_error("failed");
+    }),
+    std::runtime_error);
+}
+
+TEST(TaskRuntime, BudgetIsSetThroughTheLibrary) {
+  budget_guard budget(4);
+  pressio_set_thread_budget(2);
+  EXPECT_EQ(pressio_thread_budget(), 2u);
+  EXPECT_EQ(pressio_task_runtime::instance().budget(), 2u);
+  pressio_set_thread_budget(0);
+  EXPECT_EQ(pressio_thread_budget(), 1u);
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <regex>
+#include <sstream>
+#include <vector>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/metrics.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+
+namespace {
+  struct event {
+    double ts;
+    double dur;
+  };
+
+  std::vector<event> read_events(std::string const& file) {
+    std::ifstream in(file);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string contents = ss.str();
+    std::regex pattern(R"("ts":([0-9.]+),"dur":([0-9.]+))");
+    std::vector<event> events;
+    for (auto it = std::sregex_iterator(contents.begin(), contents.end(), pattern); it != std::sregex_iterator(); ++it) {
+      events.push_back(event{std::stod((*it)[1]), std::stod((*it)[2])});
+    }
+    return events;
+  }
+
+  uint64_t spans(libpressio_metrics_plugin& metric) {
+    uint64_t n = 0;
+    metric.get_metrics_results({}).get("trace:spans", &n);
+    return n;
+  }
+}
+
+TEST(Trace, RecordsNestedSpans) {
+  pressio library;
+  const std::string file = "test_trace_nested.json";
+  std::remove(file.c_str());
+  auto metric = library.get_metric("trace");
+  ASSERT_EQ(metric->set_options({{"trace:file", file}}), 0);
+  auto data = pressio_data::owning(pressio_float_dtype, {16});
+
+  metric->begin_compress(&data, nullptr);
+  metric->begin_compress(&data, nullptr);
+  metric->end_compress(&data, nullptr, 0);
+  metric->end_compress(&data, nullptr, 0);
+  metric->begin_decompress(nullptr, &data);
+  metric->end_decompress(nullptr, &data, 0);
+
+  auto results = metric->get_metrics_results({});
+  uint64_t n = 0, dropped = 0;
+  ASSERT_EQ(results.get("trace:spans", &n), pressio_options_key_set);
+  ASSERT_EQ(results.get("trace:dropped", &dropped), pressio_options_key_set);
+  EXPECT_EQ(n, 3u);
+  EXPECT_EQ(dropped, 0u);
+  std::vector<std::string> summary;
+  ASSERT_EQ(results.get("trace:summary", &summary), pressio_options_key_set);
+  ASSERT_EQ(summary.size(), 2u);
+  EXPECT_EQ(summary[0].rfind("/ compress 2 ", 0), 0u) << summary[0];
+  EXPECT_EQ(summary[1].rfind("/ decompress 1 ", 0), 0u) << summary[1];
+
+  //retrieving the results does not write the file
+  EXPECT_FALSE(std::ifstream(file).good());
+  ASSERT_EQ(metric->set_options({{"trace:flush", true}}), 0);
+  auto events = read_events(file);
+  ASSERT_EQ(events.size(), 3u);
+  //spans are recorded as they end, so the inner compress comes before the outer one
+  auto const& inner = events[0];
+  auto const& outer = events[1];
+  EXPECT_LE(outer.ts, inner.ts);
+  EXPECT_LE(inner.ts + inner.dur, outer.ts + outer.dur + 1e-3);
+  EXPECT_GE(events[2].ts, outer.ts + outer.dur - 1e-3);
+  metric.reset();
+  std::remove(file.c_str());
+}
+
+TEST(Trace, LogsArePerInstance) {
+  pressio library;
+  auto data = pressio_data::owning(pressio_float_dtype, {16});
+  auto a = library.get_metric("trace");
+  auto b = library.get_metric("trace");
+  a->begin_compress(&data, nullptr);
+  a->end_compress(&data, nullptr, 0);
+  EXPECT_EQ(spans(*a), 1u);
+  EXPECT_EQ(spans(*b), 0u);
+
+  //clones share the log of the plugin they were cloned from
+  auto clone = a->clone();
+  clone->begin_compress(&data, nullptr);
+  clone->end_compress(&data, nullptr, 0);
+  EXPECT_EQ(spans(*a), 2u);
+  EXPECT_EQ(spans(*clone), 2u);
+
+  //plugins in the same session share a log
+  a->set_options({{"trace:session", std::string("test_trace_session")}});
+  b->set_options({{"trace:session", std::string("test_trace_session")}});
+  b->begin_decompress(nullptr, &data);
+  b->end_decompress(nullptr, &data, 0);
+  EXPECT_EQ(spans(*a), 1u);
+  EXPECT_EQ(spans(*b), 1u);
+}
+
+TEST(Trace, CapsTheLog) {
+  pressio library;
+  auto data = pressio_data::owning(pressio_float_dtype, {16});
+  auto metric = library.get_metric("trace");
+  ASSERT_EQ(metric->set_options({{"trace:max_spans", uint64_t{2}}}), 0);
+  for (int i = 0; i < 5; ++i) {
+    metric->begin_compress(&data, nullptr);
+    metric->end_compress(&data, nullptr, 0);
+  }
+  auto results = metric->get_metrics_results({});
+  uint64_t n = 0, dropped = 0;
+  results.get("trace:spans", &n);
+  results.get("trace:dropped", &dropped);
+  EXPECT_EQ(n, 2u);
+  EXPECT_EQ(dropped, 3u);
+  std::vector<std::string> summary;
+  results.get("trace:summary", &summary);
+  ASSERT_EQ(summary.size(), 1u);
+  EXPECT_EQ(summary[0].rfind("/ compress 5 ", 0), 0u) << summary[0];
+}
+
+TEST(Trace, WritesOnDestruction) {
+  const std::string file = "test_trace_destruction.json";
+  std::remove(file.c_str());
+  {
+    pressio library;
+    auto data = pressio_data::owning(pressio_float_dtype, {16});
+    auto metric = library.get_metric("trace");
+    ASSERT_EQ(metric->set_options({{"trace:file", file}}), 0);
+    metric->begin_compress(&data, nullptr);
+    metric->end_compress(&data, nullptr, 0);
+    EXPECT_FALSE(std::ifstream(file).good());
+  }
+  EXPECT_EQ(read_events(file).size(), 1u);
+  std::remove(file.c_str());
+}
@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <numeric>
+
+#include "libpressio_ext/cpp/data.h"
+#include "libpressio_ext/cpp/compressor.h"
+#include "libpressio_ext/cpp/options.h"
+#include "libpressio_ext/cpp/pressio.h"
+
+namespace {
+  pressio_data iota(std::vector<size_t> const& dims) {
+    auto data = pressio_data::owning(pressio_float_dtype, dims);
+    auto ptr = static_cast<float*>(data.data());
+    std::iota(ptr, ptr + data.num_elements(), 0.0f);
+    return data;
+  }
+}
+
+TEST(Transpose, RoundTripsAndOnlyCopiesWhenTheLayoutChanges) {
+  pressio library;
+  struct test_case {
+    std::vector<size_t> dims;
+    std::vector<size_t> axis;
+    bool copied;
+  };
+  for (auto const& t : std::vector<test_case>{
+      {{3, 40, 50}, {1, 2, 0}, true},
+      {{3, 40, 50}, {}, true},
+      {{40, 1, 50}, {1, 0, 2}, false},
+      }) {
+    auto compressor = library.get_compressor("transpose");
+    ASSERT_TRUE(compressor);
+    pressio_options options{{"transpose:compressor", "noop"}};
+    if(!t.axis.empty()) {
+      options.set("transpose:axis", pressio_data(t.axis.begin(), t.axis.end()));
+    }
+    ASSERT_EQ(compressor->set_options(options), 0) << compressor->error_msg();
+
+    auto input = iota(t.dims);
+    auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+    auto output = pressio_data::owning(pressio_float_dtype, t.dims);
+    ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+    ASSERT_EQ(compressor->decompress(&compressed, &output), 0) << compressor->error_msg();
+    EXPECT_EQ(output, input);
+
+    bool copied = !t.copied;
+    ASSERT_EQ(compressor->get_metrics_results().get("transpose:copied", &copied), pressio_options_key_set);
+    EXPECT_EQ(copied, t.copied);
+  }
+}
+
+TEST(Transpose, RejectsInvalidAxes) {
+  pressio library;
+  auto compressor = library.get_compressor("transpose");
+  ASSERT_EQ(compressor->set_options({
+    {"transpose:compressor", "noop"},
+    {"transpose:axis", pressio_data{size_t{0}, size_t{0}}},
+  }), 0);
+  auto input = iota({4, 5});
+  auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+  EXPECT_NE(compressor->compress(&input, &compressed), 0);
+}
+
+TEST(Resize, PassesAViewOfTheInput) {
+  pressio library;
+  auto compressor = library.get_compressor("resize");
+  ASSERT_TRUE(compressor);
+  const std::vector<size_t> compressed_dims{20, 30};
+  ASSERT_EQ(compressor->set_options({
+    {"resize:compressor", "noop"},
+    {"resize:compressed_dims", pressio_data(compressed_dims.begin(), compressed_dims.end())},
+  }), 0);
+
+  auto input = iota({600});
+  auto compressed = pressio_data::empty(pressio_byte_dtype, {});
+  auto output = pressio_data::owning(pressio_float_dtype, {600});
+  ASSERT_EQ(compressor->compress(&input, &compressed), 0) << compressor->error_msg();
+  ASSERT_EQ(compressor->decompress(&compressed, &output), 0) << compressor->error_msg();
+  EXPECT_EQ(memcmp(output.data(), input.data(), input.size_in_bytes()), 0);
+
+  auto small = iota({100});
+  EXPECT_NE(compressor->compress(&small, &compressed), 0);
+}
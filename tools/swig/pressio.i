@@ -23,9 +23,7 @@ python bindings for pressio
 #if LIBPRESSIO_HAS_JSON
 #include "libpressio_ext/json/pressio_options_json.h"
 #endif
-#if LIBPRESSIO_HAS_OPENSSL
 #include "libpressio_ext/hash/libpressio_hash.h"
-#endif
 %}
 
 %include <stdint.i>
@@ -348,7 +346,5 @@ def io_data_to_numpy(ptr):
 %newobject pressio_options_to_json;
 %include "libpressio_ext/json/pressio_options_json.h"
 #endif
-#if LIBPRESSIO_HAS_OPENSSL
 %include "libpressio_ext/hash/libpressio_hash.h"
-#endif
 %include "libpressio_ext/highlevel/libpressio_highlevel.h"